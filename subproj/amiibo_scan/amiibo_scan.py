@@ -6,20 +6,59 @@
     https://www.adafruit.com/product/364
 
   This program communicates to amiibrOS via a pre-established pipe found at
-    argv[1].
+    argv[1]. Every event is written as one frame of the scanner protocol
+    described in amiibrOS's scan_proto.h.
 
   Joseph Yankel (jpyankel@gmail.com)
 """
 
 import os
 import sys
+import time
+import struct
 import board
 import busio
 from digitalio import DigitalInOut
 from adafruit_pn532.spi import PN532_SPI
 
 # Helpful constants:
-CHAR_ID_BLOCK = 0x15
+AMIIBO_ID_BLOCK = 0x15 # The 8-byte amiibo ID spans this block and the next
+UID_MAX = 10 # Longest NFC UID
+
+# Scanner protocol (see scan_proto.h):
+FRAME_HEADER = struct.Struct('<2sBBHHQ') # magic, version, type, len, 0, time
+FRAME_VERSION = 1
+EV_TAG = 1
+EV_REMOVED = 2
+EV_ERROR = 3
+ERR_UNKNOWN_TAG = 1
+
+def write_frame(fd, ev_type, timestamp, payload=b''):
+  """
+  Writes one frame to amiibrOS. timestamp is the time.monotonic_ns() at which
+    the event was seen, which shares amiibrOS's clock. A frame is written with
+    a single write so that it is never interleaved with anything else.
+  """
+  header = FRAME_HEADER.pack(b'AS', FRAME_VERSION, ev_type, len(payload), 0,
+      timestamp)
+  os.write(fd, header + payload)
+
+def read_amiibo_id(pn532):
+  """
+  Returns the 8-byte amiibo ID of the tag on the scanner, or None if it could
+    not be read.
+  """
+  try:
+    head = pn532.ntag2xx_read_block(AMIIBO_ID_BLOCK)
+    tail = pn532.ntag2xx_read_block(AMIIBO_ID_BLOCK + 1)
+  except TypeError:
+    # A bug in PN532_SPI will try to subscript a NoneType when the tag read
+    #   becomes garbled (usually because an amiibo was lifted off of the
+    #   scanner)
+    return None
+  if head == None or tail == None:
+    return None
+  return bytes(head) + bytes(tail)
 
 def main():
   # Initialize SPI connection:
@@ -33,7 +72,13 @@ def main():
   # Configure PN532 to communicate with MiFare cards
   pn532.SAM_configuration()
 
+  # Note sys.argv[1] has the pipe's file descriptor if this program is called
+  #   from amiibrOS.
+  fd = int(sys.argv[1])
+
   lastCharID = None # Keep track of last charID to prevent spam of same ID
+  present = False # Whether a tag was on the scanner at the last poll
+  errored = False # Whether an error was sent for the tag(s) on the scanner
 
   # Enter scanning loop:
   while True:
@@ -42,30 +87,36 @@ def main():
       uid = pn532.read_passive_target(timeout=0.5)
     except RuntimeError:
       # This occurs when more than one card or incompatible card is detected.
-      # Tell amiibrOS that the scanned card could not be identified:
-      pass #TODO Remove and do as the above comment says
-    
+      # Tell amiibrOS that the scanned card could not be identified, once
+      #   until it is taken off:
+      if not errored:
+        write_frame(fd, EV_ERROR, time.monotonic_ns(),
+            bytes([ERR_UNKNOWN_TAG]))
+        errored = True
+      present = True
+      continue
+
     # Try again if no card is available
     if uid == None:
+      if present:
+        write_frame(fd, EV_REMOVED, time.monotonic_ns())
+        present = False
+        errored = False
       continue
+    seen = time.monotonic_ns() # The scan starts the launch's clock
+    present = True
+    errored = False
 
-    try:
-      charID = pn532.ntag2xx_read_block(CHAR_ID_BLOCK)
-    except TypeError:
-      # A bug in PN532_SPI will try to subscript a NoneType when the tag read
-      #   becomes garbled (usually because an amiibo was lifted off of the
-      #   scanner)
+    amiiboID = read_amiibo_id(pn532)
+    if amiiboID == None:
       continue # If this happens, we just try again.
 
-    # Try again if no ID is available
-    if charID == None:
-      continue
-
-    # Note sys.argv[1] has the pipe's file descriptor if this program is called
-    #   from amiibrOS.
-    # Tell amiibrOS the hex charID we found:
+    # Tell amiibrOS the charID we found:
+    charID = amiiboID[:4]
     if charID != lastCharID: # But only if it is not the same as previous
-      os.write(int(sys.argv[1]), charID)
+      uid = bytes(uid[:UID_MAX])
+      payload = bytes([len(uid)]) + uid.ljust(UID_MAX, b'\0') + amiiboID
+      write_frame(fd, EV_TAG, seen, payload)
       lastCharID = charID
 
 if __name__ == "__main__":
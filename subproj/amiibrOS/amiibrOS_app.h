@@ -0,0 +1,118 @@
+/**
+ * amiibrOS_app.h
+ *
+ * Optional helpers for apps launched by amiibrOS. Apps run fine without any of
+ *   this; apps that use it let os_ctrl (and its benchmarks) see how far along
+ *   their launch is.
+ *
+ * This header is self-contained so that apps (such as slideshow) can include
+ *   it without linking against anything from os_ctrl.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef AMIIBROS_APP_H
+#define AMIIBROS_APP_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t, uint64_t
+#include <stdlib.h> // getenv, atoi
+#include <time.h> // clock_gettime
+#include <errno.h> // errno
+#include <unistd.h> // read, write, close
+
+// Environment variable holding the fd an app reports its progress on:
+#define AMIIBROS_READY_FD_ENV "AMIIBROS_READY_FD"
+// Environment variable holding the fd of an app's handoff barrier:
+#define AMIIBROS_HANDOFF_FD_ENV "AMIIBROS_HANDOFF_FD"
+
+// Symbol os_ctrl's zygote calls in an app built as a zygote module. It must
+//   have the signature: int amiibrOS_app_main (int argc, char **argv)
+#define AMIIBROS_APP_ENTRY "amiibrOS_app_main"
+
+// Events an app reports:
+#define AMIIBROS_APP_STARTED 1 // Entered main (done exec and linking)
+#define AMIIBROS_APP_FIRST_FRAME 2 // Presented its first frame
+#define AMIIBROS_APP_LOADED 3 // Done loading, waiting for the handoff
+
+// A single report as written to the ready fd (atomically, as one write):
+typedef struct amiibrOS_app_report
+{
+  uint32_t event; // AMIIBROS_APP_*
+  uint32_t reserved; // 0
+  uint64_t ns; // CLOCK_MONOTONIC time of the event in nanoseconds
+} amiibrOS_app_report;
+
+/**
+ * Writes a report of the given event, timestamped now, to the fd in
+ *   AMIIBROS_READY_FD_ENV (if any). Used by the functions below.
+ */
+static inline void amiibrOS_app_report_event (uint32_t event, bool last)
+{
+  const char *fd_str = getenv(AMIIBROS_READY_FD_ENV);
+  if (fd_str == NULL)
+    return;
+  int fd = atoi(fd_str);
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  amiibrOS_app_report report = {event, 0,
+    (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec};
+  if (write(fd, &report, sizeof(report)) == -1)
+    return; // Nobody is listening anymore; nothing else to do
+  if (last)
+    close(fd);
+}
+
+/**
+ * Reports that the app has entered its main. Should be called first thing in
+ *   main, before any setup.
+ */
+static inline void amiibrOS_app_report_started (void)
+{
+  amiibrOS_app_report_event(AMIIBROS_APP_STARTED, false);
+}
+
+/**
+ * Reports that the app is done loading, then blocks until amiibrOS hands the
+ *   display over to it. Should be called once, right before the app opens
+ *   its window (e.g. raylib's InitWindow).
+ *
+ * Apps whose .conf sets 'handoff yes' are started while amiibrOS's UI still
+ *   plays its animations and owns the display. Everything up to this call
+ *   (reading configs, decoding images, ...) overlaps with them, and nothing
+ *   after it may touch the display. For any other app, this returns at once.
+ */
+static inline void amiibrOS_app_wait_handoff (void)
+{
+  amiibrOS_app_report_event(AMIIBROS_APP_LOADED, false);
+
+  const char *fd_str = getenv(AMIIBROS_HANDOFF_FD_ENV);
+  if (fd_str == NULL)
+    return;
+  int fd = atoi(fd_str);
+
+  // amiibrOS closes its end once the display is free (as does its exit):
+  char go;
+  while (read(fd, &go, 1) == -1 && errno == EINTR);
+  close(fd);
+}
+
+/**
+ * Reports that the app has presented its first frame. The fd is closed
+ *   afterwards.
+ *
+ * Only the first call does anything; it is safe to call this every frame.
+ *   Nothing happens if the app was not given a ready fd.
+ */
+static inline void amiibrOS_app_report_ready (void)
+{
+  static bool reported = false;
+  if (reported)
+    return;
+  reported = true;
+
+  amiibrOS_app_report_event(AMIIBROS_APP_FIRST_FRAME, true);
+}
+
+#endif
@@ -0,0 +1,36 @@
+/**
+ * anim_curve.c
+ *
+ * Contains implementation of anim_curve.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <math.h> // floor
+#include "anim_curve.h"
+
+void anim_curve_bake (anim_curve *curve, float (*fn)(float progress))
+{
+  for (unsigned int i = 0; i <= ANIM_CURVE_SEGMENTS; i++)
+    curve->samples[i] = fn((float)i / ANIM_CURVE_SEGMENTS);
+}
+
+float anim_curve_eval (const anim_curve *curve, float progress)
+{
+  if (!(progress > 0.0f)) // Also catches NaN
+    return curve->samples[0];
+  if (progress >= 1.0f)
+    return curve->samples[ANIM_CURVE_SEGMENTS];
+
+  float x = progress * ANIM_CURVE_SEGMENTS;
+  unsigned int i = (unsigned int)x; // < ANIM_CURVE_SEGMENTS
+  float frac = x - (float)i;
+  return curve->samples[i] + (curve->samples[i + 1] - curve->samples[i]) *
+      frac;
+}
+
+float anim_curve_phase (double elapsed, double period)
+{
+  double cycles = elapsed / period;
+  return (float)(cycles - floor(cycles));
+}
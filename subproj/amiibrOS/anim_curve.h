@@ -0,0 +1,47 @@
+/**
+ * anim_curve.h
+ *
+ * Contains prototypes for the interface's animation curves: functions of an
+ *   animation's progress (0 at its start, 1 at its end), such as the touch
+ *   indicator's pulse or an easing, baked into a table once and then sampled
+ *   with linear interpolation.
+ *
+ * Sampling a curve is a multiply, two loads and a lerp in single precision,
+ *   whatever the function behind it costs (sin, easings.h calls, ...). With
+ *   ANIM_CURVE_SEGMENTS segments, a curve holding one period of a sine is off
+ *   by less than 1e-4, far below what one step of an 8-bit color can show.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef ANIM_CURVE_H
+#define ANIM_CURVE_H
+
+// Segments each curve is split into (its table holds one more sample):
+#define ANIM_CURVE_SEGMENTS 256
+
+typedef struct anim_curve
+{
+  float samples[ANIM_CURVE_SEGMENTS + 1]; // At progress 0, 1/SEGMENTS, ..., 1
+} anim_curve;
+
+/**
+ * Fills curve with samples of fn, a function of an animation's progress from
+ *   0 to 1 (both included).
+ */
+void anim_curve_bake (anim_curve *curve, float (*fn)(float progress));
+
+/**
+ * Returns the value of curve at the given progress, interpolated between the
+ *   nearest samples. Progress is clamped to [0, 1].
+ */
+float anim_curve_eval (const anim_curve *curve, float progress);
+
+/**
+ * Returns the progress of a repeating animation of the given period (in
+ *   seconds, > 0), elapsed seconds after it started: the fraction [0, 1) of
+ *   the current repetition that is done.
+ */
+float anim_curve_phase (double elapsed, double period);
+
+#endif
@@ -0,0 +1,619 @@
+/**
+ * app_index.c
+ *
+ * Contains implementation of app_index.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdlib.h> // calloc, realloc, free
+#include <string.h> // strlen, strcmp, strdup
+#include <errno.h> // errno
+#include <limits.h> // NAME_MAX
+#include <unistd.h> // read, close
+#include <dirent.h> // opendir, readdir
+#include <sys/inotify.h> // inotify_*
+#include "app_index.h"
+#include "registry.h" // registry_*
+#include "stats.h" // stats_now_ns
+
+// Initial number of hash table slots (must be a power of 2):
+#define INDEX_MIN_CAPACITY 64
+// The table doubles once more than 1/INDEX_MAX_LOAD_INV of it is used:
+#define INDEX_MAX_LOAD_INV 2
+
+// Changes to the app root that add, remove or rename app directories:
+#define ROOT_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |\
+                         IN_ONLYDIR)
+// Changes inside an app directory that may change its launch plan:
+#define APP_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |\
+                        IN_CLOSE_WRITE | IN_ATTRIB | IN_ONLYDIR)
+// Room for at least 16 events with maximum length names:
+#define WATCH_BUF_SIZE (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+// One hash table slot. The slot is empty if plan == NULL.
+typedef struct index_slot
+{
+  uint32_t tag;
+  launch_plan *plan;
+} index_slot;
+
+/**
+ * Associates an inotify watch descriptor with the app directory it watches. A
+ *   directory may be both a tag's and one named in the registry (an alias).
+ */
+typedef struct app_watch
+{
+  int wd;
+  bool is_tag; // Whether the directory is the app of tag
+  uint32_t tag;
+  int app; // Registry app the directory holds (-1 if none)
+} app_watch;
+
+// === Index State ===
+static char *root; // App root directory path
+static index_slot *slots; // Open-addressing (linear probing) hash table
+static size_t capacity; // Number of slots (power of 2)
+static size_t count; // Number of used slots
+
+static registry reg; // Tag patterns of named apps (see registry.h)
+static bool have_registry; // Whether reg was loaded
+static launch_plan **named_plans; // Plan of each of reg's apps (or NULL)
+
+static int watch_fd = -1; // inotify instance
+static int root_wd = -1; // Watch descriptor of the app root
+static app_watch *watches; // Watches of each app directory
+static size_t watch_cnt;
+static size_t watch_cap;
+
+static uint64_t build_ns; // Duration of the initial scan
+static uint64_t last_refresh_ns; // Duration of the last applied refresh
+static unsigned long refresh_cnt; // Number of inotify events applied
+static unsigned long rebuild_cnt; // Full rescans after inotify overflows
+// ===================
+
+// --- Helper Function Prototypes ---
+size_t index_slot_of (uint32_t tag);
+bool index_insert (uint32_t tag, launch_plan *plan);
+void index_remove (uint32_t tag);
+void index_clear (void);
+bool index_grow (void);
+bool parse_hex_tag (const char *name, uint32_t *tag);
+launch_plan *create_app_plan (const char *name);
+bool load_app (uint32_t tag);
+bool load_named_app (int app);
+void clear_named_apps (void);
+bool watch_app_dir (const char *name, bool is_tag, uint32_t tag, int app);
+app_watch *find_watch (int wd);
+void forget_watch (int wd);
+void unwatch_app_dir (bool is_tag, uint32_t tag, int app);
+bool add_app_dir (const char *name);
+void remove_app_dir (const char *name);
+bool scan_root (void);
+bool apply_watch_event (const struct inotify_event *event);
+const char *plan_kind (const launch_plan *plan);
+// --- ---
+
+uint32_t app_index_tag (const unsigned char *raw_tag)
+{
+  return (uint32_t)raw_tag[0] << 24 | (uint32_t)raw_tag[1] << 16 |
+         (uint32_t)raw_tag[2] << 8 | (uint32_t)raw_tag[3];
+}
+
+bool app_index_init (const char *root_path, const char *registry_path)
+{
+  uint64_t start = stats_now_ns();
+
+  if ( (root = strdup(root_path)) == NULL)
+    return false;
+
+  // Without a registry, only tag directories are apps:
+  if (registry_path != NULL) {
+    if (registry_load(&reg, registry_path))
+      have_registry = true;
+    else if (errno != ENOENT)
+      return false;
+  }
+  if (have_registry) {
+    named_plans = calloc(reg.app_cnt > 0 ? reg.app_cnt : 1,
+        sizeof(launch_plan *));
+    if (named_plans == NULL)
+      return false;
+  }
+
+  capacity = INDEX_MIN_CAPACITY;
+  count = 0;
+  if ( (slots = calloc(capacity, sizeof(index_slot))) == NULL)
+    return false;
+
+  // Watch before scanning so that no change can slip in between:
+  if ( (watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    return false;
+  if ( (root_wd = inotify_add_watch(watch_fd, root, ROOT_WATCH_MASK)) == -1)
+    return false;
+
+  if (!scan_root())
+    return false;
+
+  build_ns = stats_now_ns() - start;
+  return true;
+}
+
+launch_plan *app_index_lookup (uint32_t tag)
+{
+  for (size_t i = index_slot_of(tag); slots[i].plan != NULL;
+       i = (i + 1) & (capacity - 1)) {
+    if (slots[i].tag == tag)
+      return slots[i].plan;
+  }
+
+  // No directory of its own, so it is up to the registry's patterns:
+  if (!have_registry)
+    return NULL;
+  int app = registry_lookup(&reg, tag);
+  return app >= 0 ? named_plans[app] : NULL;
+}
+
+int app_index_watch_fd (void)
+{
+  return watch_fd;
+}
+
+bool app_index_refresh (void)
+{
+  // Align the buffer as inotify events require:
+  char buf[WATCH_BUF_SIZE]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  uint64_t start = stats_now_ns();
+  bool applied = false;
+
+  for (;;) {
+    ssize_t rd_cnt = read(watch_fd, buf, sizeof(buf));
+    if (rd_cnt == -1) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break; // No more pending events
+      return false;
+    }
+
+    for (char *p = buf; p < buf + rd_cnt;) {
+      const struct inotify_event *event = (const struct inotify_event *)p;
+      if (!apply_watch_event(event))
+        return false;
+      refresh_cnt++;
+      applied = true;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  if (applied)
+    last_refresh_ns = stats_now_ns() - start;
+  return true;
+}
+
+void app_index_dump_stats (FILE *out)
+{
+  fprintf(out, "app_index: %zu apps in %zu slots (%zu bytes), %zu watches\n",
+      count, capacity, capacity * sizeof(index_slot), watch_cnt);
+  fprintf(out, "app_index: built in %.3f ms; %lu changes applied (last took "
+      "%.3f ms), %lu full rebuilds\n", build_ns / 1e6, refresh_cnt,
+      last_refresh_ns / 1e6, rebuild_cnt);
+  for (size_t i = 0; i < capacity; i++) {
+    if (slots[i].plan != NULL) {
+      fprintf(out, "  %08X -> %s%s%s\n", slots[i].tag,
+          slots[i].plan->exec_path, plan_kind(slots[i].plan),
+          slots[i].plan->zygote_module != NULL ? " (zygote)" : "");
+    }
+  }
+
+  if (!have_registry)
+    return;
+  fprintf(out, "app_index: registry of %u apps in %u nodes (%zu bytes)\n",
+      reg.app_cnt, reg.node_cnt, reg.file_size);
+  for (uint32_t a = 0; a < reg.app_cnt; a++) {
+    launch_plan *plan = named_plans[a];
+    if (plan != NULL) {
+      fprintf(out, "  %s -> %s%s%s\n", reg.apps[a], plan->exec_path,
+          plan_kind(plan), plan->zygote_module != NULL ? " (zygote)" : "");
+    }
+    else
+      fprintf(out, "  %s -> (missing)\n", reg.apps[a]);
+  }
+}
+
+void app_index_free (void)
+{
+  index_clear();
+  free(slots);
+  slots = NULL;
+  capacity = 0;
+
+  clear_named_apps();
+  free(named_plans);
+  named_plans = NULL;
+  registry_free(&reg);
+  have_registry = false;
+
+  if (watch_fd != -1)
+    close(watch_fd); // Also removes every watch
+  watch_fd = -1;
+  root_wd = -1;
+  free(watches);
+  watches = NULL;
+  watch_cnt = watch_cap = 0;
+
+  free(root);
+  root = NULL;
+}
+
+// Returns the home slot of tag (Fibonacci hashing, folded for the low bits).
+size_t index_slot_of (uint32_t tag)
+{
+  uint32_t h = tag * 2654435769u;
+  h ^= h >> 16;
+  return h & (capacity - 1);
+}
+
+/**
+ * Inserts plan under tag, replacing (and freeing) any previous plan for it.
+ * Returns false if the table needed to grow but memory ran out.
+ */
+bool index_insert (uint32_t tag, launch_plan *plan)
+{
+  if ((count + 1) * INDEX_MAX_LOAD_INV > capacity && !index_grow())
+    return false;
+
+  size_t i = index_slot_of(tag);
+  while (slots[i].plan != NULL && slots[i].tag != tag)
+    i = (i + 1) & (capacity - 1);
+
+  if (slots[i].plan != NULL)
+    launch_plan_free(slots[i].plan);
+  else
+    count++;
+
+  slots[i].tag = tag;
+  slots[i].plan = plan;
+  return true;
+}
+
+/**
+ * Removes tag (and frees its plan) if present. Uses backward shift deletion
+ *   so that no tombstones are needed.
+ */
+void index_remove (uint32_t tag)
+{
+  size_t mask = capacity - 1;
+  size_t i = index_slot_of(tag);
+  while (slots[i].plan != NULL && slots[i].tag != tag)
+    i = (i + 1) & mask;
+  if (slots[i].plan == NULL)
+    return; // Not present
+
+  launch_plan_free(slots[i].plan);
+  slots[i].plan = NULL;
+  count--;
+
+  // Move back any following entry whose probe sequence passes the hole:
+  for (size_t j = (i + 1) & mask; slots[j].plan != NULL; j = (j + 1) & mask) {
+    size_t home = index_slot_of(slots[j].tag);
+    // The entry may fill the hole at i if i lies cyclically in [home, j):
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      slots[i] = slots[j];
+      slots[j].plan = NULL;
+      i = j;
+    }
+  }
+}
+
+// Removes every entry (and frees its plan), keeping the table's capacity.
+void index_clear (void)
+{
+  for (size_t i = 0; i < capacity; i++) {
+    launch_plan_free(slots[i].plan);
+    slots[i].plan = NULL;
+  }
+  count = 0;
+}
+
+// Doubles the table's capacity. Returns false if memory ran out.
+bool index_grow (void)
+{
+  index_slot *old_slots = slots;
+  size_t old_capacity = capacity;
+
+  if ( (slots = calloc(old_capacity * 2, sizeof(index_slot))) == NULL) {
+    slots = old_slots;
+    return false;
+  }
+  capacity = old_capacity * 2;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].plan == NULL)
+      continue;
+    size_t j = index_slot_of(old_slots[i].tag);
+    while (slots[j].plan != NULL)
+      j = (j + 1) & (capacity - 1);
+    slots[j] = old_slots[i];
+  }
+
+  free(old_slots);
+  return true;
+}
+
+/**
+ * Parses an app directory name (exactly HEX_TAG_SIZE uppercase hex digits, as
+ *   os_ctrl has always named them) into a tag. Returns false for other names.
+ */
+bool parse_hex_tag (const char *name, uint32_t *tag)
+{
+  uint32_t t = 0;
+  size_t i;
+  for (i = 0; i < HEX_TAG_SIZE && name[i] != '\0'; i++) {
+    char c = name[i];
+    if (c >= '0' && c <= '9')
+      t = t << 4 | (uint32_t)(c - '0');
+    else if (c >= 'A' && c <= 'F')
+      t = t << 4 | (uint32_t)(c - 'A' + 10);
+    else
+      return false;
+  }
+  if (i != HEX_TAG_SIZE || name[i] != '\0')
+    return false;
+
+  *tag = t;
+  return true;
+}
+
+/**
+ * Resolves the launch plan of the app in the app directory of the given name
+ *   (<root>/<name>/<name>.sh, configured by <name>.conf). Returns NULL with
+ *   errno set if there is no such app or memory ran out (ENOMEM).
+ */
+launch_plan *create_app_plan (const char *name)
+{
+  size_t name_len = strlen(name);
+  char app_dir[strlen(root) + name_len + 2]; // +1 for '/' +1 for NUL
+  char app_script[name_len + 4]; // +3 for ".sh" +1 for NUL
+  char app_conf[name_len + 6]; // +5 for ".conf" +1 for NUL
+  sprintf(app_dir, "%s/%s", root, name);
+  sprintf(app_script, "%s.sh", name);
+  sprintf(app_conf, "%s.conf", name);
+
+  return launch_plan_create(app_dir, app_script, app_conf);
+}
+
+/**
+ * (Re)builds the launch plan of the app for tag, dropping the app from the
+ *   index if it no longer exists. Returns false only on memory errors.
+ */
+bool load_app (uint32_t tag)
+{
+  char name[HEX_TAG_SIZE + 1];
+  sprintf(name, "%08X", tag);
+
+  launch_plan *plan = create_app_plan(name);
+  if (plan == NULL) {
+    if (errno == ENOMEM)
+      return false;
+    index_remove(tag); // Missing or inaccessible: not an app (anymore)
+    return true;
+  }
+
+  if (!index_insert(tag, plan)) {
+    launch_plan_free(plan);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * (Re)builds the launch plan of the registry's app, dropping it if its
+ *   directory no longer holds an app. Returns false only on memory errors.
+ */
+bool load_named_app (int app)
+{
+  launch_plan *plan = create_app_plan(reg.apps[app]);
+  if (plan == NULL && errno == ENOMEM)
+    return false;
+
+  launch_plan_free(named_plans[app]);
+  named_plans[app] = plan;
+  return true;
+}
+
+// Frees the plans of all of the registry's apps.
+void clear_named_apps (void)
+{
+  for (uint32_t a = 0; have_registry && a < reg.app_cnt; a++) {
+    launch_plan_free(named_plans[a]);
+    named_plans[a] = NULL;
+  }
+}
+
+/**
+ * Starts watching the app directory of the given name, which is the app of
+ *   tag if is_tag and the registry's app (unless app is -1). Returns false
+ *   only on memory errors; directories that can not be watched are skipped.
+ */
+bool watch_app_dir (const char *name, bool is_tag, uint32_t tag, int app)
+{
+  char app_dir[strlen(root) + strlen(name) + 2]; // +1 for '/' +1 for NUL
+  sprintf(app_dir, "%s/%s", root, name);
+
+  int wd = inotify_add_watch(watch_fd, app_dir, APP_WATCH_MASK);
+  if (wd == -1)
+    return true; // Vanished already or not a directory
+
+  app_watch *w = find_watch(wd);
+  if (w == NULL) {
+    if (watch_cnt == watch_cap) {
+      size_t new_cap = watch_cap ? watch_cap * 2 : 16;
+      app_watch *new_watches = realloc(watches, new_cap * sizeof(app_watch));
+      if (new_watches == NULL)
+        return false;
+      watches = new_watches;
+      watch_cap = new_cap;
+    }
+    w = &watches[watch_cnt++];
+  }
+  w->wd = wd;
+  w->is_tag = is_tag;
+  w->tag = tag;
+  w->app = app;
+  return true;
+}
+
+// Returns the app watch with the given watch descriptor, or NULL.
+app_watch *find_watch (int wd)
+{
+  for (size_t i = 0; i < watch_cnt; i++) {
+    if (watches[i].wd == wd)
+      return &watches[i];
+  }
+  return NULL;
+}
+
+// Drops our record of the given watch descriptor (if any).
+void forget_watch (int wd)
+{
+  app_watch *w = find_watch(wd);
+  if (w != NULL)
+    *w = watches[--watch_cnt];
+}
+
+/**
+ * Stops watching the app directory of tag (if is_tag) or of the registry's
+ *   app. A moved away directory would otherwise still be watched.
+ */
+void unwatch_app_dir (bool is_tag, uint32_t tag, int app)
+{
+  for (size_t i = 0; i < watch_cnt; i++) {
+    if ((is_tag && watches[i].is_tag && watches[i].tag == tag) ||
+        (!is_tag && watches[i].app == app)) {
+      inotify_rm_watch(watch_fd, watches[i].wd);
+      forget_watch(watches[i].wd);
+      return;
+    }
+  }
+}
+
+/**
+ * Watches and loads the app directory of the given name if it is a tag's or
+ *   one of the registry's apps (or both). Returns false only on memory
+ *   errors.
+ */
+bool add_app_dir (const char *name)
+{
+  uint32_t tag = 0;
+  bool is_tag = parse_hex_tag(name, &tag);
+  int app = have_registry ? registry_find_app(&reg, name) : -1;
+  if (!is_tag && app < 0)
+    return true; // Not an app directory
+
+  if (!watch_app_dir(name, is_tag, tag, app))
+    return false;
+  if (is_tag && !load_app(tag))
+    return false;
+  return app < 0 || load_named_app(app);
+}
+
+// Drops the app(s) in the app directory of the given name, which is gone.
+void remove_app_dir (const char *name)
+{
+  uint32_t tag = 0;
+  bool is_tag = parse_hex_tag(name, &tag);
+  int app = have_registry ? registry_find_app(&reg, name) : -1;
+
+  if (is_tag)
+    index_remove(tag);
+  if (app >= 0) {
+    launch_plan_free(named_plans[app]);
+    named_plans[app] = NULL;
+  }
+  if (is_tag || app >= 0)
+    unwatch_app_dir(is_tag, tag, app);
+}
+
+// Loads every app in the app root. Returns false with errno set on error.
+bool scan_root (void)
+{
+  DIR *dir = opendir(root);
+  if (dir == NULL)
+    return false;
+
+  struct dirent *entry;
+  errno = 0;
+  while ( (entry = readdir(dir)) != NULL) {
+    if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+      continue;
+
+    if (!add_app_dir(entry->d_name)) {
+      closedir(dir);
+      errno = ENOMEM;
+      return false;
+    }
+    errno = 0;
+  }
+
+  int preserve_errno = errno; // readdir sets errno only on error
+  closedir(dir);
+  errno = preserve_errno;
+  return preserve_errno == 0;
+}
+
+/**
+ * Applies a single inotify event to the index. Returns false with errno set
+ *   on error.
+ */
+bool apply_watch_event (const struct inotify_event *event)
+{
+  if (event->mask & IN_Q_OVERFLOW) {
+    // Events were lost: start over from what is on disk.
+    rebuild_cnt++;
+    index_clear();
+    clear_named_apps();
+    return scan_root();
+  }
+
+  if (event->wd == root_wd) {
+    if (event->len == 0)
+      return true;
+
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+      if (!add_app_dir(event->name)) {
+        errno = ENOMEM;
+        return false;
+      }
+    }
+    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+      remove_app_dir(event->name);
+    return true;
+  }
+
+  if (event->mask & IN_IGNORED) {
+    forget_watch(event->wd); // The directory was deleted or unwatched
+    return true;
+  }
+
+  // Anything changing inside an app directory may change its plan (the
+  //   script, or the binary the script runs):
+  app_watch *w = find_watch(event->wd);
+  if (w == NULL)
+    return true;
+  if ((w->is_tag && !load_app(w->tag)) ||
+      (w->app >= 0 && !load_named_app(w->app))) {
+    errno = ENOMEM;
+    return false;
+  }
+  return true;
+}
+
+// Returns how the plan starts its app, as shown by app_index_dump_stats.
+const char *plan_kind (const launch_plan *plan)
+{
+  if (plan->manifest)
+    return " (manifest)";
+  return plan->direct ? " (direct)" : "";
+}
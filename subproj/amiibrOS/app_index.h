@@ -0,0 +1,84 @@
+/**
+ * app_index.h
+ *
+ * Contains prototypes for os_ctrl's in-memory tag-to-app index.
+ *
+ * The app root directory is scanned once at startup. Every app found there
+ *   (APP_ROOT/XXXXXXXX/XXXXXXXX.sh, optionally configured by XXXXXXXX.conf)
+ *   gets a launch plan stored in a compact open-addressing hash table keyed by
+ *   the raw 4-byte tag. An inotify watch on the app root and on each app
+ *   directory keeps the table up to date, so looking up a scanned tag never
+ *   touches the file system.
+ *
+ * Tags without an app directory of their own may still map to an app through
+ *   the registry (see registry.h): any directory of the app root named in it
+ *   is indexed and watched the same way, and serves every tag its patterns
+ *   match. A tag's own directory always takes precedence over the registry.
+ *
+ * The index is a single, module-wide instance and is not thread safe: it must
+ *   only be used from os_ctrl's main thread.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef APP_INDEX_H
+#define APP_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t
+#include <stdio.h> // FILE
+#include "launcher.h" // launch_plan
+
+// Raw tag (character ID) size in bytes; the first bytes of a scanned ID:
+#define RAW_TAG_SIZE 4
+// Size of the hex string naming a tag's app (not including NUL):
+#define HEX_TAG_SIZE (RAW_TAG_SIZE*2)
+
+/**
+ * Packs the scanner's raw tag bytes into the key used by the index. The first
+ *   byte ends up most significant so that the key printed with "%08X" is the
+ *   tag's app directory name.
+ */
+uint32_t app_index_tag (const unsigned char *raw_tag);
+
+/**
+ * Loads the compiled registry at registry_path (unless it is NULL or the file
+ *   does not exist), scans root_path for apps, builds the index and starts
+ *   watching root_path and each app directory for changes.
+ *
+ * Returns true if successful; false with errno set if the registry is invalid
+ *   (EINVAL) or could not be read, root_path could not be read, the watch
+ *   could not be created or memory could not be allocated.
+ */
+bool app_index_init (const char *root_path, const char *registry_path);
+
+/**
+ * Returns the launch plan of the app for the given tag, or NULL if no app
+ *   exists for it. Never performs any system calls.
+ */
+launch_plan *app_index_lookup (uint32_t tag);
+
+/**
+ * Returns the inotify fd that becomes readable when app_index_refresh has
+ *   changes to apply.
+ */
+int app_index_watch_fd (void);
+
+/**
+ * Applies all pending app root changes reported by inotify to the index.
+ *   Does not block if there are none.
+ *
+ * Plans of changed apps are replaced: plans previously returned by
+ *   app_index_lookup must not be used after calling this.
+ *
+ * Returns true if successful; false with errno set otherwise.
+ */
+bool app_index_refresh (void);
+
+// Prints index size and build/refresh statistics to the given stream.
+void app_index_dump_stats (FILE *out);
+
+// Stops watching the app root and frees the index along with its plans.
+void app_index_free (void);
+
+#endif
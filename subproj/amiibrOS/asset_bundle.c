@@ -0,0 +1,185 @@
+/**
+ * asset_bundle.c
+ *
+ * Contains implementation of asset_bundle.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdlib.h> // calloc, free
+#include <string.h> // memcmp, memcpy, memchr, strncmp
+#include <errno.h> // errno
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#include <sys/mman.h> // mmap, munmap
+#include <sys/stat.h> // fstat
+#include "asset_bundle.h"
+
+// --- Helper Function Prototypes ---
+bool decode_asset_bundle (asset_bundle *bundle);
+bool check_asset_bundle (const asset_bundle *bundle);
+uint16_t asset_le16 (const uint8_t *p);
+uint32_t asset_le32 (const uint8_t *p);
+// --- ---
+
+bool asset_bundle_open (asset_bundle *bundle, const char *path)
+{
+  bundle->map = NULL;
+  bundle->pages = NULL;
+  bundle->sprites = NULL;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return false;
+  }
+  size_t size = (size_t)st.st_size;
+  if (size < ASSET_BUNDLE_HEADER_SIZE) {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+
+  // Populated now, rather than a page fault at a time during the uploads:
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd); // The mapping keeps the file
+  if (map == MAP_FAILED)
+    return false;
+
+  bundle->map = map;
+  bundle->size = size;
+  if (!decode_asset_bundle(bundle)) {
+    int preserve_errno = errno;
+    asset_bundle_close(bundle);
+    errno = preserve_errno;
+    return false;
+  }
+  return true;
+}
+
+const asset_sprite *asset_bundle_find (const asset_bundle *bundle,
+    const char *name)
+{
+  // A handful of sprites: a scan is as fast as anything else
+  for (uint16_t i = 0; i < bundle->sprite_cnt; i++) {
+    if (!strncmp(bundle->sprites[i].name, name, ASSET_NAME_LEN))
+      return &bundle->sprites[i];
+  }
+  return NULL;
+}
+
+const void *asset_bundle_pixels (const asset_bundle *bundle, uint16_t page)
+{
+  return bundle->map + bundle->pages[page].offset;
+}
+
+void asset_bundle_close (asset_bundle *bundle)
+{
+  if (bundle->map == NULL)
+    return;
+  munmap((void *)bundle->map, bundle->size);
+  free(bundle->pages);
+  free(bundle->sprites);
+  bundle->map = NULL;
+  bundle->pages = NULL;
+  bundle->sprites = NULL;
+}
+
+/**
+ * Decodes the little-endian header and entries of the mapped bundle into its
+ *   pages and sprites, and checks them (see check_asset_bundle). Returns false
+ *   with errno set otherwise (EINVAL if it is not a bundle this build can
+ *   use), leaving whatever was decoded for asset_bundle_close to free.
+ */
+bool decode_asset_bundle (asset_bundle *bundle)
+{
+  const uint8_t *map = bundle->map;
+  uint16_t page_cnt = asset_le16(map + 6);
+  uint16_t sprite_cnt = asset_le16(map + 8);
+  if (memcmp(map, ASSET_BUNDLE_MAGIC, 4) ||
+      asset_le16(map + 4) != ASSET_BUNDLE_VERSION ||
+      bundle->size - ASSET_BUNDLE_HEADER_SIZE <
+      (size_t)page_cnt * ASSET_PAGE_SIZE +
+      (size_t)sprite_cnt * ASSET_SPRITE_SIZE) {
+    errno = EINVAL;
+    return false;
+  }
+
+  // One extra entry each, so that empty lists are allocated too:
+  bundle->pages = calloc((size_t)page_cnt + 1, sizeof(asset_page));
+  bundle->sprites = calloc((size_t)sprite_cnt + 1, sizeof(asset_sprite));
+  if (bundle->pages == NULL || bundle->sprites == NULL) {
+    errno = ENOMEM;
+    return false;
+  }
+  bundle->page_cnt = page_cnt;
+  bundle->sprite_cnt = sprite_cnt;
+
+  const uint8_t *entry = map + ASSET_BUNDLE_HEADER_SIZE;
+  for (uint16_t i = 0; i < page_cnt; i++, entry += ASSET_PAGE_SIZE) {
+    asset_page *p = &bundle->pages[i];
+    p->width = asset_le32(entry);
+    p->height = asset_le32(entry + 4);
+    p->format = asset_le32(entry + 8);
+    p->offset = asset_le32(entry + 12);
+  }
+  for (uint16_t i = 0; i < sprite_cnt; i++, entry += ASSET_SPRITE_SIZE) {
+    asset_sprite *s = &bundle->sprites[i];
+    memcpy(s->name, entry, ASSET_NAME_LEN);
+    s->page = asset_le16(entry + ASSET_NAME_LEN);
+    s->x = asset_le16(entry + ASSET_NAME_LEN + 2);
+    s->y = asset_le16(entry + ASSET_NAME_LEN + 4);
+    s->width = asset_le16(entry + ASSET_NAME_LEN + 6);
+    s->height = asset_le16(entry + ASSET_NAME_LEN + 8);
+  }
+
+  if (!check_asset_bundle(bundle)) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Returns whether the decoded entries of bundle are ones this build can use:
+ *   every page lies within the file, in the one format, and every sprite lies
+ *   within its page.
+ */
+bool check_asset_bundle (const asset_bundle *bundle)
+{
+  const asset_page *pages = bundle->pages;
+  size_t size = bundle->size;
+  for (uint16_t i = 0; i < bundle->page_cnt; i++) {
+    const asset_page *p = &pages[i];
+    uint64_t len = (uint64_t)p->width * p->height * 4;
+    if (p->format != ASSET_FORMAT_RGBA8 || p->width == 0 || p->height == 0 ||
+        p->width > ASSET_PAGE_MAX || p->height > ASSET_PAGE_MAX ||
+        p->offset % ASSET_BUNDLE_ALIGN != 0 || p->offset > size ||
+        len > size - p->offset)
+      return false;
+  }
+
+  for (uint16_t i = 0; i < bundle->sprite_cnt; i++) {
+    const asset_sprite *s = &bundle->sprites[i];
+    if (s->page >= bundle->page_cnt || s->width == 0 || s->height == 0 ||
+        (uint32_t)s->x + s->width > pages[s->page].width ||
+        (uint32_t)s->y + s->height > pages[s->page].height ||
+        memchr(s->name, '\0', ASSET_NAME_LEN) == NULL)
+      return false;
+  }
+  return true;
+}
+
+uint16_t asset_le16 (const uint8_t *p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+uint32_t asset_le32 (const uint8_t *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
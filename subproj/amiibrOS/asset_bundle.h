@@ -0,0 +1,108 @@
+/**
+ * asset_bundle.h
+ *
+ * Contains prototypes for the interface's asset bundle: every image the UI
+ *   draws, already decoded into GPU-ready pixels and packed into one file.
+ *
+ * The bundle is written by assetc (see assetc.c) at build time, from the
+ *   PNGs in resources/. assetc packs the images, as sprites, into as few
+ *   atlas pages as it can (normally one), so that the UI uploads a single
+ *   texture and draws the whole screen from it in one batch. The UI thread
+ *   maps the bundle once and uploads each page straight from the mapping, so
+ *   starting the interface neither reads nor decodes PNGs and makes no copy
+ *   of the pixels. The mapping is kept for as long as os_ctrl runs, so later
+ *   starts find its pages in memory already.
+ *
+ * All integers are little-endian; every page's pixels start on a page
+ *   boundary (of memory):
+ *
+ *   offset  size  field
+ *        0     4  magic: 'A' 'A' 'S' 'T'
+ *        4     2  version: ASSET_BUNDLE_VERSION
+ *        6     2  number of atlas pages
+ *        8     2  number of sprites
+ *       10     2  reserved (0)
+ *       12     -  pages: ASSET_PAGE_SIZE bytes each (see asset_page)
+ *        -     -  sprites: ASSET_SPRITE_SIZE bytes each (see asset_sprite)
+ *        -     -  pixels of each page (width * height * 4 bytes, RGBA)
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef ASSET_BUNDLE_H
+#define ASSET_BUNDLE_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint16_t, uint32_t
+
+#define ASSET_BUNDLE_MAGIC "AAST"
+#define ASSET_BUNDLE_VERSION 2
+#define ASSET_BUNDLE_HEADER_SIZE 12
+#define ASSET_BUNDLE_ALIGN 4096 // Alignment of each page's pixels
+#define ASSET_PAGE_SIZE 16
+#define ASSET_SPRITE_SIZE 48
+#define ASSET_NAME_LEN 32
+// Largest page side: the most the Raspberry Pi's GPU takes for a texture:
+#define ASSET_PAGE_MAX 2048
+// raylib's UNCOMPRESSED_R8G8B8A8, the only format pages are stored in:
+#define ASSET_FORMAT_RGBA8 7
+
+// An atlas page's entry, as decoded from the file:
+typedef struct asset_page
+{
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // ASSET_FORMAT_RGBA8
+  uint32_t offset; // Of its pixels, from the start of the file
+} asset_page;
+
+// A sprite's entry (an image, within a page), as decoded from the file:
+typedef struct asset_sprite
+{
+  char name[ASSET_NAME_LEN]; // PNG file name without ".png", NUL-padded
+  uint16_t page; // Index of its page
+  uint16_t x; // Of its top left corner, in the page
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+  uint16_t reserved[3];
+} asset_sprite;
+
+// A mapped bundle:
+typedef struct asset_bundle
+{
+  const uint8_t *map; // NULL if none is mapped
+  size_t size;
+  asset_page *pages; // Decoded from the mapping's entries
+  uint16_t page_cnt;
+  asset_sprite *sprites;
+  uint16_t sprite_cnt;
+} asset_bundle;
+
+/**
+ * Maps the bundle at path into bundle, reading all of it in up front. Its
+ *   entries are decoded into pages and sprites, whatever the host's byte
+ *   order; the pixels stay in the mapping. Every page is checked to lie
+ *   within the file, and every sprite within its page, so that lookups need
+ *   no checks of their own.
+ *
+ * Returns true if successful; false with errno set otherwise (EINVAL if the
+ *   file is not a valid bundle).
+ */
+bool asset_bundle_open (asset_bundle *bundle, const char *path);
+
+/**
+ * Returns the sprite of the given name (e.g. "logo"), or NULL if the bundle
+ *   has none.
+ */
+const asset_sprite *asset_bundle_find (const asset_bundle *bundle,
+    const char *name);
+
+// Returns the pixels of the given page of bundle.
+const void *asset_bundle_pixels (const asset_bundle *bundle, uint16_t page);
+
+// Unmaps the bundle and frees its entries. Does nothing if none is mapped.
+void asset_bundle_close (asset_bundle *bundle);
+
+#endif
@@ -0,0 +1,306 @@
+/**
+ * assetc.c
+ *
+ * The asset compiler: decodes the interface's PNGs and packs them into the
+ *   atlas pages of the bundle of GPU-ready pixels that os_ctrl's UI thread
+ *   maps (see asset_bundle.h). It runs on the build host as the image is
+ *   built, so the device never decodes a PNG to start the interface.
+ *
+ * Each image becomes a sprite named after its file without the directory and
+ *   ".png" (resources/logo.png becomes "logo"). No two images may have the
+ *   same name.
+ *
+ * Images are packed onto shelves, tallest first. Every width a page can have
+ *   is tried, and the one that fits the most images into the smallest page
+ *   is kept; images left over go to the next page.
+ *
+ * Usage: assetc <bundle> <png>...
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, fopen, fwrite, perror
+#include <stdlib.h> // calloc, free, qsort
+#include <string.h> // strrchr, strlen, strcmp, strncmp, memcpy, memset
+#include <stdint.h> // uint8_t, uint16_t, uint32_t
+#include <stdbool.h>
+#include "asset_bundle.h"
+#include "png_decode.h"
+
+// Transparent pixels around each sprite, so that filtering never blends in
+//   its neighbours:
+#define SPRITE_PAD 2
+
+// An image to pack, and where it went:
+typedef struct sprite_src
+{
+  const char *path;
+  char name[ASSET_NAME_LEN];
+  png_image img;
+  uint16_t page;
+  uint16_t x;
+  uint16_t y;
+} sprite_src;
+
+// --- Helper Function Prototypes ---
+bool asset_name (const char *path, char *name);
+int cmp_sprite_height (const void *a, const void *b);
+size_t pack_shelves (sprite_src *srcs, size_t cnt, uint32_t width,
+    uint32_t *height);
+void put_le16 (uint8_t *p, uint16_t v);
+void put_le32 (uint8_t *p, uint32_t v);
+bool write_padding (FILE *out, size_t len);
+// --- ---
+
+int main (int argc, char **argv)
+{
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <bundle> <png>...\n", argv[0]);
+    return 1;
+  }
+  size_t src_cnt = argc - 2;
+  if (src_cnt > UINT16_MAX) {
+    fprintf(stderr, "assetc: too many images\n");
+    return 1;
+  }
+
+  sprite_src *srcs = calloc(src_cnt, sizeof(sprite_src));
+  uint32_t *page_dims = calloc(src_cnt * 2, sizeof(uint32_t)); // Width, height
+  if (srcs == NULL || page_dims == NULL) {
+    perror("assetc out of memory\nerror");
+    return 1;
+  }
+
+  // Decode every image:
+  for (size_t i = 0; i < src_cnt; i++) {
+    sprite_src *src = &srcs[i];
+    src->path = argv[i + 2];
+    if (!asset_name(src->path, src->name)) {
+      fprintf(stderr, "assetc: %s: name longer than %d characters\n",
+          src->path, ASSET_NAME_LEN - 1);
+      return 1;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (!strncmp(src->name, srcs[j].name, ASSET_NAME_LEN)) {
+        fprintf(stderr, "assetc: %s: same name as %s\n", src->path,
+            srcs[j].path);
+        return 1;
+      }
+    }
+    if (!png_decode(src->path, &src->img)) {
+      fprintf(stderr, "assetc: %s: ", src->path);
+      perror("unable to decode (8-bit, non-interlaced PNGs only)\nerror");
+      return 1;
+    }
+    if (src->img.width + 2 * SPRITE_PAD > ASSET_PAGE_MAX ||
+        src->img.height + 2 * SPRITE_PAD > ASSET_PAGE_MAX) {
+      fprintf(stderr, "assetc: %s: larger than a page (%d pixels a side)\n",
+          src->path, ASSET_PAGE_MAX);
+      return 1;
+    }
+  }
+
+  // Pack them, a page at a time:
+  qsort(srcs, src_cnt, sizeof(sprite_src), cmp_sprite_height);
+  size_t page_cnt = 0;
+  for (size_t start = 0; start < src_cnt; page_cnt++) {
+    uint32_t widest = 0;
+    for (size_t i = start; i < src_cnt; i++) {
+      if (srcs[i].img.width > widest)
+        widest = srcs[i].img.width;
+    }
+    size_t best_cnt = 0;
+    uint32_t best_width = 0;
+    uint64_t best_area = 0;
+    for (uint32_t w = widest + 2 * SPRITE_PAD; w <= ASSET_PAGE_MAX; w++) {
+      uint32_t h;
+      size_t cnt = pack_shelves(srcs + start, src_cnt - start, w, &h);
+      if (cnt > best_cnt || (cnt == best_cnt && (uint64_t)w * h < best_area)) {
+        best_cnt = cnt;
+        best_width = w;
+        best_area = (uint64_t)w * h;
+      }
+    }
+    uint32_t best_height;
+    pack_shelves(srcs + start, best_cnt, best_width, &best_height);
+    page_dims[page_cnt * 2] = best_width;
+    page_dims[page_cnt * 2 + 1] = best_height;
+    for (size_t i = start; i < start + best_cnt; i++)
+      srcs[i].page = (uint16_t)page_cnt;
+    start += best_cnt;
+  }
+
+  // Lay the bundle out:
+  size_t header_len = ASSET_BUNDLE_HEADER_SIZE + page_cnt * ASSET_PAGE_SIZE +
+      src_cnt * ASSET_SPRITE_SIZE;
+  uint8_t *header = calloc(1, header_len);
+  if (header == NULL) {
+    perror("assetc out of memory\nerror");
+    return 1;
+  }
+  memcpy(header, ASSET_BUNDLE_MAGIC, 4);
+  put_le16(header + 4, ASSET_BUNDLE_VERSION);
+  put_le16(header + 6, (uint16_t)page_cnt);
+  put_le16(header + 8, (uint16_t)src_cnt);
+  uint64_t offset = (header_len + ASSET_BUNDLE_ALIGN - 1) /
+      ASSET_BUNDLE_ALIGN * ASSET_BUNDLE_ALIGN;
+  for (size_t p = 0; p < page_cnt; p++) {
+    uint8_t *entry = header + ASSET_BUNDLE_HEADER_SIZE + p * ASSET_PAGE_SIZE;
+    uint64_t len = (uint64_t)page_dims[p * 2] * page_dims[p * 2 + 1] * 4;
+    if (offset + len > UINT32_MAX) {
+      fprintf(stderr, "assetc: bundle too large\n");
+      return 1;
+    }
+    put_le32(entry, page_dims[p * 2]);
+    put_le32(entry + 4, page_dims[p * 2 + 1]);
+    put_le32(entry + 8, ASSET_FORMAT_RGBA8);
+    put_le32(entry + 12, (uint32_t)offset);
+    offset = (offset + len + ASSET_BUNDLE_ALIGN - 1) / ASSET_BUNDLE_ALIGN *
+        ASSET_BUNDLE_ALIGN;
+  }
+  for (size_t i = 0; i < src_cnt; i++) {
+    uint8_t *entry = header + ASSET_BUNDLE_HEADER_SIZE +
+        page_cnt * ASSET_PAGE_SIZE + i * ASSET_SPRITE_SIZE;
+    memcpy(entry, srcs[i].name, ASSET_NAME_LEN);
+    put_le16(entry + ASSET_NAME_LEN, srcs[i].page);
+    put_le16(entry + ASSET_NAME_LEN + 2, srcs[i].x);
+    put_le16(entry + ASSET_NAME_LEN + 4, srcs[i].y);
+    put_le16(entry + ASSET_NAME_LEN + 6, (uint16_t)srcs[i].img.width);
+    put_le16(entry + ASSET_NAME_LEN + 8, (uint16_t)srcs[i].img.height);
+  }
+
+  FILE *out = fopen(argv[1], "wb");
+  if (out == NULL) {
+    perror("assetc unable to create bundle\nerror");
+    return 1;
+  }
+  bool ok = fwrite(header, header_len, 1, out) == 1;
+  size_t at = header_len;
+  size_t pixel_bytes = 0;
+  for (size_t p = 0; ok && p < page_cnt; p++) {
+    uint32_t width = page_dims[p * 2], height = page_dims[p * 2 + 1];
+    size_t len = (size_t)width * height * 4;
+    uint8_t *pixels = calloc(1, len); // Transparent between sprites
+    if (pixels == NULL) {
+      perror("assetc out of memory\nerror");
+      return 1;
+    }
+    for (size_t i = 0; i < src_cnt; i++) {
+      const sprite_src *src = &srcs[i];
+      if (src->page != p)
+        continue;
+      for (uint32_t y = 0; y < src->img.height; y++) {
+        memcpy(pixels + ((size_t)(src->y + y) * width + src->x) * 4,
+            src->img.pixels + (size_t)y * src->img.width * 4,
+            (size_t)src->img.width * 4);
+      }
+    }
+
+    size_t pad = (ASSET_BUNDLE_ALIGN - at % ASSET_BUNDLE_ALIGN) %
+        ASSET_BUNDLE_ALIGN;
+    ok = write_padding(out, pad) && fwrite(pixels, len, 1, out) == 1;
+    free(pixels);
+    at += pad + len;
+    pixel_bytes += len;
+    printf("assetc: page %zu: %ux%u\n", p, (unsigned int)width,
+        (unsigned int)height);
+  }
+  if (fclose(out) != 0 || !ok) {
+    perror("assetc unable to write bundle\nerror");
+    remove(argv[1]);
+    return 1;
+  }
+
+  printf("assetc: %zu sprites on %zu pages, %zu bytes of pixels, %zu byte "
+      "bundle\n", src_cnt, page_cnt, pixel_bytes, at);
+  for (size_t i = 0; i < src_cnt; i++)
+    free(srcs[i].img.pixels);
+  free(srcs);
+  free(page_dims);
+  free(header);
+  return 0;
+}
+
+/**
+ * Writes the name of the image at path (its file name without ".png") to
+ *   name, NUL-padded to ASSET_NAME_LEN bytes. Returns false if it is too long.
+ */
+bool asset_name (const char *path, char *name)
+{
+  const char *base = strrchr(path, '/');
+  base = base != NULL ? base + 1 : path;
+  size_t len = strlen(base);
+  if (len > 4 && !strcmp(base + len - 4, ".png"))
+    len -= 4;
+  if (len >= ASSET_NAME_LEN)
+    return false;
+
+  memset(name, 0, ASSET_NAME_LEN);
+  memcpy(name, base, len);
+  return true;
+}
+
+// Orders sprite_srcs tallest first (widest first among equals), for qsort.
+int cmp_sprite_height (const void *a, const void *b)
+{
+  const png_image *ia = &((const sprite_src *)a)->img;
+  const png_image *ib = &((const sprite_src *)b)->img;
+  if (ia->height != ib->height)
+    return ia->height > ib->height ? -1 : 1;
+  if (ia->width != ib->width)
+    return ia->width > ib->width ? -1 : 1;
+  return 0;
+}
+
+/**
+ * Places as many of the cnt sprites, in order, as fit onto the shelves of a
+ *   page of the given width (and at most ASSET_PAGE_MAX tall), setting their
+ *   positions and height to the page's height.
+ *
+ * Returns how many were placed.
+ */
+size_t pack_shelves (sprite_src *srcs, size_t cnt, uint32_t width,
+    uint32_t *height)
+{
+  uint32_t shelf_y = 0, shelf_h = 0, x = 0;
+  size_t i;
+  for (i = 0; i < cnt; i++) {
+    uint32_t w = srcs[i].img.width + 2 * SPRITE_PAD;
+    uint32_t h = srcs[i].img.height + 2 * SPRITE_PAD;
+    if (w > width)
+      break;
+    if (x + w > width) { // Start the next shelf
+      shelf_y += shelf_h;
+      shelf_h = 0;
+      x = 0;
+    }
+    if (shelf_y + h > ASSET_PAGE_MAX)
+      break;
+    srcs[i].x = (uint16_t)(x + SPRITE_PAD);
+    srcs[i].y = (uint16_t)(shelf_y + SPRITE_PAD);
+    x += w;
+    if (h > shelf_h)
+      shelf_h = h;
+  }
+  *height = shelf_y + shelf_h;
+  return i;
+}
+
+void put_le16 (uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void put_le32 (uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++, v >>= 8)
+    p[i] = v & 0xFF;
+}
+
+// Writes len zero bytes to out. Returns false if writing failed.
+bool write_padding (FILE *out, size_t len)
+{
+  static const uint8_t zeros[ASSET_BUNDLE_ALIGN];
+  return len == 0 || fwrite(zeros, len, 1, out) == 1;
+}
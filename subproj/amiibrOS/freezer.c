@@ -0,0 +1,258 @@
+/**
+ * freezer.c
+ *
+ * Contains implementation of freezer.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // fprintf, snprintf, fopen, fread, fgets, sscanf
+#include <stdlib.h> // strtoul
+#include <string.h> // strncmp, strrchr
+#include <limits.h> // NAME_MAX
+#include <signal.h> // kill, SIGSTOP, SIGCONT, SIGKILL, SIGTERM
+#include <unistd.h> // close
+#include <dirent.h> // opendir, readdir
+#include "freezer.h"
+#include "log_ring.h" // log_write
+
+// A frozen app:
+typedef struct frozen_app
+{
+  pid_t pid; // Leader of the app's process group
+  int pidfd; // Owned by the cache (-1 if unsupported)
+  uint32_t tag;
+  unsigned long rss_kb; // Resident memory of the group when frozen
+  unsigned long last_use; // Value of use_clock when frozen (LRU order)
+} frozen_app;
+
+// One more than the limit, for the app resumed next (see freezer_freeze):
+static frozen_app apps[FREEZER_APP_CAP + 1];
+static size_t app_cnt = 0;
+static unsigned int max_apps = 0;
+static unsigned long budget_kb = 0;
+static unsigned long use_clock = 0; // Ticks once per freeze
+
+static unsigned long freeze_cnt = 0;
+static unsigned long thaw_cnt = 0;
+static unsigned long evict_cnt = 0; // Evicted to respect the limits
+static unsigned long refuse_cnt = 0; // Too large to freeze at all
+static unsigned long lost_cnt = 0; // Exited (or were killed) while frozen
+
+// --- Helper Function Prototypes ---
+unsigned long group_rss_kb (pid_t pgid);
+unsigned long process_rss_kb (const char *pid_str);
+unsigned long frozen_rss_kb (void);
+frozen_app *find_frozen (uint32_t tag);
+void remove_frozen (frozen_app *app, bool kill_group);
+void evict_lru (unsigned long room_kb, uint32_t keep_tag);
+// --- ---
+
+void freezer_init (unsigned int max, unsigned long budget)
+{
+  max_apps = max < FREEZER_APP_CAP ? max : FREEZER_APP_CAP;
+  budget_kb = budget;
+}
+
+bool freezer_freeze (pid_t pid, int pidfd, uint32_t tag, uint32_t next_tag)
+{
+  if (max_apps == 0)
+    return false;
+
+  // Measured before stopping, so an app too large to keep just goes on to its
+  //   normal teardown:
+  unsigned long rss = group_rss_kb(pid);
+  if (rss > budget_kb) {
+    refuse_cnt++;
+    return false;
+  }
+  if (kill(-pid, SIGSTOP) == -1)
+    return false; // Already gone: let its exit be handled as usual
+
+  freezer_discard(tag); // An older instance of the same app, if any
+  evict_lru(rss, next_tag);
+  frozen_app *app = &apps[app_cnt++];
+  app->pid = pid;
+  app->pidfd = pidfd;
+  app->tag = tag;
+  app->rss_kb = rss;
+  app->last_use = ++use_clock;
+  freeze_cnt++;
+  return true;
+}
+
+bool freezer_contains (uint32_t tag)
+{
+  return find_frozen(tag) != NULL;
+}
+
+bool freezer_thaw (uint32_t tag, pid_t *pid, int *pidfd)
+{
+  frozen_app *app = find_frozen(tag);
+  if (app == NULL)
+    return false;
+
+  *pid = app->pid;
+  *pidfd = app->pidfd;
+  kill(-app->pid, SIGCONT);
+  remove_frozen(app, false);
+  thaw_cnt++;
+  return true;
+}
+
+void freezer_discard (uint32_t tag)
+{
+  frozen_app *app = find_frozen(tag);
+  if (app != NULL)
+    remove_frozen(app, true);
+}
+
+bool freezer_forget (pid_t pid)
+{
+  for (size_t i = 0; i < app_cnt; i++) {
+    if (apps[i].pid == pid) {
+      // Whatever it started may still be around:
+      remove_frozen(&apps[i], true);
+      lost_cnt++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void freezer_terminate_all (void)
+{
+  for (size_t i = 0; i < app_cnt; i++) {
+    kill(-apps[i].pid, SIGTERM); // Pending until it is continued
+    kill(-apps[i].pid, SIGCONT);
+  }
+}
+
+void freezer_dump_stats (FILE *out)
+{
+  fprintf(out, "freezer: %zu of %u apps frozen, %lu of %lu KiB; %lu frozen, "
+      "%lu resumed, %lu evicted, %lu too large, %lu lost\n", app_cnt,
+      max_apps, frozen_rss_kb(), budget_kb, freeze_cnt, thaw_cnt, evict_cnt,
+      refuse_cnt, lost_cnt);
+  for (size_t i = 0; i < app_cnt; i++) {
+    fprintf(out, "  %08X pid %d, %lu KiB\n", (unsigned int)apps[i].tag,
+        (int)apps[i].pid, apps[i].rss_kb);
+  }
+}
+
+/**
+ * Returns the resident memory (in KiB) of every process in the process group
+ *   pgid, as reported by /proc. Processes that vanish meanwhile are skipped.
+ */
+unsigned long group_rss_kb (pid_t pgid)
+{
+  DIR *proc = opendir("/proc");
+  if (proc == NULL)
+    return 0;
+
+  unsigned long rss = 0;
+  struct dirent *entry;
+  while ( (entry = readdir(proc)) != NULL) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+      continue;
+
+    // The group is the 5th field of stat, after the ')' closing the name:
+    char path[NAME_MAX + 16];
+    char stat[512];
+    snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+      continue;
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = '\0';
+
+    char *name_end = strrchr(stat, ')');
+    int pgrp;
+    if (name_end != NULL && sscanf(name_end + 1, " %*c %*d %d", &pgrp) == 1 &&
+        pgrp == pgid)
+      rss += process_rss_kb(entry->d_name);
+  }
+  closedir(proc);
+  return rss;
+}
+
+// Returns VmRSS of the process of the given pid (in KiB), or 0.
+unsigned long process_rss_kb (const char *pid_str)
+{
+  char path[NAME_MAX + 16];
+  char line[128];
+  snprintf(path, sizeof(path), "/proc/%s/status", pid_str);
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return 0;
+
+  unsigned long rss = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (strncmp(line, "VmRSS:", 6) == 0) {
+      rss = strtoul(line + 6, NULL, 10);
+      break;
+    }
+  }
+  fclose(file);
+  return rss;
+}
+
+// Returns the resident memory of every frozen app together (in KiB).
+unsigned long frozen_rss_kb (void)
+{
+  unsigned long rss = 0;
+  for (size_t i = 0; i < app_cnt; i++)
+    rss += apps[i].rss_kb;
+  return rss;
+}
+
+// Returns the frozen app of the given tag, or NULL.
+frozen_app *find_frozen (uint32_t tag)
+{
+  for (size_t i = 0; i < app_cnt; i++) {
+    if (apps[i].tag == tag)
+      return &apps[i];
+  }
+  return NULL;
+}
+
+/**
+ * Removes app from the cache. If kill_group is set, its process group is
+ *   killed and its pidfd closed (the exit is then reaped through SIGCHLD).
+ */
+void remove_frozen (frozen_app *app, bool kill_group)
+{
+  if (kill_group) {
+    kill(-app->pid, SIGKILL);
+    if (app->pidfd != -1)
+      close(app->pidfd); // Also removes it from os_ctrl's epoll set
+  }
+  *app = apps[--app_cnt];
+}
+
+/**
+ * Evicts the least recently used apps until there is room for one more app
+ *   of room_kb KiB within the cache's limits. The app of keep_tag (if frozen)
+ *   is neither evicted nor counted.
+ */
+void evict_lru (unsigned long room_kb, uint32_t keep_tag)
+{
+  frozen_app *keep = find_frozen(keep_tag);
+  size_t cnt = app_cnt - (keep != NULL);
+  unsigned long rss = frozen_rss_kb() - (keep != NULL ? keep->rss_kb : 0);
+
+  while (cnt > 0 && (cnt >= max_apps || rss + room_kb > budget_kb)) {
+    frozen_app *lru = NULL;
+    for (size_t i = 0; i < app_cnt; i++) {
+      if (apps[i].tag != keep_tag &&
+          (lru == NULL || apps[i].last_use < lru->last_use))
+        lru = &apps[i];
+    }
+    cnt--;
+    rss -= lru->rss_kb;
+    log_write(LOG_EV_FREEZER_EVICT, 0, NULL, lru->tag, lru->rss_kb, 0);
+    remove_frozen(lru, true);
+    evict_cnt++;
+  }
+}
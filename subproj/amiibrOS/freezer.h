@@ -0,0 +1,85 @@
+/**
+ * freezer.h
+ *
+ * Contains prototypes for os_ctrl's cache of suspended apps.
+ *
+ * Switching away from an app normally tears it down, so coming back to it
+ *   means a cold start (an emulator re-reads its ROM and loses its state).
+ *   Apps that opt in (see 'resumable' in launcher.h) are frozen instead: their
+ *   whole process group is sent SIGSTOP and kept, pidfd and all, until their
+ *   tag is scanned again, when SIGCONT resumes them where they left off.
+ *
+ * Frozen apps still hold their memory, so the cache is bounded both by a
+ *   number of apps and by a budget on the sum of their resident set sizes
+ *   (VmRSS in /proc/<pid>/status, summed over the app's process group,
+ *   measured as it is frozen). When either is exceeded, the least recently
+ *   used apps are evicted (their groups killed). An app that alone exceeds
+ *   the budget is not frozen at all.
+ *
+ * The cache is a single, module-wide instance that must only be used from
+ *   os_ctrl's main thread.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef FREEZER_H
+#define FREEZER_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t
+#include <stdio.h> // FILE
+#include <sys/types.h> // pid_t
+
+// Most apps that can ever be kept frozen:
+#define FREEZER_APP_CAP 8
+
+/**
+ * Sets the limits of the cache: at most max_apps frozen apps (clamped to
+ *   FREEZER_APP_CAP; 0 disables freezing) using at most budget_kb KiB of
+ *   resident memory together.
+ */
+void freezer_init (unsigned int max_apps, unsigned long budget_kb);
+
+/**
+ * Freezes the process group led by pid, the running app of tag. The cache
+ *   takes over pidfd (which may be -1), closing it once the app leaves the
+ *   cache other than through freezer_thaw. Less recently used apps are
+ *   evicted to make room, except that of next_tag: the app about to be
+ *   resumed in its place, which is counted as gone already (the limits may be
+ *   exceeded until then).
+ *
+ * Returns false, leaving the app running and pidfd to the caller, if
+ *   freezing is disabled or the app alone exceeds the budget.
+ */
+bool freezer_freeze (pid_t pid, int pidfd, uint32_t tag, uint32_t next_tag);
+
+// Returns whether an app of the given tag is frozen.
+bool freezer_contains (uint32_t tag);
+
+/**
+ * Resumes the frozen app of the given tag, removing it from the cache and
+ *   handing its pid and pidfd back to the caller. Returns false if no app of
+ *   that tag is frozen.
+ */
+bool freezer_thaw (uint32_t tag, pid_t *pid, int *pidfd);
+
+// Kills the frozen app of the given tag (if any) and removes it from the cache.
+void freezer_discard (uint32_t tag);
+
+/**
+ * Handles the exit of the (already reaped) child pid. If it was a frozen
+ *   app, whatever is left of its group is killed and it is removed from the
+ *   cache. Returns whether it was a frozen app.
+ */
+bool freezer_forget (pid_t pid);
+
+/**
+ * Sends SIGTERM to every frozen app's group and resumes them, so that they
+ *   can exit. Used when os_ctrl itself exits.
+ */
+void freezer_terminate_all (void);
+
+// Prints the frozen apps and freeze/thaw/eviction counts to the stream.
+void freezer_dump_stats (FILE *out);
+
+#endif
@@ -9,18 +9,84 @@
  * Joseph Yankel (jpyankel@gmail.com)
  */
 
-#include <stdio.h> // sprintf
-#include <math.h> // sin fmod
-#include <pthread.h> // pthread_cond_wait, ... etc.
+#include <stdio.h> // snprintf, fprintf
+#include <stdlib.h> // getenv, strtol
+#include <errno.h> // errno
+#include <math.h> // sinf
+#include <pthread.h> // pthread_create, pthread_join, ... etc.
 #include <signal.h> // sigset_t, etc.
+#include <time.h> // clock_gettime
 #include <unistd.h> // getpid
+#include "raylib.h"
 #include "easings.h"
 #include "interface.h"
+#include "stats.h" // stats_mark, stats_now_ns
+#include "log_ring.h" // log_write
+#include "ui_queue.h" // ui_queue_*
+#include "asset_bundle.h" // asset_bundle_*
+#include "anim_curve.h" // anim_curve_*
+
+// === Asset Constants ===
+// Bundle of the images below, already decoded at build time (see
+//   asset_bundle.h). Images it lacks are decoded from their PNGs instead:
+#define ASSETS_PATH "resources/interface.assets"
+// Environment variable overriding ASSETS_PATH (e.g. with a missing file, to
+//   compare with decoding the PNGs):
+#define ASSETS_ENV "AMIIBROS_ASSETS"
+// Folder of the PNG of each sprite, named after it (e.g. resources/logo.png):
+#define SPRITE_DIR "resources/"
+// Length of a sprite's PNG path (folder + name + ".png" including NUL):
+#define SPRITE_PATH_LEN sizeof(SPRITE_DIR) + ASSET_NAME_LEN + 4
+// Most atlas pages uploaded. Sprites on later pages are decoded from PNGs:
+#define UI_PAGE_MAX 4
+// Number of sprites the interface draws (logo, indicators):
+#define UI_SPRITE_CNT 5
+
+// An image the interface draws: part of an atlas page's texture, or the whole
+//   texture of a PNG the bundle lacks:
+typedef struct ui_sprite
+{
+  Texture2D texture;
+  Rectangle src; // Of the sprite, within texture
+  bool owned; // Whether texture is only the sprite's (unloaded with it)
+} ui_sprite;
+// ======================
+
+// === Frame Rate Constants ===
+// Frame rate while an animation (scan or fade out) plays:
+#define UI_ACTIVE_FPS 60
+// Frame rate while only the touch indicator pulses. Its slow fade needs far
+//   fewer frames; between them, the UI thread sleeps on ui_cmds, so that a
+//   command still starts its animation at once:
+#define UI_IDLE_FPS 20
+// Environment variable overriding UI_IDLE_FPS (e.g. with 60, to compare):
+#define IDLE_FPS_ENV "AMIIBROS_IDLE_FPS"
+// Longest a mode's time goes unaccounted (see interface_dump_stats):
+#define UI_MODE_ACCOUNT_NS 1000000000ull
+
+// Modes of the frame rate:
+typedef enum ui_mode
+{
+  UI_MODE_IDLE, // UI_IDLE_FPS
+  UI_MODE_ACTIVE, // UI_ACTIVE_FPS
+  UI_MODE_CNT
+} ui_mode;
+
+// Time the UI thread spent in a mode:
+typedef struct ui_mode_stats
+{
+  uint64_t cpu_ns; // CPU time of the UI thread
+  uint64_t wall_ns;
+  uint64_t frame_cnt;
+} ui_mode_stats;
+
+static const char *ui_mode_names[UI_MODE_CNT] = {"idle", "active"};
+// ============================
 
 // === Logo Constants ===
 #define SCREEN_WIDTH 1440
 #define SCREEN_HEIGHT 900
-static const char *LOGO_PATH = "resources/logo.png";
+#define LOGO_NAME "logo"
 // In order to center the logo we perform the calculation:
 // left margin = (SCREEN_WIDTH - IMAGE_WIDTH)/2 = (1440-1276)/2 = 164/2 = 82.
 #define LOGO_X 82
@@ -28,13 +94,18 @@ static const char *LOGO_PATH = "resources/logo.png";
 // ======================
 
 // === Touch Indicator Constants ===
-// Beginning of the path to each touch indicator we will cycle between:
-#define TI_PREF_DEF "resources/touch_indicator"
-// Length of touch indicator path (prefix len + id + ".png" including NUL):
-#define TI_PATH_LEN sizeof(TI_PREF_DEF) + 6
-// Number of touch indicators to cycle between. Note that this means TI_TEX_CNT
-//   indicator .png files must exist with the above prefix.
-#define TI_TEX_CNT 6
+// The touch indicator's shape, in white, tinted with each color in turn:
+#define TI_NAME "touch_indicator"
+// Its glowing core, in white, drawn untinted over the shape. Over the white
+//   background, this blends the color into white exactly as the full color
+//   images of each indicator did, at any opacity:
+#define TI_CORE_NAME "touch_indicator_core"
+// Number of colors (those of the logo) to cycle between:
+#define TI_COLOR_CNT 6
+static const Color TI_COLORS[TI_COLOR_CNT] = {
+  {230, 0, 30, 255}, {170, 199, 0, 255}, {0, 170, 234, 255},
+  {0, 135, 99, 255}, {245, 170, 0, 255}, {199, 0, 125, 255}
+};
 // TODO: These will need to be reconfigured when the physical build is
 //   constructed.
 #define TI_X 960
@@ -46,8 +117,8 @@ const float TI_PULSE_PERIOD = 1/TI_PULSE_FREQ;
 // =================================
 
 // === Success Indicator Constants ===
-// Success indicator texture path:
-#define SI_PATH "resources/success_indicator.png"
+// Success indicator sprite:
+#define SI_NAME "success_indicator"
 // Success indicator tint colors:
 #define SI_TINT (Color){0, 255, 0, 255}
 // Length (in seconds) of success animation:
@@ -57,16 +128,14 @@ const float TI_PULSE_PERIOD = 1/TI_PULSE_FREQ;
 // ===================================
 
 // === Failure Indicator Constants ===
-// Failure indicator texture path:
-#define FI_PATH "resources/failure_indicator.png"
+// Failure indicator sprite:
+#define FI_NAME "failure_indicator"
 // Failure indicator flashing animation duration (in seconds):
 #define FI_ANIM_LEN 1
 // Failure indicator tint color
 #define FI_TINT (Color){255, 0, 0, 255}
 // # of times the indicator flashes in the duration FI_ANIM_LEN
 #define FI_ANIM_FLSH_CNT 2
-const double FI_ANIM_PERIOD = (double)FI_ANIM_LEN / (double)FI_ANIM_FLSH_CNT;
-const double FI_ANIM_FREQ = 1.0/((double)FI_ANIM_LEN/(double)FI_ANIM_FLSH_CNT);
 // ===================================
 
 // === Fade Out Constants ===
@@ -81,47 +150,89 @@ const double FI_ANIM_FREQ = 1.0/((double)FI_ANIM_LEN/(double)FI_ANIM_FLSH_CNT);
 #define INSTR_COLOR DARKGRAY
 // ===================================
 
-// === Runtime Flags ===
-// These flags are controllable by the host program via helper functions.
-// They signal to the mainUI_thread, telling it to perform animations, etc..
-volatile bool flag_stop = false; // Stops the mainUI_thread
-volatile bool flag_scan_success_anim = false; // Starts scan_success animation
-volatile bool flag_scan_fail_anim = false; // Starts scan failed animation
-// =====================
 // === Runtime Variables ===
+// Every animation is timed by the frame clock: GetTime, read once per frame.
 double anim_start; // Current animation start time.
-pthread_mutex_t flag_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t flag_cond = PTHREAD_COND_INITIALIZER;
+double ti_start; // When the touch indicator started pulsing
+// Curves of the animations (see anim_curve.h), baked by the first
+//   mainUI_thread:
+anim_curve pulse_curve; // Touch indicator alpha, over TI_PULSE_PERIOD
+anim_curve flash_curve; // Failure indicator alpha, over FI_ANIM_LEN
+anim_curve grow_curve; // Success indicator growth, over SI_ANIM_LEN
+anim_curve fade_curve; // Fade out alpha, over FADEOUT_ANIM_LEN
+bool ui_curves_baked = false;
+// Commands from the host program to the mainUI_thread (animations, stopping),
+//   read without locks once per frame:
+ui_queue ui_cmds;
+bool ui_cmds_ready = false; // Whether ui_cmds is initialized
 pthread_t mainUI_thread; // Thread running the amiibrOS interface
 bool mainUI_thread_active = false; // Whether or not mainUI_thread is running
+uint32_t stop_seq = 0; // Command stopping mainUI_thread (0 if not sent yet)
+// Mapped once by the first mainUI_thread and kept, so that later ones find
+//   its pages in memory:
+asset_bundle ui_assets;
+bool ui_assets_tried = false; // Whether mapping ui_assets was attempted
+ui_mode cur_mode; // Mode of the mainUI_thread's frames
+int idle_fps; // Frame rate of UI_MODE_IDLE
+uint64_t mode_cpu_ns; // mainUI_thread's CPU time when cur_mode was accounted
+uint64_t mode_wall_ns; // When cur_mode was accounted
+uint64_t mode_frame_cnt; // Frames drawn since
+// Time per mode of the current mainUI_thread, and of every one so far (read
+//   by interface_dump_stats from the main thread, under mode_lock):
+ui_mode_stats mode_session[UI_MODE_CNT];
+ui_mode_stats mode_totals[UI_MODE_CNT];
+pthread_mutex_t mode_lock = PTHREAD_MUTEX_INITIALIZER;
 // =========================
 
 // === Function Prototypes ===
 bool start_interface (void);
+ui_anim fade_out_interface (void);
 bool stop_interface (void);
-bool play_scan_success_anim (void);
-bool play_scan_fail_anim (void);
+ui_anim play_scan_success_anim (void);
+ui_anim play_scan_fail_anim (void);
+bool cancel_anim (ui_anim anim);
+bool is_anim_done (ui_anim anim);
+int interface_anim_fd (void);
+void clear_anim_fd (void);
 bool is_interface_active (void);
+void interface_dump_stats (FILE *out);
 
 void *start_mainUI_thread (void* arg);
 
-void anim_success_indicator (Texture2D *texture);
-void anim_fail_indicator (Texture2D *texture);
-void anim_fadeout (bool *flag_fade_anim);
-
-float fwrap (float x, float y);
-bool threadsafe_read_flag (volatile bool *flag, bool *state);
-bool threadsafe_write_flag (volatile bool *flag, bool new_state);
-bool threadsafe_read_mainUI_flags (bool *stop_val,
-    bool *scan_success_val, bool *scan_fail_val);
-
-void update_ti(float *ti_alpha, unsigned int *current_ti);
-void draw_touch_indicator (Texture2D *texture, Color *tint);
+bool anim_success_indicator (ui_sprite *sprite, double now);
+bool anim_fail_indicator (ui_sprite *sprite, double now);
+void anim_fadeout (bool *flag_fade_anim, double now);
+
+void bake_ui_curves (void);
+float pulse_curve_fn (float progress);
+float flash_curve_fn (float progress);
+float grow_curve_fn (float progress);
+float fade_curve_fn (float progress);
+unsigned int load_ui_pages (Texture2D *pages);
+ui_sprite load_ui_sprite (const char *name, const Texture2D *pages,
+    unsigned int page_cnt, unsigned int *bundled);
+void unload_ui_sprite (ui_sprite *sprite);
+bool init_ui_cmds (void);
+ui_anim push_ui_cmd (ui_cmd_type type, uint32_t arg);
+int get_idle_fps (void);
+void init_ui_modes (void);
+void set_ui_mode (ui_mode mode);
+void pace_idle_frame (uint64_t frame_ns);
+void account_ui_mode (void);
+void log_ui_modes (void);
+uint64_t thread_cpu_ns (void);
+
+void update_ti (double now, float *ti_alpha, unsigned int *current_ti);
+void draw_touch_indicator (ui_sprite *shape, ui_sprite *core, Color *tint);
 // ===========================
 
 // === interface.h Implementation ===
 bool start_interface (void)
 {
+  if (!init_ui_cmds())
+    return false;
+  stop_seq = 0;
+
   // Temporarily block all signals so that child thread inherits a mask with
   //   all blockable signals blocked:
   sigset_t set;
@@ -142,12 +253,20 @@ bool start_interface (void)
   return true; // Thread creation and signal mask handling was successful
 }
 
+ui_anim fade_out_interface (void)
+{
+  // Tell main ui thread to stop. It begins the unloading process on the next
+  //   draw cycle, and the command is done once the thread is:
+  if (stop_seq == 0)
+    stop_seq = push_ui_cmd(UI_CMD_STOP, 0);
+  return stop_seq;
+}
+
 bool stop_interface (void)
 {
-  // Setting this flag will begin the unloading process on the next draw cycle.
-  if (!threadsafe_write_flag(&flag_stop, true)) // Tell main ui thread to stop
+  if (fade_out_interface() == 0)
     return false;
-  
+
   // Wait for the mainUI_thread to finish cleanup before returning:
   if (pthread_join(mainUI_thread, NULL))
     return false;
@@ -156,52 +275,63 @@ bool stop_interface (void)
   return true; // Animation complete and thread rejoined.
 }
 
-bool play_scan_success_anim (void)
+ui_anim play_scan_success_anim (void)
 {
-  if (pthread_mutex_lock(&flag_mutex))
-    return false;
-
-  // Signal animation to start by setting animation flag:
-  flag_scan_success_anim = true;
-
-  // Wait for the flag change to signal us that animation completed:
-  while (flag_scan_success_anim) {
-    // Sleep main thread until pthread_cond_signal is called on UI thread.
-    if (pthread_cond_wait (&flag_cond, &flag_mutex))
-      return false;
-  }
-
-  if (pthread_mutex_unlock(&flag_mutex))
-    return false;
-
-  return true; // Animation finished successfully
+  return push_ui_cmd(UI_CMD_SCAN_SUCCESS, 0);
 }
 
-bool play_scan_fail_anim (void)
+ui_anim play_scan_fail_anim (void)
 {
-  if (pthread_mutex_lock(&flag_mutex))
-    return false;
+  return push_ui_cmd(UI_CMD_SCAN_FAIL, 0);
+}
 
-  // Signal animation to start by setting animation flag:
-  flag_scan_fail_anim = true;
+bool cancel_anim (ui_anim anim)
+{
+  // Nothing to do for animations that are done, or will be by the time the
+  //   command would be taken (the UI thread is stopping):
+  if (is_anim_done(anim) || stop_seq != 0)
+    return true;
+  return push_ui_cmd(UI_CMD_CANCEL, anim) != 0;
+}
 
-  // Wait for the flag change to signal us that animation completed:
-  while (flag_scan_fail_anim) {
-    // Sleep main thread until pthread_cond_signal is called on UI thread.
-    if (pthread_cond_wait (&flag_cond, &flag_mutex))
-      return false;
-  }
+bool is_anim_done (ui_anim anim)
+{
+  return anim == 0 || !ui_cmds_ready || ui_queue_done(&ui_cmds, anim);
+}
 
-  if (pthread_mutex_unlock(&flag_mutex))
-    return false;
+int interface_anim_fd (void)
+{
+  return init_ui_cmds() ? ui_cmds.done_fd : -1;
+}
 
-  return true; // Animation finished successfully
+void clear_anim_fd (void)
+{
+  if (ui_cmds_ready)
+    ui_queue_clear(&ui_cmds);
 }
 
 bool is_interface_active (void)
 {
   return mainUI_thread_active;
 }
+
+void interface_dump_stats (FILE *out)
+{
+  ui_mode_stats totals[UI_MODE_CNT];
+  pthread_mutex_lock(&mode_lock);
+  for (unsigned int m = 0; m < UI_MODE_CNT; m++)
+    totals[m] = mode_totals[m];
+  pthread_mutex_unlock(&mode_lock);
+
+  fprintf(out, "interface: idle at %d fps, active at %d fps\n", get_idle_fps(),
+      UI_ACTIVE_FPS);
+  for (unsigned int m = 0; m < UI_MODE_CNT; m++) {
+    const ui_mode_stats *t = &totals[m];
+    fprintf(out, "  %-8s %10lu frames %10.1f s %6.2f%% CPU\n",
+        ui_mode_names[m], (unsigned long)t->frame_cnt, t->wall_ns / 1e9,
+        t->wall_ns != 0 ? 100.0 * t->cpu_ns / t->wall_ns : 0.0);
+  }
+}
 // ==================================
 
 // === Threading Functions ===
@@ -222,88 +352,177 @@ void *start_mainUI_thread (void* arg)
 {
   // arg exists only to satisfy pthreads.
   (void)arg; // We tell compiler to ignore the fact that we never use arg.
+  uint64_t start_ns = stats_now_ns(); // Startup to first frame is logged
 
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "amiibrOS"); // Init OpenGL context
   
-  SetTargetFPS(60);
-  // Load logo and other images into GPU memory (must do after OpenGL context)
-  Texture2D logo = LoadTexture(LOGO_PATH);
-  Texture2D success_indicator = LoadTexture(SI_PATH);
-  Texture2D fail_indicator = LoadTexture(FI_PATH);
+  init_ui_modes(); // Animating until the first frame is ready
+  if (!ui_assets_tried) {
+    ui_assets_tried = true;
+    const char *assets_path = getenv(ASSETS_ENV);
+    if (!asset_bundle_open(&ui_assets, assets_path != NULL ? assets_path
+                                                           : ASSETS_PATH))
+      log_write(LOG_EV_UI_ASSETS_FAILED, errno, NULL, 0, 0, 0);
+  }
+  if (!ui_curves_baked) {
+    bake_ui_curves();
+    ui_curves_baked = true;
+  }
 
-  Texture2D tis[TI_TEX_CNT];
-  unsigned int current_ti; // The current touch indicator texture in the cycle
+  // Load logo and other images into GPU memory (must do after OpenGL context)
+  uint64_t load_ns = stats_now_ns();
+  Texture2D pages[UI_PAGE_MAX]; // Atlas pages of ui_assets
+  unsigned int page_cnt = load_ui_pages(pages);
+  unsigned int bundled = 0; // Sprites found on pages
+  ui_sprite logo = load_ui_sprite(LOGO_NAME, pages, page_cnt, &bundled);
+  ui_sprite success_indicator = load_ui_sprite(SI_NAME, pages, page_cnt,
+      &bundled);
+  ui_sprite fail_indicator = load_ui_sprite(FI_NAME, pages, page_cnt,
+      &bundled);
+  ui_sprite ti = load_ui_sprite(TI_NAME, pages, page_cnt, &bundled);
+  ui_sprite ti_core = load_ui_sprite(TI_CORE_NAME, pages, page_cnt, &bundled);
+  unsigned int current_ti = 0; // The current touch indicator color
   float ti_alpha = 0.0f; // Alpha value of ti [0.0f, 1.0f]
-  
-  // Pre-load all touch indicator textures:
-  for (current_ti = 0; current_ti < TI_TEX_CNT; current_ti++) {
-    char ti_path[TI_PATH_LEN]; // Calc'd once at compile-time.
-    sprintf(ti_path, "%s%d.png", TI_PREF_DEF, current_ti);
-    tis[current_ti] = LoadTexture(ti_path);
-  }
-  current_ti = 0; // Start the sequence from beginning.
-
-  bool stop_val;
-  bool scan_success_val;
-  bool scan_fail_val;
-  // Read in thread-shared values:
-  // TODO Error check:
-  threadsafe_read_mainUI_flags(&stop_val, &scan_success_val, &scan_fail_val);
-  
+  load_ns = stats_now_ns() - load_ns;
+  ti_start = GetTime();
+
+  // raylib reports the details of textures that failed to load (id 0):
+  unsigned int loaded = (logo.texture.id != 0) +
+      (success_indicator.texture.id != 0) + (fail_indicator.texture.id != 0) +
+      (ti.texture.id != 0) + (ti_core.texture.id != 0);
+  log_write(LOG_EV_UI_STARTED, 0, NULL, loaded, UI_SPRITE_CNT, 0);
+  bool first_frame = true;
+
+  ui_cmd cmd;
+  uint32_t last_seq = 0; // Last command taken
+  uint32_t anim_seq = 0; // Command of the animation playing (0 if none)
+  ui_cmd_type anim_type = UI_CMD_SCAN_SUCCESS;
+  bool stop_val = false;
+
   bool abort_key = false;
-  while (stop_val != true && !(abort_key = WindowShouldClose())) {
+  while (!(abort_key = WindowShouldClose())) {
+    uint64_t frame_ns = stats_now_ns();
+
+    // Take the commands sent since the last frame. When there are none (the
+    //   usual case), this is just two atomic loads:
+    while (ui_queue_pop(&ui_cmds, &cmd)) {
+      last_seq = cmd.seq;
+      if (cmd.type == UI_CMD_STOP)
+        stop_val = true;
+      else if (cmd.type == UI_CMD_CANCEL) {
+        // Completing the cancel also completes the animation before it:
+        if (anim_seq != 0 && cmd.arg == anim_seq) {
+          ui_queue_complete(&ui_cmds, cmd.seq);
+          anim_seq = 0;
+          anim_start = 0;
+        }
+      }
+      else {
+        if (anim_seq != 0) // Replaced by the newer animation
+          ui_queue_complete(&ui_cmds, anim_seq);
+        anim_seq = cmd.seq;
+        anim_type = cmd.type;
+        anim_start = 0;
+      }
+    }
+    if (stop_val)
+      break;
+    // Back to full rate on the frame a command starts an animation:
+    set_ui_mode(anim_seq != 0 ? UI_MODE_ACTIVE : UI_MODE_IDLE);
+    double now = GetTime(); // The frame's time, for every animation in it
+
     BeginDrawing();
 
     ClearBackground(WHITE);
-    DrawTexture(logo, LOGO_X, LOGO_Y, WHITE); // Draw logo centered, no tint
+    // The text goes first: all that follows is drawn from the atlas, in one
+    //   batch (if the bundle was mapped):
     DrawText(INSTR_TEXT, INSTR_X, INSTR_Y, INSTR_FONTSIZE, INSTR_COLOR);
-    update_ti(&ti_alpha, &current_ti); // Calculate alpha value & current_ti
-    Color color = Fade(WHITE, ti_alpha);
-    Texture2D texture = tis[current_ti];
-    draw_touch_indicator(&texture, &color);
-
-    if (scan_success_val) {
-      if (anim_start == 0) // If the animation hasn't been started yet...
-        anim_start = GetTime(); // ... start it from beginning!
-      anim_success_indicator(&success_indicator);
+    // Draw logo centered, no tint:
+    DrawTextureRec(logo.texture, logo.src, (Vector2){LOGO_X, LOGO_Y}, WHITE);
+    update_ti(now, &ti_alpha, &current_ti); // Calculate alpha & current_ti
+    Color color = Fade(TI_COLORS[current_ti], ti_alpha);
+    draw_touch_indicator(&ti, &ti_core, &color);
+
+    bool anim_done = false;
+    if (anim_seq != 0 && anim_type == UI_CMD_SCAN_SUCCESS) {
+      if (anim_start == 0) { // If the animation hasn't been started yet...
+        anim_start = now; // ... start it from beginning!
+        // os_ctrl does not end the launch before this is done (see stats.h):
+        stats_mark(STATS_ANIM_START);
+        log_write(LOG_EV_UI_ANIM, 0, "success", 0, 0, 0);
+      }
+      anim_done = anim_success_indicator(&success_indicator, now);
+    }
+    else if (anim_seq != 0) {
+      if (anim_start == 0) {
+        anim_start = now;
+        log_write(LOG_EV_UI_ANIM, 0, "fail", 0, 0, 0);
+      }
+      anim_done = anim_fail_indicator(&fail_indicator, now);
     }
-    else if (scan_fail_val) {
-      if (anim_start == 0)
-        anim_start = GetTime();
-      anim_fail_indicator(&fail_indicator);
+
+    // Timed before EndDrawing, which may wait to keep the frame rate:
+    if (first_frame) { // Where the textures came from makes the difference
+      first_frame = false;
+      const char *source = bundled == 0 ? "PNGs" : "bundle and PNGs";
+      if (bundled == UI_SPRITE_CNT)
+        source = "bundle";
+      log_write(LOG_EV_UI_FIRST_FRAME, 0, source,
+          (stats_now_ns() - start_ns) / 1000, load_ns / 1000, 0);
     }
 
     EndDrawing();
 
-    // Read in thread-shared values so that loop guards gets updated values:
-    // TODO Error check:
-    threadsafe_read_mainUI_flags(&stop_val, &scan_success_val, &scan_fail_val);
+    if (anim_done) { // Its last frame is drawn: tell whoever waits for it
+      ui_queue_complete(&ui_cmds, anim_seq);
+      anim_seq = 0;
+    }
+
+    mode_frame_cnt++;
+    if (cur_mode == UI_MODE_IDLE)
+      pace_idle_frame(frame_ns);
+    if (stats_now_ns() - mode_wall_ns >= UI_MODE_ACCOUNT_NS)
+      account_ui_mode();
   }
 
   // We received a signal to stop the interface: Next, play fade out animation:
+  set_ui_mode(UI_MODE_ACTIVE);
   anim_start = GetTime();
   bool flag_fade_anim = true;
   while (flag_fade_anim) {
+    double now = GetTime();
     BeginDrawing();
     ClearBackground(WHITE);
 
-    DrawTexture(logo, LOGO_X, LOGO_Y, WHITE); // Draw logo centered, no tint
-    anim_fadeout(&flag_fade_anim);
+    // Draw logo centered, no tint:
+    DrawTextureRec(logo.texture, logo.src, (Vector2){LOGO_X, LOGO_Y}, WHITE);
+    anim_fadeout(&flag_fade_anim, now);
 
     EndDrawing();
+    mode_frame_cnt++;
   }
+  account_ui_mode();
   
-  // Unload all touch indicator textures:
-  for (current_ti = 0; current_ti < TI_TEX_CNT; current_ti++) {
-    UnloadTexture(tis[current_ti]);
-  }
-  UnloadTexture(fail_indicator);
-  UnloadTexture(success_indicator);
-  UnloadTexture(logo);
+  // Unload the textures of sprites the atlas lacked, then the atlas:
+  unload_ui_sprite(&ti_core);
+  unload_ui_sprite(&ti);
+  unload_ui_sprite(&fail_indicator);
+  unload_ui_sprite(&success_indicator);
+  unload_ui_sprite(&logo);
+  for (unsigned int i = 0; i < page_cnt; i++)
+    UnloadTexture(pages[i]);
 
   CloseWindow(); // Close OpenGL context
 
-  threadsafe_write_flag(&flag_stop, false); // Reset flag: We have handled it.
+  // Nothing may be left waiting for us (e.g. when we stopped for the escape
+  //   key), and the next mainUI_thread must start from an empty queue:
+  while (ui_queue_pop(&ui_cmds, &cmd))
+    last_seq = cmd.seq;
+  if (last_seq != 0)
+    ui_queue_complete(&ui_cmds, last_seq);
+  log_ui_modes();
+  log_write(LOG_EV_UI_STOPPED, 0, abort_key ? "escape key" : "os_ctrl", 0, 0,
+      0);
 
   // If we exited due to the user pressing escape key, let the main thread know
   //   so that it can terminate the entire amiibrOS program:
@@ -317,109 +536,97 @@ void *start_mainUI_thread (void* arg)
 
 // === Drawing Functions ===
 /**
- * Updates the animatable values of the success indicator and draws it.
+ * Updates the animatable values of the success indicator for the frame at now
+ *   (see GetTime) and draws it.
  * This function must be called between BeginDrawing/EndDrawing calls.
  *
- * Once the animation time runs out, the animation flag is reset.
+ * Returns true once the animation time runs out (on its last frame).
  */
-void anim_success_indicator (Texture2D *texture)
+bool anim_success_indicator (ui_sprite *sprite, double now)
 {
   // Update time:
-  double time_elapsed = GetTime() - anim_start;
-  if (time_elapsed > SI_ANIM_LEN) {
+  float progress = (now - anim_start) / SI_ANIM_LEN;
+  if (progress > 1) {
     // This is our last draw cycle:
-    time_elapsed = SI_ANIM_LEN;
+    progress = 1;
   }
 
   // Calculate updated values:
-  double size = EaseLinearInOut(time_elapsed, SI_ANIM_SIZE_START,
-                                SI_ANIM_SIZE_END, SI_ANIM_LEN);
-  Rectangle srcRec = (Rectangle){0, 0, texture->width, texture->height};
+  float size = SI_ANIM_SIZE_START + SI_ANIM_SIZE_END *
+      anim_curve_eval(&grow_curve, progress);
+  Rectangle srcRec = sprite->src;
   Rectangle destRec = (Rectangle){TI_X, TI_Y, size, size};
   Vector2 origin = {destRec.width / 2, destRec.height / 2};
   float rot = 0;
   Color tint = SI_TINT;
 
   // Draw the indicator
-  DrawTexturePro(*texture, srcRec, destRec, origin, rot, tint);
+  DrawTexturePro(sprite->texture, srcRec, destRec, origin, rot, tint);
 
   // Check to see if time ran out:
-  if (time_elapsed == SI_ANIM_LEN) {
+  if (progress == 1) {
     anim_start = 0; // Reset animation start time to indicate no animation
-    pthread_mutex_lock(&flag_mutex); // TODO Error checking
-    
-    flag_scan_success_anim = false; // Disable animation
-
-    pthread_cond_signal(&flag_cond); // Wake main thread
-    pthread_mutex_unlock(&flag_mutex); // TODO Error checking
+    return true;
   }
+  return false;
 }
 
 /**
- * Updates the animatable values of the failure indicator and draws it. This
- *   function must be called between BeginDrawing/EndDrawing calls.
+ * Updates the animatable values of the failure indicator for the frame at now
+ *   (see GetTime) and draws it. This function must be called between
+ *   BeginDrawing/EndDrawing calls.
  *
- * Once the animation time runs out, the animation flag is reset.
+ * Returns true once the animation time runs out (on its last frame).
  */
-void anim_fail_indicator (Texture2D *texture)
+bool anim_fail_indicator (ui_sprite *sprite, double now)
 {
   // Update time:
-  double time_elapsed = GetTime() - anim_start;
-  if (time_elapsed > FI_ANIM_LEN) {
+  float progress = (now - anim_start) / FI_ANIM_LEN;
+  if (progress > 1) {
     // This is our last draw cycle:
-    time_elapsed = FI_ANIM_LEN;
+    progress = 1;
   }
   
   // Recalculate time-based variables:
-  Rectangle srcRec = (Rectangle){0, 0, texture->width, texture->height};
+  Rectangle srcRec = sprite->src;
   Rectangle destRec = (Rectangle){TI_X, TI_Y, SI_ANIM_SIZE_START,
                                   SI_ANIM_SIZE_START};
   Vector2 origin = {destRec.width / 2, destRec.height / 2};
   float rot = 0;
   Color tint = FI_TINT;
-  int new_alpha = trunc(
-    255 * sin(fwrap(time_elapsed, FI_ANIM_PERIOD) * 2 * PI * FI_ANIM_FREQ)
-  );
-  if (new_alpha < 0) { // Clamp to 0 (invisible) when sine goes negative.
-    new_alpha = 0;
-  }
-  tint.a = (unsigned char)new_alpha;
+  tint.a = (unsigned char)(255 * anim_curve_eval(&flash_curve, progress));
 
   // Draw the indicator
-  DrawTexturePro(*texture, srcRec, destRec, origin, rot, tint);
+  DrawTexturePro(sprite->texture, srcRec, destRec, origin, rot, tint);
   
   // Check to see if time ran out:
-  if (time_elapsed == FI_ANIM_LEN) {
+  if (progress == 1) {
     anim_start = 0; // Reset animation start time to indicate no animation
-    pthread_mutex_lock(&flag_mutex); // TODO Error checking
-    
-    flag_scan_fail_anim = false; // Disable animation
-
-    pthread_cond_signal(&flag_cond); // Wake main thread
-    pthread_mutex_unlock(&flag_mutex); // TODO Error checking
+    return true;
   }
+  return false;
 }
 
 /**
  * Animates a screen fade out configurable by constants at the top of this
- *   file.
+ *   file, for the frame at now (see GetTime).
  *
  * This function must be called between BeginDrawing/EndDrawing calls.
  *
  * Resets the local flag (not shared between threads) flag_fade_anim on
  *   completion.
  */
-void anim_fadeout (bool *flag_fade_anim)
+void anim_fadeout (bool *flag_fade_anim, double now)
 {
   // Update time:
-  double time_elapsed = GetTime() - anim_start;
-  if (time_elapsed > FADEOUT_ANIM_LEN) {
+  float progress = (now - anim_start) / FADEOUT_ANIM_LEN;
+  if (progress > 1) {
     // This is our last draw cycle:
-    time_elapsed = FADEOUT_ANIM_LEN;
+    progress = 1;
   }
 
   // Calculate time-updated values:
-  double alpha = EaseLinearInOut(time_elapsed, 0, 255, FADEOUT_ANIM_LEN);
+  float alpha = 255 * anim_curve_eval(&fade_curve, progress);
   Color color = (Color){0, 0, 0, alpha};
   Rectangle destRec = (Rectangle){0, 0, GetScreenWidth(), GetScreenHeight()};
 
@@ -427,7 +634,7 @@ void anim_fadeout (bool *flag_fade_anim)
   DrawRectangleRec(destRec, color);
 
   // Check to see if time ran out:
-  if (time_elapsed == FADEOUT_ANIM_LEN) {
+  if (progress == 1) {
     anim_start = 0; // Reset animation start time to indicate no animation
     *flag_fade_anim = false; // Animation is completed
   }
@@ -436,118 +643,256 @@ void anim_fadeout (bool *flag_fade_anim)
 
 // === Helpers ===
 /**
- * Performs a simplified integer modulus (x mod y) for the two given floats.
- * Useful for wrapping an indefinitely incrementing float value back to 0.
- * Preconditions:
- * * y must be a strictly positive float (for this to make sense).
+ * Bakes the curves of every animation (see anim_curve.h), so that no frame
+ *   evaluates a sine or an easing.
+ */
+void bake_ui_curves (void)
+{
+  anim_curve_bake(&pulse_curve, pulse_curve_fn);
+  anim_curve_bake(&flash_curve, flash_curve_fn);
+  anim_curve_bake(&grow_curve, grow_curve_fn);
+  anim_curve_bake(&fade_curve, fade_curve_fn);
+}
+
+// Touch indicator alpha: one sine wave per pulse, visible while it is positive.
+float pulse_curve_fn (float progress)
+{
+  float alpha = sinf(progress * 2 * PI);
+  return alpha > 0.0f ? alpha : 0.0f; // Clamp to 0 if the sine goes below 0
+}
+
+// Failure indicator alpha: FI_ANIM_FLSH_CNT pulses.
+float flash_curve_fn (float progress)
+{
+  return pulse_curve_fn(progress * FI_ANIM_FLSH_CNT);
+}
+
+// Success indicator growth, from 0 to 1 (times SI_ANIM_SIZE_END).
+float grow_curve_fn (float progress)
+{
+  return EaseLinearInOut(progress, 0, 1, 1);
+}
+
+// Fade out alpha, from 0 to 1 (times 255).
+float fade_curve_fn (float progress)
+{
+  return EaseLinearInOut(progress, 0, 1, 1);
+}
+
+/**
+ * Uploads the atlas pages of ui_assets (up to UI_PAGE_MAX) into pages,
+ *   straight from the mapping, without decoding or copying. Returns how many
+ *   there are (0 if the bundle is not mapped).
  */
-float fwrap (float x, float y)
+unsigned int load_ui_pages (Texture2D *pages)
 {
-  return x - y * floor(x / y);
+  unsigned int page_cnt = 0;
+  for (; ui_assets.map != NULL && page_cnt < ui_assets.page_cnt &&
+      page_cnt < UI_PAGE_MAX; page_cnt++) {
+    const asset_page *page = &ui_assets.pages[page_cnt];
+    Image image = {(void *)asset_bundle_pixels(&ui_assets, page_cnt),
+        (int)page->width, (int)page->height, 1, (int)page->format};
+    // Never frees the (mapped) pixels:
+    pages[page_cnt] = LoadTextureFromImage(image);
+  }
+  return page_cnt;
 }
 
 /**
- * Thread safe function using mutexes to ensure only one thread is setting or
- *   reading flags at a time.
- * Sets the given bool to the state read from the given flag.
- *
- * Returns true if successful, false if an error occured.
+ * Returns the sprite of the given name (e.g. "logo"). It is drawn from its
+ *   atlas page if ui_assets has it on one of the page_cnt pages uploaded
+ *   (bundled is then incremented). Otherwise its PNG is decoded into a
+ *   texture of its own.
  */
-bool threadsafe_read_flag (volatile bool *flag, bool *state)
+ui_sprite load_ui_sprite (const char *name, const Texture2D *pages,
+    unsigned int page_cnt, unsigned int *bundled)
 {
-  // Ensure this thread is the only thread accessing the flags:
-  if (pthread_mutex_lock(&flag_mutex))
-    return false;
+  const asset_sprite *entry = ui_assets.map != NULL ?
+      asset_bundle_find(&ui_assets, name) : NULL;
+  if (entry != NULL && entry->page < page_cnt && pages[entry->page].id != 0) {
+    (*bundled)++;
+    return (ui_sprite){pages[entry->page], (Rectangle){entry->x, entry->y,
+        entry->width, entry->height}, false};
+  }
 
-  *state = *flag;
+  char path[SPRITE_PATH_LEN];
+  snprintf(path, sizeof(path), "%s%s.png", SPRITE_DIR, name);
+  Texture2D texture = LoadTexture(path);
+  return (ui_sprite){texture, (Rectangle){0, 0, texture.width,
+      texture.height}, true};
+}
 
-  if (pthread_mutex_unlock(&flag_mutex)) // Let other threads access flags
-    return false;
+// Unloads the texture of the given sprite, if it is only the sprite's.
+void unload_ui_sprite (ui_sprite *sprite)
+{
+  if (sprite->owned)
+    UnloadTexture(sprite->texture);
+}
 
-  return true;
+/**
+ * Prepares ui_cmds, unless it already is. The queue outlives each
+ *   mainUI_thread (it is empty whenever one ends).
+ *
+ * Returns true if successful, false if an error occured and errno is set.
+ */
+bool init_ui_cmds (void)
+{
+  if (!ui_cmds_ready)
+    ui_cmds_ready = ui_queue_init(&ui_cmds);
+  return ui_cmds_ready;
 }
 
 /**
- * Thread safe function using mutexes to ensure only one thread is setting or
- *   reading flags at a time.
- * Sets the given flag to the given state.
+ * Sends the mainUI_thread the command of the given type and argument.
+ *   Commands are only sent to a running mainUI_thread, as the next one would
+ *   otherwise act on them.
  *
- * Returns true if successful, false if an error occured.
+ * Returns the command's sequence number, or 0 if an error occured.
  */
-bool threadsafe_write_flag (volatile bool *flag, bool new_state)
+ui_anim push_ui_cmd (ui_cmd_type type, uint32_t arg)
 {
-  // Ensure this thread is the only thread accessing the flags:
-  if (pthread_mutex_lock(&flag_mutex))
-    return false;
+  if (!mainUI_thread_active)
+    return 0;
+  return ui_queue_push(&ui_cmds, type, arg); // 0 if the queue is full
+}
 
-  *flag = new_state;
+// Returns the frame rate of UI_MODE_IDLE: UI_IDLE_FPS, or its override.
+int get_idle_fps (void)
+{
+  const char *env = getenv(IDLE_FPS_ENV);
+  long fps = env != NULL ? strtol(env, NULL, 10) : 0;
+  if (fps <= 0)
+    return UI_IDLE_FPS;
+  return fps < UI_ACTIVE_FPS ? (int)fps : UI_ACTIVE_FPS;
+}
 
-  if (pthread_mutex_unlock(&flag_mutex)) // Let other threads access flags
-    return false;
+/**
+ * Starts the mainUI_thread in UI_MODE_ACTIVE and its accounting of the time
+ *   spent in each mode. Must be called from the mainUI_thread.
+ */
+void init_ui_modes (void)
+{
+  idle_fps = get_idle_fps();
+  for (unsigned int m = 0; m < UI_MODE_CNT; m++)
+    mode_session[m] = (ui_mode_stats){0, 0, 0};
+  cur_mode = UI_MODE_ACTIVE;
+  SetTargetFPS(UI_ACTIVE_FPS);
+  mode_cpu_ns = thread_cpu_ns();
+  mode_wall_ns = stats_now_ns();
+  mode_frame_cnt = 0;
+}
 
-  return true;
+/**
+ * Switches the frame rate to that of the given mode, accounting the time
+ *   spent in the previous one. In UI_MODE_IDLE, raylib does not wait for the
+ *   next frame: pace_idle_frame does.
+ */
+void set_ui_mode (ui_mode mode)
+{
+  if (mode == cur_mode)
+    return;
+  account_ui_mode();
+  cur_mode = mode;
+  SetTargetFPS(mode == UI_MODE_ACTIVE ? UI_ACTIVE_FPS : 0); // 0: no waiting
 }
 
-bool threadsafe_read_mainUI_flags (bool *stop_val,
-    bool *scan_success_val, bool *scan_fail_val)
+/**
+ * Waits until the next frame of UI_MODE_IDLE is due, given when the current
+ *   one started, or until a command is sent (the next frame then takes it at
+ *   once).
+ */
+void pace_idle_frame (uint64_t frame_ns)
 {
-  // Ensure this thread is the only thread accessing the flags:
-  if (pthread_mutex_lock(&flag_mutex))
-    return false;
+  uint64_t due_ns = frame_ns + 1000000000ull / idle_fps;
+  uint64_t now_ns = stats_now_ns();
+  if (due_ns <= now_ns)
+    return;
+  // Only fails if poll does; the next frame is then merely early:
+  ui_queue_sleep(&ui_cmds, (int)((due_ns - now_ns + 500000) / 1000000));
+}
 
-  *stop_val = flag_stop;
-  *scan_success_val = flag_scan_success_anim;
-  *scan_fail_val = flag_scan_fail_anim;
+/**
+ * Adds the time and frames since cur_mode was last accounted to its totals.
+ *   Must be called from the mainUI_thread.
+ */
+void account_ui_mode (void)
+{
+  uint64_t cpu_ns = thread_cpu_ns();
+  uint64_t wall_ns = stats_now_ns();
+  ui_mode_stats delta = {cpu_ns - mode_cpu_ns, wall_ns - mode_wall_ns,
+      mode_frame_cnt};
+  mode_cpu_ns = cpu_ns;
+  mode_wall_ns = wall_ns;
+  mode_frame_cnt = 0;
+
+  ui_mode_stats *session = &mode_session[cur_mode];
+  session->cpu_ns += delta.cpu_ns;
+  session->wall_ns += delta.wall_ns;
+  session->frame_cnt += delta.frame_cnt;
+  pthread_mutex_lock(&mode_lock);
+  ui_mode_stats *total = &mode_totals[cur_mode];
+  total->cpu_ns += delta.cpu_ns;
+  total->wall_ns += delta.wall_ns;
+  total->frame_cnt += delta.frame_cnt;
+  pthread_mutex_unlock(&mode_lock);
+}
 
-  if (pthread_mutex_unlock(&flag_mutex)) // Let other threads access flags
-    return false;
+// Logs the average CPU use of the mainUI_thread in each mode it was in.
+void log_ui_modes (void)
+{
+  for (unsigned int m = 0; m < UI_MODE_CNT; m++) {
+    const ui_mode_stats *session = &mode_session[m];
+    if (session->wall_ns == 0)
+      continue;
+    log_write(LOG_EV_UI_CPU, 0, ui_mode_names[m],
+        session->cpu_ns * 1000000 / session->wall_ns,
+        session->wall_ns / 1000000, session->frame_cnt);
+  }
+}
 
-  return true;
+// Returns the CPU time the calling thread has used.
+uint64_t thread_cpu_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
 }
 // ===========================
 
 // TODO: Refactor these:
 /**
- * Updates the touch indicator's alpha value and cycles its color.
+ * Updates the touch indicator's alpha value and cycles its color, for the
+ *   frame at now (see GetTime).
  * Must be called at the beginning of every frame.
- * Does not assume a constant 60 fps: This function utilizes a deltaTime for
- *   robustness and can be called with a variable FPS.
+ * Does not assume a constant 60 fps: Both follow from the time since ti_start
+ *   alone, so any frame rate (see UI_IDLE_FPS) shows the same pulse.
  * Pulse Frequency is determined via TI_PULSE_FREQ.
  */
-void update_ti(float *ti_alpha, unsigned int *current_ti)
+void update_ti (double now, float *ti_alpha, unsigned int *current_ti)
 {
-  // Keeps track of when we cycle between colors:
-  static bool visible_switch = true; // true at start avoids skipping 1st color
-  // Keeps track of the sine wave we use to create a pulse effect:
-  static float theta = 0.0f;
-  
-  // Essentially adding deltaTime since last frame:
-  theta = fwrap(theta + GetFrameTime(), TI_PULSE_PERIOD);
-
-  if ( (*ti_alpha = sin(theta * 2 * PI * TI_PULSE_FREQ) ) < 0.0f) {
-    *ti_alpha = 0.0f; // Clamp to 0 if the sine wave goes below 0.
-    visible_switch = false; // We cannot see the pulse.
-  }
-  else if (visible_switch == false && *ti_alpha > 0.0f) {
-    // We went from not seeing the pulse to seeing it. We update the current_ti
-    *current_ti = (*current_ti + 1) % TI_TEX_CNT;
-    visible_switch = true;
-  }
+  double elapsed = now - ti_start;
+  *ti_alpha = anim_curve_eval(&pulse_curve,
+      anim_curve_phase(elapsed, TI_PULSE_PERIOD));
+  // Each pulse starts invisible, so the color changes unseen as it starts:
+  *current_ti = (unsigned long)(elapsed / TI_PULSE_PERIOD) % TI_COLOR_CNT;
 }
 
 /**
- * Draws the touch indicator given its texture and a tint determining opacity.
+ * Draws the touch indicator given its shape and core sprites and a tint
+ *   determining its color and opacity.
  *
  * This function must be called between BeginDrawing/EndDrawing calls.
  */
-void draw_touch_indicator (Texture2D *texture, Color *tint)
+void draw_touch_indicator (ui_sprite *shape, ui_sprite *core, Color *tint)
 {
   // Draw amiibo touch indicator with the alpha value we calculated and the
-  //   current texture in the cycle:
-  Rectangle srcRec = (Rectangle){0, 0, texture->width, texture->height };
+  //   current color in the cycle:
   Rectangle destRec = (Rectangle){TI_X, TI_Y, TI_SIZE, TI_SIZE};
   Vector2 origin = {destRec.width / 2, destRec.height / 2};
   float rot = 0;
 
-  DrawTexturePro(*texture, srcRec, destRec, origin, rot, *tint);
+  DrawTexturePro(shape->texture, shape->src, destRec, origin, rot, *tint);
+  // The core whitens the color towards the middle. It is left opaque: faded
+  //   out along with the shape, white over white is no change:
+  DrawTexturePro(core->texture, core->src, destRec, origin, rot, WHITE);
 }
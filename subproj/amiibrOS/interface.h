@@ -12,7 +12,18 @@
  */
 
 #include <stdbool.h>
-#include "raylib.h"
+#include <stdint.h> // uint32_t
+#include <stdio.h> // FILE
+
+/**
+ * Handle of an animation the UI thread was told to play (0 is none).
+ *
+ * Animations never block the caller. One is done once its last frame is
+ *   drawn, or once it is cancelled or superseded: a newer animation replaces
+ *   the one playing (e.g. a scan during the scan failed flash). Each time an
+ *   animation is done, interface_anim_fd becomes readable.
+ */
+typedef uint32_t ui_anim;
 
 /**
  * Creates the main UI thread and begins the runtime loop for the UI drawing.
@@ -28,32 +39,68 @@
 bool start_interface (void);
 
 /**
- * Joins the main UI thread after a short cleanup and fade-out animation.
+ * Starts the fade-out animation that ends the main UI thread. Once it is
+ *   done, stop_interface joins the thread without waiting.
+ *
+ * Returns the animation's handle; 0 if the interface is not active or there
+ *   were errors.
+ */
+ui_anim fade_out_interface (void);
+
+/**
+ * Joins the main UI thread after a short cleanup and fade-out animation
+ *   (started by fade_out_interface, or now). Blocks until the thread is done.
  *
  * Must be called only after a successful start_interface.
  */
 bool stop_interface (void);
 
 /**
- * Plays a scan success animation.
+ * Starts a scan success animation.
  *
- * Note, this function will block until the animation is completed.
- * 
- * Returns true if successful; false if there were errors.
+ * Returns the animation's handle; 0 if the interface is not active or there
+ *   were errors.
  */
-bool play_scan_success_anim (void);
+ui_anim play_scan_success_anim (void);
 
 /**
- * Plays a scan failed animation: A flashing X mark.
+ * Starts a scan failed animation: A flashing X mark.
  *
- * bg: bg must != NULL. bg is a screencapture of the state right before closing
- *   the last running program (or mainUI_thread).
+ * Returns the animation's handle; 0 if the interface is not active or there
+ *   were errors.
+ */
+ui_anim play_scan_fail_anim (void);
+
+/**
+ * Stops the given animation, unless it is already done. It is done (see
+ *   is_anim_done) once the UI thread has removed it from the screen.
  *
- * Note, this function will block until the animation is completed.
- * 
  * Returns true if successful; false if there were errors.
  */
-bool play_scan_fail_anim (void);
+bool cancel_anim (ui_anim anim);
+
+// Returns whether the given animation is done.
+bool is_anim_done (ui_anim anim);
+
+/**
+ * Returns an fd (for poll/epoll) that becomes readable whenever an animation
+ *   is done, or -1 (with errno set) if it can not be created. It stays the
+ *   same for as long as the program runs, across restarts of the interface.
+ */
+int interface_anim_fd (void);
+
+/**
+ * Resets interface_anim_fd once it has been seen readable. Animations done
+ *   after the reset make it readable again, so check is_anim_done after this.
+ */
+void clear_anim_fd (void);
 
 // Returns whether or not the interface (mainUI_thread's interface) is active.
 bool is_interface_active (void);
+
+/**
+ * Prints the frames drawn, time spent and average CPU use of the UI thread in
+ *   each of its frame rates (idle and animating), over every start of the
+ *   interface, to out.
+ */
+void interface_dump_stats (FILE *out);
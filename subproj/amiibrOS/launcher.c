@@ -0,0 +1,808 @@
+/**
+ * launcher.c
+ *
+ * Contains implementation of launcher.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // O_PATH, posix_spawn_file_actions_addfchdir_np
+
+#include <stdio.h> // snprintf
+#include <stdlib.h> // malloc, calloc, realloc, free, getenv, strtoul
+#include <string.h> // strlen, strchr, strdup, strpbrk, strtok_r, strcspn
+#include <ctype.h> // isspace
+#include <errno.h> // errno
+#include <fcntl.h> // open, openat, O_* flags
+#include <unistd.h> // read, close, access, fchdir, execve, vfork, setpgid
+#include <signal.h> // sigset_t, sigaction, sigprocmask
+#include <spawn.h> // posix_spawn, posix_spawn_file_actions_*
+#include <sys/wait.h> // waitpid
+#include "launcher.h"
+
+// glibc 2.29 introduced a spawn file action to change directory by fd. Without
+//   it we fall back to doing the same steps by hand in a vfork child:
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)
+#define LAUNCHER_HAVE_FCHDIR_ACTION
+#endif
+
+// PATH used to find a script's command if os_ctrl's environment has none:
+#define LAUNCHER_DEFAULT_PATH "/usr/bin:/bin:/usr/sbin:/sbin"
+// Characters that make a line more than a plain list of words to the shell:
+#define SHELL_SPECIAL_CHARS "$`\"'\\|&;<>(){}[]*?~#"
+
+extern char **environ; // Handed to every spawned app (plus the plan's env)
+
+// The program and arguments declared by a .conf manifest (see launcher.h):
+typedef struct conf_manifest
+{
+  char *exec; // As written in the .conf (NULL if there is no manifest)
+  char **args; // NULL terminated (or NULL if there are none)
+  char *cwd; // As written in the .conf (or NULL)
+} conf_manifest;
+
+// --- Helper Function Prototypes ---
+char *path_join (const char *dir, const char *name);
+char *read_script (int dir_fd, const char *script_name);
+bool parse_conf (launch_plan *plan, conf_manifest *man, char *conf,
+    const char *conf_name);
+bool apply_manifest (launch_plan *plan, conf_manifest *man,
+    const char *conf_name);
+bool strv_append (char ***strv, const char *str);
+char **split_simple_command (char *script);
+char *find_program (const launch_plan *plan, const char *name);
+void free_argv (char **argv);
+char **build_envp (const launch_plan *plan);
+void build_default_sigset (sigset_t *set);
+int movable_fd (int fd);
+bool movable_fds (int ready_fd, int handoff_fd, int *src_fds);
+void close_moved_fds (int ready_fd, int handoff_fd, const int *src_fds);
+// --- ---
+
+launch_plan *launch_plan_create (const char *app_dir, const char *script_name,
+    const char *conf_name)
+{
+  launch_plan *plan = calloc(1, sizeof(launch_plan));
+  if (plan == NULL)
+    return NULL;
+  plan->dir_fd = -1;
+  plan->cwd_fd = -1;
+  plan->teardown_grace_ms = LAUNCHER_TEARDOWN_GRACE_MS;
+  plan->handoff = false;
+  plan->resumable = false;
+
+  int preserve_errno;
+  char *script = NULL; // Contents of the .sh script
+  char *conf = NULL; // Contents of the .conf file
+  conf_manifest man = {NULL, NULL, NULL};
+
+  // O_PATH is enough to fchdir into the directory and open files relative to
+  //   it, without needing read permission on the directory itself.
+  if ( (plan->dir_fd = open(app_dir, O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1)
+    goto error;
+  if ( (plan->dir_path = strdup(app_dir)) == NULL ||
+      (plan->script_path = path_join(app_dir, script_name)) == NULL)
+    goto error;
+
+  // The .conf file is optional; a missing one just means default options:
+  if (conf_name != NULL) {
+    if ( (conf = read_script(plan->dir_fd, conf_name)) != NULL) {
+      if (!parse_conf(plan, &man, conf, conf_name))
+        goto error;
+    }
+    else if (errno == EFBIG)
+      printf("launcher conf error: %s/%s is too large\n", app_dir, conf_name);
+    else if (errno == ENOMEM)
+      goto error;
+  }
+
+  // A manifest needs neither the script nor a shell:
+  if (!apply_manifest(plan, &man, conf_name))
+    goto error;
+  if (plan->manifest)
+    goto done;
+
+  // A missing or unreadable script means there is no app to plan for:
+  if ( (script = read_script(plan->dir_fd, script_name)) == NULL &&
+      errno != EFBIG)
+    goto error;
+
+  // Try to bypass the shell:
+  char **argv = NULL;
+  char *target = NULL;
+  if (script != NULL && (argv = split_simple_command(script)) != NULL &&
+      (target = find_program(plan, argv[0])) != NULL) {
+    plan->exec_path = target;
+    plan->argv = argv;
+    plan->direct = true;
+  }
+  else {
+    free_argv(argv);
+
+    // The script needs a real shell: run it the same way a user would.
+    plan->exec_path = strdup(LAUNCHER_SHELL_PATH);
+    plan->argv = calloc(3, sizeof(char *));
+    if (plan->exec_path == NULL || plan->argv == NULL)
+      goto error;
+    if ( (plan->argv[0] = strdup("sh")) == NULL ||
+        (plan->argv[1] = strdup(plan->script_path)) == NULL)
+      goto error;
+    plan->direct = false;
+  }
+
+done:
+  free(man.exec);
+  free_argv(man.args);
+  free(man.cwd);
+  free(conf);
+  free(script);
+  return plan;
+
+error:
+  preserve_errno = errno;
+  free(man.exec);
+  free_argv(man.args);
+  free(man.cwd);
+  free(conf);
+  free(script);
+  launch_plan_free(plan);
+  errno = preserve_errno;
+  return NULL;
+}
+
+#ifdef LAUNCHER_HAVE_FCHDIR_ACTION
+bool launch_plan_spawn (const launch_plan *plan, const int *close_fds,
+    size_t close_cnt, int ready_fd, int handoff_fd, pid_t *pid)
+{
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t mask, defaults;
+  int err;
+
+  int src_fds[2]; // ready_fd and handoff_fd, moved out of each other's way
+  if (!movable_fds(ready_fd, handoff_fd, src_fds))
+    return false;
+
+  if ( (err = posix_spawn_file_actions_init(&actions)) ) {
+    close_moved_fds(ready_fd, handoff_fd, src_fds);
+    errno = err;
+    return false;
+  }
+  if ( (err = posix_spawnattr_init(&attr)) ) {
+    posix_spawn_file_actions_destroy(&actions);
+    close_moved_fds(ready_fd, handoff_fd, src_fds);
+    errno = err;
+    return false;
+  }
+
+  // Move into the app's directory so that its relative paths work (first, as
+  //   the dir fd may be replaced below), close fds the app must not inherit
+  //   and hand it its ready and handoff fds:
+  err = posix_spawn_file_actions_addfchdir_np(&actions,
+      plan->cwd_fd != -1 ? plan->cwd_fd : plan->dir_fd);
+  for (size_t i = 0; i < close_cnt && !err; i++)
+    err = posix_spawn_file_actions_addclose(&actions, close_fds[i]);
+  if (!err && src_fds[0] != -1) {
+    err = posix_spawn_file_actions_adddup2(&actions, src_fds[0],
+        LAUNCHER_READY_FD);
+  }
+  if (!err && src_fds[1] != -1) {
+    err = posix_spawn_file_actions_adddup2(&actions, src_fds[1],
+        LAUNCHER_HANDOFF_FD);
+  }
+
+  // The app should not inherit os_ctrl's blocked or ignored signals, and
+  //   gets a process group of its own (pgroup 0 means its own pid):
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+      POSIX_SPAWN_SETPGROUP;
+#ifdef POSIX_SPAWN_USEVFORK
+  flags |= POSIX_SPAWN_USEVFORK; // Implied by newer glibc; explicit for older
+#endif
+  sigemptyset(&mask);
+  build_default_sigset(&defaults);
+  if (!err)
+    err = posix_spawnattr_setsigmask(&attr, &mask);
+  if (!err)
+    err = posix_spawnattr_setsigdefault(&attr, &defaults);
+  if (!err)
+    err = posix_spawnattr_setpgroup(&attr, 0);
+  if (!err)
+    err = posix_spawnattr_setflags(&attr, flags);
+
+  char **envp = build_envp(plan);
+  if (envp == NULL)
+    err = ENOMEM;
+
+  // Returns only after the child has exec'd (or failed to):
+  if (!err)
+    err = posix_spawn(pid, plan->exec_path, &actions, &attr, plan->argv,
+        envp);
+
+  if (envp != environ)
+    free(envp);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  close_moved_fds(ready_fd, handoff_fd, src_fds);
+
+  if (err) {
+    errno = err;
+    return false;
+  }
+  return true;
+}
+#else
+bool launch_plan_spawn (const launch_plan *plan, const int *close_fds,
+    size_t close_cnt, int ready_fd, int handoff_fd, pid_t *pid)
+{
+  // The child shares our memory until it execs, so it can report its exec
+  //   error through this variable:
+  volatile int child_errno = 0;
+  sigset_t all, old, defaults;
+
+  // The child must not allocate, so its environment is built up front:
+  char **envp = build_envp(plan);
+  if (envp == NULL)
+    return false;
+
+  int src_fds[2]; // ready_fd and handoff_fd, moved out of each other's way
+  if (!movable_fds(ready_fd, handoff_fd, src_fds)) {
+    if (envp != environ)
+      free(envp);
+    return false;
+  }
+
+  // Signal handlers must not run in the child while it borrows our memory:
+  sigfillset(&all);
+  if (sigprocmask(SIG_SETMASK, &all, &old) == -1) {
+    close_moved_fds(ready_fd, handoff_fd, src_fds);
+    if (envp != environ)
+      free(envp);
+    return false;
+  }
+
+  build_default_sigset(&defaults);
+  pid_t p = vfork();
+  if (p == 0) {
+    // Restore default dispositions before unblocking anything:
+    struct sigaction sa;
+    sa.sa_handler = SIG_DFL;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+    for (int sig = 1; sig < NSIG; sig++) {
+      if (sigismember(&defaults, sig) == 1)
+        sigaction(sig, &sa, NULL);
+    }
+    sigemptyset(&all);
+    sigprocmask(SIG_SETMASK, &all, NULL);
+    setpgid(0, 0);
+
+    // First, as the dir fd may be replaced:
+    if (fchdir(plan->cwd_fd != -1 ? plan->cwd_fd : plan->dir_fd) != -1) {
+      for (size_t i = 0; i < close_cnt; i++)
+        close(close_fds[i]);
+      if ( (src_fds[0] == -1 || dup2(src_fds[0], LAUNCHER_READY_FD) != -1) &&
+          (src_fds[1] == -1 || dup2(src_fds[1], LAUNCHER_HANDOFF_FD) != -1))
+        execve(plan->exec_path, plan->argv, envp);
+    }
+
+    child_errno = errno;
+    _exit(127);
+  }
+  int preserve_errno = errno;
+  sigprocmask(SIG_SETMASK, &old, NULL);
+  close_moved_fds(ready_fd, handoff_fd, src_fds);
+  if (envp != environ)
+    free(envp);
+
+  if (p == -1) {
+    errno = preserve_errno;
+    return false;
+  }
+  if (child_errno != 0) {
+    waitpid(p, NULL, 0); // The child already exited; reap it
+    errno = child_errno;
+    return false;
+  }
+
+  *pid = p;
+  return true;
+}
+#endif
+
+void launch_plan_free (launch_plan *plan)
+{
+  if (plan == NULL)
+    return;
+
+  if (plan->dir_fd != -1)
+    close(plan->dir_fd);
+  if (plan->cwd_fd != -1)
+    close(plan->cwd_fd);
+  free(plan->dir_path);
+  free(plan->cwd_path);
+  free(plan->script_path);
+  free(plan->exec_path);
+  free_argv(plan->argv);
+  free_argv(plan->env);
+  free(plan->zygote_module);
+  free(plan);
+}
+
+/**
+ * Returns a newly allocated "dir/name" string, or NULL if malloc failed.
+ */
+char *path_join (const char *dir, const char *name)
+{
+  size_t len = strlen(dir) + strlen(name) + 2; // +1 for '/' +1 for NUL
+  char *path = malloc(len);
+  if (path != NULL)
+    snprintf(path, len, "%s/%s", dir, name);
+  return path;
+}
+
+/**
+ * Reads the whole script at script_name (relative to dir_fd) into a newly
+ *   allocated NUL-terminated string. Also used for .conf files.
+ *
+ * Returns NULL with errno set if the script could not be read. errno is set
+ *   to EFBIG if the script exists but is longer than LAUNCHER_SCRIPT_MAX.
+ */
+char *read_script (int dir_fd, const char *script_name)
+{
+  int fd = openat(dir_fd, script_name, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+
+  char *script = malloc(LAUNCHER_SCRIPT_MAX + 1);
+  if (script == NULL) {
+    close(fd);
+    return NULL;
+  }
+
+  // Read one byte past the maximum so that oversized scripts are detected:
+  size_t len = 0;
+  ssize_t rd_cnt;
+  while (len <= LAUNCHER_SCRIPT_MAX &&
+      (rd_cnt = read(fd, script + len, LAUNCHER_SCRIPT_MAX + 1 - len)) != 0) {
+    if (rd_cnt == -1) {
+      if (errno == EINTR)
+        continue;
+      int preserve_errno = errno;
+      free(script);
+      close(fd);
+      errno = preserve_errno;
+      return NULL;
+    }
+    len += rd_cnt;
+  }
+  close(fd);
+
+  if (len > LAUNCHER_SCRIPT_MAX) {
+    free(script);
+    errno = EFBIG;
+    return NULL;
+  }
+  script[len] = '\0';
+  return script;
+}
+
+/**
+ * Applies each 'option value' line of the given .conf file contents to plan,
+ *   collecting the manifest's options in man for apply_manifest. Unknown
+ *   options and bad values are reported and skipped. So is a zygote alongside
+ *   env, as zygote apps inherit the zygote's environment.
+ *
+ * The conf string is modified in the process. Returns false only if memory
+ *   could not be allocated.
+ */
+bool parse_conf (launch_plan *plan, conf_manifest *man, char *conf,
+    const char *conf_name)
+{
+  size_t lineno = 0; // Current line number in conf file. Used for error msg.
+
+  for (char *line = conf; line != NULL && *line != '\0';) {
+    char *line_end = strchr(line, '\n');
+    if (line_end != NULL)
+      *line_end = '\0';
+    char *next_line = line_end != NULL ? line_end + 1 : NULL;
+    lineno++;
+
+    // Trim surrounding whitespace and skip blank and comment lines:
+    while (isspace((unsigned char)*line))
+      line++;
+    char *end = line + strlen(line);
+    while (end != line && isspace((unsigned char)end[-1]))
+      *--end = '\0';
+    if (*line == '\0' || *line == '#') {
+      line = next_line;
+      continue;
+    }
+
+    // Split option name from its value:
+    char *opt = line;
+    char *value = opt;
+    while (*value != '\0' && !isspace((unsigned char)*value))
+      value++;
+    if (*value != '\0')
+      *value++ = '\0';
+    while (isspace((unsigned char)*value))
+      value++;
+
+    if (*value == '\0') {
+      printf("launcher conf error: option %s in %s line %zu ended without"
+          " settings\n", opt, conf_name, lineno);
+    }
+    else if (!strcmp(opt, "zygote")) {
+      char *module = value[0] == '/' ? strdup(value)
+                                     : path_join(plan->dir_path, value);
+      if (module == NULL)
+        return false;
+      free(plan->zygote_module);
+      plan->zygote_module = module;
+    }
+    else if (!strcmp(opt, "handoff") || !strcmp(opt, "resumable")) {
+      bool *flag = !strcmp(opt, "handoff") ? &plan->handoff : &plan->resumable;
+      if (!strcmp(value, "yes") || !strcmp(value, "no"))
+        *flag = !strcmp(value, "yes");
+      else {
+        printf("launcher conf error: %s in %s line %zu must be yes or no\n",
+            opt, conf_name, lineno);
+      }
+    }
+    else if (!strcmp(opt, "exec") || !strcmp(opt, "cwd")) {
+      char *copy = strdup(value);
+      if (copy == NULL)
+        return false;
+      char **field = !strcmp(opt, "exec") ? &man->exec : &man->cwd;
+      free(*field);
+      *field = copy;
+    }
+    else if (!strcmp(opt, "arg")) {
+      if (!strv_append(&man->args, value))
+        return false;
+    }
+    else if (!strcmp(opt, "env")) {
+      if (strchr(value, '=') == NULL || value[0] == '=') {
+        printf("launcher conf error: env in %s line %zu must be NAME=value\n",
+            conf_name, lineno);
+      }
+      else if (!strv_append(&plan->env, value))
+        return false;
+    }
+    else if (!strcmp(opt, "teardown_grace")) {
+      char *num_end;
+      unsigned long ms = strtoul(value, &num_end, 10);
+      if (*num_end != '\0' || ms > LAUNCHER_TEARDOWN_GRACE_MAX_MS) {
+        printf("launcher conf error: teardown_grace in %s line %zu must be"
+            " 0-%d ms\n", conf_name, lineno, LAUNCHER_TEARDOWN_GRACE_MAX_MS);
+      }
+      else
+        plan->teardown_grace_ms = (unsigned int)ms;
+    }
+    else {
+      printf("launcher conf error: unknown option %s in %s line %zu\n", opt,
+          conf_name, lineno);
+    }
+
+    line = next_line;
+  }
+
+  if (plan->zygote_module != NULL && plan->env != NULL) {
+    printf("launcher conf error: zygote in %s can not be used with env,"
+        " starting the app without it\n", conf_name);
+    free(plan->zygote_module);
+    plan->zygote_module = NULL;
+  }
+
+  return true;
+}
+
+/**
+ * Resolves the manifest collected by parse_conf into the plan's program,
+ *   argv and starting directory. If the manifest's program or directory can
+ *   not be found, the problem is reported and the plan is left to the .sh
+ *   script.
+ *
+ * Returns false only if memory could not be allocated.
+ */
+bool apply_manifest (launch_plan *plan, conf_manifest *man,
+    const char *conf_name)
+{
+  if (man->cwd != NULL) {
+    char *cwd = man->cwd[0] == '/' ? strdup(man->cwd)
+                                   : path_join(plan->dir_path, man->cwd);
+    if (cwd == NULL)
+      return false;
+    int fd = open(cwd, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+      printf("launcher conf error: cwd %s in %s is not a directory\n", cwd,
+          conf_name);
+      free(cwd);
+    }
+    else {
+      plan->cwd_fd = fd;
+      plan->cwd_path = cwd;
+    }
+  }
+
+  if (man->args != NULL && man->exec == NULL) {
+    printf("launcher conf error: arg in %s without an exec\n", conf_name);
+    return true;
+  }
+  if (man->exec == NULL)
+    return true;
+
+  errno = 0;
+  char *target = find_program(plan, man->exec);
+  if (target == NULL) {
+    if (errno == ENOMEM)
+      return false;
+    printf("launcher conf error: exec %s in %s not found, using the .sh"
+        " script\n", man->exec, conf_name);
+    return true;
+  }
+
+  char **argv = NULL;
+  if (!strv_append(&argv, man->exec)) {
+    free(target);
+    return false;
+  }
+  for (char **arg = man->args; arg != NULL && *arg != NULL; arg++) {
+    if (!strv_append(&argv, *arg)) {
+      free_argv(argv);
+      free(target);
+      return false;
+    }
+  }
+
+  plan->exec_path = target;
+  plan->argv = argv;
+  plan->direct = true;
+  plan->manifest = true;
+  return true;
+}
+
+/**
+ * Appends a copy of str to the NULL terminated string vector *strv (which
+ *   may be NULL for an empty one). Returns false if memory ran out.
+ */
+bool strv_append (char ***strv, const char *str)
+{
+  size_t cnt = 0;
+  while (*strv != NULL && (*strv)[cnt] != NULL)
+    cnt++;
+
+  char **grown = realloc(*strv, (cnt + 2) * sizeof(char *));
+  if (grown == NULL)
+    return false;
+  *strv = grown;
+  if ( (grown[cnt] = strdup(str)) == NULL) {
+    if (cnt == 0) {
+      free(grown);
+      *strv = NULL;
+    }
+    return false;
+  }
+  grown[cnt + 1] = NULL;
+  return true;
+}
+
+/**
+ * Splits the given script into a newly allocated argv if (and only if) the
+ *   script is a single simple command: one line of plain words, optionally
+ *   prefixed by 'exec', besides a "#!" line, comment lines and blank lines.
+ *
+ * The script string is modified in the process. Returns NULL if the script
+ *   is not a simple command or if memory could not be allocated.
+ */
+char **split_simple_command (char *script)
+{
+  char *command = NULL; // The single line holding the command
+
+  // Find the only non-comment, non-blank line:
+  for (char *line = script; line != NULL && *line != '\0';) {
+    char *line_end = strchr(line, '\n');
+    if (line_end != NULL)
+      *line_end = '\0';
+
+    while (isspace((unsigned char)*line))
+      line++;
+
+    if (*line != '\0' && *line != '#') {
+      if (command != NULL)
+        return NULL; // More than one command: leave it to the shell
+      command = line;
+    }
+
+    line = line_end != NULL ? line_end + 1 : NULL;
+  }
+
+  // Anything the shell would interpret (expansions, quoting, redirection,
+  //   globbing, pipelines) means we can not run it ourselves:
+  if (command == NULL || strpbrk(command, SHELL_SPECIAL_CHARS) != NULL)
+    return NULL;
+
+  // Worst case every other char starts a word (+1 for NULL terminator):
+  size_t max_words = strlen(command) / 2 + 2;
+  char **argv = calloc(max_words, sizeof(char *));
+  if (argv == NULL)
+    return NULL;
+
+  size_t argc = 0;
+  bool first_word = true;
+  char *saveptr;
+  for (char *word = strtok_r(command, " \t\r", &saveptr); word != NULL;
+       word = strtok_r(NULL, " \t\r", &saveptr)) {
+    if (first_word) {
+      first_word = false;
+      if (!strcmp(word, "exec"))
+        continue; // We exec anyway
+    }
+    if ( (argv[argc] = strdup(word)) == NULL) {
+      free_argv(argv);
+      return NULL;
+    }
+    argc++;
+  }
+
+  // 'NAME=value cmd' sets environment variables for the command:
+  if (argc == 0 || strchr(argv[0], '=') != NULL) {
+    free_argv(argv);
+    return NULL;
+  }
+
+  return argv;
+}
+
+/**
+ * Resolves the program the shell would run for the command name 'name' when
+ *   started in the plan's directory.
+ *
+ * Returns a newly allocated absolute path, or NULL if no executable could be
+ *   found (such as for shell builtins).
+ */
+char *find_program (const launch_plan *plan, const char *name)
+{
+  char *path;
+
+  // Names with a '/' are not looked up in PATH:
+  if (strchr(name, '/') != NULL) {
+    path = name[0] == '/' ? strdup(name) : path_join(plan->dir_path, name);
+    if (path != NULL && access(path, X_OK) == -1) {
+      free(path);
+      return NULL;
+    }
+    return path;
+  }
+
+  const char *search = getenv("PATH");
+  if (search == NULL)
+    search = LAUNCHER_DEFAULT_PATH;
+
+  while (*search != '\0') {
+    const char *entry_end = strchr(search, ':');
+    size_t entry_len = entry_end != NULL ? (size_t)(entry_end - search)
+                                         : strlen(search);
+
+    // An empty PATH entry means the current directory (the app directory):
+    char entry[entry_len + 1];
+    memcpy(entry, search, entry_len);
+    entry[entry_len] = '\0';
+    path = path_join(entry_len != 0 ? entry : plan->dir_path, name);
+    if (path == NULL)
+      return NULL;
+    if (path[0] == '/' && access(path, X_OK) == 0)
+      return path;
+    free(path);
+
+    if (entry_end == NULL)
+      break;
+    search = entry_end + 1;
+  }
+
+  return NULL;
+}
+
+// Frees a NULL terminated argv and each of its strings (NULL is ignored).
+void free_argv (char **argv)
+{
+  if (argv == NULL)
+    return;
+  for (char **arg = argv; *arg != NULL; arg++)
+    free(*arg);
+  free(argv);
+}
+
+/**
+ * Returns the environment to start the plan's app with: environ itself if the
+ *   plan adds nothing, otherwise a newly allocated array of environ's strings
+ *   (minus those the plan overrides) followed by the plan's env. Returns NULL
+ *   with errno set if memory ran out.
+ *
+ * It is built at each launch, as os_ctrl's environment is only complete once
+ *   the app index (and every plan) exists.
+ */
+char **build_envp (const launch_plan *plan)
+{
+  if (plan->env == NULL)
+    return environ;
+
+  size_t env_cnt = 0, add_cnt = 0;
+  while (environ[env_cnt] != NULL)
+    env_cnt++;
+  while (plan->env[add_cnt] != NULL)
+    add_cnt++;
+
+  char **envp = malloc((env_cnt + add_cnt + 1) * sizeof(char *));
+  if (envp == NULL)
+    return NULL;
+
+  size_t cnt = 0;
+  for (size_t i = 0; i < env_cnt; i++) {
+    size_t name_len = strcspn(environ[i], "=");
+    bool overridden = false;
+    for (size_t j = 0; j < add_cnt && !overridden; j++) {
+      overridden = !strncmp(environ[i], plan->env[j], name_len) &&
+                   plan->env[j][name_len] == '=';
+    }
+    if (!overridden)
+      envp[cnt++] = environ[i];
+  }
+  for (size_t j = 0; j < add_cnt; j++)
+    envp[cnt++] = plan->env[j];
+  envp[cnt] = NULL;
+  return envp;
+}
+
+// Fills set with every signal an app should start with a default handler for.
+void build_default_sigset (sigset_t *set)
+{
+  sigfillset(set);
+  sigdelset(set, SIGKILL); // Can never be caught or ignored anyway
+  sigdelset(set, SIGSTOP);
+}
+
+/**
+ * Returns an fd for fd that can be dup2'ed onto LAUNCHER_READY_FD or
+ *   LAUNCHER_HANDOFF_FD in a new process without being overwritten by the
+ *   other dup2 first (or being dup2'ed onto itself, which would leave
+ *   close-on-exec set). This is fd itself if it is above both, otherwise a
+ *   close-on-exec duplicate that is, which the caller must close.
+ *
+ * Returns -1 if fd is -1 or could not be duplicated (errno set).
+ */
+int movable_fd (int fd)
+{
+  if (fd == -1 || fd > LAUNCHER_HANDOFF_FD)
+    return fd;
+  return fcntl(fd, F_DUPFD_CLOEXEC, LAUNCHER_HANDOFF_FD + 1);
+}
+
+/**
+ * Stores movable_fd of ready_fd and handoff_fd in src_fds[0] and src_fds[1].
+ *   Returns false with errno set (and nothing to close) on failure.
+ */
+bool movable_fds (int ready_fd, int handoff_fd, int *src_fds)
+{
+  if ( (src_fds[0] = movable_fd(ready_fd)) == -1 && ready_fd != -1)
+    return false;
+  if ( (src_fds[1] = movable_fd(handoff_fd)) == -1 && handoff_fd != -1) {
+    int preserve_errno = errno;
+    if (src_fds[0] != ready_fd)
+      close(src_fds[0]);
+    errno = preserve_errno;
+    return false;
+  }
+  return true;
+}
+
+// Closes the duplicates movable_fds made, keeping errno.
+void close_moved_fds (int ready_fd, int handoff_fd, const int *src_fds)
+{
+  int preserve_errno = errno;
+  if (src_fds[0] != ready_fd)
+    close(src_fds[0]);
+  if (src_fds[1] != handoff_fd)
+    close(src_fds[1]);
+  errno = preserve_errno;
+}
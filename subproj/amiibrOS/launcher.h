@@ -0,0 +1,126 @@
+/**
+ * launcher.h
+ *
+ * Contains prototypes for os_ctrl's app launcher.
+ *
+ * A launch plan is everything needed to start an app, resolved once ahead of
+ *   time: an open fd of the app's directory, the program to exec and its argv.
+ *   When the app's .sh script is nothing but a single (optionally 'exec'ed)
+ *   command line, the plan points straight at that command's binary so that
+ *   no shell needs to be started on launch.
+ *
+ * Plans are started with posix_spawn, which avoids duplicating os_ctrl's
+ *   (multithreaded, GL-mapped) address space the way fork would.
+ *
+ * An app may also have an optional .conf file next to its .sh script, with
+ *   one 'option value' pair per line ('#' starts a comment line). The
+ *   options exec, arg, env and cwd form a manifest that is exec'd directly in
+ *   place of the .sh script, which may then be left out (or kept as the
+ *   fallback for when the program can not be found):
+ *     exec <program>   The program to run: relative to the app directory if
+ *                      it holds a '/', otherwise looked up in PATH.
+ *     arg <argument>   Appends the rest of the line, spaces included, as one
+ *                      argument. Repeat for every argument, in order.
+ *     env <NAME=value> Sets an environment variable for the app on top of
+ *                      os_ctrl's environment. A .conf that also names a
+ *                      zygote is reported and its zygote ignored, as zygote
+ *                      launches inherit the zygote's environment.
+ *     cwd <dir>        Directory the app starts in, relative to the app
+ *                      directory (default: the app directory itself).
+ *     zygote <module>  Start the app from os_ctrl's zygote (see zygote.h) by
+ *                      calling into the given shared object, which is
+ *                      relative to the app directory. The .sh script is still
+ *                      used whenever the zygote is unavailable.
+ *     handoff <yes|no> Start the app while the UI's animations still play
+ *                      (default no). The app must not touch the display
+ *                      before its handoff barrier opens (see amiibrOS_app.h).
+ *     resumable <yes|no>
+ *                      Freeze the app (SIGSTOP) rather than tear it down when
+ *                      another app replaces it, and resume it (SIGCONT) when
+ *                      its tag is scanned again (default no; see freezer.h).
+ *     teardown_grace <ms>
+ *                      How long the app is given to exit after SIGTERM
+ *                      before its whole process group is killed (default
+ *                      LAUNCHER_TEARDOWN_GRACE_MS).
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <sys/types.h> // pid_t
+
+// Program used to run .sh scripts that are too complex to exec directly:
+#define LAUNCHER_SHELL_PATH "/bin/sh"
+// Largest .sh script we will attempt to parse into a direct exec:
+#define LAUNCHER_SCRIPT_MAX 4096
+// fd numbers an app's ready and handoff fds are given as (see amiibrOS_app.h):
+#define LAUNCHER_READY_FD 3
+#define LAUNCHER_HANDOFF_FD 4
+// Default time an app has to exit after SIGTERM before it is killed:
+#define LAUNCHER_TEARDOWN_GRACE_MS 2000
+// Longest teardown_grace a .conf may set:
+#define LAUNCHER_TEARDOWN_GRACE_MAX_MS 60000
+
+typedef struct launch_plan
+{
+  int dir_fd; // O_PATH fd of the app directory
+  char *dir_path; // Absolute path of the app directory
+  int cwd_fd; // O_PATH fd of the directory the app starts in (-1: dir_fd)
+  char *cwd_path; // Absolute path of that directory (NULL: dir_path)
+  char *script_path; // Absolute path of the app's .sh script
+  char *exec_path; // Program handed to posix_spawn (shell or target binary)
+  char **argv; // NULL terminated argv for exec_path
+  char **env; // NULL terminated NAME=value pairs added for the app (or NULL)
+  bool direct; // True if the .sh script is bypassed
+  bool manifest; // True if exec_path and argv come from the .conf manifest
+  char *zygote_module; // Absolute path of the app's zygote module (or NULL)
+  unsigned int teardown_grace_ms; // SIGTERM to SIGKILL delay on teardown
+  bool handoff; // True if the app is started before the display is free
+  bool resumable; // True if the app is frozen rather than torn down
+} launch_plan;
+
+/**
+ * Resolves a launch plan for the script app_dir/script_name, configured by
+ *   the optional file app_dir/conf_name (conf_name may be NULL).
+ *
+ * If the .conf holds a manifest whose program can be found, the plan execs
+ *   it directly and the script is not needed. Otherwise the script is read
+ *   once: if it consists of a single simple command (no variables, quoting,
+ *   redirection or other shell syntax), the command's binary is looked up (in
+ *   app_dir if given a relative path, otherwise in PATH) and used directly.
+ *   Otherwise the plan falls back to running the script through
+ *   LAUNCHER_SHELL_PATH.
+ *
+ * Returns a newly allocated plan, or NULL with errno set if the app directory
+ *   is not accessible, there is neither a manifest nor a script or memory
+ *   could not be allocated. Errors in the .conf file are printed and the
+ *   offending lines ignored.
+ */
+launch_plan *launch_plan_create (const char *app_dir, const char *script_name,
+    const char *conf_name);
+
+/**
+ * Starts a new process from the given plan and stores its pid in pid.
+ *
+ * The new process starts in the plan's directory (cwd_fd, or else dir_fd)
+ *   with os_ctrl's environment plus the plan's env, default signal
+ *   dispositions, an empty signal mask and each of the close_cnt fds in
+ *   close_fds closed. Unless ready_fd is -1, it is given to the process as
+ *   LAUNCHER_READY_FD; unless handoff_fd is -1, it is given to the process as
+ *   LAUNCHER_HANDOFF_FD. It leads a new process group (its pid is the group's
+ *   id), so that the app and everything it starts can be signalled at once.
+ *
+ * Returns true if the program was successfully executed; false with errno set
+ *   otherwise.
+ */
+bool launch_plan_spawn (const launch_plan *plan, const int *close_fds,
+    size_t close_cnt, int ready_fd, int handoff_fd, pid_t *pid);
+
+// Releases all resources held by the given plan (NULL is ignored).
+void launch_plan_free (launch_plan *plan);
+
+#endif
@@ -0,0 +1,360 @@
+/**
+ * log_ring.c
+ *
+ * Contains implementation of log_ring.h
+ *
+ * The ring is a bounded multi-producer queue in which every slot carries a
+ *   sequence number: a slot at position pos is free for a writer while its
+ *   sequence is pos, and holds a published record once it is pos + 1. Writers
+ *   claim positions by advancing the head with a compare-and-swap; the single
+ *   reader advances the tail and hands the slot back to the writers of the
+ *   next lap by setting its sequence to pos + LOG_RING_CAPACITY. A writer
+ *   interrupted between claiming and publishing a slot only holds the reader
+ *   back until it resumes; it never blocks other writers.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // snprintf, fputs, fflush
+#include <string.h> // strerror_r
+#include <errno.h> // errno
+#include <time.h> // clock_gettime, nanosleep
+#include <signal.h> // sigset_t, sigfillset
+#include <pthread.h> // pthread_create, pthread_join, pthread_sigmask
+#include <unistd.h> // write, close
+#include <fcntl.h> // open
+#include "log_ring.h"
+
+// How often the drain thread empties the ring:
+#define LOG_RING_DRAIN_MS 20
+
+// A slot of the ring:
+typedef struct log_slot
+{
+  uint32_t seq; // See above
+  log_record rec;
+} log_slot;
+
+// Level and format of each event. The format's %u, %d and %x (8 hex digits,
+//   for tags) each take the next argument, %s the text and %% is a '%':
+typedef struct log_event_info
+{
+  const char *name;
+  log_level level;
+  const char *fmt;
+} log_event_info;
+
+static const log_event_info event_info[LOG_EV_CNT] = {
+  [LOG_EV_DROPPED] = {"dropped", LOG_RING_WARN,
+      "%u records lost to a full ring"},
+  [LOG_EV_SCAN] = {"scan", LOG_RING_DEBUG, "tag %x"},
+  [LOG_EV_NO_APP] = {"no_app", LOG_RING_INFO, "no app for tag %x"},
+  [LOG_EV_LAUNCH] = {"launch", LOG_RING_INFO, "app %x started as pid %d"},
+  [LOG_EV_RESUME] = {"resume", LOG_RING_INFO,
+      "frozen app %x resumed (pid %d)"},
+  [LOG_EV_SPAWN_FAILED] = {"spawn_failed", LOG_RING_ERROR,
+      "unable to spawn app %x"},
+  [LOG_EV_ZYGOTE_FAILED] = {"zygote_failed", LOG_RING_WARN,
+      "unable to start app %x from zygote"},
+  [LOG_EV_PIPE_FAILED] = {"pipe_failed", LOG_RING_ERROR,
+      "unable to create %s pipe for app %x"},
+  [LOG_EV_TEARDOWN_KILL] = {"teardown_kill", LOG_RING_WARN,
+      "app %x ignored SIGTERM, killing it"},
+  [LOG_EV_APP_EXIT] = {"app_exit", LOG_RING_INFO, "app %x (pid %d) exited"},
+  [LOG_EV_FROZEN_EXIT] = {"frozen_exit", LOG_RING_WARN,
+      "frozen app pid %d exited"},
+  [LOG_EV_FREEZER_EVICT] = {"freezer_evict", LOG_RING_INFO,
+      "evicting frozen app %x (%u KiB)"},
+  [LOG_EV_ZYGOTE_EXIT] = {"zygote_exit", LOG_RING_WARN,
+      "zygote exited, apps will be cold launched"},
+  [LOG_EV_ZYGOTE_START_FAILED] = {"zygote_start_failed", LOG_RING_WARN,
+      "unable to start zygote, apps will be cold launched"},
+  [LOG_EV_STATS_SOCKET_FAILED] = {"stats_socket_failed", LOG_RING_WARN,
+      "unable to open stats socket"},
+  [LOG_EV_UI_STARTED] = {"ui_started", LOG_RING_INFO,
+      "%u of %u textures loaded"},
+  [LOG_EV_UI_ANIM] = {"ui_anim", LOG_RING_DEBUG, "%s animation"},
+  [LOG_EV_UI_STOPPED] = {"ui_stopped", LOG_RING_INFO, "stopped by %s"},
+  [LOG_EV_UI_ASSETS_FAILED] = {"ui_assets_failed", LOG_RING_WARN,
+      "unable to map asset bundle, decoding PNGs"},
+  [LOG_EV_UI_FIRST_FRAME] = {"ui_first_frame", LOG_RING_INFO,
+      "first frame ready %u us after start, textures took %u us (from %s)"},
+  [LOG_EV_UI_CPU] = {"ui_cpu", LOG_RING_INFO,
+      "%s: %u us of CPU per second over %u ms, %u frames"},
+  [LOG_EV_UI_CMD_FAILED] = {"ui_cmd_failed", LOG_RING_WARN,
+      "unable to %s, UI command queue full or UI stopping"},
+};
+
+static const char *level_names[LOG_RING_LEVEL_CNT] = {
+  "DEBUG", "INFO", "WARN", "ERROR"
+};
+
+static log_slot slots[LOG_RING_CAPACITY];
+static uint32_t ring_head; // Next position to claim (writers)
+static uint32_t ring_tail; // Next position to take (reader)
+static uint32_t dropped_cnt; // Records dropped since the drain last looked
+
+static pthread_t drain_thread;
+static bool drain_running = false;
+static bool drain_stop; // Atomic; tells the drain thread to finish
+static int drain_fd = -1; // Binary log file, or -1 for text on stdout
+
+// --- Helper Function Prototypes ---
+void *run_log_drain (void *arg);
+void drain_log_ring (void);
+void emit_log_record (const log_record *rec);
+// --- ---
+
+void log_ring_init (void)
+{
+  for (uint32_t i = 0; i < LOG_RING_CAPACITY; i++)
+    slots[i].seq = i;
+  ring_head = 0;
+  ring_tail = 0;
+  dropped_cnt = 0;
+}
+
+bool log_write (log_event event, int err, const char *text, uint64_t arg0,
+    uint64_t arg1, uint64_t arg2)
+{
+  // Taken before claiming a slot, so records are (nearly) in time order:
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  uint32_t pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+  log_slot *slot;
+  for (;;) {
+    slot = &slots[pos & (LOG_RING_CAPACITY - 1)];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t)(seq - pos);
+    if (diff == 0) {
+      // Free: claim it (on failure, pos is reloaded with the current head):
+      if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, true,
+          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if (diff < 0) { // Still holds the record of the previous lap
+      __atomic_add_fetch(&dropped_cnt, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    else // Another writer claimed it first
+      pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+  }
+
+  log_record *rec = &slot->rec;
+  rec->ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  rec->event = (uint16_t)event;
+  rec->level = (uint8_t)event_info[event].level;
+  rec->reserved = 0;
+  rec->err = err;
+  rec->args[0] = arg0;
+  rec->args[1] = arg1;
+  rec->args[2] = arg2;
+  // Copied by hand: only async-signal-safe calls are allowed here.
+  size_t i = 0;
+  if (text != NULL) {
+    for (; i < LOG_RING_TEXT_LEN - 1 && text[i] != '\0'; i++)
+      rec->text[i] = text[i];
+  }
+  rec->text[i] = '\0';
+
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE); // Publish
+  return true;
+}
+
+bool log_ring_start (const char *path)
+{
+  if (drain_running)
+    return true;
+
+  if (path != NULL) {
+    drain_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (drain_fd == -1)
+      return false;
+
+    unsigned char header[8];
+    uint16_t version = LOG_RING_VERSION;
+    uint16_t rec_size = sizeof(log_record);
+    memcpy(header, LOG_RING_MAGIC, 4);
+    memcpy(header + 4, &version, 2);
+    memcpy(header + 6, &rec_size, 2);
+    if (write(drain_fd, header, sizeof(header)) != sizeof(header)) {
+      int preserve_errno = errno;
+      close(drain_fd);
+      drain_fd = -1;
+      errno = preserve_errno;
+      return false;
+    }
+  }
+
+  // The drain thread must not take any of the signals os_ctrl reads from its
+  //   signalfd:
+  sigset_t set, oldset;
+  sigfillset(&set);
+  pthread_sigmask(SIG_SETMASK, &set, &oldset);
+  __atomic_store_n(&drain_stop, false, __ATOMIC_RELAXED);
+  int ret = pthread_create(&drain_thread, NULL, run_log_drain, NULL);
+  pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+  if (ret != 0) {
+    if (drain_fd != -1)
+      close(drain_fd);
+    drain_fd = -1;
+    errno = ret;
+    return false;
+  }
+  drain_running = true;
+  return true;
+}
+
+void log_ring_stop (void)
+{
+  if (!drain_running) {
+    drain_log_ring(); // Nothing else will
+    return;
+  }
+
+  __atomic_store_n(&drain_stop, true, __ATOMIC_RELEASE);
+  pthread_join(drain_thread, NULL);
+  drain_running = false;
+  if (drain_fd != -1)
+    close(drain_fd);
+  drain_fd = -1;
+}
+
+bool log_ring_take (log_record *rec)
+{
+  log_slot *slot = &slots[ring_tail & (LOG_RING_CAPACITY - 1)];
+  uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+  if ((int32_t)(seq - (ring_tail + 1)) < 0)
+    return false; // Free, or claimed but not yet published
+
+  *rec = slot->rec;
+  // Hand the slot to the writers of the next lap:
+  __atomic_store_n(&slot->seq, ring_tail + LOG_RING_CAPACITY,
+      __ATOMIC_RELEASE);
+  ring_tail++;
+  return true;
+}
+
+void log_ring_format (const log_record *rec, char *buf, size_t len)
+{
+  int n = snprintf(buf, len, "[%6llu.%06llu] %-5s ",
+      (unsigned long long)(rec->ns / 1000000000ull),
+      (unsigned long long)(rec->ns % 1000000000ull / 1000),
+      log_level_name(rec->level));
+  size_t at = n > 0 && (size_t)n < len ? (size_t)n : len - 1;
+
+  if (rec->event >= LOG_EV_CNT) {
+    snprintf(buf + at, len - at, "event %u", (unsigned int)rec->event);
+    return;
+  }
+  const log_event_info *info = &event_info[rec->event];
+  n = snprintf(buf + at, len - at, "%s: ", info->name);
+  at = n > 0 && (size_t)n < len - at ? at + n : len - 1;
+
+  // Expand the event's format:
+  size_t arg = 0;
+  for (const char *f = info->fmt; *f != '\0' && at < len - 1; f++) {
+    if (*f != '%' || f[1] == '\0') {
+      buf[at++] = *f;
+      continue;
+    }
+    f++;
+    uint64_t value = arg < LOG_RING_ARG_CNT ? rec->args[arg] : 0;
+    switch (*f) {
+      case 'u':
+        n = snprintf(buf + at, len - at, "%llu", (unsigned long long)value);
+        arg++;
+        break;
+      case 'd':
+        n = snprintf(buf + at, len - at, "%lld", (long long)value);
+        arg++;
+        break;
+      case 'x':
+        n = snprintf(buf + at, len - at, "%08llX", (unsigned long long)value);
+        arg++;
+        break;
+      case 's':
+        // The text may come from a file written by another build:
+        n = snprintf(buf + at, len - at, "%.*s", LOG_RING_TEXT_LEN - 1,
+            rec->text);
+        break;
+      default:
+        n = snprintf(buf + at, len - at, "%c", *f);
+        break;
+    }
+    at = n > 0 && (size_t)n < len - at ? at + n : len - 1;
+  }
+  buf[at] = '\0';
+
+  if (rec->err != 0) {
+    char msg[64];
+    if (strerror_r(rec->err, msg, sizeof(msg)) != 0)
+      snprintf(msg, sizeof(msg), "error %d", (int)rec->err);
+    snprintf(buf + at, len - at, ": %s", msg);
+  }
+}
+
+const char *log_level_name (unsigned int level)
+{
+  return level < LOG_RING_LEVEL_CNT ? level_names[level] : "?";
+}
+
+/**
+ * Body of the drain thread: empties the ring every LOG_RING_DRAIN_MS until
+ *   told to stop, then empties it one last time.
+ */
+void *run_log_drain (void *arg)
+{
+  (void)arg;
+
+  struct timespec period = {0, LOG_RING_DRAIN_MS * 1000000L};
+  while (!__atomic_load_n(&drain_stop, __ATOMIC_ACQUIRE)) {
+    drain_log_ring();
+    nanosleep(&period, NULL);
+  }
+  drain_log_ring();
+  return NULL;
+}
+
+// Writes out every record published so far, and how many were dropped.
+void drain_log_ring (void)
+{
+  log_record rec;
+  bool wrote = false;
+  while (log_ring_take(&rec)) {
+    emit_log_record(&rec);
+    wrote = true;
+  }
+
+  uint32_t dropped = __atomic_exchange_n(&dropped_cnt, 0, __ATOMIC_RELAXED);
+  if (dropped != 0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    memset(&rec, 0, sizeof(rec));
+    rec.ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    rec.event = LOG_EV_DROPPED;
+    rec.level = event_info[LOG_EV_DROPPED].level;
+    rec.args[0] = dropped;
+    emit_log_record(&rec);
+    wrote = true;
+  }
+
+  if (wrote && drain_fd == -1)
+    fflush(stdout);
+}
+
+// Writes rec to the log file, or as a text line to stdout.
+void emit_log_record (const log_record *rec)
+{
+  if (drain_fd != -1) {
+    // A failed write loses the record; there is nowhere to report it:
+    (void)!write(drain_fd, rec, sizeof(*rec));
+    return;
+  }
+
+  char line[LOG_RING_LINE_LEN];
+  log_ring_format(rec, line, sizeof(line));
+  fputs(line, stdout);
+  fputc('\n', stdout);
+}
@@ -0,0 +1,145 @@
+/**
+ * log_ring.h
+ *
+ * Contains prototypes for os_ctrl's structured log: a lock-free ring buffer
+ *   of fixed-size binary records, drained to a file or stdout by a thread of
+ *   its own.
+ *
+ * Writing to the console can block (a slow serial console, a full pipe), so
+ *   the main loop and the UI thread never do. Logging a record only claims a
+ *   slot of the ring with a compare-and-swap, copies the event id, its
+ *   arguments and a CLOCK_MONOTONIC timestamp into it and publishes it with a
+ *   release store: no locks, no allocation and no system call other than
+ *   clock_gettime. Any number of threads may log at once, and log_write is
+ *   async-signal-safe. If the ring is full, the record is dropped and
+ *   counted; the drain reports how many were lost.
+ *
+ * A record holds an event id (whose level and format are fixed by the event
+ *   table in log_ring.c), an errno value (0 if none), up to
+ *   LOG_RING_ARG_CNT integer arguments and a short text, truncated to
+ *   LOG_RING_TEXT_LEN - 1 characters.
+ *
+ * The drain writes either decoded text lines to stdout, or the raw records to
+ *   a binary file, decoded later with logdump (see logdump.c). A binary file
+ *   is a header followed by the records as they are in memory (host byte
+ *   order):
+ *
+ *   offset  size  field
+ *        0     4  magic: 'A' 'L' 'O' 'G'
+ *        4     2  version: LOG_RING_VERSION
+ *        6     2  size of a record: sizeof(log_record)
+ *        8     -  records
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint16_t, int32_t, uint64_t
+
+#define LOG_RING_MAGIC "ALOG"
+// Changes whenever the record layout or the meaning of an event id does:
+#define LOG_RING_VERSION 1
+// Records the ring holds (a power of 2):
+#define LOG_RING_CAPACITY 1024
+#define LOG_RING_ARG_CNT 3
+#define LOG_RING_TEXT_LEN 24
+// Longest decoded line, including the NUL:
+#define LOG_RING_LINE_LEN 192
+
+typedef enum log_level
+{
+  LOG_RING_DEBUG,
+  LOG_RING_INFO,
+  LOG_RING_WARN,
+  LOG_RING_ERROR,
+  LOG_RING_LEVEL_CNT
+} log_level;
+
+// Events os_ctrl and its UI log. Only ever append, or bump LOG_RING_VERSION:
+typedef enum log_event
+{
+  LOG_EV_DROPPED, // Records lost to a full ring (logged by the drain)
+  LOG_EV_SCAN, // Tag read off the scanner pipe
+  LOG_EV_NO_APP, // Scanned tag has no app
+  LOG_EV_LAUNCH, // App started
+  LOG_EV_RESUME, // Frozen app resumed
+  LOG_EV_SPAWN_FAILED,
+  LOG_EV_ZYGOTE_FAILED, // App could not be started from the zygote
+  LOG_EV_PIPE_FAILED, // Ready or handoff pipe could not be created
+  LOG_EV_TEARDOWN_KILL, // App ignored SIGTERM for its whole grace period
+  LOG_EV_APP_EXIT, // Current app exited on its own
+  LOG_EV_FROZEN_EXIT, // Frozen app died
+  LOG_EV_FREEZER_EVICT, // Frozen app killed to respect the cache's limits
+  LOG_EV_ZYGOTE_EXIT,
+  LOG_EV_ZYGOTE_START_FAILED,
+  LOG_EV_STATS_SOCKET_FAILED,
+  LOG_EV_UI_STARTED, // UI thread is drawing (with how many textures loaded)
+  LOG_EV_UI_ANIM, // UI animation started
+  LOG_EV_UI_STOPPED,
+  LOG_EV_UI_ASSETS_FAILED, // Asset bundle could not be mapped
+  LOG_EV_UI_FIRST_FRAME, // UI thread's first frame ready (startup time)
+  LOG_EV_UI_CPU, // UI thread's average CPU use in a frame rate mode
+  LOG_EV_UI_CMD_FAILED, // Command could not be given to the UI thread
+  LOG_EV_CNT
+} log_event;
+
+typedef struct log_record
+{
+  uint64_t ns; // CLOCK_MONOTONIC
+  uint16_t event; // log_event
+  uint8_t level; // log_level of the event
+  uint8_t reserved;
+  int32_t err; // errno value, or 0
+  uint64_t args[LOG_RING_ARG_CNT];
+  char text[LOG_RING_TEXT_LEN]; // NUL-terminated
+} log_record;
+
+// Empties the ring. Must be called before any other log_ring function.
+void log_ring_init (void);
+
+/**
+ * Logs the given event with its errno value (or 0), text (or NULL) and
+ *   arguments (unused ones are ignored). Never blocks; returns false if the
+ *   record was dropped because the ring is full. Safe to call from any
+ *   thread and from signal handlers.
+ */
+bool log_write (log_event event, int err, const char *text, uint64_t arg0,
+    uint64_t arg1, uint64_t arg2);
+
+/**
+ * Starts the drain thread. Records are written to a new binary log file at
+ *   path (replacing any old one), or as text lines to stdout if path is NULL.
+ *   Returns false (with errno set) if the file or thread could not be
+ *   created.
+ */
+bool log_ring_start (const char *path);
+
+/**
+ * Stops the drain thread after it has written every record logged so far. If
+ *   it is not running, the records are written to stdout by the caller
+ *   instead. Must not be called from a signal handler.
+ */
+void log_ring_stop (void);
+
+/**
+ * Takes the oldest record from the ring into rec. Returns false if the ring
+ *   is empty (or its oldest record is still being written). Only one thread
+ *   may take records at a time; normally, this is the drain thread.
+ */
+bool log_ring_take (log_record *rec);
+
+/**
+ * Decodes rec into a text line (without a newline) of at most len bytes in
+ *   buf: its timestamp, level, event name and formatted arguments, followed
+ *   by the errno message if any. Records of unknown events are shown by id.
+ */
+void log_ring_format (const log_record *rec, char *buf, size_t len);
+
+// Returns the name of the given level ("?" if unknown).
+const char *log_level_name (unsigned int level);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * logdump.c
+ *
+ * The log decoder: prints a binary log written by os_ctrl (see log_ring.h and
+ *   the AMIIBROS_LOG environment variable) as text lines, the same ones
+ *   os_ctrl prints when it logs to stdout.
+ *
+ * The decoder shares its event table with os_ctrl, so it must be built from
+ *   the same sources as the os_ctrl that wrote the log; files of another
+ *   version are refused.
+ *
+ * Usage: logdump [-l <level>] <log file>
+ *   -l <level>  Only prints records of this level or above (debug, info, warn
+ *               or error; default debug).
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, fopen, fread, perror
+#include <string.h> // memcmp, memcpy
+#include <strings.h> // strcasecmp
+#include <unistd.h> // getopt
+#include "log_ring.h"
+
+// --- Helper Function Prototypes ---
+bool parse_level (const char *name, unsigned int *level);
+bool check_log_header (FILE *in, const char *path);
+// --- ---
+
+int main (int argc, char **argv)
+{
+  unsigned int min_level = LOG_RING_DEBUG;
+  int opt;
+  while ( (opt = getopt(argc, argv, "l:")) != -1) {
+    if (opt != 'l' || !parse_level(optarg, &min_level)) {
+      fprintf(stderr, "usage: %s [-l debug|info|warn|error] <log file>\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-l debug|info|warn|error] <log file>\n",
+        argv[0]);
+    return 1;
+  }
+
+  const char *path = argv[optind];
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    perror("logdump unable to open log\nerror");
+    return 1;
+  }
+  if (!check_log_header(in, path)) {
+    fclose(in);
+    return 1;
+  }
+
+  log_record rec;
+  char line[LOG_RING_LINE_LEN];
+  size_t rd_cnt;
+  while ( (rd_cnt = fread(&rec, 1, sizeof(rec), in)) == sizeof(rec)) {
+    if (rec.level < min_level)
+      continue;
+    log_ring_format(&rec, line, sizeof(line));
+    printf("%s\n", line);
+  }
+  // os_ctrl may have died halfway through a record:
+  if (rd_cnt != 0)
+    fprintf(stderr, "logdump: %s ends with a partial record\n", path);
+
+  fclose(in);
+  return 0;
+}
+
+// Sets level to the level of the given name. Returns false if there is none.
+bool parse_level (const char *name, unsigned int *level)
+{
+  for (unsigned int i = 0; i < LOG_RING_LEVEL_CNT; i++) {
+    if (!strcasecmp(name, log_level_name(i))) {
+      *level = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Reads and checks the header of the log in (see log_ring.h). Returns false,
+ *   after reporting why, if it is not a log this build can decode.
+ */
+bool check_log_header (FILE *in, const char *path)
+{
+  unsigned char header[8];
+  uint16_t version, rec_size;
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+      memcmp(header, LOG_RING_MAGIC, 4)) {
+    fprintf(stderr, "logdump: %s is not an amiibrOS log\n", path);
+    return false;
+  }
+  memcpy(&version, header + 4, 2);
+  memcpy(&rec_size, header + 6, 2);
+  if (version != LOG_RING_VERSION || rec_size != sizeof(log_record)) {
+    fprintf(stderr, "logdump: %s is a version %u log (with %u byte records), "
+        "expected version %u (%zu)\n", path, (unsigned int)version,
+        (unsigned int)rec_size, (unsigned int)LOG_RING_VERSION,
+        sizeof(log_record));
+    return false;
+  }
+  return true;
+}
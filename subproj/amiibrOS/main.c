@@ -4,84 +4,196 @@
  * Contains implementation of os_ctrl.
  *
  * Spawns an amiibo_scan.py process and main_interface process upon starting.
- * 
+ *
  * Continuously monitors a pipe written to by the amiibo_scan process to allow
  *   for switching between game/UI processes.
  *
+ * All of os_ctrl's work happens in a single epoll loop on the main thread:
+ *   scanner tags, app root changes, child process exits (pidfds), app launch
+ *   progress reports, stats requests and signals (signalfd) are all just
+ *   events. No signal handlers are installed, so no
+ *   system call is ever interrupted and no work is done in signal context.
+ *
  * Terminates execution and outputs an error message when any programmer caused
  *   errors occur. This is to help find bugs; the goal is to never have the
  *   program terminate upon release. Recoverable errors aside from these will
- *   always be recovered from (see read_tag_info for signal example).
- * 
+ *   always be recovered from.
+ *
  * Joseph Yankel (jpyankel@gmail.com)
  */
 
+#define _GNU_SOURCE // syscall
+
 #include <unistd.h> // pipe, fork, execv, ... etc. system calls.
 #include <stdio.h> // perror, sprintf
 #include <errno.h> // errno
-#include <stdlib.h> // exit
-#include <signal.h> // signal
+#include <stdlib.h> // exit, setenv, strtoul
+#include <string.h> // memset, strncpy
+#include <stdint.h> // uint32_t, uint64_t
+#include <signal.h> // sigset_t, sigprocmask
 #include <sys/wait.h> // waitpid, wait
-#include <sys/stat.h> // stat
+#include <sys/epoll.h> // epoll_*
+#include <sys/signalfd.h> // signalfd
+#include <sys/timerfd.h> // timerfd_*
+#include <sys/syscall.h> // SYS_pidfd_open
+#include <sys/socket.h> // socket, bind, listen, accept4
+#include <sys/un.h> // sockaddr_un
+#include <fcntl.h> // O_CLOEXEC, O_NONBLOCK
 #include <stdbool.h> // true, false
 #include <pthread.h> // various multithreading
 #include "interface.h" // amiibrOS interface
+#include "launcher.h" // launch_plan
+#include "app_index.h" // app_index_*
+#include "scan_proto.h" // scan_reader, scan_event, SCAN_EV_*
+#include "scan_queue.h" // scan_queue_*
+#include "zygote.h" // zygote_*
+#include "stats.h" // stats_*
+#include "freezer.h" // freezer_*
+#include "log_ring.h" // log_*
+#include "amiibrOS_app.h" // AMIIBROS_READY_FD_ENV, amiibrOS_app_report
 
 #define INTERPRETER_PATH "/usr/bin/python"
 #define A_SCAN_PATH "/usr/bin/amiibrOS/amiibo_scan/amiibo_scan.py"
 
-// Raw info size in bytes to be retrieved from scanner output:
-#define RAW_INFO_SIZE 4
-// Size of hex string we will construct from the raw info (not including NUL):
-#define HEX_TAG_SIZE (RAW_INFO_SIZE*2)
+// Repeats of the same tag within this window are dropped (see scan_queue.h):
+#define SCAN_DEBOUNCE_MS 1000
 
 // Directory holding all of the game/display app directories:
 #define APP_ROOT_PATH "/usr/bin/amiibrOS/app"
-// Length of "/usr/bin/amiibrOS/app/12345678" (+1 for extra '/', no NUL)
-#define APP_DIR_LEN (sizeof(APP_ROOT_PATH) + HEX_TAG_SIZE + 1)
-// Length of "/usr/bin/amiibrOS/app/12345678/12345678" (+1 for '/', no NUL)
-#define APP_PATH_LEN (APP_DIR_LEN + HEX_TAG_SIZE + 1)
-
-// Error message for when the scanner terminates early:
-#define SIGCHLD_SCANNER_ERROR "os_ctrl unexpected sigchld\nerror: "\
-                              "sigchld_handler reaped scanner\n"
-// -1 since we need not include the NUL terminator:
-#define SIGCHLD_SCANNER_ERROR_LEN (sizeof(SIGCHLD_SCANNER_ERROR) - 1)
-// Error message for when a programmer error occurs:
-#define PROG_ERROR "os_ctrl programmer error occured\n"
-// Length of above error:
-#define PROG_ERROR_LEN (sizeof(PROG_ERROR) - 1)
-
-// amiibo scan subprocess pid. Important for sigchld_handler. Should be set
-//   only once during this process's lifetime.
+
+// Compiled tag registry mapping tag patterns to apps (see registry.h):
+#define REGISTRY_PATH "/usr/bin/amiibrOS/registry.bin"
+
+// Resumable apps kept frozen, and the resident memory they may hold together
+//   (see freezer.h):
+#define FREEZE_MAX_APPS 2
+#define FREEZE_BUDGET_KB (128 * 1024)
+
+// Local socket that dumps os_ctrl's statistics to whoever connects to it:
+#define STATS_SOCKET_PATH "/tmp/amiibrOS_stats.sock"
+
+// Environment variables that override the paths above, so that os_ctrl can be
+//   run off the device (see test/loadgen.c). The scanner they name is run as
+//   '<scanner> <pipe fd>', without an interpreter:
+#define SCANNER_ENV "AMIIBROS_SCANNER"
+#define APP_ROOT_ENV "AMIIBROS_APP_ROOT"
+#define REGISTRY_ENV "AMIIBROS_REGISTRY"
+#define STATS_SOCKET_ENV "AMIIBROS_STATS_SOCKET"
+// Environment variables that override the freezer's limits (0 apps disables
+//   freezing):
+#define FREEZE_MAX_APPS_ENV "AMIIBROS_FREEZE_MAX_APPS"
+#define FREEZE_BUDGET_KB_ENV "AMIIBROS_FREEZE_BUDGET_KB"
+// Environment variable naming a binary log file (see log_ring.h). Without it,
+//   the log is written to stdout as text:
+#define LOG_FILE_ENV "AMIIBROS_LOG"
+
+// Maximum number of events handled per epoll_wait:
+#define MAX_EVENTS 8
+
+// Kinds of event sources registered with the epoll instance:
+typedef enum event_source
+{
+  EV_SCANNER, // Scanner pipe read-end
+  EV_SIGNAL, // signalfd
+  EV_APP_INDEX, // App index inotify fd
+  EV_CHILD, // pidfd of a child process (pid is in the event's data)
+  EV_APP_READY, // Read-end of the current app's ready pipe
+  EV_STATS, // Listening stats socket
+  EV_TEARDOWN, // timerfd of the app teardown grace period
+  EV_UI, // interface_anim_fd (an animation of the UI is done)
+} event_source;
+
+// amiibo scan subprocess pid. Should be set only once during this process's
+//   lifetime.
 static pid_t a_scan_pid;
-static pid_t app_pid; // current game/display pid
+static pid_t app_pid; // current game/display pid (0 if there is none)
+static int app_pidfd = -1; // pidfd of app_pid (-1 if unsupported or none)
+static int zygote_pidfd = -1; // pidfd of the zygote (-1 if unsupported or none)
+static int app_ready_fd = -1; // Read-end of app_pid's ready pipe (-1 if none)
+static int app_handoff_fd = -1; // Write-end of app_pid's handoff barrier (-1
+                                //   once the app was handed the display)
+static uint32_t app_tag; // Tag app_pid was launched for
+static pid_t teardown_pid; // Old app exiting after SIGTERM (0 if there is none)
+static int teardown_pidfd = -1; // pidfd of teardown_pid (-1 if unsupported)
+static uint32_t teardown_tag; // Tag teardown_pid was launched for
+static uint64_t teardown_start; // When teardown_pid was sent SIGTERM (ns)
+static bool teardown_killed; // Whether teardown_pid was sent SIGKILL
+static int teardown_timer = -1; // timerfd expiring at the end of the grace
+static bool launch_pending; // Whether pending_tag waits for the teardown
+static uint32_t pending_tag; // Tag to launch once teardown_pid has exited
 static int pipefds[2]; // pipes to communicate with scanner program
+static scan_reader scanner; // Frames read off pipefds[0] (see scan_proto.h)
+static scan_queue scans; // Tags waiting to be launched (see scan_queue.h)
+static int epoll_fd; // The main loop's epoll instance
+// A launch from the main interface waits for the UI's animations while the
+//   main loop keeps running (see launch_app and continue_launch):
+static ui_anim launch_anim; // Animation it waits for (0 if none)
+static bool launch_fading; // Whether launch_anim is the UI's fade out
+static uint32_t launch_tag; // Tag being launched
+static bool launch_early; // Whether its app was started before the animations
+static ui_anim fail_anim; // Scan failed animation playing (0 if none)
+
+// Returns the value of the environment variable name, or def if it is unset.
+const char *env_or (const char *name, const char *def)
+{
+  const char *value = getenv(name);
+  return value != NULL ? value : def;
+}
+
+/**
+ * Returns the value of the environment variable name as a number, or def if it
+ *   is unset or not a number.
+ */
+unsigned long env_ulong_or (const char *name, unsigned long def)
+{
+  const char *value = getenv(name);
+  char *end;
+  if (value == NULL || *value == '\0')
+    return def;
+  unsigned long num = strtoul(value, &end, 10);
+  return *end == '\0' ? num : def;
+}
+
+/**
+ * Sends SIGTERM to the process group of the current app and of every frozen
+ *   app, and SIGKILL to that of an app that is already being torn down.
+ */
+void signal_apps (void)
+{
+  if (app_pid != 0)
+    kill(-app_pid, SIGTERM);
+  if (teardown_pid != 0)
+    kill(-teardown_pid, SIGKILL);
+  freezer_terminate_all();
+}
 
 /**
  * Prints error message (and optionally errno's error).
  * Sends SIGTERM to all child processes and waits for each to exit.
  * Terminates the program with an error status.
- * This is not async signal safe.
  *
  * Should be called from parent process
  */
 void p_exit_err (const char *msg, bool perrno)
 {
-  if (perrno) 
+  if (perrno)
     perror(msg);
   else
     printf(msg);
+  log_ring_stop(); // Whatever led up to this is worth having
 
-  // Ignore sigchld so that we don't jump to sigchld_handler:
+  // Make sure no signal can end us before our children are reaped:
   sigset_t block_set;
   sigemptyset(&block_set);
   sigaddset(&block_set, SIGCHLD);
+  sigaddset(&block_set, SIGTERM);
   sigprocmask(SIG_BLOCK, &block_set, NULL);
 
-  // Send terminate signal to all inside our process group
+  // Send terminate signal to all inside our process group, and to the apps
+  //   in their own:
   pid_t gid = getpgid(getpid());
   kill(-gid, SIGTERM);
+  signal_apps();
 
   while (wait(NULL) > 0); // Will wait until -1 returned (ERROR)
   // We just assume that the ERROR is no child processes left, ignore any other
@@ -89,40 +201,13 @@ void p_exit_err (const char *msg, bool perrno)
   exit(1);
 }
 
-/**
- * Prints error message.
- * Sends SIGTERM to all child processes and waits for each to exit.
- * Terminates the program with an error status.
- * This version is async-signal-safe.
- *
- * Should be called from parent process.
- */
-void p_exit_err_sigsafe (const char *msg, size_t len)
-{
-  // Ignore sigchld so that we don't jump to sigchld_handler:
-  sigset_t block_set;
-  sigemptyset(&block_set);
-  sigaddset(&block_set, SIGCHLD);
-  sigprocmask(SIG_BLOCK, &block_set, NULL);
-
-  // Print error message:
-  write(STDOUT_FILENO, msg, len);
-  // Send terminate signal to all children:
-  pid_t gid = getpgid(getpid());
-  kill(-gid, SIGTERM);
-  // Wait until all finish:
-  while (wait(NULL) > 0);
-
-  exit(1);
-}
-
 /**
  * Send SIGTERM signal to parent process after reporting error.
  * Should be called from child process.
  */
 void c_exit_err (const char *msg, bool perrno)
 {
-  if (perrno) 
+  if (perrno)
     perror(msg);
   else
     printf(msg);
@@ -132,262 +217,889 @@ void c_exit_err (const char *msg, bool perrno)
 }
 
 /**
- * SIGCHLD handler. It is used to reap app subprocesses and to detect if the
- *   scanner subprocess terminates.
+ * Registers fd with the main loop's epoll instance. Events on it are reported
+ *   with the given source and argument (e.g. the pid of a child's pidfd).
+ */
+void watch_event_source (int fd, event_source source, uint32_t arg)
+{
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uint64_t)source << 32 | arg;
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    p_exit_err("os_ctrl unable to watch event source\nerror", true);
+}
+
+/**
+ * Returns a pidfd for the child pid registered with the main loop, or -1 if
+ *   the kernel does not support pidfds. Without pidfds, exits are still seen
+ *   through SIGCHLD on the signalfd.
+ */
+int watch_child (pid_t pid)
+{
+#ifdef SYS_pidfd_open
+  int pidfd = syscall(SYS_pidfd_open, pid, 0);
+  if (pidfd != -1) {
+    watch_event_source(pidfd, EV_CHILD, (uint32_t)pid);
+    return pidfd;
+  }
+  if (errno != ENOSYS)
+    p_exit_err("os_ctrl unable to open pidfd\nerror", true);
+#else
+  (void)pid;
+#endif
+  return -1;
+}
+
+/**
+ * Hands the display over to app_pid by closing its end of the app's handoff
+ *   barrier (see amiibrOS_app_wait_handoff). Does nothing if it already has it.
+ */
+void release_handoff (void)
+{
+  if (app_handoff_fd == -1)
+    return;
+  close(app_handoff_fd);
+  app_handoff_fd = -1;
+  stats_mark(STATS_HANDOFF);
+}
+
+/**
+ * Starts the app of the given plan (for the given tag), which becomes app_pid.
+ *   If it can not be started, the main interface is brought back instead
+ *   (unless it is still running).
  *
- * If the a_scan_pid process was reaped, then an error is thrown and the
- *   program is forced to terminate.
+ * If hold_display is set, the app waits in amiibrOS_app_wait_handoff until
+ *   release_handoff is called. Otherwise it is handed the display right away.
  */
-void sigchld_handler(int sig)
+void start_app (const launch_plan *plan, uint32_t tag, bool hold_display)
 {
-  (void)sig; // Ignore compiler warnings
-  int preserve_errno = errno;
-  
-  pid_t p;
-  // Quickly check and reap ready processes (do not block if there are none)
-  while ( (p = waitpid(-1, NULL, WNOHANG)) > 0) {
-    if (p == a_scan_pid) { // Our scanner died unexpectedly...
-      // print error message, wait for processes to die, exit.
-      p_exit_err_sigsafe(SIGCHLD_SCANNER_ERROR, SIGCHLD_SCANNER_ERROR_LEN);
+  // The new app reports its launch progress through this pipe. Without it,
+  //   the app still launches; only its stats are incomplete:
+  int ready_pipe[2] = {-1, -1};
+  if (pipe2(ready_pipe, O_CLOEXEC) == -1)
+    log_write(LOG_EV_PIPE_FAILED, errno, "ready", tag, 0, 0);
+  else
+    fcntl(ready_pipe[0], F_SETFL, O_NONBLOCK);
+  // Every app gets a handoff barrier, so that the one it is told about in its
+  //   environment is always its own. Without it, the app is never held back:
+  int handoff_pipe[2] = {-1, -1};
+  if (pipe2(handoff_pipe, O_CLOEXEC) == -1)
+    log_write(LOG_EV_PIPE_FAILED, errno, "handoff", tag, 0, 0);
+
+  // Apps that opted in are forked from the warm zygote, skipping exec and
+  //   dynamic linking. Any zygote failure falls back to a cold launch:
+  bool launched = false;
+  stats_mark(STATS_SPAWN);
+  if (plan->zygote_module != NULL) {
+    if ( !(launched = zygote_spawn(plan, ready_pipe[1], handoff_pipe[0],
+            &app_pid)) )
+      log_write(LOG_EV_ZYGOTE_FAILED, errno, NULL, tag, 0, 0);
+  }
+
+  // Attempt to execute a new app. The app must not hold on to the read-end
+  //   of the scanner pipe:
+  int app_close_fds[] = {pipefds[0]};
+  if (!launched && !launch_plan_spawn(plan, app_close_fds, 1, ready_pipe[1],
+        handoff_pipe[0], &app_pid)) {
+    log_write(LOG_EV_SPAWN_FAILED, errno, NULL, tag, 0, 0);
+    app_pid = 0;
+    if (ready_pipe[0] != -1) {
+      close(ready_pipe[0]);
+      close(ready_pipe[1]);
     }
-    else { // Our child program died.
-      if (!is_interface_active())
-        start_interface(); // Start a new thread for our main interface.
+    stats_launch_end();
+    // There is no app to return from, so bring back the main interface:
+    if (!is_interface_active() && !start_interface())
+      log_write(LOG_EV_UI_CMD_FAILED, 0, "restart the UI", 0, 0, 0);
+  }
+  else {
+    stats_mark(STATS_SPAWNED);
+    log_write(LOG_EV_LAUNCH, 0, NULL, tag, (uint64_t)app_pid, 0);
+    app_tag = tag;
+    app_pidfd = watch_child(app_pid);
+    if (ready_pipe[0] != -1) {
+      close(ready_pipe[1]); // Only the app writes to it
+      app_ready_fd = ready_pipe[0];
+      watch_event_source(app_ready_fd, EV_APP_READY, 0);
+    }
+    if (handoff_pipe[0] != -1) {
+      close(handoff_pipe[0]); // Only the app waits on it
+      if (hold_display)
+        app_handoff_fd = handoff_pipe[1];
+      else
+        close(handoff_pipe[1]); // Nothing to wait for
+      handoff_pipe[1] = -1;
     }
   }
-  if (p == -1) {
-    // A programmer error occured.
-    p_exit_err_sigsafe(PROG_ERROR, PROG_ERROR_LEN);
+  if (handoff_pipe[1] != -1) { // Not started
+    close(handoff_pipe[0]);
+    close(handoff_pipe[1]);
   }
+}
 
-  errno = preserve_errno;
+/**
+ * Freezes app_pid instead of tearing it down if its app is resumable (see
+ *   freezer.h). Apps still waiting for the display are never frozen. The app
+ *   of next_tag, launched in its place, is not evicted to make room.
+ *
+ * Returns true if app_pid was frozen (and is now 0).
+ */
+bool suspend_app (uint32_t next_tag)
+{
+  // The plan may have changed since the app started; its current setting is
+  //   the one that counts:
+  launch_plan *plan = app_index_lookup(app_tag);
+  if (app_pid == 0 || app_handoff_fd != -1 || plan == NULL ||
+      !plan->resumable ||
+      !freezer_freeze(app_pid, app_pidfd, app_tag, next_tag))
+    return false;
+
+  app_pid = 0;
+  app_pidfd = -1; // Now the freezer's
+  stats_mark(STATS_APP_STOPPED);
+  return true;
 }
 
 /**
- * Handles SIGTERM (and SIGINT) signals.
- * Signals SIGTERM to all children and waits to reaps them all before exiting.
+ * Resumes the frozen app of the given tag, which becomes app_pid. Returns
+ *   false if there is none.
  */
-void sigterm_handler(int sig)
+bool resume_app (uint32_t tag)
 {
-  (void)sig; // Ignore compiler warning
+  pid_t pid;
+  int pidfd;
+  if (!freezer_thaw(tag, &pid, &pidfd))
+    return false;
 
-  // Ignore sigchld so that we don't jump to sigchld_handler:
-  sigset_t block_set;
-  sigemptyset(&block_set);
-  sigaddset(&block_set, SIGCHLD);
-  sigprocmask(SIG_BLOCK, &block_set, NULL);
+  app_pid = pid;
+  app_pidfd = pidfd;
+  app_tag = tag;
+  // It presented its first frame long ago, so this launch ends here:
+  stats_mark(STATS_RESUMED);
+  stats_launch_end();
+  log_write(LOG_EV_RESUME, 0, NULL, tag, (uint64_t)pid, 0);
+  return true;
+}
+
+/**
+ * Runs the app of the given plan (for the given tag): the frozen one if there
+ *   is one, otherwise a new one (see start_app).
+ */
+void run_app (const launch_plan *plan, uint32_t tag)
+{
+  if (!resume_app(tag))
+    start_app(plan, tag, false);
+}
+
+/**
+ * Starts tearing down app_pid, which becomes teardown_pid: its process group
+ *   is sent SIGTERM, and SIGKILL once its grace period (see launcher.h) runs
+ *   out on teardown_timer. finish_teardown is called once it has exited.
+ */
+void begin_teardown (void)
+{
+  teardown_pid = app_pid;
+  teardown_pidfd = app_pidfd;
+  teardown_tag = app_tag;
+  teardown_killed = false;
+  app_pid = 0;
+  app_pidfd = -1;
+
+  // An app that never got the display has nothing to save. It is killed
+  //   before its barrier goes away, so it can not reach for the display:
+  if (app_handoff_fd != -1) {
+    teardown_start = stats_now_ns();
+    kill(-teardown_pid, SIGKILL);
+    teardown_killed = true;
+    close(app_handoff_fd);
+    app_handoff_fd = -1;
+    return;
+  }
+
+  // The plan may have changed since the app started; its current grace
+  //   period is the one that counts:
+  launch_plan *plan = app_index_lookup(teardown_tag);
+  unsigned int grace_ms = plan != NULL ? plan->teardown_grace_ms
+                                       : LAUNCHER_TEARDOWN_GRACE_MS;
+
+  teardown_start = stats_now_ns();
+  if (grace_ms == 0) {
+    kill(-teardown_pid, SIGKILL);
+    teardown_killed = true;
+    return;
+  }
+  // ESRCH: the app already exited, and is just not reaped yet:
+  if (kill(-teardown_pid, SIGTERM) == -1 && errno != ESRCH)
+    p_exit_err("amiibrOS unable to close previous app\nerror", true);
 
-  // Send terminate signal to all inside our process group
+  struct itimerspec grace = {{0, 0}, {grace_ms / 1000,
+      (grace_ms % 1000) * 1000000L}};
+  if (timerfd_settime(teardown_timer, 0, &grace, NULL) == -1)
+    p_exit_err("amiibrOS unable to time app teardown\nerror", true);
+}
+
+/**
+ * Kills the process group of the app being torn down once its grace period
+ *   has run out.
+ */
+void handle_teardown_timer (void)
+{
+  uint64_t expirations;
+  if (read(teardown_timer, &expirations, sizeof(expirations)) == -1)
+    return; // Disarmed in the meantime (EAGAIN)
+
+  if (teardown_pid != 0 && !teardown_killed) {
+    log_write(LOG_EV_TEARDOWN_KILL, 0, NULL, teardown_tag, 0, 0);
+    kill(-teardown_pid, SIGKILL);
+    teardown_killed = true;
+  }
+}
+
+/**
+ * Handles the exit of the (already reaped) app being torn down: records how
+ *   long it took and starts the app waiting to be launched, if any.
+ */
+void finish_teardown (void)
+{
+  struct itimerspec disarm;
+  memset(&disarm, 0, sizeof(disarm));
+  timerfd_settime(teardown_timer, 0, &disarm, NULL);
+  if (teardown_pidfd != -1)
+    close(teardown_pidfd); // Also removes it from the epoll set
+  teardown_pidfd = -1;
+
+  // Whatever the app started may still be around in its group:
+  kill(-teardown_pid, SIGKILL);
+  teardown_pid = 0;
+  stats_teardown(teardown_tag, stats_now_ns() - teardown_start,
+      teardown_killed);
+  stats_mark(STATS_APP_STOPPED);
+
+  // The index may have changed during the teardown, so look the tag up again:
+  launch_plan *plan = launch_pending ? app_index_lookup(pending_tag) : NULL;
+  launch_pending = false;
+  if (plan != NULL)
+    run_app(plan, pending_tag);
+  else {
+    stats_launch_end();
+    if (!is_interface_active() && !start_interface())
+      log_write(LOG_EV_UI_CMD_FAILED, 0, "restart the UI", 0, 0, 0);
+  }
+}
+
+/**
+ * Handles the exit of an already reaped child.
+ *
+ * If the scanner exited, an error is thrown and the program is forced to
+ *   terminate. If the current app exited, the main interface is restarted. If
+ *   the zygote exited, apps are cold launched from then on.
+ */
+void handle_child_exit (pid_t pid)
+{
+  if (pid == a_scan_pid) { // Our scanner died unexpectedly...
+    p_exit_err("os_ctrl unexpected child exit\nerror: scanner terminated\n",
+        false);
+  }
+  else if (pid == app_pid) { // Our app exited or crashed
+    log_write(LOG_EV_APP_EXIT, 0, NULL, app_tag, (uint64_t)pid, 0);
+    if (app_pidfd != -1)
+      close(app_pidfd); // Also removes it from the epoll set
+    app_pidfd = -1;
+    app_pid = 0;
+    kill(-pid, SIGKILL); // Whatever it started may still be around
+    if (app_handoff_fd != -1) // It died while waiting for the display
+      close(app_handoff_fd);
+    app_handoff_fd = -1;
+
+    if (!is_interface_active())
+      start_interface(); // Start a new thread for our main interface.
+  }
+  else if (pid == teardown_pid) // Our old app finally exited
+    finish_teardown();
+  else if (freezer_forget(pid)) // A frozen app died (e.g. killed by the OOM)
+    log_write(LOG_EV_FROZEN_EXIT, 0, NULL, (uint64_t)pid, 0, 0);
+  else if (pid == zygote_pid()) {
+    log_write(LOG_EV_ZYGOTE_EXIT, 0, NULL, 0, 0, 0);
+    zygote_exited(pid);
+    if (zygote_pidfd != -1)
+      close(zygote_pidfd);
+    zygote_pidfd = -1;
+  }
+}
+
+/**
+ * Reaps every child that has exited so far without blocking and handles
+ *   each exit.
+ */
+void reap_children (void)
+{
+  pid_t p;
+  while ( (p = waitpid(-1, NULL, WNOHANG)) > 0)
+    handle_child_exit(p);
+  if (p == -1 && errno != ECHILD) {
+    // A programmer error occured.
+    p_exit_err("os_ctrl unable to reap children\nerror", true);
+  }
+}
+
+/**
+ * Sends SIGTERM to all children and waits to reap them all before exiting.
+ */
+void terminate (void)
+{
+  // Send terminate signal to all inside our process group (we ignore our own,
+  //   as it is blocked and only ever read from the signalfd):
   pid_t gid = getpgid(getpid());
   kill(-gid, SIGTERM);
+  signal_apps();
 
   while (wait(NULL) > 0); // Will wait until all child processes terminate
-  
+
+  log_ring_stop();
   exit(1);
 }
 
 /**
- * Reads RAW_INFO_SIZE bytes from pipe read end given by pipefd and stores it
- *   in info_buf. Returns the total number of bytes read - useful for checking
- *   if the write-end of the pipe was closed prematurely.
- *
- * Accounts for signal interruptions that may occur by restarting the read.
- *   If read would fail in any other case, this function causes the program to
- *   with an error message.
- *
- * Note, this is a blocking call. We only return when RAW_INFO_SIZE bytes have
- *   been read into info_buf, or if the write-end of the pipe was closed.
+ * Prints the scanner protocol's counters to the given stream.
  */
-size_t read_raw_info (int pipefd, char *raw_info)
-{
-  ssize_t rd_total = 0; // # of chars in info_buf (also next idx to write to)
-  ssize_t rd_cnt; // tmp var for storing return value of read sys call
-
-  // read will block until either EOF, error, or some number of chars are read
-  // We must also check if rd_total has already been read
-  while ( rd_total != RAW_INFO_SIZE &&
-      (rd_cnt = read(pipefd, raw_info+rd_total, RAW_INFO_SIZE-rd_total)) != 0)
-  {
-    // We have read a non-zero number of chars!
-    if (rd_cnt == -1) { // Check for errors
-      if (errno != EINTR) { // If our read wasn't interrupted by a signal...
-        // We have a serious error:
-        perror("os_ctrl pipe read failed\nerror");
-        exit(1);
-      }
-      // Else, we just restart the read.
+void dump_scanner_stats (FILE *out)
+{
+  fprintf(out, "scanner: %lu frames, %lu skipped, %lu bytes resynced\n",
+      scanner.frame_cnt, scanner.skip_cnt, scanner.resync_cnt);
+  fprintf(out, "scanner: %lu tags, %lu debounced, %lu superseded\n",
+      scans.push_cnt, scans.debounce_cnt, scans.supersede_cnt);
+}
+
+/**
+ * Reads and handles every pending signal from the signalfd sfd.
+ */
+void handle_signals (int sfd)
+{
+  struct signalfd_siginfo info;
+  ssize_t rd_cnt;
+
+  while ( (rd_cnt = read(sfd, &info, sizeof(info))) == sizeof(info)) {
+    switch (info.ssi_signo) {
+      case SIGCHLD:
+        // Several exits may be merged into one SIGCHLD, so reap them all:
+        reap_children();
+        break;
+      case SIGTERM:
+      case SIGINT:
+        terminate();
+        break;
+      case SIGUSR1:
+        app_index_dump_stats(stdout);
+        freezer_dump_stats(stdout);
+        dump_scanner_stats(stdout);
+        stats_dump(stdout);
+        interface_dump_stats(stdout);
+        fflush(stdout);
+        break;
     }
-    else {
-      // On the next pipe read, we write into info_buf starting from rd_total
-      rd_total += rd_cnt; // ... so we need to update the total at each read
+  }
+  if (rd_cnt == -1 && errno != EAGAIN)
+    p_exit_err("os_ctrl unable to read signalfd\nerror", true);
+}
+
+/**
+ * Reads every pending launch progress report from the current app's ready
+ *   pipe and marks them in the current launch. The launch ends once the app
+ *   reports its first frame or closes the pipe (e.g. by exiting).
+ */
+void handle_app_ready (void)
+{
+  amiibrOS_app_report report;
+  ssize_t rd_cnt;
+
+  while ( (rd_cnt = read(app_ready_fd, &report, sizeof(report))) ==
+      sizeof(report)) {
+    if (report.event == AMIIBROS_APP_STARTED)
+      stats_mark_at(STATS_APP_STARTED, report.ns);
+    else if (report.event == AMIIBROS_APP_LOADED)
+      stats_mark_at(STATS_APP_LOADED, report.ns);
+    else if (report.event == AMIIBROS_APP_FIRST_FRAME) {
+      stats_mark_at(STATS_FIRST_FRAME, report.ns);
+      rd_cnt = 0; // Nothing more to expect
+      break;
     }
   }
+  if (rd_cnt == -1 && errno == EAGAIN)
+    return; // More to come
 
-  return rd_total;
+  // First frame, EOF or a broken app: either way this launch is over, unless
+  //   it still waits for the UI's animations (an app started early died):
+  if (launch_anim == 0)
+    stats_launch_end();
+  close(app_ready_fd); // Also removes it from the epoll set
+  app_ready_fd = -1;
 }
 
 /**
- * Converts a char array containing raw bytes into a hex string.
- * Array hex_tag must be of length HEX_TAG_SIZE + 1
+ * Accepts a connection on the stats socket sfd and writes all statistics to
+ *   it before closing it. Connect with e.g. `nc -U` to read them.
  */
-void raw_to_hex_tag (const char *raw_info, char *hex_tag)
+void handle_stats_request (int sfd)
 {
-  for (unsigned int i = 0; i < RAW_INFO_SIZE; i++) {
-    sprintf(hex_tag + 2*i, "%02X", (unsigned char)raw_info[i]);
+  int conn = accept4(sfd, NULL, NULL, SOCK_CLOEXEC);
+  if (conn == -1)
+    return; // The client may have given up already
+
+  // Never let a stuck reader stall the main loop for long:
+  struct timeval timeout = {0, 100000};
+  setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  FILE *out = fdopen(conn, "w");
+  if (out == NULL) {
+    close(conn);
+    return;
   }
-  hex_tag[HEX_TAG_SIZE] = '\0'; // Assign NUL manually
+  app_index_dump_stats(out);
+  freezer_dump_stats(out);
+  dump_scanner_stats(out);
+  stats_dump(out);
+  interface_dump_stats(out);
+  fclose(out); // Also closes conn
 }
 
 /**
- * Uses the given hex_tag to find an app for launching.
- * Then tells the UI thread to play an animation and blocks until the animation
- *   is complete.
- * Launches this app, replacing any old app processes.
+ * Returns a listening, non-blocking local socket at STATS_SOCKET_PATH (or
+ *   STATS_SOCKET_ENV), or -1 if it could not be created (stats are then only
+ *   dumped on SIGUSR1).
  */
-void launch_app (const char *hex_tag)
+int open_stats_socket (void)
 {
-  char app_dir[APP_DIR_LEN + 1]; // +1 for NUL
-  char app_path[APP_PATH_LEN + 4]; // +1 for NUL +3 for ".sh"
-  struct stat stat_buf; // We need this as a mandatory parameter for stat call
+  const char *path = env_or(STATS_SOCKET_ENV, STATS_SOCKET_PATH);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
 
-  // Construct the paths to the directory and executable:
-  sprintf(app_dir, "%s/%s", APP_ROOT_PATH, hex_tag);
-  sprintf(app_path, "%s/%s.sh", app_dir, hex_tag);
+  int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (sfd == -1)
+    return -1;
+  unlink(path); // Left over from an earlier run
+  if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+      listen(sfd, 4) == -1) {
+    close(sfd);
+    return -1;
+  }
+  return sfd;
+}
 
-  printf("app_path: %s\n", app_path); // TODO REMOVE
+/**
+ * Reads everything pending on the scanner pipe with a single read and handles
+ *   every complete event in it (see scan_proto.h). Tags are pushed to the scan
+ *   queue, to be launched by handle_scanner; read errors get the same response
+ *   as an incompatible amiibo.
+ *
+ * If the write-end of the pipe was closed, this function causes the program to
+ *   exit with an error message.
+ */
+void read_scanner (void)
+{
+  long rd_cnt = scan_reader_fill(&scanner, pipefds[0]);
+  if (rd_cnt == 0) {
+    // Write-end of pipe closed prematurely. There is an error!
+    p_exit_err("os_ctrl detected erroneous pipe disconnect\nerror: "
+        "pipe write-end closed prematurely\n", false);
+  }
+  if (rd_cnt == -1) {
+    if (errno == EAGAIN)
+      return;
+    p_exit_err("os_ctrl pipe read failed\nerror", true);
+  }
 
-  // Check if a program matching hex_tag exists and is accessible:
-  if (stat(app_path, &stat_buf) != -1) {
-    // Stop the previous screen:
-    if (is_interface_active()) { // Only play the animation if on main UI
-      // Tell our UI to play 'amiibo scanned' and 'fade out' animation and then
-      //   auto stop:
-      // TODO Error check both:
-      play_scan_success_anim(); // Blocks until animation completes
-      stop_interface(); // Also blocks until animation completes
-    }
-    else { // We are running a program that isn't main interface
-      // Block SIGCHLD so that we can synchronously use waitpid:
-      sigset_t block_set, old_set;
-      if (sigemptyset(&block_set) == -1 ||
-          sigaddset(&block_set, SIGCHLD) == -1)
-        p_exit_err("amiibrOS unable to create signal mask\nerror", true);
-      if (sigprocmask(SIG_BLOCK, &block_set, &old_set) == -1)
-        p_exit_err("amiibrOS unable to block signals\nerror", true);
-
-      // We are exiting from a program.
-      // First, send sigterm signal:
-      if (kill(app_pid, SIGTERM) == -1)
-        p_exit_err("amiibrOS unable to close previous app\nerror", true);
-
-      // Wait for child process to exit:
-      if (waitpid(app_pid, NULL, 0) == -1)
-        p_exit_err("amiibrOS unable to close previous app\nerror", true);
-
-      // Restore signal mask so that we can asynchronously reap processes again
-      sigprocmask(SIG_SETMASK, &old_set, NULL);
+  scan_event ev;
+  while (scan_reader_next(&scanner, &ev)) {
+    switch (ev.type) {
+      case SCAN_EV_TAG:
+        // Only the latest tag is kept (see scan_queue.h):
+        scan_queue_push(&scans, app_index_tag(ev.id), ev.ts_ns);
+        break;
+      case SCAN_EV_ERROR:
+        // Never cuts a launch's success animation short:
+        if (is_interface_active() && launch_anim == 0) {
+          fail_anim = play_scan_fail_anim(); // Replaces an earlier one
+          if (fail_anim == 0)
+            log_write(LOG_EV_UI_CMD_FAILED, 0, "play fail animation", 0, 0, 0);
+        }
+        break;
+      case SCAN_EV_REMOVED:
+        // Apps keep running once their amiibo is lifted, but the X only
+        //   flashes while the amiibo that caused it is still there:
+        if (fail_anim != 0 && !cancel_anim(fail_anim)) // Left to play out
+          log_write(LOG_EV_UI_CMD_FAILED, 0, "cancel fail animation", 0, 0, 0);
+        fail_anim = 0;
+        break;
     }
+  }
+}
+
+// Returns whether tag has an app to launch (see scan_queue_supersedes).
+bool has_app (uint32_t tag)
+{
+  return app_index_lookup(tag) != NULL;
+}
+
+/**
+ * Takes the launch waiting for the UI's animations (see launch_app) a step
+ *   further, once launch_anim is done: from the success animation to the fade
+ *   out, and from the fade out to starting (or handing the display to) its
+ *   app. If the UI can not be stopped, the launch is given up and the UI kept
+ *   (or brought back).
+ */
+void continue_launch (void)
+{
+  if (!launch_fading) {
+    stats_mark(STATS_ANIM_END);
+    launch_fading = true;
+    if ( (launch_anim = fade_out_interface()) != 0)
+      return;
+  }
+  launch_anim = 0;
+  // Quick, as the fade out is done (unless it could not be queued). The app
+  //   must not be given the display while the UI may still hold it, so the
+  //   launch is given up otherwise:
+  if (!stop_interface()) {
+    log_write(LOG_EV_UI_CMD_FAILED, 0, "stop the UI", 0, 0, 0);
+    if (launch_early && app_pid != 0)
+      begin_teardown(); // Killed before it is handed the display
+    stats_launch_end();
+    if (!is_interface_active() && !start_interface())
+      log_write(LOG_EV_UI_CMD_FAILED, 0, "restart the UI", 0, 0, 0);
+    return;
+  }
+  stats_mark(STATS_UI_STOPPED);
+
+  // Tags scanned during the animations win over this one, as long as they
+  //   have an app to launch instead (launch_scans launches it next):
+  read_scanner();
+  if (scan_queue_supersedes(&scans, has_app)) {
+    if (launch_early && app_pid != 0)
+      begin_teardown(); // The newer tag's app waits for it to exit
+    stats_launch_end();
+    return;
+  }
+
+  if (launch_early && app_pid != 0) {
+    release_handoff();
+    return;
+  }
+
+  // The index may have changed during the animations, so look the tag up
+  //   again:
+  launch_plan *plan = app_index_lookup(launch_tag);
+  if (plan != NULL)
+    run_app(plan, launch_tag);
+  else {
+    stats_launch_end();
+    if (!start_interface())
+      log_write(LOG_EV_UI_CMD_FAILED, 0, "restart the UI", 0, 0, 0);
+  }
+}
+
+/**
+ * Uses the given tag to find an app for launching.
+ * Then tells the UI thread to play an animation; the launch goes on once it is
+ *   done (see continue_launch). Tags scanned in the meantime wait for it.
+ * Launches this app, replacing any old app processes. An old app is torn down
+ *   asynchronously (see begin_teardown); the new app is started once it is
+ *   gone, while the main loop keeps handling events. A newer tag scanned in
+ *   the meantime replaces the one waiting, as does one scanned during the
+ *   UI's animations.
+ *
+ * Apps with a handoff (see launcher.h) are started before the animations, and
+ *   load while they play. They are handed the display once the UI has stopped.
+ *
+ * Resumable apps are frozen rather than torn down when replaced, and resumed
+ *   when scanned again (see freezer.h). Switching from a resumable app does
+ *   not wait for it to exit.
+ */
+void launch_app (uint32_t tag)
+{
+  // Resolved entirely in memory (see app_index.h):
+  launch_plan *plan = app_index_lookup(tag);
+  stats_mark(STATS_LOOKUP);
 
-    // Attempt to execute a new app:
-    if ( (app_pid = fork()) == 0) {
-      // Close unused read-end of pipe for the newly spawned app
-      if (close(pipefds[0]))
-        c_exit_err("os_ctrl unable to close write end of pipe\nerror", true);
+  // A frozen instance of an app that is gone or no longer resumable must not
+  //   be resumed:
+  if (plan == NULL || !plan->resumable)
+    freezer_discard(tag);
 
-      // Change directory to exec from (we want all relative paths to function)
-      if (chdir(app_dir) == -1)
-        c_exit_err("os_ctrl unable to change dir. for new app\nerror", true);
+  if (plan != NULL) {
+    // Reports of the previous app no longer matter:
+    if (app_ready_fd != -1)
+      close(app_ready_fd);
+    app_ready_fd = -1;
 
-      execl("/bin/sh", "sh", app_path, NULL); // Execute as .sh shell script
-      
-      c_exit_err("os_ctrl unable to spawn app\nerror", true);
-      // Note, as mentioned ealier, no need to undo our signal stuff
+    // Stop the previous screen:
+    if (is_interface_active()) { // Only play the animation if on main UI
+      // The UI is the only thing on screen, so the app can start loading now.
+      //   If it fails to start, it is tried again (cold) after the animations:
+      launch_early = plan->handoff && !freezer_contains(tag);
+      if (launch_early)
+        start_app(plan, tag, true);
+
+      // Tell our UI to play 'amiibo scanned' (replacing a scan failed flash)
+      //   and 'fade out' animation and then auto stop:
+      launch_tag = tag;
+      launch_fading = false;
+      fail_anim = 0;
+      launch_anim = play_scan_success_anim();
+      if (launch_anim == 0) { // Skip to the fade out
+        log_write(LOG_EV_UI_CMD_FAILED, 0, "play success animation", 0, 0, 0);
+        continue_launch();
+      }
+      return;
     }
+    else if (app_pid != 0 || teardown_pid != 0) {
+      // We are exiting from a program that isn't main UI. Unless it is frozen
+      //   on the spot, the new app is started by finish_teardown once the old
+      //   one is gone:
+      if (app_pid != 0 && !suspend_app(tag))
+        begin_teardown();
+      if (teardown_pid != 0) {
+        if (launch_pending)
+          scan_queue_cancelled(&scans); // Replaces the launch still waiting
+        pending_tag = tag;
+        launch_pending = true;
+        return;
+      }
+    }
+
+    run_app(plan, tag);
   }
   else {
     // No program matches. Notify user of the given amiibo's incompatibility:
+    log_write(LOG_EV_NO_APP, 0, NULL, tag, 0, 0);
     // Tell UI to play 'not found' animation.
     if (is_interface_active()) { // Only play the animation if on main UI
       // Tell our UI to play 'amiibo scanned' and 'fade out' animation and then
       //   auto stop:
-      play_scan_fail_anim(); // TODO Error checking
+      fail_anim = play_scan_fail_anim();
+      if (fail_anim == 0)
+        log_write(LOG_EV_UI_CMD_FAILED, 0, "play fail animation", 0, 0, 0);
     }
+    stats_launch_end();
   }
 }
 
+/**
+ * Launches the latest tag read so far, if any. Tags wait while a launch waits
+ *   for the UI's animations; continue_launch then decides which one wins.
+ */
+void launch_scans (void)
+{
+  uint32_t tag;
+  uint64_t ts_ns;
+  while (launch_anim == 0 && scan_queue_take(&scans, &tag, &ts_ns)) {
+    // Launch app based on the tag. The scanner shares our clock, so the
+    //   launch is timed from the moment it saw the tag:
+    stats_launch_begin();
+    stats_mark_at(STATS_SCAN, ts_ns);
+    log_write(LOG_EV_SCAN, 0, NULL, tag, 0, 0);
+    launch_app(tag); // May queue an even newer tag
+  }
+}
+
+/**
+ * Handles the UI's animations that are done: the launch waiting for them goes
+ *   on (see continue_launch), as may the tags waiting for that launch.
+ */
+void handle_ui_anims (void)
+{
+  clear_anim_fd(); // Before checking, so that no animation goes unseen
+  if (is_anim_done(fail_anim))
+    fail_anim = 0;
+  if (launch_anim == 0 || !is_anim_done(launch_anim))
+    return;
+
+  continue_launch();
+  launch_scans();
+}
+
+/**
+ * Reads new scanner events (see read_scanner) and launches the latest tag
+ *   among them, if any (see launch_scans).
+ */
+void handle_scanner (void)
+{
+  read_scanner();
+  launch_scans();
+}
+
 int main (void)
 {
   sigset_t prev_set, block_set;
 
+  // Everything logged is held in the ring until its drain starts:
+  log_ring_init();
+
   // Set up pipe for communication between amiibo_scan and this process
   if (pipe(pipefds))
     p_exit_err("os_ctrl unable to create pipe\nerror", true);
 
   // Construct signal block mask:
-  if (sigemptyset(&block_set) == -1 || sigaddset(&block_set, SIGCHLD) == -1)
+  if (sigemptyset(&block_set) == -1 || sigaddset(&block_set, SIGCHLD) == -1 ||
+      sigaddset(&block_set, SIGTERM) == -1 ||
+      sigaddset(&block_set, SIGINT) == -1 ||
+      sigaddset(&block_set, SIGUSR1) == -1)
     p_exit_err("os_ctrl unable to create signal mask\nerror", true);
 
-  // Block signals:
+  // Block signals for good. They are read from a signalfd instead (the UI
+  //   thread inherits a mask with every signal blocked):
   if (sigprocmask(SIG_BLOCK, &block_set, &prev_set) == -1)
     p_exit_err("os_ctrl unable to block signals\nerror", true);
-
-  // Install SIGCHLD handler.
-  if (signal(SIGCHLD, sigchld_handler) == SIG_ERR)
-    p_exit_err("os_ctrl unable to install signal handler\nerror", true);
-  
-  // Install SIGTERM and SIGINT handler:
-  if (signal(SIGTERM, sigterm_handler) == SIG_ERR)
-    p_exit_err("os_ctrl unable to install signal handler\nerror", true);
-  if (signal(SIGINT, sigterm_handler) == SIG_ERR)
-    p_exit_err("os_ctrl unable to install signal handler\nerror", true);
+  int sfd = signalfd(-1, &block_set, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (sfd == -1)
+    p_exit_err("os_ctrl unable to create signalfd\nerror", true);
 
   if ( (a_scan_pid = fork()) == 0) { // SCANNER CHILD BEGIN
     // Delete unused read-end of the pipe for child
     if (close(pipefds[0]))
       c_exit_err("os_ctrl unable to close read end of pipe\nerror", true);
 
+    // Blocked signals survive exec, so give the scanner our original mask:
+    if (sigprocmask(SIG_SETMASK, &prev_set, NULL) == -1)
+      c_exit_err("os_ctrl unable to unblock signals\nerror", true);
+
     // Execute amiibo_scan.py
     // Construct argv and exec the python interpreter:
     char fd_str[12];
     sprintf(fd_str, "%d", pipefds[1]); // We want to send the write-end of pipe
-    char *const argv[] = {INTERPRETER_PATH, A_SCAN_PATH, fd_str, NULL};
-    execv(INTERPRETER_PATH, argv);
+    const char *scanner_path = getenv(SCANNER_ENV);
+    if (scanner_path != NULL) {
+      char *const argv[] = {(char *)scanner_path, fd_str, NULL};
+      execv(scanner_path, argv);
+    }
+    else {
+      char *const argv[] = {INTERPRETER_PATH, A_SCAN_PATH, fd_str, NULL};
+      execv(INTERPRETER_PATH, argv);
+    }
 
     // If execv returns, we had an error
     perror("os_ctrl unable to spawn amiibo_scan\nerror");
-    // Note: We did not need to fiddle with the signal handler or blocked set
-    //   in the child process as they get overwritten by execv anyways.
   } // SCANNER CHILD END
   else {
-    // Reopen parent process to receiving SICHLD:
-    if (sigprocmask(SIG_SETMASK, &prev_set, NULL) == -1)
-      p_exit_err("amiibrOS unable to unblock signals\nerror", true);
-
     // Close unused write-end of pipe for parent (and for other process).
     if (close(pipefds[1]))
       p_exit_err("os_ctrl unable to close write end of pipe\nerror", true);
 
-    // Start a new thread for our main interface:
+    // Each wakeup takes whatever frames are pending in a single read:
+    scan_reader_init(&scanner);
+    scan_queue_init(&scans, SCAN_DEBOUNCE_MS);
+    if (fcntl(pipefds[0], F_SETFL, O_NONBLOCK) == -1)
+      p_exit_err("os_ctrl unable to configure pipe\nerror", true);
+
+    freezer_init(env_ulong_or(FREEZE_MAX_APPS_ENV, FREEZE_MAX_APPS),
+        env_ulong_or(FREEZE_BUDGET_KB_ENV, FREEZE_BUDGET_KB));
+
+    // Index every installed app once, up front:
+    if (!app_index_init(env_or(APP_ROOT_ENV, APP_ROOT_PATH),
+        env_or(REGISTRY_ENV, REGISTRY_PATH)))
+      p_exit_err("os_ctrl unable to index apps\nerror", true);
+    app_index_dump_stats(stdout);
+
+    // Apps always find their ready pipe and handoff barrier at the same fds
+    //   (see launcher.h):
+    char ready_fd_str[12];
+    sprintf(ready_fd_str, "%d", LAUNCHER_READY_FD);
+    if (setenv(AMIIBROS_READY_FD_ENV, ready_fd_str, 1) == -1)
+      p_exit_err("os_ctrl unable to set environment\nerror", true);
+    char handoff_fd_str[12];
+    sprintf(handoff_fd_str, "%d", LAUNCHER_HANDOFF_FD);
+    if (setenv(AMIIBROS_HANDOFF_FD_ENV, handoff_fd_str, 1) == -1)
+      p_exit_err("os_ctrl unable to set environment\nerror", true);
+
+    // The zygote must be forked while we are still single threaded (before the
+    //   UI thread exists). It needs none of our event sources:
+    int zygote_close_fds[] = {pipefds[0], sfd, app_index_watch_fd()};
+    if (!zygote_start(zygote_close_fds, 3))
+      log_write(LOG_EV_ZYGOTE_START_FAILED, errno, NULL, 0, 0, 0);
+
+    // Register everything the main loop waits on:
+    if ( (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+      p_exit_err("os_ctrl unable to create epoll instance\nerror", true);
+    watch_event_source(pipefds[0], EV_SCANNER, 0);
+    watch_event_source(sfd, EV_SIGNAL, 0);
+    watch_event_source(app_index_watch_fd(), EV_APP_INDEX, 0);
+    teardown_timer = timerfd_create(CLOCK_MONOTONIC,
+        TFD_NONBLOCK | TFD_CLOEXEC);
+    if (teardown_timer == -1)
+      p_exit_err("os_ctrl unable to create timerfd\nerror", true);
+    watch_event_source(teardown_timer, EV_TEARDOWN, 0);
+    watch_child(a_scan_pid); // Kept open for as long as we run
+    if (zygote_pid() != 0)
+      zygote_pidfd = watch_child(zygote_pid());
+    int stats_sock = open_stats_socket();
+    if (stats_sock == -1)
+      log_write(LOG_EV_STATS_SOCKET_FAILED, errno, NULL, 0, 0, 0);
+    else
+      watch_event_source(stats_sock, EV_STATS, 0);
+
+    // The log's drain thread, like the UI thread, must only be started after
+    //   the zygote is forked. Records logged so far wait in the ring:
+    if (!log_ring_start(getenv(LOG_FILE_ENV)))
+      p_exit_err("os_ctrl unable to start log\nerror", true);
+
+    // Start a new thread for our main interface. Its animations never block
+    //   us; the main loop is told when each is done:
+    int anim_fd = interface_anim_fd();
+    if (anim_fd == -1)
+      p_exit_err("os_ctrl unable to watch UI animations\nerror", true);
+    watch_event_source(anim_fd, EV_UI, 0);
     start_interface();
 
-    // Continuously monitor the scanner:
-    char raw_info[RAW_INFO_SIZE];
-    char hex_tag[HEX_TAG_SIZE + 1]; // +1 for NUL
+    // Continuously monitor the scanner, app root, children and signals:
+    struct epoll_event events[MAX_EVENTS];
     for(;;) {
-      // Read raw tag
-      if (read_raw_info(pipefds[0], raw_info) == 0) {
-        // Write-end of pipe closed prematurely. There is an error!
-        p_exit_err("os_ctrl detected erroneous pipe disconnect\nerror: pipe "
-            "write-end closed prematurely\n", false);
+      int ev_cnt = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+      if (ev_cnt == -1) {
+        if (errno == EINTR)
+          continue; // Only possible when stopped/continued (e.g. debugger)
+        p_exit_err("os_ctrl unable to wait for events\nerror", true);
       }
 
-      // Convert raw tag to hex string:
-      raw_to_hex_tag(raw_info, hex_tag);
-      
-      // Launch app based on hex string:
-      launch_app(hex_tag);
+      for (int i = 0; i < ev_cnt; i++) {
+        event_source source = (event_source)(events[i].data.u64 >> 32);
+        uint32_t arg = (uint32_t)events[i].data.u64;
+
+        switch (source) {
+          case EV_SIGNAL:
+            handle_signals(sfd);
+            break;
+          case EV_CHILD:
+            // The child may already be reaped by an earlier SIGCHLD:
+            if (waitpid((pid_t)arg, NULL, WNOHANG) == (pid_t)arg)
+              handle_child_exit((pid_t)arg);
+            break;
+          case EV_APP_INDEX:
+            // Keep the index in sync with the app root:
+            if (!app_index_refresh())
+              p_exit_err("os_ctrl unable to refresh app index\nerror", true);
+            break;
+          case EV_SCANNER:
+            handle_scanner();
+            break;
+          case EV_APP_READY:
+            // The pipe may have been replaced earlier in this batch:
+            if (app_ready_fd != -1)
+              handle_app_ready();
+            break;
+          case EV_STATS:
+            handle_stats_request(stats_sock);
+            break;
+          case EV_TEARDOWN:
+            handle_teardown_timer();
+            break;
+          case EV_UI:
+            handle_ui_anims();
+            break;
+        }
+      }
     }
   }
-  
+
   return 0;
 }
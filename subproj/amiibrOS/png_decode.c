@@ -0,0 +1,200 @@
+/**
+ * png_decode.c
+ *
+ * Contains implementation of png_decode.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // FILE, fopen, fread, fclose
+#include <stdlib.h> // malloc, realloc, free, abs
+#include <string.h> // memcmp, memcpy
+#include <errno.h> // errno
+#include <zlib.h> // uncompress
+#include "png_decode.h"
+
+#define PNG_COLOR_GRAY 0
+#define PNG_COLOR_RGB 2
+#define PNG_COLOR_GRAY_ALPHA 4
+#define PNG_COLOR_RGBA 6
+
+static const uint8_t png_signature[8] = {137, 'P', 'N', 'G', 13, 10, 26, 10};
+
+// --- Helper Function Prototypes ---
+uint8_t *read_whole_file (const char *path, size_t *size);
+uint32_t png_be32 (const uint8_t *p);
+bool png_unfilter (uint8_t *raw, uint32_t width, uint32_t height,
+    unsigned int bpp);
+uint8_t png_paeth (uint8_t a, uint8_t b, uint8_t c);
+// --- ---
+
+bool png_decode (const char *path, png_image *img)
+{
+  size_t size;
+  uint8_t *file = read_whole_file(path, &size);
+  if (file == NULL)
+    return false;
+
+  // The signature, then IHDR, which must come first:
+  if (size < 33 || memcmp(file, png_signature, 8) ||
+      memcmp(file + 12, "IHDR", 4) || png_be32(file + 8) != 13) {
+    free(file);
+    errno = EINVAL;
+    return false;
+  }
+  uint32_t width = png_be32(file + 16);
+  uint32_t height = png_be32(file + 20);
+  uint8_t depth = file[24], color = file[25], interlace = file[28];
+  if (width == 0 || height == 0 || width > 16384 || height > 16384 ||
+      depth != 8 || (color != PNG_COLOR_GRAY && color != PNG_COLOR_RGB &&
+      color != PNG_COLOR_GRAY_ALPHA && color != PNG_COLOR_RGBA) ||
+      file[26] != 0 || file[27] != 0 || interlace != 0) {
+    free(file);
+    errno = EINVAL;
+    return false;
+  }
+  // Bytes per pixel, one per channel:
+  unsigned int bpp = color == PNG_COLOR_GRAY ? 1 : color == PNG_COLOR_RGB ? 3 :
+      color == PNG_COLOR_GRAY_ALPHA ? 2 : 4;
+
+  // Gather the compressed stream of every IDAT chunk, in place:
+  size_t zlen = 0;
+  bool ended = false;
+  for (size_t at = 33; at + 12 <= size; ) {
+    uint32_t len = png_be32(file + at);
+    if (len > size - at - 12)
+      break; // Truncated
+    const uint8_t *type = file + at + 4;
+    if (!memcmp(type, "IDAT", 4)) {
+      memmove(file + zlen, file + at + 8, len); // Never ahead of at
+      zlen += len;
+    }
+    else if (!memcmp(type, "IEND", 4)) {
+      ended = true;
+      break;
+    }
+    at += 12 + (size_t)len; // Length, type, data and CRC
+  }
+
+  // Each row is a filter type byte followed by its pixels:
+  uLongf raw_len = (uLongf)height * (1 + (uLongf)width * bpp);
+  uLongf out_len = raw_len;
+  uint8_t *raw = malloc(raw_len);
+  if (raw == NULL) {
+    free(file);
+    return false;
+  }
+  int zerr = ended ? uncompress(raw, &out_len, file, zlen) : Z_DATA_ERROR;
+  free(file);
+  if (zerr != Z_OK || out_len != raw_len ||
+      !png_unfilter(raw, width, height, bpp)) {
+    free(raw);
+    errno = EINVAL;
+    return false;
+  }
+
+  uint8_t *pixels = malloc((size_t)width * height * 4);
+  if (pixels == NULL) {
+    free(raw);
+    return false;
+  }
+  for (uint32_t y = 0; y < height; y++) {
+    const uint8_t *src = raw + (size_t)y * (1 + width * bpp) + 1;
+    uint8_t *dst = pixels + (size_t)y * width * 4;
+    if (bpp == 4) {
+      memcpy(dst, src, (size_t)width * 4);
+      continue;
+    }
+    for (uint32_t x = 0; x < width; x++, src += bpp, dst += 4) {
+      bool gray = bpp < 3;
+      dst[0] = src[0];
+      dst[1] = src[gray ? 0 : 1];
+      dst[2] = src[gray ? 0 : 2];
+      dst[3] = bpp == 2 ? src[1] : 255;
+    }
+  }
+  free(raw);
+
+  img->width = width;
+  img->height = height;
+  img->pixels = pixels;
+  return true;
+}
+
+/**
+ * Reads the file at path into a malloc'd buffer and sets size to its length.
+ *   Returns NULL (with errno set) if it can not be read.
+ */
+uint8_t *read_whole_file (const char *path, size_t *size)
+{
+  FILE *in = fopen(path, "rb");
+  if (in == NULL)
+    return NULL;
+
+  size_t cap = 1 << 16, len = 0, rd_cnt;
+  uint8_t *buf = malloc(cap);
+  while (buf != NULL && (rd_cnt = fread(buf + len, 1, cap - len, in)) > 0) {
+    len += rd_cnt;
+    if (len == cap) {
+      uint8_t *bigger = realloc(buf, cap *= 2);
+      if (bigger == NULL)
+        free(buf);
+      buf = bigger;
+    }
+  }
+  if (buf != NULL && ferror(in)) {
+    free(buf);
+    buf = NULL;
+    errno = EIO;
+  }
+  fclose(in);
+  *size = len;
+  return buf;
+}
+
+// Returns the big-endian 32-bit integer at p.
+uint32_t png_be32 (const uint8_t *p)
+{
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+      p[3];
+}
+
+/**
+ * Reverses the filter of every row of raw (see the PNG specification, section
+ *   9) in place. Returns false if a row has an unknown filter type.
+ */
+bool png_unfilter (uint8_t *raw, uint32_t width, uint32_t height,
+    unsigned int bpp)
+{
+  size_t stride = (size_t)width * bpp;
+  const uint8_t *prev = NULL; // Row above (NULL on the first row)
+  for (uint32_t y = 0; y < height; y++) {
+    uint8_t filter = raw[y * (stride + 1)];
+    uint8_t *row = raw + y * (stride + 1) + 1;
+    for (size_t i = 0; i < stride; i++) {
+      uint8_t a = i >= bpp ? row[i - bpp] : 0; // Left
+      uint8_t b = prev != NULL ? prev[i] : 0; // Up
+      uint8_t c = i >= bpp && prev != NULL ? prev[i - bpp] : 0; // Up left
+      switch (filter) {
+        case 0: break;
+        case 1: row[i] += a; break;
+        case 2: row[i] += b; break;
+        case 3: row[i] += (uint8_t)(((unsigned int)a + b) / 2); break;
+        case 4: row[i] += png_paeth(a, b, c); break;
+        default: return false;
+      }
+    }
+    prev = row;
+  }
+  return true;
+}
+
+// Returns whichever of a, b and c is closest to a + b - c.
+uint8_t png_paeth (uint8_t a, uint8_t b, uint8_t c)
+{
+  int p = (int)a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
@@ -0,0 +1,36 @@
+/**
+ * png_decode.h
+ *
+ * Contains prototypes for a minimal PNG decoder, used by the asset compiler
+ *   (see assetc.c) on the build host.
+ *
+ * Only what the interface's resources use is supported: 8-bit grayscale,
+ *   grayscale with alpha, RGB or RGBA, non-interlaced images. Every image is
+ *   decoded to 8-bit RGBA.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef PNG_DECODE_H
+#define PNG_DECODE_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint8_t, uint32_t
+
+// A decoded image:
+typedef struct png_image
+{
+  uint32_t width;
+  uint32_t height;
+  uint8_t *pixels; // width * height RGBA pixels, row by row (malloc'd)
+} png_image;
+
+/**
+ * Decodes the PNG file at path into img, whose pixels the caller frees.
+ *
+ * Returns true if successful; false with errno set otherwise (EINVAL if the
+ *   file is not a PNG, is corrupt or uses an unsupported format).
+ */
+bool png_decode (const char *path, png_image *img);
+
+#endif
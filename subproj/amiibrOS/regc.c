@@ -0,0 +1,470 @@
+/**
+ * regc.c
+ *
+ * The registry compiler: compiles a text registry into the binary form that
+ *   os_ctrl loads (see registry.h). It runs on the build host as the image is
+ *   built, so os_ctrl never parses text or resolves wildcards itself.
+ *
+ * The text form has one entry per line ('#' starts a comment):
+ *   <pattern> <app>
+ *
+ *   pattern  8 hex digits (either case) of a tag, any of which may be a '?'
+ *            wildcard. A trailing '*' stands for '?' in every remaining digit
+ *            ('01*' is '01??????'), and 'default' is the same as '*'.
+ *   app      The name of the app's directory in the app root. Letters,
+ *            digits, '_', '-' and '.' (but not leading).
+ *
+ * For example:
+ *   01000000  link        # Exactly this figure
+ *   0100??00  link        # Every variant of the character
+ *   01*       zelda       # Every other figure of the series
+ *   default   gallery     # Anything else
+ *
+ * No two entries may have the same pattern.
+ *
+ * Usage: regc <registry.txt> <registry.bin>
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, fopen, fwrite, getline
+#include <stdlib.h> // malloc, calloc, realloc, free, qsort
+#include <string.h> // strtok, strchr, strcmp, strdup, memcmp, memcpy
+#include <stdint.h> // uint8_t, uint16_t, uint32_t, uint64_t
+#include <stdbool.h>
+#include "registry.h"
+
+#define MEMO_BUCKETS 4096 // Buckets of each memo table (a power of 2)
+
+// A parsed entry:
+typedef struct reg_entry
+{
+  uint32_t value; // Tag digits (0 where wildcards are)
+  uint32_t mask; // 0xF for every exact digit, 0 for every wildcard
+  uint32_t app; // Index into app_names
+  unsigned long line;
+} reg_entry;
+
+// A memo table record, mapping a key at some trie depth to a node or app:
+typedef struct memo_rec
+{
+  struct memo_rec *next;
+  int depth;
+  uint32_t value;
+  size_t key_len;
+  uint8_t key[]; // key_len bytes
+} memo_rec;
+
+static const char *src_path; // For error messages
+static reg_entry *entries; // Sorted by precedence once parsed
+static size_t entry_cnt;
+static char **app_names;
+static size_t app_cnt;
+static size_t words; // uint64_t words per entry set (1 bit per entry)
+static uint64_t *matches; // Entry set of each (depth, nibble), see build
+static uint16_t *nodes; // Children of every node built; node 0 is empty
+static size_t node_cnt;
+static memo_rec *subset_memo[MEMO_BUCKETS]; // Entry sets already built
+static memo_rec *node_memo[MEMO_BUCKETS]; // Nodes by their children
+
+// --- Helper Function Prototypes ---
+bool parse_pattern (const char *str, uint32_t *value, uint32_t *mask);
+bool valid_app_name (const char *name);
+bool add_entry (uint32_t value, uint32_t mask, const char *app,
+    unsigned long line);
+bool parse_registry (FILE *in);
+int compare_entries (const void *a, const void *b);
+uint32_t memo_hash (int depth, const void *key, size_t key_len);
+memo_rec *memo_find (memo_rec **memo, int depth, const void *key,
+    size_t key_len);
+bool memo_add (memo_rec **memo, int depth, const void *key, size_t key_len,
+    uint32_t value);
+long build (int depth, const uint64_t *set);
+void put_le16 (uint8_t *p, uint16_t v);
+void put_le32 (uint8_t *p, uint32_t v);
+bool write_registry (FILE *out, uint32_t root);
+// --- ---
+
+int main (int argc, char **argv)
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <registry.txt> <registry.bin>\n", argv[0]);
+    return 1;
+  }
+  src_path = argv[1];
+
+  FILE *in = fopen(argv[1], "r");
+  if (in == NULL) {
+    perror("regc unable to open registry\nerror");
+    return 1;
+  }
+  bool parsed = parse_registry(in);
+  fclose(in);
+  if (!parsed)
+    return 1;
+
+  // The winner among several matching entries is simply the first of them:
+  qsort(entries, entry_cnt, sizeof(reg_entry), compare_entries);
+  for (size_t i = 1; i < entry_cnt; i++) {
+    if (entries[i].mask == entries[i - 1].mask &&
+        entries[i].value == entries[i - 1].value) {
+      fprintf(stderr, "regc: %s:%lu: same pattern as line %lu\n", src_path,
+          entries[i].line, entries[i - 1].line);
+      return 1;
+    }
+  }
+
+  // Set of the entries matching each nibble value at each depth:
+  words = entry_cnt / 64 + 1;
+  matches = calloc(REGISTRY_NIBBLES * REGISTRY_FANOUT * words,
+      sizeof(uint64_t));
+  nodes = calloc(REGISTRY_FANOUT, sizeof(uint16_t)); // The sentinel
+  uint64_t *all = calloc(words, sizeof(uint64_t));
+  if (matches == NULL || nodes == NULL || all == NULL) {
+    perror("regc out of memory\nerror");
+    return 1;
+  }
+  node_cnt = 1;
+  for (size_t i = 0; i < entry_cnt; i++) {
+    all[i / 64] |= 1ull << (i % 64);
+    for (int d = 0; d < REGISTRY_NIBBLES; d++) {
+      int shift = 4 * (REGISTRY_NIBBLES - 1 - d);
+      for (int v = 0; v < REGISTRY_FANOUT; v++) {
+        if ((entries[i].mask >> shift & 0xF) == 0 ||
+            (entries[i].value >> shift & 0xF) == (uint32_t)v)
+          matches[(d * REGISTRY_FANOUT + v) * words + i / 64] |=
+              1ull << (i % 64);
+      }
+    }
+  }
+
+  long root = build(0, all);
+  if (root == 0) { // No entries: the root must still be a node of its own
+    uint16_t *grown = realloc(nodes, 2 * REGISTRY_FANOUT * sizeof(uint16_t));
+    if (grown != NULL) {
+      nodes = grown;
+      memset(nodes + REGISTRY_FANOUT, 0, REGISTRY_FANOUT * sizeof(uint16_t));
+      root = node_cnt++;
+    }
+    else
+      root = -1;
+  }
+  if (root < 0) {
+    fprintf(stderr, "regc: out of memory or more than %d nodes\n",
+        REGISTRY_MAX_NODES);
+    return 1;
+  }
+
+  FILE *out = fopen(argv[2], "wb");
+  if (out == NULL || !write_registry(out, (uint32_t)root) || fclose(out)) {
+    perror("regc unable to write registry\nerror");
+    return 1;
+  }
+  printf("regc: %zu entries for %zu apps -> %zu nodes\n", entry_cnt, app_cnt,
+      node_cnt);
+  return 0;
+}
+
+/**
+ * Parses a pattern (see the top of this file) into its digits and a mask of
+ *   its exact digits. Returns false if it is malformed.
+ */
+bool parse_pattern (const char *str, uint32_t *value, uint32_t *mask)
+{
+  if (strcmp(str, "default") == 0)
+    str = "*";
+
+  *value = 0;
+  *mask = 0;
+  int digits = 0;
+  for (; *str != '\0' && digits < REGISTRY_NIBBLES; str++, digits++) {
+    char c = *str;
+    uint32_t v;
+    if (c == '*' && str[1] == '\0')
+      break;
+    if (c == '?') {
+      *value <<= 4;
+      *mask <<= 4;
+      continue;
+    }
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if (c >= 'A' && c <= 'F')
+      v = c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f')
+      v = c - 'a' + 10;
+    else
+      return false;
+    *value = *value << 4 | v;
+    *mask = *mask << 4 | 0xF;
+  }
+
+  if (*str == '*') { // The rest are wildcards
+    int left = REGISTRY_NIBBLES - digits;
+    *value = left < REGISTRY_NIBBLES ? *value << 4 * left : 0;
+    *mask = left < REGISTRY_NIBBLES ? *mask << 4 * left : 0;
+    return true;
+  }
+  return *str == '\0' && digits == REGISTRY_NIBBLES;
+}
+
+// Returns whether name is allowed as the name of an app's directory.
+bool valid_app_name (const char *name)
+{
+  if (name[0] == '\0' || name[0] == '.')
+    return false;
+  for (const char *c = name; *c != '\0'; c++) {
+    if (!((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+          (*c >= '0' && *c <= '9') || *c == '_' || *c == '-' || *c == '.'))
+      return false;
+  }
+  return true;
+}
+
+// Appends an entry, adding its app to app_names if it is new.
+bool add_entry (uint32_t value, uint32_t mask, const char *app,
+    unsigned long line)
+{
+  size_t a;
+  for (a = 0; a < app_cnt && strcmp(app_names[a], app) != 0; a++);
+  if (a == app_cnt) {
+    if (app_cnt == REGISTRY_MAX_APPS)
+      return false;
+    char **grown = realloc(app_names, (app_cnt + 1) * sizeof(char *));
+    if (grown == NULL)
+      return false;
+    app_names = grown;
+    if ( (app_names[app_cnt] = strdup(app)) == NULL)
+      return false;
+    app_cnt++;
+  }
+
+  reg_entry *grown = realloc(entries, (entry_cnt + 1) * sizeof(reg_entry));
+  if (grown == NULL)
+    return false;
+  entries = grown;
+  entries[entry_cnt].value = value;
+  entries[entry_cnt].mask = mask;
+  entries[entry_cnt].app = a;
+  entries[entry_cnt].line = line;
+  entry_cnt++;
+  return true;
+}
+
+// Parses every line of the text registry. Errors are printed.
+bool parse_registry (FILE *in)
+{
+  char *line = NULL;
+  size_t line_size = 0;
+  unsigned long line_no = 0;
+  bool ok = true;
+
+  while (getline(&line, &line_size, in) != -1) {
+    line_no++;
+    char *comment = strchr(line, '#');
+    if (comment != NULL)
+      *comment = '\0';
+
+    char *pattern = strtok(line, " \t\r\n");
+    char *app = strtok(NULL, " \t\r\n");
+    if (pattern == NULL)
+      continue; // Blank
+
+    uint32_t value, mask;
+    if (app == NULL || strtok(NULL, " \t\r\n") != NULL) {
+      fprintf(stderr, "regc: %s:%lu: expected '<pattern> <app>'\n", src_path,
+          line_no);
+      ok = false;
+    }
+    else if (!parse_pattern(pattern, &value, &mask)) {
+      fprintf(stderr, "regc: %s:%lu: bad pattern '%s'\n", src_path, line_no,
+          pattern);
+      ok = false;
+    }
+    else if (!valid_app_name(app)) {
+      fprintf(stderr, "regc: %s:%lu: bad app name '%s'\n", src_path, line_no,
+          app);
+      ok = false;
+    }
+    else if (!add_entry(value & mask, mask, app, line_no)) {
+      fprintf(stderr, "regc: out of memory or more than %d apps\n",
+          REGISTRY_MAX_APPS);
+      ok = false;
+      break;
+    }
+  }
+  free(line);
+  return ok;
+}
+
+/**
+ * Orders entries by precedence: the entry whose first wildcard comes later
+ *   (the larger mask) goes first. Entries with the same mask never match the
+ *   same tag, and are ordered by value to keep the output reproducible.
+ */
+int compare_entries (const void *a, const void *b)
+{
+  const reg_entry *x = a;
+  const reg_entry *y = b;
+  if (x->mask != y->mask)
+    return x->mask > y->mask ? -1 : 1;
+  return (x->value > y->value) - (x->value < y->value);
+}
+
+// FNV-1a over the depth and key.
+uint32_t memo_hash (int depth, const void *key, size_t key_len)
+{
+  uint32_t h = 2166136261u ^ (uint32_t)depth;
+  const uint8_t *p = key;
+  for (size_t i = 0; i < key_len; i++)
+    h = (h ^ p[i]) * 16777619u;
+  return h;
+}
+
+// Returns the record of key at depth in memo, or NULL.
+memo_rec *memo_find (memo_rec **memo, int depth, const void *key,
+    size_t key_len)
+{
+  memo_rec *rec = memo[memo_hash(depth, key, key_len) & (MEMO_BUCKETS - 1)];
+  for (; rec != NULL; rec = rec->next) {
+    if (rec->depth == depth && rec->key_len == key_len &&
+        memcmp(rec->key, key, key_len) == 0)
+      return rec;
+  }
+  return NULL;
+}
+
+// Records value for key at depth in memo.
+bool memo_add (memo_rec **memo, int depth, const void *key, size_t key_len,
+    uint32_t value)
+{
+  memo_rec *rec = malloc(sizeof(memo_rec) + key_len);
+  if (rec == NULL)
+    return false;
+  uint32_t bucket = memo_hash(depth, key, key_len) & (MEMO_BUCKETS - 1);
+  rec->next = memo[bucket];
+  rec->depth = depth;
+  rec->value = value;
+  rec->key_len = key_len;
+  memcpy(rec->key, key, key_len);
+  memo[bucket] = rec;
+  return true;
+}
+
+/**
+ * Builds the subtree for tags whose first depth digits are matched by exactly
+ *   the entries in set, and returns it as a child: the index of its node, or
+ *   at depth REGISTRY_NIBBLES the winning app + 1. 0 if set is empty, -1 on
+ *   errors.
+ *
+ * Wildcards need no special handling: an entry with a wildcard digit is in
+ *   the set of every nibble value (see main). Subtrees are built once per
+ *   distinct set, and nodes with the same children are shared.
+ */
+long build (int depth, const uint64_t *set)
+{
+  size_t first;
+  for (first = 0; first < entry_cnt; first++) {
+    if (set[first / 64] >> (first % 64) & 1)
+      break;
+  }
+  if (first == entry_cnt)
+    return 0; // Nothing matches
+  if (depth == REGISTRY_NIBBLES)
+    return entries[first].app + 1; // The one with the highest precedence
+
+  size_t set_size = words * sizeof(uint64_t);
+  memo_rec *known = memo_find(subset_memo, depth, set, set_size);
+  if (known != NULL)
+    return known->value;
+
+  uint16_t children[REGISTRY_FANOUT];
+  uint64_t *sub = malloc(set_size);
+  if (sub == NULL)
+    return -1;
+  for (int v = 0; v < REGISTRY_FANOUT; v++) {
+    const uint64_t *match = &matches[(depth * REGISTRY_FANOUT + v) * words];
+    for (size_t w = 0; w < words; w++)
+      sub[w] = set[w] & match[w];
+    long child = build(depth + 1, sub);
+    if (child < 0) {
+      free(sub);
+      return -1;
+    }
+    children[v] = (uint16_t)child;
+  }
+  free(sub);
+
+  memo_rec *same = memo_find(node_memo, depth, children, sizeof(children));
+  long node;
+  if (same != NULL)
+    node = same->value;
+  else {
+    if (node_cnt == REGISTRY_MAX_NODES)
+      return -1;
+    uint16_t *grown = realloc(nodes,
+        (node_cnt + 1) * REGISTRY_FANOUT * sizeof(uint16_t));
+    if (grown == NULL)
+      return -1;
+    nodes = grown;
+    memcpy(nodes + node_cnt * REGISTRY_FANOUT, children, sizeof(children));
+    node = node_cnt++;
+    if (!memo_add(node_memo, depth, children, sizeof(children), node))
+      return -1;
+  }
+  if (!memo_add(subset_memo, depth, set, set_size, node))
+    return -1;
+  return node;
+}
+
+void put_le16 (uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void put_le32 (uint8_t *p, uint32_t v)
+{
+  for (int i = 0; i < 4; i++, v >>= 8)
+    p[i] = v & 0xFF;
+}
+
+// Writes the binary registry (see registry.h) with the given root node.
+bool write_registry (FILE *out, uint32_t root)
+{
+  uint32_t strings_size = 0;
+  for (size_t a = 0; a < app_cnt; a++)
+    strings_size += strlen(app_names[a]) + 1;
+
+  uint8_t header[REGISTRY_HEADER_SIZE];
+  memcpy(header, REGISTRY_MAGIC, 4);
+  put_le16(header + 4, REGISTRY_VERSION);
+  put_le16(header + 6, 0);
+  put_le32(header + 8, node_cnt);
+  put_le32(header + 12, root);
+  put_le32(header + 16, app_cnt);
+  put_le32(header + 20, strings_size);
+  if (fwrite(header, sizeof(header), 1, out) != 1)
+    return false;
+
+  for (size_t i = 0; i < node_cnt * REGISTRY_FANOUT; i++) {
+    uint8_t child[2];
+    put_le16(child, nodes[i]);
+    if (fwrite(child, sizeof(child), 1, out) != 1)
+      return false;
+  }
+
+  uint32_t offset = 0;
+  for (size_t a = 0; a < app_cnt; a++) {
+    uint8_t le[4];
+    put_le32(le, offset);
+    if (fwrite(le, sizeof(le), 1, out) != 1)
+      return false;
+    offset += strlen(app_names[a]) + 1;
+  }
+  for (size_t a = 0; a < app_cnt; a++) {
+    if (fwrite(app_names[a], strlen(app_names[a]) + 1, 1, out) != 1)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,195 @@
+/**
+ * registry.c
+ *
+ * Contains implementation of registry.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // FILE, fopen, fread, fclose
+#include <stdlib.h> // malloc, calloc, realloc, free
+#include <string.h> // memcmp, memcpy, memset, strcmp
+#include <errno.h> // errno
+#include "registry.h"
+
+// --- Helper Function Prototypes ---
+uint16_t reg_le16 (const uint8_t *p);
+uint32_t reg_le32 (const uint8_t *p);
+bool read_registry_file (const char *path, uint8_t **data, size_t *size);
+bool check_nodes (const registry *reg);
+// --- ---
+
+bool registry_load (registry *reg, const char *path)
+{
+  memset(reg, 0, sizeof(registry));
+
+  uint8_t *data;
+  size_t size;
+  if (!read_registry_file(path, &data, &size))
+    return false;
+
+  if (size < REGISTRY_HEADER_SIZE || memcmp(data, REGISTRY_MAGIC, 4) != 0 ||
+      reg_le16(data + 4) != REGISTRY_VERSION)
+    goto invalid;
+  reg->node_cnt = reg_le32(data + 8);
+  reg->root = reg_le32(data + 12);
+  reg->app_cnt = reg_le32(data + 16);
+  uint32_t strings_size = reg_le32(data + 20);
+  if (reg->node_cnt == 0 || reg->node_cnt > REGISTRY_MAX_NODES ||
+      reg->root >= reg->node_cnt || reg->app_cnt > REGISTRY_MAX_APPS ||
+      size != REGISTRY_HEADER_SIZE +
+              (size_t)reg->node_cnt * REGISTRY_FANOUT * 2 +
+              (size_t)reg->app_cnt * 4 + strings_size ||
+      (strings_size > 0 && data[size - 1] != '\0'))
+    goto invalid;
+
+  const uint8_t *p = data + REGISTRY_HEADER_SIZE;
+  size_t child_cnt = (size_t)reg->node_cnt * REGISTRY_FANOUT;
+  reg->nodes = malloc(child_cnt * sizeof(uint16_t));
+  reg->apps = calloc(reg->app_cnt > 0 ? reg->app_cnt : 1, sizeof(char *));
+  reg->strings = malloc(strings_size > 0 ? strings_size : 1);
+  if (reg->nodes == NULL || reg->apps == NULL || reg->strings == NULL) {
+    free(data);
+    registry_free(reg);
+    errno = ENOMEM;
+    return false;
+  }
+
+  for (size_t i = 0; i < child_cnt; i++, p += 2)
+    reg->nodes[i] = reg_le16(p);
+  const uint8_t *offsets = p;
+  memcpy(reg->strings, offsets + (size_t)reg->app_cnt * 4, strings_size);
+  for (uint32_t a = 0; a < reg->app_cnt; a++) {
+    uint32_t offset = reg_le32(offsets + (size_t)a * 4);
+    if (offset >= strings_size)
+      goto invalid;
+    reg->apps[a] = reg->strings + offset;
+  }
+  if (!check_nodes(reg))
+    goto invalid;
+
+  reg->file_size = size;
+  free(data);
+  return true;
+
+invalid:
+  free(data);
+  registry_free(reg);
+  errno = EINVAL;
+  return false;
+}
+
+int registry_lookup (const registry *reg, uint32_t tag)
+{
+  uint32_t n = reg->root;
+  for (int shift = 4 * (REGISTRY_NIBBLES - 1); shift >= 0; shift -= 4) {
+    n = reg->nodes[n * REGISTRY_FANOUT + (tag >> shift & 0xF)];
+    if (n == 0)
+      return -1;
+  }
+  return (int)n - 1; // The last child is an app + 1
+}
+
+int registry_find_app (const registry *reg, const char *name)
+{
+  for (uint32_t a = 0; a < reg->app_cnt; a++) {
+    if (strcmp(reg->apps[a], name) == 0)
+      return (int)a;
+  }
+  return -1;
+}
+
+void registry_free (registry *reg)
+{
+  free(reg->nodes);
+  free(reg->apps);
+  free(reg->strings);
+  memset(reg, 0, sizeof(registry));
+}
+
+uint16_t reg_le16 (const uint8_t *p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+uint32_t reg_le32 (const uint8_t *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+/**
+ * Reads the whole file at path into a newly allocated buffer. Returns false
+ *   with errno set on error.
+ */
+bool read_registry_file (const char *path, uint8_t **data, size_t *size)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return false;
+
+  size_t cap = 4096;
+  *size = 0;
+  *data = malloc(cap);
+  while (*data != NULL) {
+    *size += fread(*data + *size, 1, cap - *size, file);
+    if (*size < cap)
+      break;
+    uint8_t *grown = realloc(*data, cap *= 2);
+    if (grown == NULL)
+      free(*data);
+    *data = grown;
+  }
+
+  bool ok = *data != NULL && !ferror(file);
+  int preserve_errno = *data == NULL ? ENOMEM : EIO;
+  fclose(file);
+  if (!ok) {
+    free(*data);
+    errno = preserve_errno;
+  }
+  return ok;
+}
+
+/**
+ * Walks the trie from its root, checking that every child is in range for its
+ *   depth and that no node is reached at two different depths.
+ */
+bool check_nodes (const registry *reg)
+{
+  uint8_t *depth = calloc(reg->node_cnt, 1); // Depth + 1 (0 if not reached)
+  uint32_t *queue = malloc(reg->node_cnt * sizeof(uint32_t));
+  bool ok = depth != NULL && queue != NULL;
+  size_t head = 0, tail = 0;
+
+  if (ok) {
+    depth[reg->root] = 1;
+    queue[tail++] = reg->root;
+  }
+  while (ok && head < tail) {
+    uint32_t n = queue[head++];
+    if (n == 0) {
+      ok = false; // The sentinel must not be reached
+      break;
+    }
+    const uint16_t *children = reg->nodes + (size_t)n * REGISTRY_FANOUT;
+    for (int v = 0; v < REGISTRY_FANOUT && ok; v++) {
+      uint32_t c = children[v];
+      if (c == 0)
+        continue;
+      if (depth[n] == REGISTRY_NIBBLES)
+        ok = c <= reg->app_cnt;
+      else if (c >= reg->node_cnt ||
+          (depth[c] != 0 && depth[c] != depth[n] + 1))
+        ok = false;
+      else if (depth[c] == 0) {
+        depth[c] = depth[n] + 1;
+        queue[tail++] = c;
+      }
+    }
+  }
+
+  free(depth);
+  free(queue);
+  return ok;
+}
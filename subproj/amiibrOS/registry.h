@@ -0,0 +1,94 @@
+/**
+ * registry.h
+ *
+ * Contains prototypes for os_ctrl's tag registry: a table mapping tag
+ *   patterns to apps, so that one app can serve every variant of a character
+ *   or a whole game series without an app directory per tag.
+ *
+ * The registry is written as text (registry.txt, one '<pattern> <app>' line
+ *   per entry) and compiled to a binary file by regc at image build time (see
+ *   regc.c for the text format). A pattern is a tag of 8 hex digits in which
+ *   any digit may be a '?' wildcard; 'default' matches every tag. The app is
+ *   the name of a directory in the app root, holding <app>.sh (and optionally
+ *   <app>.conf) just like a tag's app directory does.
+ *
+ * When several patterns match a tag, the one whose first wildcard comes
+ *   latest wins: an exact tag beats '0100??00', which beats '01??????',
+ *   which beats 'default'.
+ *
+ * The binary form is a trie over the tag's 8 hex digits (nibbles, most
+ *   significant first) in which wildcards are already resolved: every node
+ *   has one child per nibble value, and the nodes after a wildcard are merged
+ *   into the more specific branches at compile time. A lookup is therefore
+ *   always exactly 8 array reads, however many entries there are. Identical
+ *   subtrees are shared, which keeps the file small. All integers are
+ *   little-endian:
+ *
+ *   offset  size  field
+ *        0     4  magic: 'A' 'R' 'E' 'G'
+ *        4     2  version: REGISTRY_VERSION
+ *        6     2  reserved, 0
+ *        8     4  number of nodes (node 0 is an empty sentinel)
+ *       12     4  root node
+ *       16     4  number of apps
+ *       20     4  size of the string table in bytes
+ *       24     -  nodes: 16 uint16 children each. In the nodes of the first 7
+ *                 nibbles, a child is the index of the next node; in those of
+ *                 the last nibble, it is the index of an app + 1. 0 means no
+ *                 match.
+ *        -     -  apps: one uint32 offset of each app's name in the strings
+ *        -     -  strings: NUL-terminated app names
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint16_t, uint32_t
+
+#define REGISTRY_MAGIC "AREG"
+#define REGISTRY_VERSION 1
+#define REGISTRY_HEADER_SIZE 24
+#define REGISTRY_NIBBLES 8 // Trie depth: hex digits in a tag
+#define REGISTRY_FANOUT 16 // Children per node
+#define REGISTRY_MAX_NODES 65536 // Children are uint16
+#define REGISTRY_MAX_APPS 65535
+
+// A loaded registry:
+typedef struct registry
+{
+  uint16_t *nodes; // node_cnt * REGISTRY_FANOUT children
+  uint32_t node_cnt;
+  uint32_t root;
+  uint32_t app_cnt;
+  char **apps; // Name of each app (pointing into strings)
+  char *strings;
+  size_t file_size; // Size of the binary form
+} registry;
+
+/**
+ * Loads the compiled registry at path into reg. The file is checked fully up
+ *   front (every child reachable from the root is in range), so that lookups
+ *   need no checks of their own.
+ *
+ * Returns true if successful; false with errno set otherwise (EINVAL if the
+ *   file is not a valid registry).
+ */
+bool registry_load (registry *reg, const char *path);
+
+/**
+ * Returns the index of the app the given tag maps to, or -1 if no pattern
+ *   matches it. Never performs any system calls.
+ */
+int registry_lookup (const registry *reg, uint32_t tag);
+
+// Returns the index of the app of the given name, or -1 if there is none.
+int registry_find_app (const registry *reg, const char *name);
+
+// Releases everything held by reg (which may also be zeroed or freed already).
+void registry_free (registry *reg);
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * scan_proto.c
+ *
+ * Contains implementation of scan_proto.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <string.h> // memcpy, memmove, memchr
+#include <errno.h> // errno
+#include <unistd.h> // read
+#include "scan_proto.h"
+
+// --- Helper Function Prototypes ---
+uint16_t get_le16 (const uint8_t *p);
+uint64_t get_le64 (const uint8_t *p);
+void put_le16 (uint8_t *p, uint16_t v);
+void put_le64 (uint8_t *p, uint64_t v);
+bool header_valid (const uint8_t *header);
+bool decode_payload (uint8_t type, const uint8_t *payload, uint16_t len,
+    scan_event *ev);
+void consume (scan_reader *reader, size_t cnt);
+// --- ---
+
+void scan_reader_init (scan_reader *reader)
+{
+  memset(reader, 0, sizeof(scan_reader));
+}
+
+long scan_reader_fill (scan_reader *reader, int fd)
+{
+  ssize_t rd_cnt;
+  do {
+    rd_cnt = read(fd, reader->buf + reader->len,
+        SCAN_READER_BUF_SIZE - reader->len);
+  } while (rd_cnt == -1 && errno == EINTR);
+
+  if (rd_cnt > 0)
+    reader->len += rd_cnt;
+  return rd_cnt;
+}
+
+bool scan_reader_next (scan_reader *reader, scan_event *ev)
+{
+  while (reader->len >= SCAN_PROTO_HEADER_SIZE) {
+    const uint8_t *header = reader->buf;
+
+    if (!header_valid(header)) {
+      // Out of sync: drop bytes up to the next possible start of a frame.
+      const uint8_t *next = memchr(reader->buf + 1, SCAN_PROTO_MAGIC0,
+          reader->len - 1);
+      size_t drop = next != NULL ? (size_t)(next - reader->buf) : reader->len;
+      reader->resync_cnt += drop;
+      consume(reader, drop);
+      continue;
+    }
+
+    uint16_t len = get_le16(header + 4);
+    if (reader->len < SCAN_PROTO_HEADER_SIZE + (size_t)len)
+      return false; // Wait for the rest of the frame
+
+    bool known = decode_payload(header[3], header + SCAN_PROTO_HEADER_SIZE,
+        len, ev);
+    if (known) {
+      ev->type = header[3];
+      ev->ts_ns = get_le64(header + 8);
+      reader->frame_cnt++;
+    }
+    else
+      reader->skip_cnt++;
+    consume(reader, SCAN_PROTO_HEADER_SIZE + len);
+    if (known)
+      return true;
+  }
+  return false;
+}
+
+size_t scan_event_encode (const scan_event *ev, uint8_t *buf)
+{
+  uint8_t *payload = buf + SCAN_PROTO_HEADER_SIZE;
+  uint16_t len;
+  switch (ev->type) {
+    case SCAN_EV_TAG:
+      payload[0] = ev->uid_len;
+      memcpy(payload + 1, ev->uid, SCAN_UID_MAX);
+      memcpy(payload + 1 + SCAN_UID_MAX, ev->id, SCAN_ID_SIZE);
+      len = SCAN_TAG_LEN;
+      break;
+    case SCAN_EV_REMOVED:
+      len = 0;
+      break;
+    case SCAN_EV_ERROR:
+      payload[0] = ev->error;
+      len = 1;
+      break;
+    default:
+      return 0;
+  }
+
+  buf[0] = SCAN_PROTO_MAGIC0;
+  buf[1] = SCAN_PROTO_MAGIC1;
+  buf[2] = SCAN_PROTO_VERSION;
+  buf[3] = ev->type;
+  put_le16(buf + 4, len);
+  put_le16(buf + 6, 0);
+  put_le64(buf + 8, ev->ts_ns);
+  return SCAN_PROTO_HEADER_SIZE + len;
+}
+
+uint16_t get_le16 (const uint8_t *p)
+{
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+uint64_t get_le64 (const uint8_t *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--)
+    v = v << 8 | p[i];
+  return v;
+}
+
+void put_le16 (uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = v >> 8;
+}
+
+void put_le64 (uint8_t *p, uint64_t v)
+{
+  for (int i = 0; i < 8; i++, v >>= 8)
+    p[i] = v & 0xFF;
+}
+
+// Returns whether the given 16 bytes could be a frame header.
+bool header_valid (const uint8_t *header)
+{
+  return header[0] == SCAN_PROTO_MAGIC0 && header[1] == SCAN_PROTO_MAGIC1 &&
+      header[2] == SCAN_PROTO_VERSION &&
+      get_le16(header + 4) <= SCAN_PROTO_MAX_LEN;
+}
+
+/**
+ * Fills in the type specific fields of ev from the given payload. Returns
+ *   false if the type is unknown or the payload does not fit it.
+ */
+bool decode_payload (uint8_t type, const uint8_t *payload, uint16_t len,
+    scan_event *ev)
+{
+  switch (type) {
+    case SCAN_EV_TAG:
+      if (len < SCAN_TAG_LEN || payload[0] > SCAN_UID_MAX)
+        return false;
+      ev->uid_len = payload[0];
+      memcpy(ev->uid, payload + 1, SCAN_UID_MAX);
+      memcpy(ev->id, payload + 1 + SCAN_UID_MAX, SCAN_ID_SIZE);
+      return true;
+    case SCAN_EV_REMOVED:
+      return true;
+    case SCAN_EV_ERROR:
+      if (len < 1)
+        return false;
+      ev->error = payload[0];
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Drops the first cnt bytes of the reader's buffer.
+void consume (scan_reader *reader, size_t cnt)
+{
+  reader->len -= cnt;
+  memmove(reader->buf, reader->buf + cnt, reader->len);
+}
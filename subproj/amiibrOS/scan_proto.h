@@ -0,0 +1,117 @@
+/**
+ * scan_proto.h
+ *
+ * Contains the framing of the scanner pipe protocol (scanner -> os_ctrl) and
+ *   prototypes for os_ctrl's side of it.
+ *
+ * Every event is sent as one frame: a fixed 16-byte header followed by
+ *   'length' bytes of payload. All integers are little-endian.
+ *
+ *   offset  size  field
+ *        0     2  magic: 'A' 'S'
+ *        2     1  version: SCAN_PROTO_VERSION
+ *        3     1  type: SCAN_EV_*
+ *        4     2  length of the payload in bytes (at most SCAN_PROTO_MAX_LEN)
+ *        6     2  reserved, 0
+ *        8     8  CLOCK_MONOTONIC time (ns) at which the scanner saw the event
+ *       16     -  payload
+ *
+ * Payloads by type:
+ *   SCAN_EV_TAG      uint8 uid_len, uint8 uid[SCAN_UID_MAX], uint8 id[8]:
+ *                    an amiibo was read. uid holds the tag's NFC UID (4, 7 or
+ *                    10 bytes used) and id the full 8-byte amiibo ID, whose
+ *                    first 4 bytes (the character ID) select the app.
+ *   SCAN_EV_REMOVED  (empty): the tag last read has left the scanner.
+ *   SCAN_EV_ERROR    uint8 code (SCAN_ERR_*): a tag could not be identified.
+ *
+ * Frames of unknown type are skipped, so new types can be added without
+ *   breaking older readers. Bytes that do not start a valid header (a bad
+ *   magic, version or length) are dropped one at a time until the stream is
+ *   back in sync, so a corrupted byte costs at most the frame it belongs to.
+ *
+ * amiibo_scan.py (and the fake scanner in test/) implement the writing side.
+ *   scan_event_encode does the same in C (for test/loadgen.c).
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef SCAN_PROTO_H
+#define SCAN_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t, uint64_t
+
+#define SCAN_PROTO_MAGIC0 'A'
+#define SCAN_PROTO_MAGIC1 'S'
+#define SCAN_PROTO_VERSION 1
+#define SCAN_PROTO_HEADER_SIZE 16
+#define SCAN_PROTO_MAX_LEN 64 // Largest payload we accept
+#define SCAN_PROTO_FRAME_MAX (SCAN_PROTO_HEADER_SIZE + SCAN_PROTO_MAX_LEN)
+
+// Frame types:
+#define SCAN_EV_TAG 1
+#define SCAN_EV_REMOVED 2
+#define SCAN_EV_ERROR 3
+
+// SCAN_EV_ERROR codes:
+#define SCAN_ERR_UNKNOWN_TAG 1 // More than one tag, or not an NTAG at all
+
+#define SCAN_UID_MAX 10 // Longest NFC UID
+#define SCAN_ID_SIZE 8 // Size of an amiibo ID
+#define SCAN_TAG_LEN (1 + SCAN_UID_MAX + SCAN_ID_SIZE) // SCAN_EV_TAG payload
+
+// Size of the buffer os_ctrl reads the pipe into. One read per wakeup takes
+//   everything that is pending, up to this many bytes:
+#define SCAN_READER_BUF_SIZE 4096
+
+// A decoded event:
+typedef struct scan_event
+{
+  uint8_t type; // SCAN_EV_*
+  uint64_t ts_ns; // Scanner's CLOCK_MONOTONIC time of the event
+  uint8_t uid_len; // SCAN_EV_TAG only
+  uint8_t uid[SCAN_UID_MAX]; // SCAN_EV_TAG only
+  uint8_t id[SCAN_ID_SIZE]; // SCAN_EV_TAG only
+  uint8_t error; // SCAN_EV_ERROR only
+} scan_event;
+
+// Reassembles frames from the pipe across reads:
+typedef struct scan_reader
+{
+  uint8_t buf[SCAN_READER_BUF_SIZE];
+  size_t len; // Bytes of buf not yet decoded
+  unsigned long frame_cnt; // Frames decoded
+  unsigned long skip_cnt; // Frames of unknown type skipped
+  unsigned long resync_cnt; // Bytes dropped to get back in sync
+} scan_reader;
+
+// Prepares reader for a new stream.
+void scan_reader_init (scan_reader *reader);
+
+/**
+ * Performs a single read of everything pending on fd (up to the free space in
+ *   the buffer).
+ *
+ * Returns the number of bytes read: 0 at EOF, or -1 with errno set (EAGAIN if
+ *   nothing was pending on a non-blocking fd).
+ */
+long scan_reader_fill (scan_reader *reader, int fd);
+
+/**
+ * Decodes the next complete event buffered in reader into ev.
+ *
+ * Returns true if an event was decoded; false once no complete frame is left
+ *   (the rest is kept for the next scan_reader_fill).
+ */
+bool scan_reader_next (scan_reader *reader, scan_event *ev);
+
+/**
+ * Encodes ev (of a known type) as a frame into buf, which must hold at least
+ *   SCAN_PROTO_FRAME_MAX bytes.
+ *
+ * Returns the size of the frame; 0 if the type of ev is unknown.
+ */
+size_t scan_event_encode (const scan_event *ev, uint8_t *buf);
+
+#endif
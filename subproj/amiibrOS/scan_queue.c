@@ -0,0 +1,68 @@
+/**
+ * scan_queue.c
+ *
+ * Contains implementation of scan_queue.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <string.h> // memset
+#include "scan_queue.h"
+
+void scan_queue_init (scan_queue *queue, unsigned int debounce_ms)
+{
+  memset(queue, 0, sizeof(scan_queue));
+  queue->debounce_ns = (uint64_t)debounce_ms * 1000000;
+}
+
+bool scan_queue_push (scan_queue *queue, uint32_t tag, uint64_t ts_ns)
+{
+  queue->push_cnt++;
+
+  // The window starts at the accepted scan, so a tag held on the scanner can
+  //   not keep itself out forever:
+  if (queue->have_last && tag == queue->last_tag &&
+      ts_ns - queue->last_ns < queue->debounce_ns) {
+    queue->debounce_cnt++;
+    return false;
+  }
+
+  if (queue->pending)
+    queue->supersede_cnt++;
+  queue->pending = true;
+  queue->tag = tag;
+  queue->ts_ns = ts_ns;
+  queue->have_last = true;
+  queue->last_tag = tag;
+  queue->last_ns = ts_ns;
+  return true;
+}
+
+bool scan_queue_pending (const scan_queue *queue)
+{
+  return queue->pending;
+}
+
+bool scan_queue_take (scan_queue *queue, uint32_t *tag, uint64_t *ts_ns)
+{
+  if (!queue->pending)
+    return false;
+
+  queue->pending = false;
+  *tag = queue->tag;
+  *ts_ns = queue->ts_ns;
+  return true;
+}
+
+void scan_queue_cancelled (scan_queue *queue)
+{
+  queue->supersede_cnt++;
+}
+
+bool scan_queue_supersedes (scan_queue *queue, bool (*has_app)(uint32_t tag))
+{
+  if (!queue->pending || !has_app(queue->tag))
+    return false;
+  scan_queue_cancelled(queue);
+  return true;
+}
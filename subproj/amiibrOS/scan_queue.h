@@ -0,0 +1,72 @@
+/**
+ * scan_queue.h
+ *
+ * Contains prototypes for os_ctrl's coalescing queue of scanned tags.
+ *
+ * Scans can arrive faster than apps can be launched (the UI's animations block
+ *   os_ctrl for a while, and the scanner keeps writing in the meantime).
+ *   Launching every one of them in turn would start and kill a cascade of
+ *   apps, so the queue only ever holds a single tag: the latest one.
+ *   * Supersede: a tag pushed while another is still waiting replaces it.
+ *   * Debounce: a tag equal to the last one accepted, seen within the debounce
+ *     window of it (by the scanner's timestamps), is dropped.
+ *
+ * os_ctrl also checks the queue before starting the process of a launch it
+ *   already began (see scan_queue_pending), so that a newer tag cancels any
+ *   launch that has not exec'd yet.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef SCAN_QUEUE_H
+#define SCAN_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t, uint64_t
+
+typedef struct scan_queue
+{
+  uint64_t debounce_ns; // Window in which a repeated tag is dropped
+  bool pending; // Whether tag is waiting to be taken
+  uint32_t tag; // Tag waiting to be launched
+  uint64_t ts_ns; // Scanner's timestamp of tag
+  bool have_last; // Whether last_tag is set
+  uint32_t last_tag; // Last tag accepted
+  uint64_t last_ns; // Scanner's timestamp of last_tag
+  unsigned long push_cnt; // Tags pushed
+  unsigned long debounce_cnt; // Tags dropped as duplicates
+  unsigned long supersede_cnt; // Tags replaced by a newer one before launch
+} scan_queue;
+
+// Prepares an empty queue dropping duplicates within debounce_ms.
+void scan_queue_init (scan_queue *queue, unsigned int debounce_ms);
+
+/**
+ * Pushes the given tag, scanned at ts_ns (CLOCK_MONOTONIC), replacing any tag
+ *   still waiting. Returns false if the tag was dropped as a duplicate.
+ */
+bool scan_queue_push (scan_queue *queue, uint32_t tag, uint64_t ts_ns);
+
+// Returns whether a tag is waiting to be taken.
+bool scan_queue_pending (const scan_queue *queue);
+
+/**
+ * Takes the waiting tag and its timestamp. Returns false if there is none.
+ */
+bool scan_queue_take (scan_queue *queue, uint32_t *tag, uint64_t *ts_ns);
+
+/**
+ * Counts the launch of the taken tag as superseded (it was cancelled in favor
+ *   of a newer tag before its app was started).
+ */
+void scan_queue_cancelled (scan_queue *queue);
+
+/**
+ * Decides whether the launch of the taken tag, about to start its app, is
+ *   cancelled in favor of a newer tag waiting: only if has_app says that tag
+ *   has an app to launch instead. If so, counts the launch as superseded and
+ *   returns true; the newer tag stays waiting, to be taken next.
+ */
+bool scan_queue_supersedes (scan_queue *queue, bool (*has_app)(uint32_t tag));
+
+#endif
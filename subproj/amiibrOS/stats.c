@@ -0,0 +1,247 @@
+/**
+ * stats.c
+ *
+ * Contains implementation of stats.h
+ *
+ * Histograms record microseconds in log-linear buckets: each power of two is
+ *   split into HIST_SUB_CNT equal buckets, so that any reported percentile is
+ *   within 1/HIST_SUB_CNT (12.5%) of the true value, from 1 us up to over an
+ *   hour, in a fixed amount of memory.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <string.h> // memset
+#include <time.h> // clock_gettime
+#include "stats.h"
+
+#define HIST_SUB_BITS 3
+#define HIST_SUB_CNT (1 << HIST_SUB_BITS)
+// Enough buckets for every 32-bit value:
+#define HIST_BUCKET_CNT ((32 - HIST_SUB_BITS + 1) * HIST_SUB_CNT)
+
+typedef struct histogram
+{
+  uint32_t buckets[HIST_BUCKET_CNT];
+  uint64_t count;
+  uint64_t sum; // In us
+  uint32_t min, max; // In us
+} histogram;
+
+// A stage is the time between two marks:
+typedef struct stage
+{
+  const char *name;
+  stats_point from;
+  stats_point to;
+} stage;
+
+static const stage stages[] = {
+  {"scan", STATS_SCAN, STATS_READ}, // Scanner to os_ctrl over the pipe
+  {"lookup", STATS_READ, STATS_LOOKUP},
+  {"anim_wait", STATS_LOOKUP, STATS_ANIM_START}, // Until the UI draws it
+  {"anim", STATS_ANIM_START, STATS_ANIM_END},
+  {"stop_ui", STATS_ANIM_END, STATS_UI_STOPPED}, // Fade out and join
+  {"stop_app", STATS_LOOKUP, STATS_APP_STOPPED}, // Switching from an app
+  {"resume", STATS_READ, STATS_RESUMED}, // Whole launch of a frozen app
+  {"fork", STATS_SPAWN, STATS_SPAWNED}, // posix_spawn also covers the exec
+  {"exec", STATS_SPAWNED, STATS_APP_STARTED}, // Dynamic linking and such
+  {"load", STATS_APP_STARTED, STATS_APP_LOADED}, // Overlaps the animations
+  {"handoff_wait", STATS_APP_LOADED, STATS_HANDOFF}, // Loaded app kept waiting
+  {"first_frame", STATS_APP_STARTED, STATS_FIRST_FRAME},
+  {"total", STATS_READ, STATS_FIRST_FRAME},
+  {"end_to_end", STATS_SCAN, STATS_FIRST_FRAME},
+};
+#define STAGE_CNT (sizeof(stages) / sizeof(stages[0]))
+
+// Teardown times of one app:
+typedef struct teardown
+{
+  uint32_t tag;
+  uint64_t kill_cnt; // Teardowns that ended in SIGKILL
+  histogram hist;
+} teardown;
+
+static histogram hists[STAGE_CNT];
+static teardown teardowns[STATS_TEARDOWN_APP_MAX];
+static size_t teardown_cnt = 0; // Apps in teardowns
+static uint64_t marks[STATS_POINT_CNT]; // 0 means not (yet) marked
+static bool in_launch = false;
+static uint64_t launch_cnt = 0;
+static uint64_t first_frame_cnt = 0; // Launches that reached a first frame
+
+// --- Helper Function Prototypes ---
+unsigned int bucket_of (uint32_t us);
+uint32_t bucket_low (unsigned int bucket);
+void hist_add (histogram *h, uint32_t us);
+uint32_t hist_percentile (const histogram *h, double p);
+uint32_t ns_to_us (uint64_t ns);
+void hist_print (FILE *out, const char *name, const histogram *h);
+// --- ---
+
+uint64_t stats_now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void stats_launch_begin (void)
+{
+  stats_launch_end();
+
+  memset(marks, 0, sizeof(marks));
+  in_launch = true;
+  marks[STATS_READ] = stats_now_ns();
+}
+
+void stats_mark (stats_point point)
+{
+  stats_mark_at(point, stats_now_ns());
+}
+
+void stats_mark_at (stats_point point, uint64_t ns)
+{
+  if (in_launch)
+    marks[point] = ns;
+}
+
+void stats_launch_end (void)
+{
+  if (!in_launch)
+    return;
+  in_launch = false;
+
+  launch_cnt++;
+  if (marks[STATS_FIRST_FRAME] != 0)
+    first_frame_cnt++;
+
+  for (size_t i = 0; i < STAGE_CNT; i++) {
+    uint64_t from = marks[stages[i].from];
+    uint64_t to = marks[stages[i].to];
+    if (from == 0 || to == 0)
+      continue;
+
+    // Points may overlap (an app forked by the zygote can start before the
+    //   zygote's reply reaches us); such a stage took no time of its own:
+    hist_add(&hists[i], ns_to_us(to > from ? to - from : 0));
+  }
+}
+
+void stats_teardown (uint32_t tag, uint64_t ns, bool killed)
+{
+  size_t i = 0;
+  while (i < teardown_cnt && teardowns[i].tag != tag)
+    i++;
+  if (i == teardown_cnt) {
+    if (teardown_cnt == STATS_TEARDOWN_APP_MAX)
+      return;
+    teardowns[teardown_cnt++].tag = tag;
+  }
+
+  hist_add(&teardowns[i].hist, ns_to_us(ns));
+  if (killed)
+    teardowns[i].kill_cnt++;
+}
+
+void stats_dump (FILE *out)
+{
+  fprintf(out, "stats: %lu launches, %lu reached a first frame\n",
+      (unsigned long)launch_cnt, (unsigned long)first_frame_cnt);
+  fprintf(out, "  %-12s %7s %10s %10s %10s %10s %10s (ms)\n", "stage", "count",
+      "mean", "p50", "p95", "p99", "max");
+
+  for (size_t i = 0; i < STAGE_CNT; i++)
+    hist_print(out, stages[i].name, &hists[i]);
+
+  if (teardown_cnt != 0)
+    fprintf(out, "teardown: (ms)\n");
+  for (size_t i = 0; i < teardown_cnt; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "%08X", (unsigned int)teardowns[i].tag);
+    hist_print(out, name, &teardowns[i].hist);
+    if (teardowns[i].kill_cnt != 0)
+      fprintf(out, "    %lu killed\n", (unsigned long)teardowns[i].kill_cnt);
+  }
+}
+
+// Returns the index of the bucket holding us.
+unsigned int bucket_of (uint32_t us)
+{
+  if (us < HIST_SUB_CNT)
+    return us; // Exact buckets for the smallest values
+
+  unsigned int msb = 31 - __builtin_clz(us);
+  unsigned int shift = msb - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB_CNT + ((us >> shift) - HIST_SUB_CNT);
+}
+
+// Returns the smallest value that falls into the given bucket.
+uint32_t bucket_low (unsigned int bucket)
+{
+  if (bucket < HIST_SUB_CNT)
+    return bucket;
+
+  unsigned int shift = bucket / HIST_SUB_CNT - 1;
+  return (uint32_t)(HIST_SUB_CNT + bucket % HIST_SUB_CNT) << shift;
+}
+
+void hist_add (histogram *h, uint32_t us)
+{
+  h->buckets[bucket_of(us)]++;
+  if (h->count == 0 || us < h->min)
+    h->min = us;
+  if (us > h->max)
+    h->max = us;
+  h->count++;
+  h->sum += us;
+}
+
+// Converts ns to the us recorded in histograms.
+uint32_t ns_to_us (uint64_t ns)
+{
+  uint64_t us = ns / 1000;
+  return us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+// Prints a one line summary of the given histogram, unless it is empty.
+void hist_print (FILE *out, const char *name, const histogram *h)
+{
+  if (h->count == 0)
+    return;
+
+  fprintf(out, "  %-12s %7lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+      (unsigned long)h->count, h->sum / 1e3 / h->count,
+      hist_percentile(h, 0.50) / 1e3, hist_percentile(h, 0.95) / 1e3,
+      hist_percentile(h, 0.99) / 1e3, h->max / 1e3);
+}
+
+/**
+ * Returns the value below which the fraction p of all recorded values lie,
+ *   estimated as the middle of the bucket it falls into.
+ */
+uint32_t hist_percentile (const histogram *h, double p)
+{
+  uint64_t rank = (uint64_t)(p * h->count + 0.5);
+  if (rank == 0)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < HIST_BUCKET_CNT; i++) {
+    seen += h->buckets[i];
+    if (seen < rank)
+      continue;
+
+    // Estimate from the middle of the bucket, but never beyond what was seen:
+    uint64_t low = bucket_low(i);
+    uint64_t high = i + 1 < HIST_BUCKET_CNT ? bucket_low(i + 1)
+                                             : (uint64_t)UINT32_MAX + 1;
+    uint64_t mid = (low + high - 1) / 2;
+    if (mid < h->min)
+      mid = h->min;
+    if (mid > h->max)
+      mid = h->max;
+    return (uint32_t)mid;
+  }
+  return h->max;
+}
@@ -0,0 +1,83 @@
+/**
+ * stats.h
+ *
+ * Contains prototypes for os_ctrl's scan-to-first-frame latency statistics.
+ *
+ * Every launch (from the moment a tag has been read off the scanner pipe) is
+ *   timestamped with CLOCK_MONOTONIC at each of the points below. As the
+ *   scanner shares the clock, the time it saw the tag is marked too. Once the
+ *   launch ends, the time between pairs of marks (the stages) is added to
+ *   fixed-size, log-linear histograms, one per stage, from which percentiles
+ *   are reported.
+ *
+ * Marks are normally set from os_ctrl's main thread. The UI thread may set
+ *   STATS_ANIM_START while the success animation plays. The main thread does
+ *   not end or begin a launch until it has seen that animation done (see
+ *   is_anim_done), which synchronizes the two threads.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t, uint64_t
+#include <stdio.h> // FILE
+
+// Number of apps whose teardown times are kept:
+#define STATS_TEARDOWN_APP_MAX 32
+
+// Points in time during a launch, in the order they normally happen (apps
+//   started with a handoff are spawned before the UI's animations):
+typedef enum stats_point
+{
+  STATS_SCAN, // Tag seen by the scanner (timestamp sent in its frame)
+  STATS_READ, // Tag read off the scanner pipe (start of the launch)
+  STATS_LOOKUP, // App index lookup done
+  STATS_ANIM_START, // First frame of the success animation drawn (UI thread)
+  STATS_ANIM_END, // Success animation done
+  STATS_UI_STOPPED, // Fade out done and UI thread joined
+  STATS_APP_STOPPED, // Previous app terminated and reaped (or frozen)
+  STATS_RESUMED, // Frozen app continued, instead of spawning one
+  STATS_SPAWN, // About to create the app's process
+  STATS_SPAWNED, // Process created (and exec'd, unless from the zygote)
+  STATS_APP_STARTED, // App entered its main (reported by the app)
+  STATS_APP_LOADED, // App waits for the display (reported by the app)
+  STATS_HANDOFF, // Display handed over to the app
+  STATS_FIRST_FRAME, // App presented its first frame (reported by the app)
+  STATS_POINT_CNT
+} stats_point;
+
+// Returns the current CLOCK_MONOTONIC time in nanoseconds.
+uint64_t stats_now_ns (void);
+
+/**
+ * Starts timing a new launch, marking STATS_READ as now. A launch that was
+ *   still in progress is ended first.
+ */
+void stats_launch_begin (void);
+
+// Marks the given point in time of the current launch as now.
+void stats_mark (stats_point point);
+
+// Marks the given point in time of the current launch as ns (CLOCK_MONOTONIC).
+void stats_mark_at (stats_point point, uint64_t ns);
+
+/**
+ * Ends the current launch, adding every stage whose two marks were set to
+ *   its histogram. Does nothing if no launch is in progress.
+ */
+void stats_launch_end (void);
+
+/**
+ * Records that the app of the given tag took ns nanoseconds to exit after
+ *   being sent SIGTERM, and whether it had to be killed. Teardowns are kept
+ *   per app (for the first STATS_TEARDOWN_APP_MAX apps torn down).
+ */
+void stats_teardown (uint32_t tag, uint64_t ns, bool killed);
+
+// Prints percentiles of every stage and every app's teardown to the stream.
+void stats_dump (FILE *out);
+
+#endif
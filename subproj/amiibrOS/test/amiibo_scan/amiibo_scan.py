@@ -4,36 +4,78 @@
   A small program that tests amiibrOS's features by feeding it fake,
     pre-generated scans.
 
+  Scans are written as frames of the scanner protocol (see scan_proto.h).
+
+  Usage: amiibo_scan.py <pipe fd> [burst <count> [interval ms]]
+
+  In burst mode, count tags are written interval ms apart (1 by default), each
+    one twice in a row, and the program exits. Every tag but the last
+    alternates between the first two test IDs; the last one is always the
+    third. Used by test/test_coalesce.c.
+
   Joseph Yankel (jpyankel@gmail.com)
 """
 
 import os
 import sys
 import time
+import struct
+
+FRAME_HEADER = struct.Struct('<2sBBHHQ') # magic, version, type, len, 0, time
+EV_TAG = 1
+UID_MAX = 10
+
+def write_tag(fd, amiibo_id):
+  """
+  Writes a tag frame for the given 8-byte amiibo ID (with a made up UID),
+    timestamped now.
+  """
+  uid = bytes.fromhex("04A1B2C3D4E5F6")
+  payload = bytes([len(uid)]) + uid.ljust(UID_MAX, b'\0') + amiibo_id
+  header = FRAME_HEADER.pack(b'AS', 1, EV_TAG, len(payload), 0,
+      time.monotonic_ns())
+  os.write(fd, header + payload)
+
+def burst(fd, count, interval):
+  """
+  Writes count rapid tags (see above) and returns.
+  """
+  ids = [bytes.fromhex("0100000000000002"), bytes.fromhex("0000000000000002")]
+  for i in range(count):
+    amiibo_id = ids[i % 2] if i < count - 1 else \
+        bytes.fromhex("0103000000000002")
+    write_tag(fd, amiibo_id)
+    write_tag(fd, amiibo_id) # A duplicate, as a flaky scanner would send
+    time.sleep(interval / 1000)
 
 if __name__ == "__main__":
-  testbytes1 = bytes.fromhex("01000000")
-  testbytes2 = bytes.fromhex("00000000")
-  testbytes3 = bytes.fromhex("01030000")
+  if len(sys.argv) > 3 and sys.argv[2] == "burst":
+    burst(int(sys.argv[1]), int(sys.argv[3]),
+        int(sys.argv[4]) if len(sys.argv) > 4 else 1)
+    sys.exit(0)
+
+  testbytes1 = bytes.fromhex("0100000000000002")
+  testbytes2 = bytes.fromhex("0000000000000002")
+  testbytes3 = bytes.fromhex("0103000000000002")
   print("PYTHON STARTED")
   print("ARGUMENTS: ", str(sys.argv), ". SLEEPING...")
   time.sleep(5)
 
-  print("SLEEP COMPLETE. SCANNER WRITING 4 BYTES...")
-  os.write(int(sys.argv[1]), testbytes1)
+  print("SLEEP COMPLETE. SCANNER WRITING TAG...")
+  write_tag(int(sys.argv[1]), testbytes1)
   print("WRITE COMPLETE. SCANNER SLEEPING...")
   time.sleep(5)
-  
-  print("SLEEP COMPLETE. SCANNER WRITING 4 BYTES...")
-  os.write(int(sys.argv[1]), testbytes2)
+
+  print("SLEEP COMPLETE. SCANNER WRITING TAG...")
+  write_tag(int(sys.argv[1]), testbytes2)
   print("WRITE COMPLETE. SCANNER SLEEPING...")
   time.sleep(5)
 
-  print("SLEEP COMPLETE. SCANNER WRITING 4 BYTES...")
-  os.write(int(sys.argv[1]), testbytes3)
+  print("SLEEP COMPLETE. SCANNER WRITING TAG...")
+  write_tag(int(sys.argv[1]), testbytes3)
   print("WRITE COMPLETE. SCANNER SLEEPING...")
   time.sleep(10)
-  
+
   #print("SLEEP COMPLETE. CHILD EXITING.")
   print("LOOPING FOREVER.")
   while True:
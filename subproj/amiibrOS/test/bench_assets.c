@@ -0,0 +1,111 @@
+/**
+ * bench_assets.c
+ *
+ * Measures what the UI thread pays, every time the interface starts, to get
+ *   its images ready for upload to the GPU, comparing:
+ *   * png: decoding each PNG from resources/ (as raylib's LoadTexture does).
+ *   * bundle: mapping the asset bundle that assetc built from the same PNGs
+ *     (see asset_bundle.h), as os_ctrl does when the bundle is installed.
+ *
+ * Either way, every pixel is then read once, as the upload would. The bundle
+ *   is mapped anew on every run, although os_ctrl keeps it mapped, and the
+ *   page cache is left warm for both, as after the first start.
+ *
+ * Usage: bench_assets <bundle> <png>... [-n runs]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, perror
+#include <stdlib.h> // atoi, free
+#include <string.h> // strcmp
+#include <stdint.h> // uint8_t, uint64_t
+#include <time.h> // clock_gettime
+#include "../asset_bundle.h"
+#include "../png_decode.h"
+
+#define DEFAULT_RUNS 20
+
+// Keeps the reads of the pixels from being optimized out:
+static volatile uint64_t sink;
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Reads len bytes of pixels, a word at a time, as an upload would.
+void read_pixels (const uint8_t *pixels, size_t len)
+{
+  const uint64_t *words = (const uint64_t *)pixels;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < len / 8; i++)
+    sum += words[i];
+  sink += sum;
+}
+
+// Decodes and reads every PNG. Returns false if one fails to decode.
+bool load_pngs (char **paths, int path_cnt)
+{
+  for (int i = 0; i < path_cnt; i++) {
+    png_image img;
+    if (!png_decode(paths[i], &img))
+      return false;
+    read_pixels(img.pixels, (size_t)img.width * img.height * 4);
+    free(img.pixels);
+  }
+  return true;
+}
+
+// Maps the bundle and reads every page in it. Returns false if it can't.
+bool load_bundle (const char *path)
+{
+  asset_bundle bundle;
+  if (!asset_bundle_open(&bundle, path))
+    return false;
+  for (uint16_t i = 0; i < bundle.page_cnt; i++) {
+    const asset_page *p = &bundle.pages[i];
+    read_pixels(asset_bundle_pixels(&bundle, i),
+        (size_t)p->width * p->height * 4);
+  }
+  asset_bundle_close(&bundle);
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  int runs = DEFAULT_RUNS;
+  if (argc > 2 && !strcmp(argv[argc - 2], "-n")) {
+    runs = atoi(argv[argc - 1]);
+    argc -= 2;
+  }
+  if (argc < 3 || runs <= 0) {
+    fprintf(stderr, "usage: %s <bundle> <png>... [-n runs]\n", argv[0]);
+    return 1;
+  }
+
+  // Warm the page cache (and check that everything loads) first:
+  if (!load_pngs(argv + 2, argc - 2) || !load_bundle(argv[1])) {
+    perror("bench_assets unable to load assets\nerror");
+    return 1;
+  }
+
+  uint64_t start = now_ns();
+  for (int r = 0; r < runs; r++)
+    load_pngs(argv + 2, argc - 2);
+  double png_ms = (now_ns() - start) / 1e6 / runs;
+
+  start = now_ns();
+  for (int r = 0; r < runs; r++)
+    load_bundle(argv[1]);
+  double bundle_ms = (now_ns() - start) / 1e6 / runs;
+
+  printf("images ready for upload, %d images, mean of %d runs:\n",
+      argc - 2, runs);
+  printf("  %-8s %8.3f ms\n", "png", png_ms);
+  printf("  %-8s %8.3f ms (%.1fx less)\n", "bundle", bundle_ms,
+      png_ms / bundle_ms);
+  return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * bench_launch.c
+ *
+ * Measures scan-to-exec latency of os_ctrl's app launch path on a Linux host.
+ *
+ * A throwaway app directory is created whose .sh script execs dummy_app, and
+ *   whose .conf manifest declares the same. Each iteration times from the
+ *   moment a tag would have been read to the moment dummy_app reports that
+ *   its main started, using three methods:
+ *   * fork: the original launch_app path (sprintf paths, stat, fork, chdir,
+ *     execl of /bin/sh running the script).
+ *   * spawn via sh: a launch plan resolved once, started with posix_spawn,
+ *     still running the script through /bin/sh (its quoting keeps it from
+ *     being exec'd directly).
+ *   * spawn manifest: the plan of the .conf manifest, which execs dummy_app
+ *     directly. The difference to the previous method is what skipping the
+ *     shell saves per launch.
+ *
+ * To make fork pay what it pays in os_ctrl, the benchmark first grows its
+ *   heap by a configurable ballast and starts an idle thread.
+ *
+ * Usage: bench_launch <path to dummy_app> [iterations] [ballast MiB]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // mkdtemp, realpath
+
+#include <stdio.h> // printf, fprintf, perror, snprintf
+#include <stdlib.h> // malloc, free, qsort, atoi, setenv, realpath, mkdtemp
+#include <stdint.h> // uint64_t
+#include <string.h> // memset
+#include <time.h> // clock_gettime
+#include <unistd.h> // pipe, fork, chdir, execl, read, close
+#include <pthread.h> // pthread_create
+#include <sys/stat.h> // stat, mkdir
+#include <sys/wait.h> // waitpid
+#include "../amiibrOS_app.h" // amiibrOS_app_report
+#include "../launcher.h"
+
+#define BENCH_TAG "DEADBEEF"
+#define DEFAULT_ITERATIONS 200
+#define DEFAULT_BALLAST_MIB 64
+
+static char app_root[] = "/tmp/amiibrOS_bench.XXXXXX";
+static char app_dir[sizeof(app_root) + sizeof(BENCH_TAG)];
+static uint64_t p50_ns[3]; // Median latency of each method run so far
+static size_t run_cnt;
+static int ready_fds[2]; // dummy_app reports its start on ready_fds[1]
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Sleeps forever. Exists only so that the benchmark is multithreaded.
+void *idle_thread (void *arg)
+{
+  (void)arg;
+  for (;;)
+    pause();
+  return NULL;
+}
+
+/**
+ * Reproduces the original launch_app: build paths, stat the script, fork,
+ *   chdir and exec the script through /bin/sh.
+ */
+pid_t launch_fork (void)
+{
+  char dir[sizeof(app_dir)];
+  char path[sizeof(app_dir) + sizeof(BENCH_TAG) + 4];
+  struct stat stat_buf;
+
+  sprintf(dir, "%s/%s", app_root, BENCH_TAG);
+  sprintf(path, "%s/%s.sh", dir, BENCH_TAG);
+  if (stat(path, &stat_buf) == -1)
+    return -1;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(ready_fds[0]);
+    if (dup2(ready_fds[1], LAUNCHER_READY_FD) == -1 || chdir(dir) == -1)
+      _exit(1);
+    execl("/bin/sh", "sh", path, NULL);
+    _exit(1);
+  }
+  return pid;
+}
+
+// Starts the app from a pre-resolved plan.
+pid_t launch_spawn (const launch_plan *plan)
+{
+  pid_t pid;
+  if (!launch_plan_spawn(plan, &ready_fds[0], 1, ready_fds[1], -1, &pid))
+    return -1;
+  return pid;
+}
+
+int compare_u64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Prints min/median/p95/mean of the given latencies (sorts them in place) and
+ *   records the median.
+ */
+void report (const char *name, uint64_t *lat, size_t cnt)
+{
+  qsort(lat, cnt, sizeof(uint64_t), compare_u64);
+  if (run_cnt < sizeof(p50_ns) / sizeof(p50_ns[0]))
+    p50_ns[run_cnt++] = lat[cnt / 2];
+  uint64_t sum = 0;
+  for (size_t i = 0; i < cnt; i++)
+    sum += lat[i];
+
+  printf("%-28s min %8.1f  p50 %8.1f  p95 %8.1f  mean %8.1f (us)\n", name,
+      lat[0] / 1e3, lat[cnt / 2] / 1e3, lat[cnt * 95 / 100] / 1e3,
+      (double)sum / cnt / 1e3);
+}
+
+/**
+ * Runs 'iterations' launches with the given method (plan == NULL selects the
+ *   fork method) and reports their latency. Returns false on any failure.
+ */
+bool run (const char *name, const launch_plan *plan, size_t iterations)
+{
+  uint64_t *lat = malloc(iterations * sizeof(uint64_t));
+  if (lat == NULL)
+    return false;
+
+  for (size_t i = 0; i < iterations; i++) {
+    uint64_t start = now_ns();
+    pid_t pid = plan != NULL ? launch_spawn(plan) : launch_fork();
+    if (pid == -1) {
+      perror("bench_launch launch failed\nerror");
+      free(lat);
+      return false;
+    }
+
+    // The first report is always the app's start:
+    amiibrOS_app_report report;
+    if (read(ready_fds[0], &report, sizeof(report)) != sizeof(report) ||
+        report.event != AMIIBROS_APP_STARTED) {
+      fprintf(stderr, "bench_launch: dummy_app did not report\n");
+      free(lat);
+      return false;
+    }
+    waitpid(pid, NULL, 0);
+    lat[i] = report.ns - start;
+
+    // Drop its remaining reports, up to its first frame:
+    do {
+      if (read(ready_fds[0], &report, sizeof(report)) != sizeof(report)) {
+        fprintf(stderr, "bench_launch: dummy_app did not report\n");
+        free(lat);
+        return false;
+      }
+    } while (report.event != AMIIBROS_APP_FIRST_FRAME);
+  }
+
+  report(name, lat, iterations);
+  free(lat);
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dummy_app> [iterations] [ballast MiB]\n",
+        argv[0]);
+    return 1;
+  }
+  size_t iterations = argc > 2 ? (size_t)atoi(argv[2]) : DEFAULT_ITERATIONS;
+  size_t ballast_mib = argc > 3 ? (size_t)atoi(argv[3]) : DEFAULT_BALLAST_MIB;
+  if (iterations == 0)
+    iterations = DEFAULT_ITERATIONS;
+
+  char *dummy_app = realpath(argv[1], NULL);
+  if (dummy_app == NULL) {
+    perror("bench_launch unable to find dummy_app\nerror");
+    return 1;
+  }
+
+  // Lay out <app_root>/DEADBEEF/DEADBEEF.sh the same way the device does:
+  if (mkdtemp(app_root) == NULL) {
+    perror("bench_launch unable to create app root\nerror");
+    return 1;
+  }
+  sprintf(app_dir, "%s/%s", app_root, BENCH_TAG);
+  char script_path[sizeof(app_dir) + sizeof(BENCH_TAG) + 4];
+  char conf_path[sizeof(app_dir) + sizeof(BENCH_TAG) + 6];
+  sprintf(script_path, "%s/%s.sh", app_dir, BENCH_TAG);
+  sprintf(conf_path, "%s/%s.conf", app_dir, BENCH_TAG);
+  FILE *script, *conf;
+  if (mkdir(app_dir, 0755) == -1 ||
+      (script = fopen(script_path, "w")) == NULL ||
+      (conf = fopen(conf_path, "w")) == NULL) {
+    perror("bench_launch unable to create app\nerror");
+    return 1;
+  }
+  // The quotes make the script a job for the shell. The manifest is the same
+  //   command, with an argument and an environment variable to set up:
+  fprintf(script, "#!/bin/sh\nexec \"%s\" --bench\n", dummy_app);
+  fprintf(conf, "exec %s\narg --bench\nenv AMIIBROS_BENCH=1\n", dummy_app);
+  fclose(script);
+  fclose(conf);
+
+  if (pipe(ready_fds) == -1) {
+    perror("bench_launch unable to create pipe\nerror");
+    return 1;
+  }
+  char fd_str[12];
+  sprintf(fd_str, "%d", LAUNCHER_READY_FD);
+  setenv(AMIIBROS_READY_FD_ENV, fd_str, 1);
+
+  // Make fork pay for a realistically sized, multithreaded process:
+  char *ballast = malloc(ballast_mib << 20);
+  if (ballast != NULL)
+    memset(ballast, 1, ballast_mib << 20);
+  pthread_t thread;
+  pthread_create(&thread, NULL, idle_thread, NULL);
+
+  launch_plan *plan = launch_plan_create(app_dir, BENCH_TAG ".sh", NULL);
+  launch_plan *manifest_plan = launch_plan_create(app_dir, BENCH_TAG ".sh",
+      BENCH_TAG ".conf");
+  if (plan == NULL || manifest_plan == NULL) {
+    perror("bench_launch unable to plan launch\nerror");
+    return 1;
+  }
+  if (plan->direct || !manifest_plan->manifest) {
+    fprintf(stderr, "bench_launch: plans are not shell and manifest\n");
+    return 1;
+  }
+
+  printf("scan-to-exec latency, %zu launches, %zu MiB ballast\n", iterations,
+      ballast_mib);
+  bool ok = run("fork + /bin/sh (original)", NULL, iterations) &&
+      run("posix_spawn plan via sh", plan, iterations) &&
+      run("posix_spawn manifest exec", manifest_plan, iterations);
+  if (ok) {
+    printf("manifest exec saves %.1f us per launch (p50) over the plan via "
+        "sh, %.1f us over the original\n",
+        ((double)p50_ns[1] - (double)p50_ns[2]) / 1e3,
+        ((double)p50_ns[0] - (double)p50_ns[2]) / 1e3);
+  }
+
+  launch_plan_free(plan);
+  launch_plan_free(manifest_plan);
+  unlink(script_path);
+  unlink(conf_path);
+  rmdir(app_dir);
+  rmdir(app_root);
+  free(ballast);
+  free(dummy_app);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+/**
+ * bench_ui_queue.c
+ *
+ * Measures what the UI thread pays every frame to learn whether os_ctrl wants
+ *   something from it, and what a command costs end to end, comparing:
+ *   * mutex: the original scheme, where the UI thread takes a mutex to read
+ *     three volatile flags every frame, and clears a flag and signals a
+ *     condition variable (under the mutex) when an animation is done.
+ *   * queue: the lock-free command queue of ui_queue.h, whose completions
+ *     are signalled through an eventfd.
+ *
+ * The per-frame cost is measured on an idle queue (no commands, as in nearly
+ *   every frame), timing many polls in a row. The round trip has a stand-in
+ *   UI thread poll once per simulated frame and immediately complete each
+ *   command, while the main thread sends one command at a time and waits for
+ *   it, as os_ctrl does for an animation.
+ *
+ * Usage: bench_ui_queue [polls] [round trips] [frame us]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // atoi, malloc, free, qsort
+#include <stdint.h> // uint32_t, uint64_t
+#include <time.h> // clock_gettime, nanosleep
+#include <pthread.h> // pthread_*
+#include "../ui_queue.h"
+
+#define DEFAULT_POLLS 10000000
+#define DEFAULT_ROUND_TRIPS 2000
+#define DEFAULT_FRAME_US 100
+
+// The original scheme's shared state:
+static pthread_mutex_t flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flag_cond = PTHREAD_COND_INITIALIZER;
+static volatile bool flag_stop = false;
+static volatile bool flag_scan_success_anim = false;
+static volatile bool flag_scan_fail_anim = false;
+
+static ui_queue queue;
+static long frame_ns;
+static bool bench_done; // Atomic; ends the stand-in UI threads
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int compare_u64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// One frame's check of the original scheme (threadsafe_read_mainUI_flags).
+bool poll_mutex (bool *stop_val, bool *success_val, bool *fail_val)
+{
+  if (pthread_mutex_lock(&flag_mutex))
+    return false;
+  *stop_val = flag_stop;
+  *success_val = flag_scan_success_anim;
+  *fail_val = flag_scan_fail_anim;
+  return !pthread_mutex_unlock(&flag_mutex);
+}
+
+// Sleeps for one simulated frame.
+void sleep_frame (void)
+{
+  struct timespec ts = {0, frame_ns};
+  nanosleep(&ts, NULL);
+}
+
+// Stand-in UI thread of the original scheme: finishes every animation at once.
+void *run_mutex_ui (void *arg)
+{
+  (void)arg;
+  bool stop_val, success_val, fail_val;
+  while (!__atomic_load_n(&bench_done, __ATOMIC_ACQUIRE)) {
+    poll_mutex(&stop_val, &success_val, &fail_val);
+    if (success_val) {
+      pthread_mutex_lock(&flag_mutex);
+      flag_scan_success_anim = false;
+      pthread_cond_signal(&flag_cond);
+      pthread_mutex_unlock(&flag_mutex);
+    }
+    sleep_frame();
+  }
+  return NULL;
+}
+
+// Stand-in UI thread of the queue: completes every command at once.
+void *run_queue_ui (void *arg)
+{
+  (void)arg;
+  ui_cmd cmd;
+  while (!__atomic_load_n(&bench_done, __ATOMIC_ACQUIRE)) {
+    while (ui_queue_pop(&queue, &cmd))
+      ui_queue_complete(&queue, cmd.seq);
+    sleep_frame();
+  }
+  return NULL;
+}
+
+// Sends a command the original way (play_scan_success_anim) and waits for it.
+void send_mutex (void)
+{
+  pthread_mutex_lock(&flag_mutex);
+  flag_scan_success_anim = true;
+  while (flag_scan_success_anim)
+    pthread_cond_wait(&flag_cond, &flag_mutex);
+  pthread_mutex_unlock(&flag_mutex);
+}
+
+// Sends a command through the queue and waits for it.
+void send_queue (void)
+{
+  ui_queue_wait(&queue, ui_queue_push(&queue, UI_CMD_SCAN_SUCCESS, 0));
+}
+
+// Prints the mean cost of one idle poll of each scheme.
+void bench_polls (size_t polls)
+{
+  bool stop_val, success_val, fail_val;
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < polls; i++)
+    poll_mutex(&stop_val, &success_val, &fail_val);
+  double mutex_ns = (double)(now_ns() - start) / polls;
+
+  ui_cmd cmd;
+  size_t popped = 0;
+  start = now_ns();
+  for (size_t i = 0; i < polls; i++)
+    popped += ui_queue_pop(&queue, &cmd);
+  double queue_ns = (double)(now_ns() - start) / polls;
+
+  if (popped != 0)
+    fprintf(stderr, "bench_ui_queue: idle queue had commands\n");
+  printf("idle per-frame check, %zu polls:\n", polls);
+  printf("  %-20s %8.2f ns\n", "mutex + 3 flags", mutex_ns);
+  printf("  %-20s %8.2f ns (%.1fx less)\n", "queue pop", queue_ns,
+      mutex_ns / queue_ns);
+}
+
+/**
+ * Times round trips of one command through the given scheme, with ui as the
+ *   stand-in UI thread. Prints the median and p99 latency.
+ */
+bool bench_round_trips (const char *name, void *(*ui)(void *),
+    void (*send)(void), size_t trips)
+{
+  uint64_t *lat = malloc(trips * sizeof(uint64_t));
+  pthread_t thread;
+  __atomic_store_n(&bench_done, false, __ATOMIC_RELEASE);
+  if (lat == NULL || pthread_create(&thread, NULL, ui, NULL)) {
+    fprintf(stderr, "bench_ui_queue: unable to start UI thread\n");
+    free(lat);
+    return false;
+  }
+
+  for (size_t i = 0; i < trips; i++) {
+    uint64_t start = now_ns();
+    send();
+    lat[i] = now_ns() - start;
+  }
+  __atomic_store_n(&bench_done, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+
+  qsort(lat, trips, sizeof(uint64_t), compare_u64);
+  printf("  %-20s p50 %8.1f us  p99 %8.1f us\n", name, lat[trips / 2] / 1e3,
+      lat[trips * 99 / 100] / 1e3);
+  free(lat);
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  size_t polls = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_POLLS;
+  size_t trips = argc > 2 ? (size_t)atoi(argv[2]) : DEFAULT_ROUND_TRIPS;
+  frame_ns = (argc > 3 ? atoi(argv[3]) : DEFAULT_FRAME_US) * 1000L;
+  if (polls == 0 || trips == 0 || frame_ns <= 0 || frame_ns >= 1000000000L) {
+    fprintf(stderr, "usage: %s [polls] [round trips] [frame us]\n", argv[0]);
+    return 1;
+  }
+  if (!ui_queue_init(&queue)) {
+    perror("bench_ui_queue unable to create eventfd\nerror");
+    return 1;
+  }
+
+  bench_polls(polls);
+  printf("command round trip, %zu commands, %ld us frames:\n", trips,
+      frame_ns / 1000);
+  bool ok = bench_round_trips("mutex + condvar", run_mutex_ui, send_mutex,
+      trips) &&
+      bench_round_trips("queue + eventfd", run_queue_ui, send_queue, trips);
+  return ok ? 0 : 1;
+}
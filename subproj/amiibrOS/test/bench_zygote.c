@@ -0,0 +1,188 @@
+/**
+ * bench_zygote.c
+ *
+ * Compares cold and zygote launch-to-first-frame latency of an installed app.
+ *
+ * The app directory is laid out like on the device (XXXXXXXX/XXXXXXXX.sh and
+ *   XXXXXXXX.conf) and its .conf must name a zygote module. Each iteration
+ *   times from the start of the launch to the moment the app reports its
+ *   first frame (see amiibrOS_app.h), then terminates the app:
+ *   * cold: the app's launch plan started with posix_spawn (exec, dynamic
+ *     linking and all of the app's own setup).
+ *   * zygote: the app forked from a warm zygote and entered through its
+ *     module.
+ *
+ * On the device, point it at the slideshow app (built with `make module` in
+ *   subproj/slideshow). On a Linux host, test/dummy_app and test/dummy_app.so
+ *   work as a stand-in (see test/README.md).
+ *
+ * Usage: bench_zygote <app dir> [iterations]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // realpath, pipe2
+
+#include <stdio.h> // printf, fprintf, perror, sprintf
+#include <stdlib.h> // malloc, free, qsort, atoi, setenv, realpath
+#include <stdint.h> // uint64_t
+#include <string.h> // strrchr, strlen
+#include <time.h> // clock_gettime
+#include <unistd.h> // pipe2, read, close
+#include <fcntl.h> // O_CLOEXEC
+#include <signal.h> // kill, SIGTERM
+#include <sys/wait.h> // waitpid
+#include "../amiibrOS_app.h" // AMIIBROS_READY_FD_ENV, amiibrOS_app_report
+#include "../launcher.h"
+#include "../zygote.h"
+
+#define DEFAULT_ITERATIONS 50
+
+static int ready_fds[2]; // Apps report their launch progress on ready_fds[1]
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int compare_u64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Prints min/median/p95/mean of the given latencies (sorts them in place).
+void report (const char *name, uint64_t *lat, size_t cnt)
+{
+  qsort(lat, cnt, sizeof(uint64_t), compare_u64);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < cnt; i++)
+    sum += lat[i];
+
+  printf("%-8s min %9.1f  p50 %9.1f  p95 %9.1f  mean %9.1f (us)\n", name,
+      lat[0] / 1e3, lat[cnt / 2] / 1e3, lat[cnt * 95 / 100] / 1e3,
+      (double)sum / cnt / 1e3);
+}
+
+/**
+ * Launches the app once (from the zygote if use_zygote is set), waits for its
+ *   first frame and terminates it. Stores the latency in lat.
+ *
+ * Returns false on any failure.
+ */
+bool launch_once (const launch_plan *plan, bool use_zygote, uint64_t *lat)
+{
+  pid_t pid;
+  uint64_t start = now_ns();
+  bool ok = use_zygote ? zygote_spawn(plan, ready_fds[1], -1, &pid)
+                       : launch_plan_spawn(plan, &ready_fds[0], 1, ready_fds[1],
+                           -1, &pid);
+  if (!ok) {
+    perror("bench_zygote launch failed\nerror");
+    return false;
+  }
+
+  // Skip any reports before the first frame:
+  amiibrOS_app_report report;
+  do {
+    if (read(ready_fds[0], &report, sizeof(report)) != sizeof(report)) {
+      fprintf(stderr, "bench_zygote: app did not report its first frame\n");
+      kill(pid, SIGTERM);
+      waitpid(pid, NULL, 0);
+      return false;
+    }
+  } while (report.event != AMIIBROS_APP_FIRST_FRAME);
+
+  // The app may have exited by itself already (then this is a no-op):
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  *lat = report.ns - start;
+  return true;
+}
+
+/**
+ * Runs one untimed warm-up launch followed by 'iterations' timed launches and
+ *   reports their latency. Returns false on any failure.
+ */
+bool run (const char *name, const launch_plan *plan, bool use_zygote,
+    size_t iterations)
+{
+  uint64_t *lat = malloc(iterations * sizeof(uint64_t));
+  if (lat == NULL)
+    return false;
+
+  // The warm-up also has the zygote load the app's module:
+  uint64_t first;
+  bool ok = launch_once(plan, use_zygote, &first);
+  for (size_t i = 0; ok && i < iterations; i++)
+    ok = launch_once(plan, use_zygote, &lat[i]);
+
+  if (ok) {
+    printf("%-8s first %9.1f (us)\n", name, first / 1e3);
+    report(name, lat, iterations);
+  }
+  free(lat);
+  return ok;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <app dir> [iterations]\n", argv[0]);
+    return 1;
+  }
+  size_t iterations = argc > 2 ? (size_t)atoi(argv[2]) : DEFAULT_ITERATIONS;
+  if (iterations == 0)
+    iterations = DEFAULT_ITERATIONS;
+
+  char *app_dir = realpath(argv[1], NULL);
+  if (app_dir == NULL) {
+    perror("bench_zygote unable to find app\nerror");
+    return 1;
+  }
+  const char *tag = strrchr(app_dir, '/') + 1;
+  char script_name[strlen(tag) + 4]; // +3 for ".sh" +1 for NUL
+  char conf_name[strlen(tag) + 6]; // +5 for ".conf" +1 for NUL
+  sprintf(script_name, "%s.sh", tag);
+  sprintf(conf_name, "%s.conf", tag);
+
+  launch_plan *plan = launch_plan_create(app_dir, script_name, conf_name);
+  if (plan == NULL) {
+    perror("bench_zygote unable to plan launch\nerror");
+    return 1;
+  }
+  if (plan->zygote_module == NULL) {
+    fprintf(stderr, "bench_zygote: %s/%s names no zygote module\n", app_dir,
+        conf_name);
+    return 1;
+  }
+
+  // Apps get the write end as LAUNCHER_READY_FD, just like in os_ctrl. The
+  //   zygote's apps inherit its environment, so it is set up first:
+  if (pipe2(ready_fds, O_CLOEXEC) == -1) {
+    perror("bench_zygote unable to create pipe\nerror");
+    return 1;
+  }
+  char fd_str[12];
+  sprintf(fd_str, "%d", LAUNCHER_READY_FD);
+  setenv(AMIIBROS_READY_FD_ENV, fd_str, 1);
+
+  if (!zygote_start(NULL, 0)) {
+    perror("bench_zygote unable to start zygote\nerror");
+    return 1;
+  }
+
+  printf("launch-to-first-frame latency of %s, %zu launches\n", tag,
+      iterations);
+  bool ok = run("cold", plan, false, iterations) &&
+      run("zygote", plan, true, iterations);
+
+  // Closing our end of the zygote's socket makes it exit:
+  zygote_stop();
+  launch_plan_free(plan);
+  free(app_dir);
+  return ok ? 0 : 1;
+}
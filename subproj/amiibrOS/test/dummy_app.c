@@ -0,0 +1,33 @@
+/**
+ * dummy_app.c
+ *
+ * Stand-in app used by the os_ctrl benchmarks on a Linux host.
+ *
+ * As soon as it starts, it reports its start, waits for the display (see
+ *   amiibrOS_app.h), reports its (nonexistent) first frame and exits. The
+ *   benchmarks compare the reported times against the time they started the
+ *   launch.
+ *
+ * It can be built both as a normal executable and as a zygote module.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include "../amiibrOS_app.h"
+
+// Zygote module entry point (see zygote.h):
+int amiibrOS_app_main (int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  amiibrOS_app_report_started();
+  amiibrOS_app_wait_handoff();
+  amiibrOS_app_report_ready();
+  return 0;
+}
+
+int main (int argc, char **argv)
+{
+  return amiibrOS_app_main(argc, argv);
+}
@@ -0,0 +1,160 @@
+/**
+ * interface_headless.c
+ *
+ * Stand-in for interface.c that lets os_ctrl run on a Linux host without
+ *   raylib, a display or a GPU (see test/loadgen.c).
+ *
+ * Nothing is drawn. Each animation just runs for the same length as on the
+ *   device (or for AMIIBROS_HEADLESS_ANIM_MS milliseconds, if set), timed by a
+ *   timerfd that doubles as interface_anim_fd. Like the real one, a newer
+ *   animation supersedes the one playing, and only stop_interface blocks.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // fprintf
+#include <stdlib.h> // getenv, atol
+#include <string.h> // memset
+#include <time.h> // nanosleep
+#include <errno.h> // errno
+#include <unistd.h> // read
+#include <sys/timerfd.h> // timerfd_*
+#include "../interface.h"
+#include "../stats.h" // stats_mark
+#include "../log_ring.h" // log_write
+
+// Environment variable overriding the length of every animation:
+#define ANIM_MS_ENV "AMIIBROS_HEADLESS_ANIM_MS"
+// Length of each animation (as SI_ANIM_LEN, FI_ANIM_LEN and FADEOUT_ANIM_LEN
+//   in interface.c):
+#define ANIM_MS 1000
+
+static bool active = false; // Whether the "UI" is up
+static int anim_timer = -1; // timerfd expiring at the end of the animation
+static ui_anim next_anim = 1;
+static ui_anim cur_anim = 0; // Animation playing (0 if none)
+static uint64_t cur_anim_end; // When cur_anim is done (ns)
+static ui_anim fade_anim = 0; // The fade out, once started
+
+// --- Helper Function Prototypes ---
+ui_anim play_anim (void);
+void arm_anim_timer (uint64_t ns);
+// --- ---
+
+// === interface.h Implementation ===
+bool start_interface (void)
+{
+  if (interface_anim_fd() == -1)
+    return false;
+  fade_anim = 0;
+  active = true;
+  return true;
+}
+
+ui_anim fade_out_interface (void)
+{
+  if (fade_anim == 0 && active)
+    fade_anim = play_anim();
+  return fade_anim;
+}
+
+bool stop_interface (void)
+{
+  if (fade_out_interface() == 0)
+    return false;
+
+  uint64_t now = stats_now_ns();
+  if (cur_anim == fade_anim && now < cur_anim_end) {
+    uint64_t left_ns = cur_anim_end - now;
+    struct timespec left = {left_ns / 1000000000, left_ns % 1000000000};
+    while (nanosleep(&left, &left) == -1 && errno == EINTR);
+  }
+  active = false;
+  return true;
+}
+
+ui_anim play_scan_success_anim (void)
+{
+  if (!active || fade_anim != 0)
+    return 0;
+  stats_mark(STATS_ANIM_START);
+  log_write(LOG_EV_UI_ANIM, 0, "success", 0, 0, 0);
+  return play_anim();
+}
+
+ui_anim play_scan_fail_anim (void)
+{
+  if (!active || fade_anim != 0)
+    return 0;
+  log_write(LOG_EV_UI_ANIM, 0, "fail", 0, 0, 0);
+  return play_anim();
+}
+
+bool cancel_anim (ui_anim anim)
+{
+  if (anim != 0 && anim == cur_anim && anim != fade_anim) {
+    cur_anim_end = stats_now_ns();
+    arm_anim_timer(1); // Reported like any other animation that is done
+  }
+  return true;
+}
+
+bool is_anim_done (ui_anim anim)
+{
+  return anim != cur_anim || stats_now_ns() >= cur_anim_end;
+}
+
+int interface_anim_fd (void)
+{
+  if (anim_timer == -1)
+    anim_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  return anim_timer;
+}
+
+void clear_anim_fd (void)
+{
+  uint64_t expirations;
+  (void)!read(anim_timer, &expirations, sizeof(expirations));
+}
+
+bool is_interface_active (void)
+{
+  return active;
+}
+
+void interface_dump_stats (FILE *out)
+{
+  fprintf(out, "interface: headless, no frames drawn\n");
+}
+// ==================================
+
+/**
+ * Starts an animation, superseding the one playing (which is done from then
+ *   on). Returns its handle.
+ */
+ui_anim play_anim (void)
+{
+  const char *ms_str = getenv(ANIM_MS_ENV);
+  long ms = ms_str != NULL ? atol(ms_str) : ANIM_MS;
+  if (ms < 0)
+    ms = 0;
+
+  cur_anim = next_anim++;
+  if (next_anim == 0)
+    next_anim = 1;
+  cur_anim_end = stats_now_ns() + (uint64_t)ms * 1000000;
+  arm_anim_timer((uint64_t)ms * 1000000);
+  return cur_anim;
+}
+
+// Makes anim_timer readable in ns nanoseconds (at least 1).
+void arm_anim_timer (uint64_t ns)
+{
+  if (ns == 0)
+    ns = 1; // A zero timer would disarm it
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = ns / 1000000000;
+  spec.it_value.tv_nsec = ns % 1000000000;
+  timerfd_settime(anim_timer, 0, &spec, NULL);
+}
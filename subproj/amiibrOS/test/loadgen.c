@@ -0,0 +1,658 @@
+/**
+ * loadgen.c
+ *
+ * Load generator for os_ctrl on a Linux host: replays a stream of scanner
+ *   events into os_ctrl's scanner pipe at a configurable pace, then reports
+ *   the launch latency and throughput os_ctrl saw.
+ *
+ * os_ctrl (built headless with `make loadgen`) is started with this program as
+ *   its scanner (see SCANNER_ENV in main.c), so the events take the same pipe,
+ *   framing and reader as real scans. That scanner side replays the events,
+ *   gives the last launch time to settle and signals the parent side, which
+ *   reads os_ctrl's stats socket, prints the report and stops os_ctrl.
+ *
+ * Events come from a scenario file, a capture of a real scanner's output or,
+ *   by default, a built-in scenario mixing all of the patterns below.
+ *
+ * Scenario files hold one command per line ('#' starts a comment). Times are
+ *   in milliseconds and advance a clock the events are placed on. Ids are 8
+ *   (character ID, the rest is zeroed) or 16 (full amiibo ID) hex digits:
+ *     wait <ms>                         Advances the clock.
+ *     tag <id> [count [interval]]       The same tag count times (repeats).
+ *     cycle <count> <interval> <id>...  count tags, going round the ids.
+ *     unknown [count [interval]]        Tags without an app.
+ *     removed                           The tag left the scanner.
+ *     error [code]                      A tag could not be identified.
+ *
+ * A capture is recorded by pointing a scanner at a file instead of os_ctrl's
+ *   pipe, e.g. `python amiibo_scan.py 3 3>capture.bin`. It is replayed with
+ *   its original spacing.
+ *
+ * Usage: loadgen [options] <os_ctrl>
+ *   -s <file>    Scenario to replay.
+ *   -c <file>    Capture to replay instead.
+ *   -x <factor>  Replays factor times as fast (default 1).
+ *   -w <ms>      Time the last launch is given before the report (3000).
+ *   -u <ms>      Length of the headless UI's animations (as on the device).
+ *   -a <dir>     App root to use. By default, a temporary one is created with
+ *                an app running the dummy app for every tag but unknown ones.
+ *   -d <path>    Dummy app (test/dummy_app).
+ *   -l <ms>      Fails if the p99 end_to_end latency is above this.
+ *
+ * Exits with 0 if the whole replay was reported, os_ctrl survived it, at least
+ *   one app reached its first frame (if any had one) and the limit was met.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // realpath, getline, mkdtemp, sigqueue
+
+#include <stdio.h> // printf, fprintf, perror, getline
+#include <stdlib.h> // malloc, realloc, free, strtoul, strtod, setenv
+#include <stdint.h> // uint8_t, uint32_t, uint64_t
+#include <string.h> // strtok, strchr, strstr, strlen, memset
+#include <errno.h> // errno
+#include <limits.h> // PATH_MAX
+#include <time.h> // clock_gettime, clock_nanosleep
+#include <unistd.h> // fork, execv, read, write, close, getopt, rmdir
+#include <fcntl.h> // open, O_RDONLY
+#include <signal.h> // sigqueue, kill
+#include <sys/signalfd.h> // signalfd
+#include <sys/socket.h> // socket, connect
+#include <sys/stat.h> // mkdir
+#include <sys/un.h> // sockaddr_un
+#include <sys/wait.h> // waitpid
+#include "../scan_proto.h"
+
+// Environment variables read by os_ctrl (as in main.c) and its headless UI:
+#define SCANNER_ENV "AMIIBROS_SCANNER"
+#define APP_ROOT_ENV "AMIIBROS_APP_ROOT"
+#define STATS_SOCKET_ENV "AMIIBROS_STATS_SOCKET"
+#define ANIM_MS_ENV "AMIIBROS_HEADLESS_ANIM_MS"
+
+// Environment variables handing our options to our scanner side:
+#define PARENT_ENV "LOADGEN_PARENT" // pid of the parent side
+#define SCENARIO_ENV "LOADGEN_SCENARIO"
+#define CAPTURE_ENV "LOADGEN_CAPTURE"
+#define SPEED_ENV "LOADGEN_SPEED"
+#define SETTLE_ENV "LOADGEN_SETTLE_MS"
+
+#define DEFAULT_DUMMY_APP "test/dummy_app"
+#define DEFAULT_SETTLE_MS 3000
+#define UNKNOWN_TAG 0xFFFF0000u // Unknown tags count up from here
+#define STATS_BUF_SIZE 65536
+
+// Used whenever no scenario or capture is given. os_ctrl's debounce window is
+//   1000 ms and the UI's animations take 2000 ms per launch on the device:
+static const char *DEFAULT_SCENARIO[] = {
+  "wait 500",
+  "tag 01000000", // A single launch
+  "wait 4000",
+  "tag 01000000 5 100", // A tag held on the scanner
+  "wait 4000",
+  "cycle 30 20 01000000 02000000 03000000", // A burst, ending on 03000000
+  "wait 4000",
+  "unknown 3 500",
+  "wait 1000",
+  "error 1",
+  "removed",
+  "tag 03000000",
+  NULL
+};
+
+// An event and when to send it:
+typedef struct load_event
+{
+  uint64_t at_ns; // Offset from the start of the replay
+  scan_event ev;
+  bool unknown; // A tag without an app
+} load_event;
+
+static load_event *events;
+static size_t event_cnt;
+static size_t event_cap;
+
+// --- Helper Function Prototypes ---
+uint64_t now_ns (void);
+bool add_event (uint64_t at_ns, const scan_event *ev, bool unknown);
+bool add_tags (uint64_t *clock, unsigned long cnt, unsigned long interval_ms,
+    char **ids, size_t id_cnt);
+bool parse_id (const char *str, uint8_t *id);
+bool parse_line (char *line, uint64_t *clock);
+bool load_scenario_lines (FILE *file, const char **lines);
+bool load_capture (const char *path);
+bool load_events (void);
+int run_scanner (int fd);
+bool make_app_root (char *root, const char *dummy_app, uint32_t **tags,
+    size_t *tag_cnt);
+void remove_app_root (const char *root, const uint32_t *tags, size_t tag_cnt);
+long read_stats (const char *socket_path, char *buf, size_t size);
+bool report (const char *stats, double replay_s, double limit_ms);
+// --- ---
+
+int main (int argc, char **argv)
+{
+  // Started by os_ctrl as its scanner:
+  if (getenv(PARENT_ENV) != NULL && argc == 2)
+    return run_scanner(atoi(argv[1]));
+
+  const char *app_root = NULL;
+  const char *dummy_app = DEFAULT_DUMMY_APP;
+  double limit_ms = 0;
+  int opt;
+  while ( (opt = getopt(argc, argv, "s:c:x:w:u:a:d:l:")) != -1) {
+    switch (opt) {
+      case 's': setenv(SCENARIO_ENV, optarg, 1); break;
+      case 'c': setenv(CAPTURE_ENV, optarg, 1); break;
+      case 'x': setenv(SPEED_ENV, optarg, 1); break;
+      case 'w': setenv(SETTLE_ENV, optarg, 1); break;
+      case 'u': setenv(ANIM_MS_ENV, optarg, 1); break;
+      case 'a': app_root = optarg; break;
+      case 'd': dummy_app = optarg; break;
+      case 'l': limit_ms = strtod(optarg, NULL); break;
+      default: optind = argc; break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-s scenario | -c capture] [-x factor] "
+        "[-w settle ms]\n  [-u anim ms] [-a app root | -d dummy app] "
+        "[-l p99 limit ms] <os_ctrl>\n", argv[0]);
+    return 1;
+  }
+  const char *os_ctrl = argv[optind];
+
+  // Load the events here too, so that mistakes show before os_ctrl starts:
+  if (!load_events())
+    return 1;
+
+  char self[PATH_MAX];
+  char root[PATH_MAX] = "/tmp/amiibrOS_loadgen.XXXXXX";
+  char socket_path[64];
+  uint32_t *tags = NULL;
+  size_t tag_cnt = 0;
+  if (realpath("/proc/self/exe", self) == NULL) {
+    perror("loadgen unable to find itself\nerror");
+    return 1;
+  }
+  if (app_root == NULL && !make_app_root(root, dummy_app, &tags, &tag_cnt))
+    return 1;
+  sprintf(socket_path, "/tmp/amiibrOS_loadgen.%d.sock", (int)getpid());
+  char pid_str[12];
+  sprintf(pid_str, "%d", (int)getpid());
+  setenv(PARENT_ENV, pid_str, 1);
+  setenv(SCANNER_ENV, self, 1);
+  setenv(APP_ROOT_ENV, app_root != NULL ? app_root : root, 1);
+  setenv(STATS_SOCKET_ENV, socket_path, 1);
+
+  // Our scanner side reports the end of the replay with SIGUSR1:
+  sigset_t block_set, prev_set;
+  sigemptyset(&block_set);
+  sigaddset(&block_set, SIGUSR1);
+  sigaddset(&block_set, SIGCHLD);
+  sigaddset(&block_set, SIGINT);
+  sigaddset(&block_set, SIGTERM);
+  sigprocmask(SIG_BLOCK, &block_set, &prev_set);
+  int sfd = signalfd(-1, &block_set, SFD_CLOEXEC);
+
+  fflush(stdout);
+  pid_t os_pid = fork();
+  if (os_pid == 0) {
+    // os_ctrl signals its own process group when it terminates:
+    setpgid(0, 0);
+    sigprocmask(SIG_SETMASK, &prev_set, NULL);
+    char *const os_argv[] = {(char *)os_ctrl, NULL};
+    execv(os_ctrl, os_argv);
+    perror("loadgen unable to run os_ctrl\nerror");
+    _exit(127);
+  }
+  if (os_pid != -1)
+    setpgid(os_pid, os_pid);
+
+  bool done = false;
+  double replay_s = 0;
+  struct signalfd_siginfo info;
+  while (os_pid != -1 && !done &&
+      read(sfd, &info, sizeof(info)) == sizeof(info)) {
+    if (info.ssi_signo == SIGUSR1 && (pid_t)info.ssi_pid != os_pid) {
+      done = true;
+      replay_s = info.ssi_int / 1e3;
+    }
+    else if (info.ssi_signo == SIGCHLD) {
+      if (waitpid(os_pid, NULL, WNOHANG) == os_pid) {
+        fprintf(stderr, "loadgen: os_ctrl exited during the replay\n");
+        os_pid = -1;
+      }
+    }
+    else if (info.ssi_signo != SIGUSR1)
+      break; // Interrupted
+  }
+
+  bool passed = false;
+  if (done) {
+    char *stats = malloc(STATS_BUF_SIZE);
+    if (stats != NULL && read_stats(socket_path, stats, STATS_BUF_SIZE) > 0)
+      passed = report(stats, replay_s, limit_ms);
+    else
+      fprintf(stderr, "loadgen: unable to read os_ctrl's stats\n");
+    free(stats);
+  }
+
+  if (os_pid > 0) {
+    kill(-os_pid, SIGTERM);
+    waitpid(os_pid, NULL, 0);
+  }
+  unlink(socket_path);
+  if (app_root == NULL)
+    remove_app_root(root, tags, tag_cnt);
+  free(tags);
+  free(events);
+  return passed ? 0 : 1;
+}
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Appends an event to events. Returns false if out of memory.
+bool add_event (uint64_t at_ns, const scan_event *ev, bool unknown)
+{
+  if (event_cnt == event_cap) {
+    size_t cap = event_cap > 0 ? 2 * event_cap : 64;
+    load_event *grown = realloc(events, cap * sizeof(load_event));
+    if (grown == NULL)
+      return false;
+    events = grown;
+    event_cap = cap;
+  }
+  events[event_cnt].at_ns = at_ns;
+  events[event_cnt].ev = *ev;
+  events[event_cnt].unknown = unknown;
+  event_cnt++;
+  return true;
+}
+
+/**
+ * Adds cnt tags interval_ms apart at the clock, going round the id_cnt ids
+ *   (unknown tags if there are none), and advances the clock past them.
+ */
+bool add_tags (uint64_t *clock, unsigned long cnt, unsigned long interval_ms,
+    char **ids, size_t id_cnt)
+{
+  static uint32_t unknown_cnt = 0;
+  static const uint8_t uid[] = {0x04, 0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6};
+
+  scan_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.type = SCAN_EV_TAG;
+  ev.uid_len = sizeof(uid);
+  memcpy(ev.uid, uid, sizeof(uid));
+
+  for (unsigned long i = 0; i < cnt; i++) {
+    if (id_cnt > 0) {
+      if (!parse_id(ids[i % id_cnt], ev.id))
+        return false;
+    }
+    else {
+      uint32_t tag = UNKNOWN_TAG + (unknown_cnt++ & 0xFFFF);
+      memset(ev.id, 0, SCAN_ID_SIZE);
+      for (int b = 0; b < 4; b++)
+        ev.id[b] = tag >> (24 - 8 * b);
+    }
+    if (!add_event(*clock, &ev, id_cnt == 0))
+      return false;
+    *clock += interval_ms * 1000000ull;
+  }
+  return true;
+}
+
+// Parses an 8 or 16 digit hex amiibo ID into id.
+bool parse_id (const char *str, uint8_t *id)
+{
+  size_t len = strlen(str);
+  if (len != 8 && len != 2 * SCAN_ID_SIZE)
+    return false;
+
+  memset(id, 0, SCAN_ID_SIZE);
+  for (size_t i = 0; i < len / 2; i++) {
+    char byte[3] = {str[2 * i], str[2 * i + 1], '\0'};
+    char *end;
+    id[i] = strtoul(byte, &end, 16);
+    if (*end != '\0')
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Adds the events of a single scenario line (see above) at the clock.
+ *
+ * Returns false if the line is malformed.
+ */
+bool parse_line (char *line, uint64_t *clock)
+{
+  char *comment = strchr(line, '#');
+  if (comment != NULL)
+    *comment = '\0';
+
+  char *args[32];
+  size_t arg_cnt = 0;
+  for (char *tok = strtok(line, " \t\r\n"); tok != NULL && arg_cnt < 32;
+       tok = strtok(NULL, " \t\r\n"))
+    args[arg_cnt++] = tok;
+  if (arg_cnt == 0)
+    return true; // Blank
+
+  const char *cmd = args[0];
+  unsigned long num1 = arg_cnt > 1 ? strtoul(args[1], NULL, 10) : 0;
+  unsigned long num2 = arg_cnt > 2 ? strtoul(args[2], NULL, 10) : 0;
+  scan_event ev;
+  memset(&ev, 0, sizeof(ev));
+
+  if (strcmp(cmd, "wait") == 0 && arg_cnt == 2)
+    *clock += num1 * 1000000ull;
+  else if (strcmp(cmd, "tag") == 0 && arg_cnt >= 2 && arg_cnt <= 4) {
+    unsigned long cnt = arg_cnt > 2 ? num2 : 1;
+    unsigned long interval = arg_cnt > 3 ? strtoul(args[3], NULL, 10) : 0;
+    return add_tags(clock, cnt, interval, &args[1], 1);
+  }
+  else if (strcmp(cmd, "cycle") == 0 && arg_cnt >= 4)
+    return add_tags(clock, num1, num2, &args[3], arg_cnt - 3);
+  else if (strcmp(cmd, "unknown") == 0 && arg_cnt <= 3)
+    return add_tags(clock, arg_cnt > 1 ? num1 : 1, num2, NULL, 0);
+  else if (strcmp(cmd, "removed") == 0 && arg_cnt == 1) {
+    ev.type = SCAN_EV_REMOVED;
+    return add_event(*clock, &ev, false);
+  }
+  else if (strcmp(cmd, "error") == 0 && arg_cnt <= 2) {
+    ev.type = SCAN_EV_ERROR;
+    ev.error = arg_cnt > 1 ? num1 : SCAN_ERR_UNKNOWN_TAG;
+    return add_event(*clock, &ev, false);
+  }
+  else
+    return false;
+  return true;
+}
+
+/**
+ * Adds the events of every line of the scenario in file (or of lines, if file
+ *   is NULL).
+ */
+bool load_scenario_lines (FILE *file, const char **lines)
+{
+  uint64_t clock = 0;
+  char *line = NULL;
+  size_t line_size = 0;
+  unsigned long line_no = 0;
+  bool ok = true;
+
+  while (ok) {
+    if (file != NULL) {
+      if (getline(&line, &line_size, file) == -1)
+        break;
+    }
+    else {
+      if (lines[line_no] == NULL)
+        break;
+      free(line);
+      if ( (line = strdup(lines[line_no])) == NULL)
+        return false;
+    }
+    line_no++;
+    if ( !(ok = parse_line(line, &clock)) )
+      fprintf(stderr, "loadgen: scenario line %lu is malformed\n", line_no);
+  }
+  free(line);
+  return ok;
+}
+
+// Adds every event of the capture at path, keeping their spacing.
+bool load_capture (const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return false;
+
+  scan_reader reader;
+  scan_reader_init(&reader);
+  scan_event ev;
+  uint64_t first_ns = 0;
+  long rd_cnt;
+  while ( (rd_cnt = scan_reader_fill(&reader, fd)) > 0) {
+    while (scan_reader_next(&reader, &ev)) {
+      if (event_cnt == 0)
+        first_ns = ev.ts_ns;
+      uint64_t at = ev.ts_ns > first_ns ? ev.ts_ns - first_ns : 0;
+      if (!add_event(at, &ev, false)) {
+        close(fd);
+        return false;
+      }
+    }
+  }
+  close(fd);
+  return rd_cnt == 0;
+}
+
+// Loads the events to replay, as chosen by the options (see main).
+bool load_events (void)
+{
+  const char *capture = getenv(CAPTURE_ENV);
+  const char *scenario = getenv(SCENARIO_ENV);
+  bool ok;
+
+  if (capture != NULL) {
+    if ( !(ok = load_capture(capture)) )
+      perror("loadgen unable to load capture\nerror");
+  }
+  else if (scenario != NULL) {
+    FILE *file = fopen(scenario, "r");
+    if (file == NULL) {
+      perror("loadgen unable to open scenario\nerror");
+      return false;
+    }
+    ok = load_scenario_lines(file, NULL);
+    fclose(file);
+  }
+  else
+    ok = load_scenario_lines(NULL, DEFAULT_SCENARIO);
+
+  if (ok && event_cnt == 0) {
+    fprintf(stderr, "loadgen: nothing to replay\n");
+    ok = false;
+  }
+  return ok;
+}
+
+/**
+ * The scanner side: replays every event into fd, then tells the parent side
+ *   how long the replay took once the last launch had time to settle. Runs
+ *   until os_ctrl stops it.
+ */
+int run_scanner (int fd)
+{
+  pid_t parent = atoi(getenv(PARENT_ENV));
+  const char *speed_str = getenv(SPEED_ENV);
+  const char *settle_str = getenv(SETTLE_ENV);
+  double speed = speed_str != NULL ? strtod(speed_str, NULL) : 1;
+  long settle_ms = settle_str != NULL ? atol(settle_str) : DEFAULT_SETTLE_MS;
+  if (speed <= 0)
+    speed = 1;
+
+  if (!load_events())
+    return 1;
+
+  unsigned long cnt[4] = {0, 0, 0, 0}; // Tags, unknown tags, removals, errors
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < event_cnt; i++) {
+    uint64_t at = start + (uint64_t)(events[i].at_ns / speed);
+    struct timespec ts = {at / 1000000000ull, at % 1000000000ull};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+        EINTR);
+
+    // os_ctrl times the launch from the moment we "saw" the event:
+    uint8_t frame[SCAN_PROTO_FRAME_MAX];
+    events[i].ev.ts_ns = now_ns();
+    size_t len = scan_event_encode(&events[i].ev, frame);
+    if (len == 0 || write(fd, frame, len) != (ssize_t)len)
+      return 1; // os_ctrl is gone
+    if (events[i].ev.type == SCAN_EV_TAG)
+      cnt[events[i].unknown ? 1 : 0]++;
+    else
+      cnt[events[i].ev.type == SCAN_EV_REMOVED ? 2 : 3]++;
+  }
+  double replay_s = (now_ns() - start) / 1e9;
+  printf("loadgen: sent %lu tags, %lu unknown tags, %lu removals and %lu "
+      "errors in %.3f s (%.1f tags/s)\n", cnt[0], cnt[1], cnt[2], cnt[3],
+      replay_s, replay_s > 0 ? (cnt[0] + cnt[1]) / replay_s : 0);
+  fflush(stdout);
+
+  struct timespec settle = {settle_ms / 1000, (settle_ms % 1000) * 1000000L};
+  while (nanosleep(&settle, &settle) == -1 && errno == EINTR);
+  union sigval value;
+  value.sival_int = (int)(replay_s * 1e3);
+  sigqueue(parent, SIGUSR1, value);
+
+  for (;;)
+    pause(); // os_ctrl takes us down with it
+}
+
+/**
+ * Creates a temporary app root from the template in root (replaced by the
+ *   actual path) with an app running dummy_app for every tag to replay that
+ *   is not unknown. The tags are stored in a new array in tags.
+ */
+bool make_app_root (char *root, const char *dummy_app, uint32_t **tags,
+    size_t *tag_cnt)
+{
+  char dummy_path[PATH_MAX];
+  if (realpath(dummy_app, dummy_path) == NULL) {
+    perror("loadgen unable to find the dummy app\nerror");
+    return false;
+  }
+  if (mkdtemp(root) == NULL) {
+    perror("loadgen unable to create app root\nerror");
+    return false;
+  }
+  if ( (*tags = malloc(event_cnt * sizeof(uint32_t))) == NULL)
+    return false;
+
+  for (size_t i = 0; i < event_cnt; i++) {
+    const scan_event *ev = &events[i].ev;
+    if (ev->type != SCAN_EV_TAG || events[i].unknown)
+      continue;
+    uint32_t tag = (uint32_t)ev->id[0] << 24 | (uint32_t)ev->id[1] << 16 |
+                   (uint32_t)ev->id[2] << 8 | (uint32_t)ev->id[3];
+    size_t t = 0;
+    while (t < *tag_cnt && (*tags)[t] != tag)
+      t++;
+    if (t < *tag_cnt)
+      continue; // Already made
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%08X", root, tag);
+    if (mkdir(path, 0755) == -1)
+      return false;
+    snprintf(path, sizeof(path), "%s/%08X/%08X.sh", root, tag, tag);
+    FILE *script = fopen(path, "w");
+    if (script == NULL)
+      return false;
+    fprintf(script, "#!/bin/sh\nexec %s\n", dummy_path);
+    fclose(script);
+    (*tags)[(*tag_cnt)++] = tag;
+  }
+  return true;
+}
+
+// Removes everything make_app_root created.
+void remove_app_root (const char *root, const uint32_t *tags, size_t tag_cnt)
+{
+  char path[PATH_MAX];
+  for (size_t t = 0; t < tag_cnt; t++) {
+    snprintf(path, sizeof(path), "%s/%08X/%08X.sh", root, tags[t], tags[t]);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%08X", root, tags[t]);
+    rmdir(path);
+  }
+  rmdir(root);
+}
+
+/**
+ * Reads everything os_ctrl's stats socket has to say into buf (NUL
+ *   terminated). Returns the length read, or -1.
+ */
+long read_stats (const char *socket_path, char *buf, size_t size)
+{
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  size_t len = 0;
+  ssize_t rd_cnt;
+  while (len < size - 1 &&
+      (rd_cnt = read(fd, buf + len, size - 1 - len)) > 0)
+    len += rd_cnt;
+  close(fd);
+  buf[len] = '\0';
+  return len;
+}
+
+/**
+ * Prints os_ctrl's stats along with the throughput over the replay. Returns
+ *   whether they pass (see the top of this file).
+ */
+bool report (const char *stats, double replay_s, double limit_ms)
+{
+  fputs(stats, stdout);
+
+  unsigned long launch_cnt = 0, first_frame_cnt = 0;
+  const char *line = strstr(stats, "stats: ");
+  if (line == NULL || sscanf(line, "stats: %lu launches, %lu reached",
+        &launch_cnt, &first_frame_cnt) != 2) {
+    fprintf(stderr, "loadgen: unable to parse os_ctrl's stats\n");
+    return false;
+  }
+  printf("loadgen: %lu launches, %lu reached a first frame, in %.3f s "
+      "(%.2f launches/s)\n", launch_cnt, first_frame_cnt, replay_s,
+      replay_s > 0 ? launch_cnt / replay_s : 0);
+
+  bool passed = true;
+  bool any_app = false;
+  for (size_t i = 0; i < event_cnt; i++)
+    any_app |= events[i].ev.type == SCAN_EV_TAG && !events[i].unknown;
+  if (any_app && first_frame_cnt == 0) {
+    printf("loadgen: FAILED, no app reached its first frame\n");
+    passed = false;
+  }
+
+  unsigned long cnt;
+  double mean, p50, p95, p99, max;
+  line = strstr(stats, "\n  end_to_end ");
+  if (line != NULL && sscanf(line, " end_to_end %lu %lf %lf %lf %lf %lf",
+        &cnt, &mean, &p50, &p95, &p99, &max) == 6) {
+    printf("loadgen: end_to_end p50 %.3f p99 %.3f max %.3f (ms)\n", p50, p99,
+        max);
+    if (limit_ms > 0 && p99 > limit_ms) {
+      printf("loadgen: FAILED, p99 end_to_end is above %.3f ms\n", limit_ms);
+      passed = false;
+    }
+  }
+  else if (limit_ms > 0) {
+    printf("loadgen: FAILED, no end_to_end latency to check\n");
+    passed = false;
+  }
+
+  if (passed)
+    printf("loadgen: passed\n");
+  return passed;
+}
@@ -0,0 +1,138 @@
+/**
+ * test_coalesce.c
+ *
+ * Checks that a burst of scans results in a single launch of the latest tag.
+ *
+ * The fake scanner (test/amiibo_scan/amiibo_scan.py) is run in burst mode,
+ *   writing its frames to a pipe exactly as it would to os_ctrl. They are read
+ *   and coalesced with os_ctrl's own scan_reader and scan_queue, following the
+ *   launch path of os_ctrl's main loop: each launch first blocks for a
+ *   simulated success animation, after which scan_queue_supersedes decides,
+ *   as it does for os_ctrl, whether a newer tag cancels it. A launch that
+ *   survives counts as exec'd.
+ *
+ * Usage: test_coalesce <fake amiibo_scan.py> [scans] [interval ms]
+ *
+ * Exits with 0 if exactly one launch, of the burst's last tag, happened.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // pipe2
+
+#include <stdio.h> // printf, fprintf, perror, sprintf
+#include <stdlib.h> // atoi
+#include <stdint.h> // uint32_t, uint64_t
+#include <errno.h> // errno
+#include <fcntl.h> // O_CLOEXEC, O_NONBLOCK, fcntl
+#include <poll.h> // poll
+#include <time.h> // nanosleep
+#include <unistd.h> // pipe2, fork, execlp, close, _exit
+#include <sys/wait.h> // waitpid
+#include "../app_index.h" // app_index_tag
+#include "../scan_proto.h"
+#include "../scan_queue.h"
+
+#define DEFAULT_SCANS "20"
+#define DEFAULT_INTERVAL_MS "1"
+#define DEBOUNCE_MS 1000 // As in os_ctrl
+#define ANIM_MS 300 // Stand-in for the success animation and fade out
+#define EXPECTED_TAG 0x01030000u // Last tag of every burst
+
+static scan_reader reader;
+static scan_queue queue;
+static int scan_fd;
+static bool scanner_done = false; // Set at EOF
+
+// Reads and queues whatever the scanner has written so far, like os_ctrl.
+void read_scans (void)
+{
+  long rd_cnt = scan_reader_fill(&reader, scan_fd);
+  if (rd_cnt == 0)
+    scanner_done = true;
+  if (rd_cnt <= 0)
+    return;
+
+  scan_event ev;
+  while (scan_reader_next(&reader, &ev)) {
+    if (ev.type == SCAN_EV_TAG)
+      scan_queue_push(&queue, app_index_tag(ev.id), ev.ts_ns);
+  }
+}
+
+// Every tag of the burst stands for an app (os_ctrl asks its app index).
+bool any_app (uint32_t tag)
+{
+  (void)tag;
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <amiibo_scan.py> [scans] [interval ms]\n",
+        argv[0]);
+    return 1;
+  }
+  const char *scans = argc > 2 ? argv[2] : DEFAULT_SCANS;
+  const char *interval = argc > 3 ? argv[3] : DEFAULT_INTERVAL_MS;
+  if (atoi(scans) <= 0)
+    scans = DEFAULT_SCANS;
+
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    perror("test_coalesce unable to create pipe\nerror");
+    return 1;
+  }
+  pid_t scanner = fork();
+  if (scanner == 0) {
+    char fd_str[12];
+    fcntl(fds[1], F_SETFD, 0); // The scanner writes to it
+    sprintf(fd_str, "%d", fds[1]);
+    execlp("python3", "python3", argv[1], fd_str, "burst", scans, interval,
+        (char *)NULL);
+    perror("test_coalesce unable to run scanner\nerror");
+    _exit(127);
+  }
+  close(fds[1]);
+  scan_fd = fds[0];
+  fcntl(scan_fd, F_SETFL, O_NONBLOCK);
+  scan_reader_init(&reader);
+  scan_queue_init(&queue, DEBOUNCE_MS);
+
+  unsigned long launch_cnt = 0;
+  uint32_t launched = 0;
+  struct pollfd pfd = {scan_fd, POLLIN, 0};
+  while (!scanner_done) {
+    if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+      break;
+    read_scans();
+
+    uint32_t tag;
+    uint64_t ts_ns;
+    while (scan_queue_take(&queue, &tag, &ts_ns)) {
+      // The UI blocks os_ctrl while the scanner keeps writing:
+      struct timespec anim = {0, ANIM_MS * 1000000L};
+      nanosleep(&anim, NULL);
+
+      read_scans();
+      if (scan_queue_supersedes(&queue, any_app))
+        continue;
+      launch_cnt++;
+      launched = tag;
+    }
+  }
+  waitpid(scanner, NULL, 0);
+
+  printf("test_coalesce: %lu tags (%lu debounced, %lu superseded), "
+      "%lu launch(es), last %08X\n", queue.push_cnt, queue.debounce_cnt,
+      queue.supersede_cnt, launch_cnt, (unsigned int)launched);
+  if (queue.push_cnt != 2 * (unsigned long)atoi(scans) || launch_cnt != 1 ||
+      launched != EXPECTED_TAG) {
+    printf("test_coalesce: FAILED, expected 1 launch of %08X\n",
+        EXPECTED_TAG);
+    return 1;
+  }
+  printf("test_coalesce: passed\n");
+  return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * test_log_ring.c
+ *
+ * Checks os_ctrl's log ring (see log_ring.h) under contention: several writer
+ *   threads log as fast as they can while this thread takes the records, the
+ *   way the drain thread does.
+ *
+ * Each writer numbers its records. Every record the ring accepted must be
+ *   taken exactly once, intact and in the order its writer logged it; records
+ *   the ring refused (log_write returned false) must be the only ones
+ *   missing. Also checks that a record's text is truncated and formatted as
+ *   documented.
+ *
+ * Usage: test_log_ring [writers] [records per writer]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf
+#include <stdlib.h> // atoi, calloc, free
+#include <string.h> // strcmp, strstr
+#include <pthread.h> // pthread_create, pthread_join
+#include "../log_ring.h"
+
+#define DEFAULT_WRITERS 4
+#define DEFAULT_RECORDS 200000
+#define MAX_WRITERS 16
+
+// A writer's progress:
+typedef struct writer
+{
+  pthread_t thread;
+  uint64_t id;
+  uint64_t record_cnt; // Records to log
+  uint64_t accepted; // Records the ring took
+} writer;
+
+static writer writers[MAX_WRITERS];
+static size_t writer_cnt;
+static size_t writers_done; // Atomic
+
+// Logs the writer's records: its id, the record's number and a checksum.
+void *run_writer (void *arg)
+{
+  writer *w = arg;
+  for (uint64_t i = 0; i < w->record_cnt; i++) {
+    if (log_write(LOG_EV_SCAN, 0, NULL, w->id, i, w->id * 31 + i))
+      w->accepted++;
+  }
+  __atomic_add_fetch(&writers_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+// Checks that the text and format of a record come out as documented.
+bool check_format (void)
+{
+  log_record rec;
+  char line[LOG_RING_LINE_LEN];
+  log_write(LOG_EV_PIPE_FAILED, 24, "handoff and a lot more than fits", 0xAB,
+      0, 0);
+  if (!log_ring_take(&rec) || strcmp(rec.text, "handoff and a lot more ") ||
+      rec.level != LOG_RING_ERROR) {
+    fprintf(stderr, "test_log_ring: record text or level is wrong\n");
+    return false;
+  }
+  log_ring_format(&rec, line, sizeof(line));
+  if (strstr(line, "ERROR pipe_failed: unable to create handoff and a lot "
+      "more  pipe for app 000000AB: ") == NULL) {
+    fprintf(stderr, "test_log_ring: bad line: %s\n", line);
+    return false;
+  }
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  writer_cnt = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_WRITERS;
+  uint64_t record_cnt = argc > 2 ? (uint64_t)atoi(argv[2]) : DEFAULT_RECORDS;
+  if (writer_cnt == 0 || writer_cnt > MAX_WRITERS || record_cnt == 0) {
+    fprintf(stderr, "usage: %s [writers (1-%d)] [records per writer]\n",
+        argv[0], MAX_WRITERS);
+    return 1;
+  }
+
+  log_ring_init();
+  if (!check_format())
+    return 1;
+
+  uint64_t next[MAX_WRITERS] = {0}; // Lowest record number each may be next
+  uint64_t taken[MAX_WRITERS] = {0};
+  for (size_t i = 0; i < writer_cnt; i++) {
+    writers[i].id = i;
+    writers[i].record_cnt = record_cnt;
+    if (pthread_create(&writers[i].thread, NULL, run_writer, &writers[i])) {
+      fprintf(stderr, "test_log_ring: unable to start writers\n");
+      return 1;
+    }
+  }
+
+  // Take records until every writer is done and the ring is empty:
+  bool ok = true;
+  log_record rec;
+  for (;;) {
+    bool done = __atomic_load_n(&writers_done, __ATOMIC_ACQUIRE) ==
+        writer_cnt;
+    if (!log_ring_take(&rec)) {
+      if (done)
+        break;
+      continue;
+    }
+
+    uint64_t id = rec.args[0];
+    if (rec.event != LOG_EV_SCAN || id >= writer_cnt ||
+        rec.args[2] != id * 31 + rec.args[1] || rec.args[1] < next[id]) {
+      fprintf(stderr, "test_log_ring: bad or out of order record (writer "
+          "%llu, record %llu)\n", (unsigned long long)id,
+          (unsigned long long)rec.args[1]);
+      ok = false;
+      break;
+    }
+    next[id] = rec.args[1] + 1;
+    taken[id]++;
+  }
+
+  uint64_t sent = 0, accepted = 0, received = 0;
+  for (size_t i = 0; i < writer_cnt; i++) {
+    pthread_join(writers[i].thread, NULL);
+    sent += writers[i].record_cnt;
+    accepted += writers[i].accepted;
+    received += taken[i];
+    if (ok && taken[i] != writers[i].accepted) {
+      fprintf(stderr, "test_log_ring: writer %zu had %llu records accepted, "
+          "but %llu were taken\n", i,
+          (unsigned long long)writers[i].accepted,
+          (unsigned long long)taken[i]);
+      ok = false;
+    }
+  }
+
+  printf("test_log_ring: %zu writers logged %llu records, %llu accepted "
+      "(%llu dropped to a full ring), %llu taken\n", writer_cnt,
+      (unsigned long long)sent, (unsigned long long)accepted,
+      (unsigned long long)(sent - accepted), (unsigned long long)received);
+  printf("test_log_ring: %s\n", ok ? "passed" : "FAILED");
+  return ok ? 0 : 1;
+}
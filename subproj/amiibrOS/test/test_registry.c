@@ -0,0 +1,175 @@
+/**
+ * test_registry.c
+ *
+ * Checks that a registry compiled by regc resolves tags by the precedence its
+ *   patterns promise, and that os_ctrl refuses damaged registry files.
+ *
+ * Usage: test_registry <regc>
+ *
+ * Exits with 0 if every check passed.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, fopen, fputs, fseek, fputc, snprintf
+#include <stdlib.h> // system, mkdtemp
+#include <string.h> // strcmp
+#include <errno.h> // errno
+#include <unistd.h> // unlink, rmdir
+#include "../registry.h"
+
+// Every kind of pattern, deliberately out of order:
+#define SAMPLE_REGISTRY \
+  "# Sample registry\n" \
+  "default   gallery\n" \
+  "01*       zelda      # The whole series\n" \
+  "0100??00  link       # Every Link\n" \
+  "01000000  link_ssb\n" \
+  "0100????  hyrule\n" \
+  "0?000000  firsts\n" \
+  "DEADbeef  gallery\n"
+
+// Two entries with the same pattern:
+#define DUPLICATE_REGISTRY \
+  "01??????  zelda\n" \
+  "01*       link\n"
+
+// A tag and the app it must resolve to:
+typedef struct expectation
+{
+  uint32_t tag;
+  const char *app;
+} expectation;
+
+static const expectation expected[] = {
+  {0x01000000, "link_ssb"}, // Exact beats everything
+  {0x01000100, "link"}, // 0100??00 beats 0100????
+  {0x0100FF00, "link"},
+  {0x01000001, "hyrule"}, // Not a ??00 variant
+  {0x01010000, "zelda"}, // 01* beats 0?000000 (its wildcard comes later)
+  {0x02000000, "firsts"},
+  {0x02000001, "gallery"}, // Only the default matches
+  {0xDEADBEEF, "gallery"},
+  {0x00000000, "firsts"},
+};
+
+static const char *regc_path;
+static char dir[] = "/tmp/test_registry.XXXXXX";
+static char txt_path[64];
+static char bin_path[64];
+static int failures = 0;
+
+// --- Helper Function Prototypes ---
+bool write_text (const char *path, const char *text);
+int run_regc (void);
+void check (bool ok, const char *what);
+bool corrupt_and_load (long offset, int byte);
+// --- ---
+
+int main (int argc, char **argv)
+{
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <regc>\n", argv[0]);
+    return 1;
+  }
+  if (mkdtemp(dir) == NULL) {
+    perror("test_registry unable to create directory\nerror");
+    return 1;
+  }
+  regc_path = argv[1];
+  snprintf(txt_path, sizeof(txt_path), "%s/registry.txt", dir);
+  snprintf(bin_path, sizeof(bin_path), "%s/registry.bin", dir);
+
+  // A duplicate pattern is a compile error:
+  check(write_text(txt_path, DUPLICATE_REGISTRY) && run_regc() != 0,
+      "regc rejects duplicate patterns");
+
+  registry reg;
+  bool loaded = write_text(txt_path, SAMPLE_REGISTRY) &&
+                run_regc() == 0 && registry_load(&reg, bin_path);
+  check(loaded, "regc output loads");
+  if (loaded) {
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+      int app = registry_lookup(&reg, expected[i].tag);
+      bool ok = app >= 0 && strcmp(reg.apps[app], expected[i].app) == 0;
+      if (!ok) {
+        printf("test_registry: %08X -> %s, expected %s\n", expected[i].tag,
+            app >= 0 ? reg.apps[app] : "(none)", expected[i].app);
+      }
+      check(ok, "lookup");
+    }
+    check(reg.app_cnt == 6, "apps are shared by their entries");
+    check(registry_find_app(&reg, "hyrule") >= 0 &&
+          registry_find_app(&reg, "nobody") == -1, "apps found by name");
+    registry_free(&reg);
+  }
+
+  // A child pointing past the last node, and a wrong version:
+  check(corrupt_and_load(REGISTRY_HEADER_SIZE + REGISTRY_FANOUT * 2 + 1, 0xFF),
+      "out of range child rejected");
+  check(corrupt_and_load(4, 2), "unknown version rejected");
+  check(!registry_load(&reg, "/nonexistent/registry.bin") && errno == ENOENT,
+      "missing file reported as ENOENT");
+
+  unlink(txt_path);
+  unlink(bin_path);
+  rmdir(dir);
+  if (failures > 0) {
+    printf("test_registry: FAILED (%d checks)\n", failures);
+    return 1;
+  }
+  printf("test_registry: passed\n");
+  return 0;
+}
+
+// Writes text to the file at path. Returns false on error.
+bool write_text (const char *path, const char *text)
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+    return false;
+  bool ok = fputs(text, file) >= 0;
+  return fclose(file) == 0 && ok;
+}
+
+// Compiles txt_path into bin_path. Returns regc's exit status.
+int run_regc (void)
+{
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "%s %s %s >/dev/null 2>&1", regc_path, txt_path,
+      bin_path);
+  return system(cmd);
+}
+
+// Records a failed check.
+void check (bool ok, const char *what)
+{
+  if (!ok) {
+    printf("test_registry: check failed: %s\n", what);
+    failures++;
+  }
+}
+
+/**
+ * Recompiles the sample, overwrites the byte at offset of the binary with
+ *   byte and returns whether loading it failed with EINVAL.
+ */
+bool corrupt_and_load (long offset, int byte)
+{
+  registry reg;
+  if (run_regc() != 0)
+    return false;
+  FILE *file = fopen(bin_path, "r+b");
+  if (file == NULL)
+    return false;
+  bool written = fseek(file, offset, SEEK_SET) == 0 &&
+                 fputc(byte, file) != EOF;
+  if (fclose(file) != 0 || !written)
+    return false;
+
+  if (registry_load(&reg, bin_path)) {
+    registry_free(&reg);
+    return false;
+  }
+  return errno == EINVAL;
+}
@@ -0,0 +1,130 @@
+/**
+ * ui_queue.c
+ *
+ * Contains implementation of ui_queue.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <errno.h> // errno
+#include <poll.h> // poll
+#include <unistd.h> // read, write, close
+#include <sys/eventfd.h> // eventfd
+#include "ui_queue.h"
+
+bool ui_queue_init (ui_queue *queue)
+{
+  queue->head = 0;
+  queue->tail = 0;
+  queue->done_seq = 0;
+  queue->next_seq = 1;
+  queue->sleeping = 0;
+  queue->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (queue->done_fd == -1)
+    return false;
+  queue->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (queue->wake_fd == -1) {
+    int err = errno;
+    close(queue->done_fd);
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+uint32_t ui_queue_push (ui_queue *queue, ui_cmd_type type, uint32_t arg)
+{
+  uint32_t head = queue->head; // Only ever written by us
+  uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  if (head - tail == UI_QUEUE_CAPACITY)
+    return 0;
+
+  ui_cmd *cmd = &queue->cmds[head & (UI_QUEUE_CAPACITY - 1)];
+  cmd->type = type;
+  cmd->arg = arg;
+  cmd->seq = queue->next_seq;
+  if (++queue->next_seq == 0)
+    queue->next_seq = 1; // 0 means a full queue
+  __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE); // Publish
+
+  // Pairs with the fence in ui_queue_sleep: either the consumer sees the
+  //   command before it sleeps, or we see it sleeping and wake it:
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&queue->sleeping, __ATOMIC_RELAXED)) {
+    uint64_t one = 1;
+    (void)!write(queue->wake_fd, &one, sizeof(one)); // Fails only if pending
+  }
+  return cmd->seq;
+}
+
+bool ui_queue_pop (ui_queue *queue, ui_cmd *cmd)
+{
+  uint32_t tail = queue->tail; // Only ever written by us
+  if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail)
+    return false;
+
+  *cmd = queue->cmds[tail & (UI_QUEUE_CAPACITY - 1)];
+  // Hands the slot back to the producer:
+  __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool ui_queue_sleep (ui_queue *queue, int timeout_ms)
+{
+  __atomic_store_n(&queue->sleeping, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int ready = 0;
+  if (__atomic_load_n(&queue->head, __ATOMIC_RELAXED) == queue->tail) {
+    struct pollfd pfd = {queue->wake_fd, POLLIN, 0};
+    ready = poll(&pfd, 1, timeout_ms);
+  }
+  int err = errno;
+  __atomic_store_n(&queue->sleeping, 0, __ATOMIC_RELAXED);
+
+  // Reset it for the next sleep (wakes meant for an earlier one included):
+  uint64_t cnt;
+  (void)!read(queue->wake_fd, &cnt, sizeof(cnt)); // EAGAIN: not signalled
+  if (ready == -1 && err != EINTR) {
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+void ui_queue_complete (ui_queue *queue, uint32_t seq)
+{
+  __atomic_store_n(&queue->done_seq, seq, __ATOMIC_RELEASE);
+  uint64_t one = 1;
+  // Only fails if the counter would overflow, which still wakes the waiter:
+  (void)!write(queue->done_fd, &one, sizeof(one));
+}
+
+bool ui_queue_done (ui_queue *queue, uint32_t seq)
+{
+  uint32_t done = __atomic_load_n(&queue->done_seq, __ATOMIC_ACQUIRE);
+  return (int32_t)(done - seq) >= 0; // Survives the numbers wrapping around
+}
+
+void ui_queue_clear (ui_queue *queue)
+{
+  uint64_t cnt;
+  (void)!read(queue->done_fd, &cnt, sizeof(cnt)); // EAGAIN: already reset
+}
+
+bool ui_queue_wait (ui_queue *queue, uint32_t seq)
+{
+  // Completion is published before done_fd is signalled, so a completion
+  //   between the check and the poll still wakes us:
+  while (!ui_queue_done(queue, seq)) {
+    struct pollfd pfd = {queue->done_fd, POLLIN, 0};
+    if (poll(&pfd, 1, -1) == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    uint64_t cnt;
+    if (read(queue->done_fd, &cnt, sizeof(cnt)) == -1 && errno != EAGAIN)
+      return false;
+  }
+  return true;
+}
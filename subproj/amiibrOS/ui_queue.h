@@ -0,0 +1,110 @@
+/**
+ * ui_queue.h
+ *
+ * Contains prototypes for the command queue from os_ctrl's main thread to its
+ *   UI thread.
+ *
+ * The UI thread checks for commands once per frame, so the check has to cost
+ *   next to nothing when there are none (nearly always). The queue is a
+ *   single-producer, single-consumer ring: os_ctrl's main thread pushes, the
+ *   UI thread pops, and each side only ever writes its own index. Popping an
+ *   empty queue is two atomic loads, without any lock or system call.
+ *
+ * Every command carries a sequence number. When the UI thread is done with a
+ *   command (e.g. its animation finished), it publishes that number and adds
+ *   to an eventfd, which os_ctrl can block on or poll together with its other
+ *   event sources.
+ *
+ * Between frames, the UI thread may sleep on the queue (see ui_queue_sleep)
+ *   instead of a timer, so that a command wakes it at once. Only a push to a
+ *   sleeping UI thread costs a system call.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef UI_QUEUE_H
+#define UI_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h> // uint32_t
+
+// Commands the queue holds at once (a power of 2):
+#define UI_QUEUE_CAPACITY 16
+
+typedef enum ui_cmd_type
+{
+  UI_CMD_SCAN_SUCCESS, // Play the scan success animation
+  UI_CMD_SCAN_FAIL, // Play the scan failed animation
+  UI_CMD_CANCEL, // Stop the animation of the command numbered arg
+  UI_CMD_STOP // Fade out and end the UI thread
+} ui_cmd_type;
+
+typedef struct ui_cmd
+{
+  ui_cmd_type type;
+  uint32_t seq; // Set by ui_queue_push
+  uint32_t arg; // Sequence number a UI_CMD_CANCEL refers to
+} ui_cmd;
+
+typedef struct ui_queue
+{
+  ui_cmd cmds[UI_QUEUE_CAPACITY];
+  // Each index is written by one side only. They are kept on cache lines of
+  //   their own so that the sides do not slow each other down:
+  uint32_t head __attribute__((aligned(64))); // Next to push (producer)
+  uint32_t tail __attribute__((aligned(64))); // Next to pop (consumer)
+  uint32_t sleeping; // Whether the consumer is in ui_queue_sleep (consumer)
+  uint32_t done_seq __attribute__((aligned(64))); // Last command completed
+  uint32_t next_seq; // Producer only
+  int done_fd; // eventfd counting completions
+  int wake_fd; // eventfd signalled by pushes while the consumer sleeps
+} ui_queue;
+
+/**
+ * Prepares an empty queue and its eventfds (non-blocking, closed on exec).
+ *   Returns false (with errno set) if they can not be created.
+ */
+bool ui_queue_init (ui_queue *queue);
+
+/**
+ * Pushes a command of the given type and argument (producer only). Returns its
+ *   sequence number, or 0 if the queue is full.
+ */
+uint32_t ui_queue_push (ui_queue *queue, ui_cmd_type type, uint32_t arg);
+
+/**
+ * Pops the oldest command into cmd (consumer only). Returns false if there is
+ *   none.
+ */
+bool ui_queue_pop (ui_queue *queue, ui_cmd *cmd);
+
+/**
+ * Blocks until a command is pushed or timeout_ms milliseconds pass, whichever
+ *   comes first (consumer only). Returns at once if a command is waiting
+ *   already. Returns false (with errno set) if waiting failed.
+ */
+bool ui_queue_sleep (ui_queue *queue, int timeout_ms);
+
+/**
+ * Marks the command of the given sequence number (and every one before it)
+ *   as completed and signals done_fd (consumer only).
+ */
+void ui_queue_complete (ui_queue *queue, uint32_t seq);
+
+// Returns whether the command of the given sequence number has completed.
+bool ui_queue_done (ui_queue *queue, uint32_t seq);
+
+/**
+ * Resets done_fd once it has been seen readable (producer only). Completions
+ *   after the reset signal it again, so check ui_queue_done after this.
+ */
+void ui_queue_clear (ui_queue *queue);
+
+/**
+ * Blocks until the command of the given sequence number has completed
+ *   (producer only). Returns false (with errno set) if waiting on done_fd
+ *   failed.
+ */
+bool ui_queue_wait (ui_queue *queue, uint32_t seq);
+
+#endif
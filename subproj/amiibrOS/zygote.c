@@ -0,0 +1,463 @@
+/**
+ * zygote.c
+ *
+ * Contains implementation of zygote.h
+ *
+ * os_ctrl and the zygote talk over a SOCK_SEQPACKET socket pair: each
+ *   zygote_request (along with the app's ready fd, if any, as SCM_RIGHTS)
+ *   gets exactly one zygote_reply. The zygote is single threaded and never
+ *   touches GL itself, so forking it is always safe.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#define _GNU_SOURCE // syscall, CLONE_PARENT
+
+#include <stdio.h> // printf, fflush
+#include <stdlib.h> // exit, realloc, free
+#include <stdint.h> // uint8_t
+#include <string.h> // strlen, strcmp, strdup, memcpy, memset
+#include <fcntl.h> // fcntl
+#include <errno.h> // errno
+#include <unistd.h> // fork, close, chdir, getppid, _exit, syscall
+#include <signal.h> // sigset_t, sigprocmask, SIGKILL, SIGCHLD
+#include <sched.h> // CLONE_PARENT
+#include <dlfcn.h> // dlopen, dlsym, dlclose, dlerror
+#include <sys/prctl.h> // prctl, PR_SET_PDEATHSIG
+#include <sys/socket.h> // socketpair, sendmsg, recvmsg, CMSG_*
+#include <sys/stat.h> // stat
+#include <sys/syscall.h> // SYS_clone
+#include <sys/wait.h> // waitpid
+#include "amiibrOS_app.h" // AMIIBROS_APP_ENTRY
+#include "zygote.h"
+
+// Longest module or directory path a request can carry (including NUL):
+#define ZYGOTE_PATH_MAX 1024
+
+// Libraries loaded into the zygote up front. Whichever of these exist on the
+//   running platform are shared (already relocated) by every app it forks:
+static const char *const preload_libs[] = {
+  "libm.so.6",
+  "libraylib.so",
+  "libGL.so.1", "libX11.so.6", // Linux
+  "libbcm_host.so", "libbrcmEGL.so", "libbrcmGLESv2.so", // Raspberry Pi
+};
+#define PRELOAD_LIB_CNT (sizeof(preload_libs) / sizeof(preload_libs[0]))
+
+// Indices of the fds that travel with a request (either may be missing):
+#define ZYGOTE_FD_READY 0
+#define ZYGOTE_FD_HANDOFF 1
+#define ZYGOTE_FD_CNT 2
+
+typedef struct zygote_request
+{
+  char module_path[ZYGOTE_PATH_MAX]; // Absolute path of the app's module
+  char dir_path[ZYGOTE_PATH_MAX]; // Directory the app starts in
+  uint8_t has_fd[ZYGOTE_FD_CNT]; // Which fds were sent along (in order)
+} zygote_request;
+
+typedef struct zygote_reply
+{
+  pid_t pid; // pid of the started app (only valid if err is 0)
+  int err; // errno value describing why the app could not be started
+} zygote_reply;
+
+typedef int (*app_entry) (int argc, char **argv);
+
+// A module the zygote has loaded, along with the file it was loaded from:
+typedef struct zygote_module
+{
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  app_entry entry;
+} zygote_module;
+
+// os_ctrl side:
+static pid_t z_pid; // The zygote's pid (0 if not running)
+static int z_sock = -1; // os_ctrl's end of the socket pair
+
+// --- Helper Function Prototypes ---
+void zygote_main (int sock);
+ssize_t recv_request (int sock, zygote_request *req, int *fds);
+bool install_app_fds (int *fds);
+app_entry zygote_handle (const zygote_request *req, zygote_reply *reply);
+app_entry load_module (const char *path, int *err);
+// --- ---
+
+bool zygote_start (const int *close_fds, size_t close_cnt)
+{
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+    return false;
+
+  // Anything still buffered would otherwise be written again by every app:
+  fflush(NULL);
+
+  pid_t parent = getpid();
+  pid_t p = fork();
+  if (p == -1) {
+    int preserve_errno = errno;
+    close(sv[0]);
+    close(sv[1]);
+    errno = preserve_errno;
+    return false;
+  }
+  if (p == 0) { // ZYGOTE BEGIN
+    close(sv[0]);
+    for (size_t i = 0; i < close_cnt; i++)
+      close(close_fds[i]);
+
+    // Never outlive os_ctrl (it may have died before the prctl took effect):
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) == -1 || getppid() != parent)
+      _exit(1);
+
+    // Apps forked from us start with the same signal state as spawned ones:
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    zygote_main(sv[1]); // Does not return
+  } // ZYGOTE END
+
+  close(sv[1]);
+  z_pid = p;
+  z_sock = sv[0];
+  return true;
+}
+
+pid_t zygote_pid (void)
+{
+  return z_pid;
+}
+
+bool zygote_spawn (const launch_plan *plan, int ready_fd, int handoff_fd,
+    pid_t *pid)
+{
+  if (z_pid == 0) {
+    errno = ECHILD;
+    return false;
+  }
+
+  zygote_request req;
+  size_t module_len = strlen(plan->zygote_module);
+  const char *dir_path = plan->cwd_path != NULL ? plan->cwd_path
+                                                : plan->dir_path;
+  size_t dir_len = strlen(dir_path);
+  if (module_len >= ZYGOTE_PATH_MAX || dir_len >= ZYGOTE_PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  memcpy(req.module_path, plan->zygote_module, module_len + 1);
+  memcpy(req.dir_path, dir_path, dir_len + 1);
+
+  // The ready and handoff fds travel with the request:
+  int fds[ZYGOTE_FD_CNT];
+  size_t fd_cnt = 0;
+  req.has_fd[ZYGOTE_FD_READY] = ready_fd != -1;
+  req.has_fd[ZYGOTE_FD_HANDOFF] = handoff_fd != -1;
+  if (ready_fd != -1)
+    fds[fd_cnt++] = ready_fd;
+  if (handoff_fd != -1)
+    fds[fd_cnt++] = handoff_fd;
+
+  struct iovec iov = {&req, sizeof(req)};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (fd_cnt != 0) {
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(fd_cnt * sizeof(int));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fd_cnt * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fd_cnt * sizeof(int));
+  }
+
+  // A dead zygote shows up as EPIPE on send or EOF on recv:
+  zygote_reply reply;
+  ssize_t rd_cnt;
+  if (sendmsg(z_sock, &msg, MSG_NOSIGNAL) != sizeof(req))
+    rd_cnt = -1;
+  else {
+    while ( (rd_cnt = recv(z_sock, &reply, sizeof(reply), 0)) == -1 &&
+        errno == EINTR);
+  }
+  if (rd_cnt != sizeof(reply)) {
+    // Without a working zygote every app falls back to launch_plan_spawn:
+    close(z_sock);
+    z_sock = -1;
+    z_pid = 0;
+    errno = ECHILD;
+    return false;
+  }
+
+  if (reply.err != 0) {
+    errno = reply.err;
+    return false;
+  }
+
+  // The app moves into a group of its own as well, but may not have gotten
+  //   that far yet. As its parent, we can do it for it (it never execs, so
+  //   this can not fail with EACCES; ESRCH just means it already died):
+  setpgid(reply.pid, reply.pid);
+  *pid = reply.pid;
+  return true;
+}
+
+void zygote_stop (void)
+{
+  if (z_pid == 0)
+    return;
+
+  close(z_sock); // The zygote exits once it sees EOF
+  waitpid(z_pid, NULL, 0);
+  z_sock = -1;
+  z_pid = 0;
+}
+
+void zygote_exited (pid_t pid)
+{
+  if (pid != z_pid || z_pid == 0)
+    return;
+
+  close(z_sock);
+  z_sock = -1;
+  z_pid = 0;
+}
+
+/**
+ * The zygote's main loop: preloads the common libraries and then serves
+ *   requests until os_ctrl goes away. Never returns; newly started apps exit
+ *   from here once their entry point returns.
+ */
+void zygote_main (int sock)
+{
+  // Bind every symbol now, so that no app pays for lazy binding later:
+  for (size_t i = 0; i < PRELOAD_LIB_CNT; i++)
+    dlopen(preload_libs[i], RTLD_NOW | RTLD_GLOBAL); // Missing ones are fine
+
+  zygote_request req;
+  zygote_reply reply;
+  app_entry entry;
+  int fds[ZYGOTE_FD_CNT];
+  ssize_t rd_cnt;
+  for (;;) {
+    rd_cnt = recv_request(sock, &req, fds);
+    if (rd_cnt == -1 && errno == EINTR)
+      continue;
+    if (rd_cnt != sizeof(req))
+      _exit(0); // os_ctrl closed its end (or broke protocol)
+
+    req.module_path[ZYGOTE_PATH_MAX - 1] = '\0';
+    req.dir_path[ZYGOTE_PATH_MAX - 1] = '\0';
+    if ( (entry = zygote_handle(&req, &reply)) != NULL) { // APP BEGIN
+      // Set up the same fds launch_plan_spawn would (the socket may have been
+      //   one of the fd numbers the app expects, so it is closed first):
+      close(sock);
+      setpgid(0, 0); // os_ctrl does the same, whoever is first wins
+      if (!install_app_fds(fds) || chdir(req.dir_path) == -1)
+        _exit(127);
+
+      char *argv[] = {req.module_path, NULL};
+      exit(entry(1, argv)); // Runs the app's atexit handlers and flushes
+    } // APP END
+
+    for (size_t i = 0; i < ZYGOTE_FD_CNT; i++) {
+      if (fds[i] != -1)
+        close(fds[i]); // Only the app keeps them open
+    }
+    if (send(sock, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+      _exit(0);
+  }
+}
+
+/**
+ * Receives a request into req, along with the fds sent with it (stored in
+ *   fds at their ZYGOTE_FD_* index, -1 for those that were not sent). Returns
+ *   as recv would.
+ */
+ssize_t recv_request (int sock, zygote_request *req, int *fds)
+{
+  struct iovec iov = {req, sizeof(*req)};
+  int recv_fds[ZYGOTE_FD_CNT];
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(recv_fds))];
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  for (size_t i = 0; i < ZYGOTE_FD_CNT; i++)
+    fds[i] = -1;
+  ssize_t rd_cnt = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  if (rd_cnt == -1)
+    return -1;
+
+  size_t fd_cnt = 0;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+      cmsg->cmsg_type == SCM_RIGHTS) {
+    fd_cnt = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    if (fd_cnt > ZYGOTE_FD_CNT)
+      fd_cnt = ZYGOTE_FD_CNT;
+    memcpy(recv_fds, CMSG_DATA(cmsg), fd_cnt * sizeof(int));
+  }
+
+  // The fds arrive in order, skipping those that were not sent:
+  size_t next = 0;
+  for (size_t i = 0; i < ZYGOTE_FD_CNT && next < fd_cnt; i++) {
+    if (rd_cnt == sizeof(*req) && req->has_fd[i])
+      fds[i] = recv_fds[next++];
+  }
+  while (next < fd_cnt)
+    close(recv_fds[next++]); // Not described by the request
+  return rd_cnt;
+}
+
+/**
+ * Moves the received fds onto LAUNCHER_READY_FD and LAUNCHER_HANDOFF_FD (in
+ *   the app process), without either overwriting the other on the way.
+ *   Returns false if an fd could not be moved.
+ */
+bool install_app_fds (int *fds)
+{
+  static const int targets[ZYGOTE_FD_CNT] = {LAUNCHER_READY_FD,
+      LAUNCHER_HANDOFF_FD};
+
+  // Get both out of the way of the targets first:
+  for (size_t i = 0; i < ZYGOTE_FD_CNT; i++) {
+    if (fds[i] == -1 || fds[i] > LAUNCHER_HANDOFF_FD)
+      continue;
+    int moved = fcntl(fds[i], F_DUPFD_CLOEXEC, LAUNCHER_HANDOFF_FD + 1);
+    if (moved == -1)
+      return false;
+    close(fds[i]);
+    fds[i] = moved;
+  }
+
+  // dup2 clears close-on-exec (set on everything received) on the copy:
+  for (size_t i = 0; i < ZYGOTE_FD_CNT; i++) {
+    if (fds[i] == -1)
+      continue;
+    if (dup2(fds[i], targets[i]) == -1)
+      return false;
+    close(fds[i]);
+  }
+  return true;
+}
+
+/**
+ * Starts the app described by req as a sibling of the zygote (a child of
+ *   os_ctrl).
+ *
+ * Returns the app's entry point in the new app process. In the zygote, NULL
+ *   is returned and reply is filled in.
+ */
+app_entry zygote_handle (const zygote_request *req, zygote_reply *reply)
+{
+  reply->pid = 0;
+  reply->err = 0;
+
+  app_entry entry = load_module(req->module_path, &reply->err);
+  if (entry == NULL)
+    return NULL;
+
+  // Pending output must not be written by both us and the app:
+  fflush(NULL);
+
+  // fork would make the app our child; CLONE_PARENT makes it os_ctrl's, so
+  //   that os_ctrl can wait for it like any app it spawned itself. Without
+  //   CLONE_VM and a stack, clone behaves exactly like fork otherwise:
+  long p = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+  if (p == 0)
+    return entry;
+
+  if (p == -1)
+    reply->err = errno;
+  else
+    reply->pid = (pid_t)p;
+  return NULL;
+}
+
+/**
+ * Returns the app entry point of the module at path, loading the module into
+ *   the zygote on first use. Returns NULL with err set on failure.
+ *
+ * Modules stay loaded for the zygote's lifetime. A module whose file changed
+ *   since it was loaded can not be loaded again (the dynamic loader would hand
+ *   back the old copy), so ESTALE is returned and os_ctrl falls back to a cold
+ *   launch of that app until it is restarted.
+ */
+app_entry load_module (const char *path, int *err)
+{
+  static zygote_module *modules = NULL;
+  static size_t module_cnt = 0;
+
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    *err = errno;
+    return NULL;
+  }
+
+  for (size_t i = 0; i < module_cnt; i++) {
+    zygote_module *m = &modules[i];
+    if (strcmp(m->path, path))
+      continue;
+    if (m->dev != st.st_dev || m->ino != st.st_ino ||
+        m->mtime.tv_sec != st.st_mtim.tv_sec ||
+        m->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+      *err = ESTALE;
+      return NULL;
+    }
+    return m->entry;
+  }
+
+  zygote_module *new_modules = realloc(modules,
+      (module_cnt + 1) * sizeof(zygote_module));
+  if (new_modules == NULL) {
+    *err = ENOMEM;
+    return NULL;
+  }
+  modules = new_modules;
+
+  void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL) {
+    printf("zygote unable to load module\nerror: %s\n", dlerror());
+    *err = ENOEXEC;
+    return NULL;
+  }
+  app_entry entry;
+  *(void **)&entry = dlsym(handle, AMIIBROS_APP_ENTRY);
+  if (entry == NULL) {
+    printf("zygote unable to load module\nerror: %s has no %s\n", path,
+        AMIIBROS_APP_ENTRY);
+    dlclose(handle);
+    *err = ENOEXEC;
+    return NULL;
+  }
+
+  zygote_module *m = &modules[module_cnt];
+  if ( (m->path = strdup(path)) == NULL) {
+    dlclose(handle);
+    *err = ENOMEM;
+    return NULL;
+  }
+  m->dev = st.st_dev;
+  m->ino = st.st_ino;
+  m->mtime = st.st_mtim;
+  m->entry = entry;
+  module_cnt++;
+  return entry;
+}
@@ -0,0 +1,65 @@
+/**
+ * zygote.h
+ *
+ * Contains prototypes for os_ctrl's optional app zygote.
+ *
+ * The zygote is a helper process forked from os_ctrl at startup (before the
+ *   interface creates any GL context) that has the libraries common to apps
+ *   (raylib, libm, GL/EGL) loaded and relocated up front. Apps built as zygote
+ *   modules (shared objects exporting AMIIBROS_APP_ENTRY, see amiibrOS_app.h)
+ *   are then started by forking the zygote and calling the module's entry
+ *   point, skipping exec and dynamic linking entirely.
+ *
+ * An app opts in through its .conf file (see launcher.h). Apps forked by the
+ *   zygote are created with CLONE_PARENT, so they are children of os_ctrl
+ *   exactly like apps started with launch_plan_spawn.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <sys/types.h> // pid_t
+#include "launcher.h" // launch_plan
+
+/**
+ * Forks the zygote and has it preload the common app libraries. Must be
+ *   called while the calling process is still single threaded.
+ *
+ * The zygote closes each of the close_cnt fds in close_fds, since it will
+ *   never exec to get rid of them.
+ *
+ * Returns true if successful; false with errno set otherwise.
+ */
+bool zygote_start (const int *close_fds, size_t close_cnt);
+
+// Returns the pid of the zygote, or 0 if it is not running.
+pid_t zygote_pid (void);
+
+/**
+ * Starts the app of the given plan (which must have a zygote_module) from the
+ *   zygote and stores its pid in pid. Unless ready_fd or handoff_fd are -1,
+ *   they are given to the app as LAUNCHER_READY_FD and LAUNCHER_HANDOFF_FD.
+ *   Like with launch_plan_spawn, the app leads a process group of its own by
+ *   the time this returns.
+ *
+ * Returns true if the app's module was loaded and its process created; false
+ *   with errno set otherwise (in which case the app may still be started with
+ *   launch_plan_spawn).
+ */
+bool zygote_spawn (const launch_plan *plan, int ready_fd, int handoff_fd,
+    pid_t *pid);
+
+// Stops the zygote (if running) and waits for it to exit.
+void zygote_stop (void);
+
+/**
+ * Tells the zygote code that the zygote (pid) has exited, so that it is no
+ *   longer used.
+ */
+void zygote_exited (pid_t pid);
+
+#endif
@@ -0,0 +1,424 @@
+/**
+ * bench_interp.c
+ *
+ * Compile with bench_interp.c in place of main.c (see make bench) to measure
+ *   what evaluating the animated properties of a slide's images costs a
+ *   frame, for a slide of 1000 images (or -n images) animating every
+ *   property with every easing, then through no keys (or -k keys) each. It
+ *   compares:
+ *   * switch: picking each property's easing function with a switch over its
+ *     interp and interp_captype every frame, then calling it once per
+ *     component (as the slideshow once did).
+ *   * resolved: resolved_eval, one image at a time, with the easing
+ *     functions resolved by the parser and one call per property, none once
+ *     its track is over.
+ *   * batch: slide_anim_eval on the slide's compiled animations (see
+ *     slide_anim.h), as the slideshow draws.
+ *
+ * The slide is written to a config file in /tmp and read back with
+ *   slidestruct_read_conf, like the slideshow's own. Only the evaluation is
+ *   timed; nothing is drawn.
+ *
+ * Usage: slideshow_bench [-n images] [-k keys]
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdio.h> // printf, fprintf, fopen, perror
+#include <stdlib.h> // atoi, mkstemp
+#include <string.h> // strcmp
+#include <stdint.h> // uint64_t
+#include <math.h> // fabsf
+#include <time.h> // clock_gettime
+#include <unistd.h> // dup, dup2, close, unlink
+#include <fcntl.h> // open
+#include "slidestruct.h"
+#include "slide_anim.h"
+#include "easings.h"
+
+#define DEFAULT_IMAGES 1000
+#define SLIDE_DURATION 10.0f
+#define FRAMES 600 // One slide, at 60 FPS
+#define RUNS 5
+#define KEY_SPACING 0.5f // Seconds from one key of a property to the next
+
+// Ways of evaluating a slide:
+typedef enum bench_mode
+{
+  MODE_SWITCH,
+  MODE_RESOLVED,
+  MODE_BATCH
+} bench_mode;
+
+// Keeps the evaluated properties from being optimized out:
+static volatile float sink;
+
+uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Writes a config of one slide of cnt images to a new file in /tmp and
+ *   returns its path (to be freed), or NULL if it can't. The images go
+ *   through every interp and interp_captype, with durations from 1 to 15
+ *   seconds, so some tracks end before the slide does. Each property then has
+ *   keys keys, KEY_SPACING apart.
+ */
+char *write_conf (int cnt, int keys)
+{
+  char *path = strdup("/tmp/slideshow_bench_XXXXXX");
+  int fd = path != NULL ? mkstemp(path) : -1;
+  FILE *f = fd != -1 ? fdopen(fd, "w") : NULL;
+  if (f == NULL) {
+    free(path);
+    return NULL;
+  }
+  fprintf(f, "title bench\nslide_duration %f\n", SLIDE_DURATION);
+  for (int i = 0; i < cnt; i++) {
+    static const char *props[] = {"tint", "pos", "size", "rot"};
+    fprintf(f, "image_name img%d.png\n", i);
+    fprintf(f, "tint_i (10, 20, 30, 40)\ntint_f (100, 100, 100, 100)\n");
+    fprintf(f, "pos_i (%d, %d)\npos_f (300, 200)\n", i % 1440, i % 900);
+    fprintf(f, "size_i (100, 100)\nsize_f (50, 80)\n");
+    fprintf(f, "rot_i 0\nrot_f 360\n");
+    for (int p = 0; p < 4; p++) {
+      fprintf(f, "%s_interp %d\n", props[p], 1 + (i + p) % INTERP_TYPE_MAX);
+      fprintf(f, "%s_interp_captype %d\n", props[p],
+              (i / INTERP_TYPE_MAX + p) % (INTERP_CAPTYPE_MAX + 1));
+      int duration = 1 + (i * 7 + p * 3) % 15;
+      fprintf(f, "%s_duration %d\n", props[p], duration);
+      for (int k = 0; k < keys; k++) {
+        fprintf(f, "%s_key %f ", props[p], duration + (k + 1) * KEY_SPACING);
+        if (p == 0)
+          fprintf(f, "(%d, 100, 200, %d)", k * 20 % 256, 255 - k * 10 % 256);
+        else if (p == 3)
+          fprintf(f, "%d", k * 90);
+        else
+          fprintf(f, "(%d, %d)", 100 + k * 37 % 900, 100 + k * 53 % 900);
+        fprintf(f, " %d %d\n", (i + p + k) % (INTERP_TYPE_MAX + 1),
+                k % (INTERP_CAPTYPE_MAX + 1));
+      }
+    }
+  }
+  if (fclose(f) != 0) {
+    unlink(path);
+    free(path);
+    return NULL;
+  }
+  return path;
+}
+
+/**
+ * Returns color channel v truncated and clamped to [0, 255] (NaN gives 0), as
+ *   slide_anim converts it.
+ */
+unsigned char to_channel (float v)
+{
+  if (!(v > 0.0f))
+    return 0;
+  if (v >= 255.0f)
+    return 255;
+  return (unsigned char)v;
+}
+
+// The easing function of a property, picked the way the slideshow did:
+ease_func switch_func (interp_type type, interp_captype captype)
+{
+  ease_func interp_func = NULL;
+  switch (type) {
+    case NONE:
+      break;
+    case LINEAR:
+      switch (captype) {
+        case IN: interp_func = &EaseLinearIn; break;
+        case OUT: interp_func = &EaseLinearOut; break;
+        case INOUT: interp_func = &EaseLinearInOut; break;
+      }
+      break;
+    case SINE:
+      switch (captype) {
+        case IN: interp_func = &EaseSineIn; break;
+        case OUT: interp_func = &EaseSineOut; break;
+        case INOUT: interp_func = &EaseSineInOut; break;
+      }
+      break;
+    case CIRCULAR:
+      switch (captype) {
+        case IN: interp_func = &EaseCircIn; break;
+        case OUT: interp_func = &EaseCircOut; break;
+        case INOUT: interp_func = &EaseCircInOut; break;
+      }
+      break;
+    case CUBIC:
+      switch (captype) {
+        case IN: interp_func = &EaseCubicIn; break;
+        case OUT: interp_func = &EaseCubicOut; break;
+        case INOUT: interp_func = &EaseCubicInOut; break;
+      }
+      break;
+    case QUADRATIC:
+      switch (captype) {
+        case IN: interp_func = &EaseQuadIn; break;
+        case OUT: interp_func = &EaseQuadOut; break;
+        case INOUT: interp_func = &EaseQuadInOut; break;
+      }
+      break;
+    case EXPONENTIAL:
+      switch (captype) {
+        case IN: interp_func = &EaseExpoIn; break;
+        case OUT: interp_func = &EaseExpoOut; break;
+        case INOUT: interp_func = &EaseExpoInOut; break;
+      }
+      break;
+    case BACK:
+      switch (captype) {
+        case IN: interp_func = &EaseBackIn; break;
+        case OUT: interp_func = &EaseBackOut; break;
+        case INOUT: interp_func = &EaseBackInOut; break;
+      }
+      break;
+    case BOUNCE:
+      switch (captype) {
+        case IN: interp_func = &EaseBounceIn; break;
+        case OUT: interp_func = &EaseBounceOut; break;
+        case INOUT: interp_func = &EaseBounceInOut; break;
+      }
+      break;
+    case ELASTIC:
+      switch (captype) {
+        case IN: interp_func = &EaseElasticIn; break;
+        case OUT: interp_func = &EaseElasticOut; break;
+        case INOUT: interp_func = &EaseElasticInOut; break;
+      }
+      break;
+  }
+  return interp_func;
+}
+
+// Evaluates img's properties the way the slideshow did.
+void switch_eval (const imgstruct *img, float t, Rectangle *destRec,
+                  float *rot, Color *tint)
+{
+  ease_func f = switch_func(img->pos_interp, img->pos_interp_captype);
+  destRec->x = f(t, img->pos_i.x, img->pos_f.x, img->pos_duration);
+  destRec->y = f(t, img->pos_i.y, img->pos_f.y, img->pos_duration);
+  f = switch_func(img->size_interp, img->size_interp_captype);
+  destRec->width = f(t, img->size_i.x, img->size_f.x, img->size_duration);
+  destRec->height = f(t, img->size_i.y, img->size_f.y, img->size_duration);
+  f = switch_func(img->rot_interp, img->rot_interp_captype);
+  *rot = f(t, img->rot_i, img->rot_f, img->rot_duration);
+  f = switch_func(img->tint_interp, img->tint_interp_captype);
+  tint->r = to_channel(f(t, img->tint_i.r, img->tint_f.r, img->tint_duration));
+  tint->g = to_channel(f(t, img->tint_i.g, img->tint_f.g, img->tint_duration));
+  tint->b = to_channel(f(t, img->tint_i.b, img->tint_f.b, img->tint_duration));
+  tint->a = to_channel(f(t, img->tint_i.a, img->tint_f.a, img->tint_duration));
+}
+
+/**
+ * Sets the EASE_COMP_MAX components v of track's property to their values t
+ *   seconds into its slide, moving its cursor to the segment t falls in.
+ */
+void resolved_track_eval (ease_track *track, float t, float *v)
+{
+  track->cursor = ease_seg_seek(track->segs, track->seg_cnt, track->cursor, t);
+  const ease_seg *seg = &track->segs[track->cursor];
+  float p = ease_seg_progress(seg, t);
+  for (int c = 0; c < EASE_COMP_MAX; c++)
+    v[c] = seg->from[c] + seg->change[c] * p;
+}
+
+// Evaluates img's properties from its resolved tracks, one image at a time.
+void resolved_eval (imgstruct *img, float t, Rectangle *destRec, float *rot,
+                    Color *tint)
+{
+  float v[EASE_COMP_MAX];
+  resolved_track_eval(&img->pos_track, t, v);
+  destRec->x = v[0];
+  destRec->y = v[1];
+
+  resolved_track_eval(&img->size_track, t, v);
+  destRec->width = v[0];
+  destRec->height = v[1];
+
+  resolved_track_eval(&img->rot_track, t, v);
+  *rot = v[0];
+
+  resolved_track_eval(&img->tint_track, t, v);
+  tint->r = to_channel(v[0]);
+  tint->g = to_channel(v[1]);
+  tint->b = to_channel(v[2]);
+  tint->a = to_channel(v[3]);
+}
+
+/**
+ * Returns the mean time, in ns, to evaluate every image of slide (compiled
+ *   into anim) a frame.
+ */
+double bench (slidestruct *slide, slide_anim *anim, bench_mode mode)
+{
+  uint64_t start = now_ns();
+  for (int r = 0; r < RUNS; r++) {
+    for (int frame = 0; frame < FRAMES; frame++) {
+      float t = frame * (SLIDE_DURATION / FRAMES);
+      float sum = 0;
+      if (mode == MODE_BATCH) {
+        slide_anim_eval(anim, t);
+        for (size_t i = 0; i < anim->cnt; i++) {
+          sum += anim->dest[i].x + anim->dest[i].height + anim->rot[i] +
+                 anim->tint[i].a;
+        }
+        sink += sum;
+        continue;
+      }
+      for (imgstruct *img = slide->images; img != NULL; img = img->next) {
+        Rectangle destRec;
+        float rot;
+        Color tint;
+        if (mode == MODE_RESOLVED)
+          resolved_eval(img, t, &destRec, &rot, &tint);
+        else
+          switch_eval(img, t, &destRec, &rot, &tint);
+        sum += destRec.x + destRec.height + rot + tint.a;
+      }
+      sink += sum;
+    }
+  }
+  return (double)(now_ns() - start) / (RUNS * FRAMES);
+}
+
+/**
+ * Returns the largest difference in position, size or rotation between the
+ *   switch and resolved ways of evaluating slide, while each track runs (the
+ *   slideshow used to carry on easing past the end of a track; it now
+ *   holds).
+ */
+float max_diff (slidestruct *slide)
+{
+  float diff = 0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    float t = frame * (SLIDE_DURATION / FRAMES);
+    for (imgstruct *img = slide->images; img != NULL; img = img->next) {
+      Rectangle a, b;
+      float rot_a, rot_b;
+      Color tint_a, tint_b;
+      resolved_eval(img, t, &a, &rot_a, &tint_a);
+      switch_eval(img, t, &b, &rot_b, &tint_b);
+      if (t < img->pos_duration && fabsf(a.x - b.x) > diff)
+        diff = fabsf(a.x - b.x);
+      if (t < img->size_duration && fabsf(a.height - b.height) > diff)
+        diff = fabsf(a.height - b.height);
+      if (t < img->rot_duration && fabsf(rot_a - rot_b) > diff)
+        diff = fabsf(rot_a - rot_b);
+    }
+  }
+  return diff;
+}
+
+/**
+ * Returns the largest difference in position, size or rotation between the
+ *   resolved and batch ways of evaluating slide. Sets tint_diffs to the
+ *   number of tint channels more than one apart.
+ */
+float max_batch_diff (slidestruct *slide, slide_anim *anim,
+                      int *tint_diffs)
+{
+  float diff = 0;
+  *tint_diffs = 0;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    float t = frame * (SLIDE_DURATION / FRAMES);
+    slide_anim_eval(anim, t);
+    size_t i = 0;
+    for (imgstruct *img = slide->images; img != NULL; img = img->next, i++) {
+      Rectangle a;
+      float rot;
+      Color tint;
+      resolved_eval(img, t, &a, &rot, &tint);
+      const Rectangle *b = &anim->dest[i];
+      float d[] = {a.x - b->x, a.y - b->y, a.width - b->width,
+                   a.height - b->height, rot - anim->rot[i]};
+      for (size_t k = 0; k < sizeof(d) / sizeof(d[0]); k++) {
+        if (fabsf(d[k]) > diff)
+          diff = fabsf(d[k]);
+      }
+
+      const unsigned char ca[] = {tint.r, tint.g, tint.b, tint.a};
+      const unsigned char cb[] = {anim->tint[i].r, anim->tint[i].g,
+                                  anim->tint[i].b, anim->tint[i].a};
+      for (int k = 0; k < 4; k++)
+        *tint_diffs += abs(ca[k] - cb[k]) > 1;
+    }
+  }
+  return diff;
+}
+
+int main (int argc, char **argv)
+{
+  int cnt = DEFAULT_IMAGES;
+  int keys = 0;
+  for (int arg = 1; arg < argc; arg += 2) {
+    if (arg + 1 < argc && !strcmp(argv[arg], "-n"))
+      cnt = atoi(argv[arg + 1]);
+    else if (arg + 1 < argc && !strcmp(argv[arg], "-k"))
+      keys = atoi(argv[arg + 1]);
+    else
+      cnt = 0;
+  }
+  if (cnt <= 0 || keys < 0) {
+    fprintf(stderr, "usage: %s [-n images] [-k keys]\n", argv[0]);
+    return 1;
+  }
+
+  char *path = write_conf(cnt, keys);
+  if (path == NULL) {
+    perror("slideshow_bench unable to write config\nerror");
+    return 1;
+  }
+  // The parser prints every image name; keep that out of the results:
+  fflush(stdout);
+  int out = dup(STDOUT_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  slidestruct *ss = slidestruct_read_conf(path);
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(null);
+  close(out);
+  unlink(path);
+  free(path);
+  if (ss == NULL) {
+    fprintf(stderr, "slideshow_bench unable to read config\n");
+    return 1;
+  }
+
+  slide_anim *anim = slide_anim_compile(ss);
+  if (anim == NULL) {
+    perror("slideshow_bench unable to compile animations\nerror");
+    return 1;
+  }
+
+  bench(ss, anim, MODE_SWITCH); // Warm up
+  double switch_ns = bench(ss, anim, MODE_SWITCH);
+  double resolved_ns = bench(ss, anim, MODE_RESOLVED);
+  double batch_ns = bench(ss, anim, MODE_BATCH);
+
+  printf("evaluating a slide of %d animated images (%d keys a property), mean"
+         " of %d frames:\n", cnt, keys, RUNS * FRAMES);
+  printf("  %-8s %8.1f us a frame\n", "switch", switch_ns / 1000);
+  printf("  %-8s %8.1f us a frame (%.1fx less)\n", "resolved",
+         resolved_ns / 1000, switch_ns / resolved_ns);
+  printf("  %-8s %8.1f us a frame (%.1fx less)\n", "batch", batch_ns / 1000,
+         switch_ns / batch_ns);
+  printf("  largest difference, switch/resolved while tracks run: %g\n",
+         max_diff(ss));
+  int tint_diffs;
+  float batch_diff = max_batch_diff(ss, anim, &tint_diffs);
+  printf("  largest difference, resolved/batch: %g (%d tint channels)\n",
+         batch_diff, tint_diffs);
+
+  slide_anim_free(anim);
+  slidestruct_free(ss);
+  return 0;
+}
@@ -10,44 +10,78 @@
  * Joseph Yankel (jpyankel@gmail.com)
  */
 
+#include <stdio.h> // perror, stdout
 #include <stdlib.h>
 #include <string.h>
 #include "slidestruct.h"
+#include "slide_loader.h" // slide_loader_*
+#include "texture_cache.h" // texture_cache_*
+#include "slide_anim.h" // slide_anim_*
 #include "raylib.h"
-#include "easings.h"
+#include "amiibrOS_app.h" // amiibrOS_app_report_ready, zygote module entry,
+                          //   amiibrOS_app_wait_handoff
 
 #define SCREEN_WIDTH 1440
 #define SCREEN_HEIGHT 900
 
 #define CONF_PATH "resources/config.txt"
-#define RES_PATH "resources/"
-#define RES_PATH_SIZE sizeof(RES_PATH)
+// Environment variable overriding TEXTURE_CACHE_BUDGET, in MiB:
+#define CACHE_BUDGET_ENV "SLIDESHOW_CACHE_MB"
 
 // === Function Prototypes ===
-Texture2D *load_slide_textures(slidestruct *current_slide,
-                               size_t *textures_len);
-void unload_slide_textures (Texture2D *textures, size_t textures_len);
-void interp_pos (imgstruct *opts, Rectangle *destRec, float timeElapsed);
-void interp_size (imgstruct *opts, Rectangle *destRec, float timeElapsed);
-void interp_rot (imgstruct *opts, float *rot, float timeElapsed);
-void interp_tint (imgstruct *opts, Color *color, float timeElapsed);
+size_t cache_budget (void);
+bool intern_images (texture_cache *cache, slidestruct *ss);
+bool compile_anims (slidestruct *ss);
+void free_anims (slidestruct *ss);
+slidestruct *slide_after (slidestruct *ss, slidestruct *slide);
 // ===========================
 
 int main (void)
 {
+  amiibrOS_app_report_started(); // Lets amiibrOS time our launch
+
   // Read slidestruct 
   slidestruct *ss = slidestruct_read_conf(CONF_PATH);
   if (ss == NULL)
     return 1; // We failed to read slidestruct TODO throw error message???
-  
+
+  // Give every image name its texture cache entry:
+  texture_cache cache;
+  texture_cache_init(&cache, cache_budget());
+  if (!intern_images(&cache, ss)) {
+    perror("slideshow unable to intern image names\nerror");
+    return 1;
+  }
+  if (!compile_anims(ss)) {
+    perror("slideshow unable to compile animations\nerror");
+    return 1;
+  }
+
+  // Decode the first slide's images before we have a window. This needs no
+  //   OpenGL context, so amiibrOS may still be animating in the meantime:
+  slidestruct *current_slide = ss;
+  slide_loader loader;
+  if (!slide_loader_start(&loader))
+    return 1;
+  if (!slide_loader_request(&loader, &cache, current_slide)) {
+    slide_loader_stop(&loader, &cache);
+    return 1;
+  }
+
+  amiibrOS_app_wait_handoff(); // Blocks until the display is ours
+
   InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "slideshow"); // Init OpenGL context
   
   SetTargetFPS(60);
   
-  slidestruct *current_slide = ss;
-  size_t textures_len; // Size of the textures array
-  // Load the necessary images for this first slide:
-  Texture2D *textures = load_slide_textures(current_slide, &textures_len);
+  // Only the upload to the GPU is left for the first slide:
+  slide_loader_wait(&loader);
+  while (!slide_loader_upload(&loader, &cache))
+    ;
+
+  // The next slide's images load while this one plays:
+  slidestruct *next_slide = slide_after(ss, current_slide);
+  bool loading = slide_loader_request(&loader, &cache, next_slide);
   double slide_start = GetTime();
 
   while (!WindowShouldClose()) {
@@ -57,456 +91,123 @@ int main (void)
     
     ClearBackground(BLACK);
     
-    size_t texture_idx = 0; // Current texture we are selecting in the array.
-    // Loop through all images, update animatable properties, and draw.
-    /**
-     * Notice that the order of textures and imgstructs is sorted such that
-     *   the texture at a given index corresponds to the imgstruct 'index away
-     *   from' the head of the imgstruct linked-list.
-     */
-    for (imgstruct *opts = current_slide->images; opts != NULL;
-         opts = opts->next) {
-
-      Texture2D texture = textures[texture_idx];
+    // Evaluate the animatable properties of all images at once, then draw.
+    slide_anim *anim = current_slide->anim;
+    slide_anim_eval(anim, (float)timeElapsed);
+    for (size_t i = 0; i < anim->cnt; i++) {
+      Texture2D texture = texture_cache_get(&cache, anim->tex_id[i]);
       // Take the entire srcRec by default: (TODO Make this animatable)
       Rectangle srcRec = (Rectangle){0, 0, texture.width, texture.height};
-      Rectangle destRec;
-      float rot;
-      Color tint;
-
-      interp_pos(opts, &destRec, (float)timeElapsed); // Interpolate position
-      interp_size(opts, &destRec, (float)timeElapsed); // Interpolate size
-      interp_rot(opts, &rot, (float)timeElapsed); // Interpolate rotation
-      interp_tint(opts, &tint, (float)timeElapsed); // Interpolate tint color
+      Rectangle destRec = anim->dest[i];
 
       // Draw:
       // Treat origin as centered: TODO Possible option per image!!!
       Vector2 origin = {destRec.width / 2, destRec.height / 2};
-      DrawTexturePro(texture, srcRec, destRec, origin, rot, tint);
-
-      if ( (++texture_idx) >= textures_len)
-        texture_idx = 0; // Reset the texture count, we looped through all imgs
+      DrawTexturePro(texture, srcRec, destRec, origin, anim->rot[i],
+                     anim->tint[i]);
     }
     
     // TODO Draw title text and stuff if applicable
 
     EndDrawing();
-
-    // Check if time has elasped for the slide:
-    if (timeElapsed >= current_slide->slide_duration) {
-      unload_slide_textures(textures, textures_len); // Unload old textures
-      
-      if ( (current_slide = current_slide->next) == NULL) {
-        // Loops back to the first slide if we reach the end.
-        current_slide = ss;
-      }
-      
-      // Update to new images:
-      textures = load_slide_textures(current_slide, &textures_len);
+    amiibrOS_app_report_ready(); // Only the first frame is reported
+
+    // Upload what the loader has decoded of the next slide's images so far:
+    bool next_ready = slide_loader_upload(&loader, &cache);
+
+    // Check if time has elasped for the slide. Should the next slide not be
+    //   ready yet, this one stays up until it is, rather than stalling:
+    if (timeElapsed >= current_slide->slide_duration && next_ready) {
+      if (!loading)
+        break; // Out of memory to request the next slide with
+      slidestruct *prev_slide = current_slide;
+      current_slide = next_slide;
+      if (current_slide == ss) // Looped back to the first slide
+        texture_cache_print_stats(&cache, stdout);
+
+      // Start on the slide after it, before the textures of the slide that
+      //   was showing may be unloaded, so that those they share stay:
+      next_slide = slide_after(ss, current_slide);
+      loading = slide_loader_request(&loader, &cache, next_slide);
+      slide_loader_release(&cache, prev_slide);
 
       slide_start = GetTime(); // Reset timer
     }
   }
 
+  slide_loader_stop(&loader, &cache);
+  texture_cache_print_stats(&cache, stdout);
+  texture_cache_free(&cache);
   CloseWindow(); // Close OpenGL context
   
+  free_anims(ss);
   slidestruct_free(ss); // Free slidestruct
   return 0;
 }
 
-/**
- * Creates an array of Texture2D structure based on the slidestruct's images
- *   linked-list.
- * Entries are ordered such that they match pairwise in index with the given
- *   slidestruct's images.
- * The argument textures_len will be populated (if non-null) with the length
- *   found during the loading.
- */
-Texture2D *load_slide_textures(slidestruct *current_slide,
-                               size_t *textures_len)
+// Entry point used when built as an amiibrOS zygote module (see zygote.h):
+int amiibrOS_app_main (int argc, char **argv)
 {
-  // Determine size of needed array:
-  size_t cnt = 0;
-  for (imgstruct *opts = current_slide->images; opts != NULL;
-       opts = opts->next) {
-    cnt++;
-  }
-  if (textures_len != NULL) *textures_len = cnt;
-  
-  // Allocate an array with the determined size:
-  Texture2D *textures = malloc(sizeof(Texture2D)*cnt);
-  if (textures == NULL)
-    return NULL; // TODO Not sure what to change this to yet...
-  
-  // Fill this array with loaded textures:
-  cnt = 0;
-  for (imgstruct *opts = current_slide->images; opts != NULL;
-       opts = opts->next) {
-    // Find out the size of the texture's path:
-    size_t name_size = strlen(opts->img_name);
-    size_t path_size = RES_PATH_SIZE + name_size; // RES_PATH_SIZE includes NUL
-    char img_path[path_size]; // Create a buffer of path_size in length
-    // Construct the image path:
-    strcpy(img_path, RES_PATH);
-    strcat(img_path, opts->img_name);
-    // Load the image and move on to the next:
-    textures[cnt] = LoadTexture(img_path);
-    cnt++;
-  }
-  
-  return textures;
+  (void)argc;
+  (void)argv;
+  return main();
 }
 
-// Unloads all textures in array 'textures' and frees the array.
-void unload_slide_textures (Texture2D *textures, size_t textures_len)
+// Returns the texture cache's budget, from CACHE_BUDGET_ENV if it is set.
+size_t cache_budget (void)
 {
-  for (size_t idx = 0; idx < textures_len; idx++) {
-    UnloadTexture(textures[idx]);
-  }
-  free(textures);
+  const char *env = getenv(CACHE_BUDGET_ENV);
+  if (env == NULL || *env == '\0')
+    return TEXTURE_CACHE_BUDGET;
+  char *end;
+  unsigned long mb = strtoul(env, &end, 10);
+  if (*end != '\0')
+    return TEXTURE_CACHE_BUDGET;
+  return (size_t)mb << 20;
 }
 
 /**
- * Interpolates the position variables of the given destRec rectangle according
- *   to the method specified by the interp_type and interp_captype in the given
- *   imgstruct 'opts'.
+ * Sets the tex_id of every image of every slide of ss to its entry in cache.
+ *   Returns false (with errno set) if memory ran out.
  */
-void interp_pos (imgstruct *opts, Rectangle *destRec, float timeElapsed)
+bool intern_images (texture_cache *cache, slidestruct *ss)
 {
-  // First, search for the interp_func based on user preferences (opt)
-  float (*interp_func)(float, float, float, float) = NULL;
-  switch (opts->pos_interp) {
-    case NONE:
-      destRec->x = opts->pos_i.x;
-      destRec->y = opts->pos_i.y;
-      break;
-    case LINEAR:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseLinearIn; break;
-        case OUT: interp_func = &EaseLinearOut; break;
-        case INOUT: interp_func = &EaseLinearInOut; break;
-      }
-      break;
-    case SINE:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseSineIn; break;
-        case OUT: interp_func = &EaseSineOut; break;
-        case INOUT: interp_func = &EaseSineInOut; break;
-      }
-      break;
-    case CIRCULAR:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseCircIn; break;
-        case OUT: interp_func = &EaseCircOut; break;
-        case INOUT: interp_func = &EaseCircInOut; break;
-      }
-      break;
-    case CUBIC:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseCubicIn; break;
-        case OUT: interp_func = &EaseCubicOut; break;
-        case INOUT: interp_func = &EaseCubicInOut; break;
-      }
-      break;
-    case QUADRATIC:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseQuadIn; break;
-        case OUT: interp_func = &EaseQuadOut; break;
-        case INOUT: interp_func = &EaseQuadInOut; break;
-      }
-      break;
-    case EXPONENTIAL:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseExpoIn; break;
-        case OUT: interp_func = &EaseExpoOut; break;
-        case INOUT: interp_func = &EaseExpoInOut; break;
-      }
-      break;
-    case BACK:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseBackIn; break;
-        case OUT: interp_func = &EaseBackOut; break;
-        case INOUT: interp_func = &EaseBackInOut; break;
-      }
-      break;
-    case BOUNCE:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseBounceIn; break;
-        case OUT: interp_func = &EaseBounceOut; break;
-        case INOUT: interp_func = &EaseBounceInOut; break;
-      }
-      break;
-    case ELASTIC:
-      switch (opts->pos_interp_captype) {
-        case IN: interp_func = &EaseElasticIn; break;
-        case OUT: interp_func = &EaseElasticOut; break;
-        case INOUT: interp_func = &EaseElasticInOut; break;
-      }
-      break;
+  for (slidestruct *slide = ss; slide != NULL; slide = slide->next) {
+    for (imgstruct *opts = slide->images; opts != NULL; opts = opts->next) {
+      if (!texture_cache_intern(cache, opts->img_name, &opts->tex_id))
+        return false;
+    }
   }
-  if (interp_func != NULL) { // If we found an interp function...
-    // ...use the function to interpolate the target values:
-    destRec->x = (*interp_func)(timeElapsed, opts->pos_i.x, opts->pos_f.x,
-                                opts->pos_duration);
-    destRec->y = (*interp_func)(timeElapsed, opts->pos_i.y,
-                                opts->pos_f.y, opts->pos_duration);
-  } // Else, we leave it alone (because the user picked NONE).
+  return true;
 }
 
 /**
- * Interpolates the size variables of the given destRec rectangle according to
- *   the method specified by the interp_type and interp_captype given.
+ * Compiles the animations of every slide of ss (whose images are interned).
+ *   Returns false (with errno set) if memory ran out.
  */
-void interp_size (imgstruct *opts, Rectangle *destRec, float timeElapsed)
+bool compile_anims (slidestruct *ss)
 {
-  // First, search for the interp_func based on user preferences (opt)
-  float (*interp_func)(float, float, float, float) = NULL;
-  switch (opts->size_interp) {
-    case NONE:
-      destRec->width = opts->size_i.x;
-      destRec->height = opts->size_i.y;
-      break;
-    case LINEAR:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseLinearIn; break;
-        case OUT: interp_func = &EaseLinearOut; break;
-        case INOUT: interp_func = &EaseLinearInOut; break;
-      }
-      break;
-    case SINE:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseSineIn; break;
-        case OUT: interp_func = &EaseSineOut; break;
-        case INOUT: interp_func = &EaseSineInOut; break;
-      }
-      break;
-    case CIRCULAR:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseCircIn; break;
-        case OUT: interp_func = &EaseCircOut; break;
-        case INOUT: interp_func = &EaseCircInOut; break;
-      }
-      break;
-    case CUBIC:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseCubicIn; break;
-        case OUT: interp_func = &EaseCubicOut; break;
-        case INOUT: interp_func = &EaseCubicInOut; break;
-      }
-      break;
-    case QUADRATIC:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseQuadIn; break;
-        case OUT: interp_func = &EaseQuadOut; break;
-        case INOUT: interp_func = &EaseQuadInOut; break;
-      }
-      break;
-    case EXPONENTIAL:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseExpoIn; break;
-        case OUT: interp_func = &EaseExpoOut; break;
-        case INOUT: interp_func = &EaseExpoInOut; break;
-      }
-      break;
-    case BACK:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseBackIn; break;
-        case OUT: interp_func = &EaseBackOut; break;
-        case INOUT: interp_func = &EaseBackInOut; break;
-      }
-      break;
-    case BOUNCE:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseBounceIn; break;
-        case OUT: interp_func = &EaseBounceOut; break;
-        case INOUT: interp_func = &EaseBounceInOut; break;
-      }
-      break;
-    case ELASTIC:
-      switch (opts->size_interp_captype) {
-        case IN: interp_func = &EaseElasticIn; break;
-        case OUT: interp_func = &EaseElasticOut; break;
-        case INOUT: interp_func = &EaseElasticInOut; break;
-      }
-      break;
+  for (slidestruct *slide = ss; slide != NULL; slide = slide->next) {
+    slide->anim = slide_anim_compile(slide);
+    if (slide->anim == NULL)
+      return false;
   }
-  if (interp_func != NULL) { // If we found an interp function...
-    // ...use the function to interpolate the target values:
-    destRec->width = (*interp_func)(timeElapsed, opts->size_i.x,
-                                    opts->size_f.x, opts->size_duration);
-    destRec->height = (*interp_func)(timeElapsed, opts->size_i.y,
-                                     opts->size_f.y, opts->size_duration);
-  } // Else, we leave it alone (because the user picked NONE).
+  return true;
 }
 
-/**
- * Interpolates the rotation variable given according to the method specified
- *   by opts.
- */
-void interp_rot (imgstruct *opts, float *rot, float timeElapsed)
+// Frees the animations of every slide of ss.
+void free_anims (slidestruct *ss)
 {
-  // First, search for the interp_func based on user preferences (opt)
-  float (*interp_func)(float, float, float, float) = NULL;
-  switch (opts->rot_interp) {
-    case NONE:
-      *rot = opts->rot_i;
-      break;
-    case LINEAR:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseLinearIn; break;
-        case OUT: interp_func = &EaseLinearOut; break;
-        case INOUT: interp_func = &EaseLinearInOut; break;
-      }
-      break;
-    case SINE:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseSineIn; break;
-        case OUT: interp_func = &EaseSineOut; break;
-        case INOUT: interp_func = &EaseSineInOut; break;
-      }
-      break;
-    case CIRCULAR:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseCircIn; break;
-        case OUT: interp_func = &EaseCircOut; break;
-        case INOUT: interp_func = &EaseCircInOut; break;
-      }
-      break;
-    case CUBIC:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseCubicIn; break;
-        case OUT: interp_func = &EaseCubicOut; break;
-        case INOUT: interp_func = &EaseCubicInOut; break;
-      }
-      break;
-    case QUADRATIC:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseQuadIn; break;
-        case OUT: interp_func = &EaseQuadOut; break;
-        case INOUT: interp_func = &EaseQuadInOut; break;
-      }
-      break;
-    case EXPONENTIAL:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseExpoIn; break;
-        case OUT: interp_func = &EaseExpoOut; break;
-        case INOUT: interp_func = &EaseExpoInOut; break;
-      }
-      break;
-    case BACK:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseBackIn; break;
-        case OUT: interp_func = &EaseBackOut; break;
-        case INOUT: interp_func = &EaseBackInOut; break;
-      }
-      break;
-    case BOUNCE:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseBounceIn; break;
-        case OUT: interp_func = &EaseBounceOut; break;
-        case INOUT: interp_func = &EaseBounceInOut; break;
-      }
-      break;
-    case ELASTIC:
-      switch (opts->rot_interp_captype) {
-        case IN: interp_func = &EaseElasticIn; break;
-        case OUT: interp_func = &EaseElasticOut; break;
-        case INOUT: interp_func = &EaseElasticInOut; break;
-      }
-      break;
+  for (slidestruct *slide = ss; slide != NULL; slide = slide->next) {
+    slide_anim_free(slide->anim);
+    slide->anim = NULL;
   }
-  if (interp_func != NULL) { // If we found an interp function...
-    // ...use the function to interpolate the target values:
-    *rot = (*interp_func)(timeElapsed, opts->rot_i, opts->rot_f,
-                          opts->rot_duration);
-  } // Else, we leave it alone (because the user picked NONE).
 }
 
-/**
- * Interpolates the tint color variable given according to the method specified
- *   by opts.
- */
-void interp_tint (imgstruct *opts, Color *color, float timeElapsed)
+// Returns the slide of ss shown after slide (the first, after the last).
+slidestruct *slide_after (slidestruct *ss, slidestruct *slide)
 {
-  // First, search for the interp_func based on user preferences (opt)
-  float (*interp_func)(float, float, float, float) = NULL;
-  switch (opts->tint_interp) {
-    case NONE:
-      *color = opts->tint_i;
-      break;
-    case LINEAR:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseLinearIn; break;
-        case OUT: interp_func = &EaseLinearOut; break;
-        case INOUT: interp_func = &EaseLinearInOut; break;
-      }
-      break;
-    case SINE:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseSineIn; break;
-        case OUT: interp_func = &EaseSineOut; break;
-        case INOUT: interp_func = &EaseSineInOut; break;
-      }
-      break;
-    case CIRCULAR:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseCircIn; break;
-        case OUT: interp_func = &EaseCircOut; break;
-        case INOUT: interp_func = &EaseCircInOut; break;
-      }
-      break;
-    case CUBIC:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseCubicIn; break;
-        case OUT: interp_func = &EaseCubicOut; break;
-        case INOUT: interp_func = &EaseCubicInOut; break;
-      }
-      break;
-    case QUADRATIC:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseQuadIn; break;
-        case OUT: interp_func = &EaseQuadOut; break;
-        case INOUT: interp_func = &EaseQuadInOut; break;
-      }
-      break;
-    case EXPONENTIAL:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseExpoIn; break;
-        case OUT: interp_func = &EaseExpoOut; break;
-        case INOUT: interp_func = &EaseExpoInOut; break;
-      }
-      break;
-    case BACK:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseBackIn; break;
-        case OUT: interp_func = &EaseBackOut; break;
-        case INOUT: interp_func = &EaseBackInOut; break;
-      }
-      break;
-    case BOUNCE:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseBounceIn; break;
-        case OUT: interp_func = &EaseBounceOut; break;
-        case INOUT: interp_func = &EaseBounceInOut; break;
-      }
-      break;
-    case ELASTIC:
-      switch (opts->tint_interp_captype) {
-        case IN: interp_func = &EaseElasticIn; break;
-        case OUT: interp_func = &EaseElasticOut; break;
-        case INOUT: interp_func = &EaseElasticInOut; break;
-      }
-      break;
-  }
-  if (interp_func != NULL) { // If we found an interp function...
-    // ...use the function to interpolate the target values:
-    color->r = (*interp_func)(timeElapsed, opts->tint_i.r, opts->tint_f.r,
-                              opts->tint_duration);
-    color->g = (*interp_func)(timeElapsed, opts->tint_i.g, opts->tint_f.g,
-                              opts->tint_duration);
-    color->b = (*interp_func)(timeElapsed, opts->tint_i.b, opts->tint_f.b,
-                              opts->tint_duration);
-    color->a = (*interp_func)(timeElapsed, opts->tint_i.a, opts->tint_f.a,
-                              opts->tint_duration);
-  } // Else, we leave it alone (because the user picked NONE).
+  if (slide->next == NULL)
+    return ss; // Loops back to the first slide if we reach the end.
+  return slide->next;
 }
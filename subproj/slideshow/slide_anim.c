@@ -0,0 +1,402 @@
+/**
+ * slide_anim.c
+ *
+ * Contains implementation of slide_anim.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdlib.h> // posix_memalign, malloc, free, qsort
+#include <string.h> // memset
+#include <stdint.h> // uint8_t
+#include <errno.h> // errno, ENOMEM
+#if defined(__SSE2__)
+#include <emmintrin.h> // _mm_*
+#elif defined(__ARM_NEON)
+#include <arm_neon.h> // v*q_f32, ... etc.
+#endif
+#include "slide_anim.h"
+
+// Alignment of every array (of a vector):
+#define ANIM_ALIGN 16
+
+// First component of each track's property, and how many it has:
+static const slide_anim_comp track_comps[SLIDE_ANIM_TRACK_CNT] = {
+  SLIDE_ANIM_X, SLIDE_ANIM_WIDTH, SLIDE_ANIM_ROTATION, SLIDE_ANIM_R
+};
+static const int track_comp_cnts[SLIDE_ANIM_TRACK_CNT] = {2, 2, 1, 4};
+
+// A track with an easing function of its own, while sorting:
+typedef struct anim_curve_src
+{
+  unsigned int img;
+  ease_func ease;
+  float duration;
+} anim_curve_src;
+
+// --- Helper Function Prototypes ---
+void *anim_carve (uint8_t **at, size_t len);
+int cmp_curve_duration (const void *a, const void *b);
+void compile_curves (slide_anim_tracks *tracks, const anim_curve_src *srcs,
+                     size_t cnt);
+void anim_set_seg (slide_anim *anim, int tr, size_t img, const ease_seg *seg);
+void eval_progress (slide_anim_tracks *tracks, size_t cap, float t);
+void eval_keyed (slide_anim *anim, int tr, float t);
+void eval_draw (slide_anim *anim);
+unsigned char clamp_channel (float v);
+// --- ---
+
+slide_anim *slide_anim_compile (const slidestruct *slide)
+{
+  size_t cnt = 0;
+  for (imgstruct *img = slide->images; img != NULL; img = img->next)
+    cnt++;
+  size_t cap = (cnt + SLIDE_ANIM_LANES - 1) / SLIDE_ANIM_LANES *
+               SLIDE_ANIM_LANES;
+  if (cap == 0)
+    cap = SLIDE_ANIM_LANES; // Keep every array allocated
+
+  slide_anim *anim = malloc(sizeof(slide_anim));
+  if (anim == NULL)
+    return NULL;
+  anim->cnt = cnt;
+  anim->cap = cap;
+
+  // Every array holds cap 4-byte elements (Rectangles count four), followed
+  //   by the lists of curves and of keyed tracks:
+  size_t arrays = 1 + SLIDE_ANIM_TRACK_CNT * 4 + SLIDE_ANIM_COMP_CNT * 2 +
+                  4 + 1 + 1;
+  size_t list_len = SLIDE_ANIM_TRACK_CNT * ((sizeof(ease_func) +
+      sizeof(unsigned int) + sizeof(float) + sizeof(slide_anim_keyed)) * cnt +
+      4 * ANIM_ALIGN);
+  size_t len = arrays * cap * 4 + list_len;
+  if (posix_memalign(&anim->mem, ANIM_ALIGN, len)) {
+    free(anim);
+    errno = ENOMEM;
+    return NULL;
+  }
+  memset(anim->mem, 0, len); // Padding images never move
+  uint8_t *at = anim->mem;
+  anim->tex_id = anim_carve(&at, cap * sizeof(unsigned int));
+  for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+    slide_anim_tracks *tracks = &anim->tracks[tr];
+    tracks->duration = anim_carve(&at, cap * sizeof(float));
+    tracks->inv_duration = anim_carve(&at, cap * sizeof(float));
+    tracks->end = anim_carve(&at, cap * sizeof(float));
+    tracks->progress = anim_carve(&at, cap * sizeof(float));
+  }
+  for (int c = 0; c < SLIDE_ANIM_COMP_CNT; c++) {
+    anim->start[c] = anim_carve(&at, cap * sizeof(float));
+    anim->change[c] = anim_carve(&at, cap * sizeof(float));
+  }
+  anim->dest = anim_carve(&at, cap * sizeof(Rectangle));
+  anim->rot = anim_carve(&at, cap * sizeof(float));
+  anim->tint = anim_carve(&at, cap * sizeof(Color));
+  for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+    slide_anim_tracks *tracks = &anim->tracks[tr];
+    tracks->curve_cnt = 0;
+    tracks->curve_ease = anim_carve(&at, cnt * sizeof(ease_func));
+    tracks->curve_img = anim_carve(&at, cnt * sizeof(unsigned int));
+    tracks->curve_duration = anim_carve(&at, cnt * sizeof(float));
+    tracks->keyed_cnt = 0;
+    tracks->keyed = anim_carve(&at, cnt * sizeof(slide_anim_keyed));
+  }
+
+  anim_curve_src *srcs[SLIDE_ANIM_TRACK_CNT];
+  size_t src_cnts[SLIDE_ANIM_TRACK_CNT] = {0};
+  for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+    srcs[tr] = malloc(sizeof(anim_curve_src) * (cnt > 0 ? cnt : 1));
+    if (srcs[tr] == NULL) {
+      while (tr-- > 0)
+        free(srcs[tr]);
+      slide_anim_free(anim);
+      return NULL;
+    }
+  }
+
+  // Lay the images out, one element of each array apiece:
+  size_t i = 0;
+  for (imgstruct *img = slide->images; img != NULL; img = img->next, i++) {
+    anim->tex_id[i] = img->tex_id;
+
+    const ease_track *img_tracks[SLIDE_ANIM_TRACK_CNT] = {
+      &img->pos_track, &img->size_track, &img->rot_track, &img->tint_track
+    };
+    const bool linear[SLIDE_ANIM_TRACK_CNT] = {
+      img->pos_interp == LINEAR, img->size_interp == LINEAR,
+      img->rot_interp == LINEAR, img->tint_interp == LINEAR
+    };
+    for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+      const ease_track *track = img_tracks[tr];
+      const ease_seg *seg = &track->segs[0];
+      slide_anim_tracks *tracks = &anim->tracks[tr];
+      anim_set_seg(anim, tr, i, seg);
+      if (track->seg_cnt > 1) {
+        // Its progress is set apart, from its current segment:
+        slide_anim_keyed *keyed = &tracks->keyed[tracks->keyed_cnt++];
+        keyed->img = i;
+        keyed->segs = track->segs;
+        keyed->seg_cnt = track->seg_cnt;
+        keyed->cursor = 0;
+        continue;
+      }
+
+      tracks->duration[i] = seg->duration;
+      tracks->inv_duration[i] = seg->duration > 0.0f ?
+                                1.0f / seg->duration : 0.0f;
+      tracks->end[i] = seg->end;
+      if (seg->duration > 0.0f && !linear[tr]) {
+        anim_curve_src *src = &srcs[tr][src_cnts[tr]++];
+        src->img = i;
+        src->ease = seg->ease;
+        src->duration = seg->duration;
+      }
+    }
+  }
+
+  for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+    qsort(srcs[tr], src_cnts[tr], sizeof(anim_curve_src), cmp_curve_duration);
+    compile_curves(&anim->tracks[tr], srcs[tr], src_cnts[tr]);
+    free(srcs[tr]);
+  }
+  return anim;
+}
+
+void slide_anim_eval (slide_anim *anim, float t)
+{
+  for (int tr = 0; tr < SLIDE_ANIM_TRACK_CNT; tr++) {
+    eval_progress(&anim->tracks[tr], anim->cap, t);
+    eval_keyed(anim, tr, t);
+  }
+  eval_draw(anim);
+}
+
+void slide_anim_free (slide_anim *anim)
+{
+  if (anim == NULL)
+    return;
+  free(anim->mem);
+  free(anim);
+}
+
+/**
+ * Returns the next len bytes at *at, and moves *at past them (rounded up to
+ *   ANIM_ALIGN).
+ */
+void *anim_carve (uint8_t **at, size_t len)
+{
+  void *p = *at;
+  *at += (len + ANIM_ALIGN - 1) / ANIM_ALIGN * ANIM_ALIGN;
+  return p;
+}
+
+// Orders anim_curve_srcs longest first, for qsort.
+int cmp_curve_duration (const void *a, const void *b)
+{
+  float da = ((const anim_curve_src *)a)->duration;
+  float db = ((const anim_curve_src *)b)->duration;
+  return (da < db) - (da > db);
+}
+
+// Copies the cnt sorted srcs into the curve lists of tracks.
+void compile_curves (slide_anim_tracks *tracks, const anim_curve_src *srcs,
+                     size_t cnt)
+{
+  for (size_t j = 0; j < cnt; j++) {
+    tracks->curve_img[j] = srcs[j].img;
+    tracks->curve_ease[j] = srcs[j].ease;
+    tracks->curve_duration[j] = srcs[j].duration;
+  }
+  tracks->curve_cnt = cnt;
+}
+
+/**
+ * Sets the start and change of the components of image img's property of
+ *   track tr to those of seg.
+ */
+void anim_set_seg (slide_anim *anim, int tr, size_t img, const ease_seg *seg)
+{
+  for (int c = 0; c < track_comp_cnts[tr]; c++) {
+    anim->start[track_comps[tr] + c][img] = seg->from[c];
+    anim->change[track_comps[tr] + c][img] = seg->change[c];
+  }
+}
+
+/**
+ * Sets the progress of every one of the cap tracks t seconds into the slide
+ *   (pass 1).
+ */
+void eval_progress (slide_anim_tracks *tracks, size_t cap, float t)
+{
+  const float *duration = tracks->duration;
+  const float *inv_duration = tracks->inv_duration;
+  const float *end = tracks->end;
+  float *progress = tracks->progress;
+
+  // Linear or over, in vectors:
+#if defined(__SSE2__)
+  __m128 tv = _mm_set1_ps(t);
+  for (size_t i = 0; i < cap; i += SLIDE_ANIM_LANES) {
+    __m128 running = _mm_cmplt_ps(tv, _mm_load_ps(duration + i));
+    __m128 linear = _mm_mul_ps(tv, _mm_load_ps(inv_duration + i));
+    __m128 p = _mm_or_ps(_mm_and_ps(running, linear),
+                         _mm_andnot_ps(running, _mm_load_ps(end + i)));
+    _mm_store_ps(progress + i, p);
+  }
+#elif defined(__ARM_NEON)
+  float32x4_t tv = vdupq_n_f32(t);
+  for (size_t i = 0; i < cap; i += SLIDE_ANIM_LANES) {
+    uint32x4_t running = vcltq_f32(tv, vld1q_f32(duration + i));
+    float32x4_t linear = vmulq_f32(tv, vld1q_f32(inv_duration + i));
+    vst1q_f32(progress + i, vbslq_f32(running, linear, vld1q_f32(end + i)));
+  }
+#else
+  for (size_t i = 0; i < cap; i++)
+    progress[i] = t < duration[i] ? t * inv_duration[i] : end[i];
+#endif
+
+  // Then the curves still running, which come first:
+  for (size_t j = 0; j < tracks->curve_cnt; j++) {
+    float d = tracks->curve_duration[j];
+    if (t >= d)
+      break;
+    progress[tracks->curve_img[j]] = tracks->curve_ease[j](t, 0.0f, 1.0f, d);
+  }
+}
+
+/**
+ * Sets the progress of the tracks of kind tr with keys t seconds into the
+ *   slide, moving each on to the segment t falls in (part of pass 1).
+ */
+void eval_keyed (slide_anim *anim, int tr, float t)
+{
+  slide_anim_tracks *tracks = &anim->tracks[tr];
+  for (size_t j = 0; j < tracks->keyed_cnt; j++) {
+    slide_anim_keyed *keyed = &tracks->keyed[j];
+    size_t seg = ease_seg_seek(keyed->segs, keyed->seg_cnt, keyed->cursor, t);
+    if (seg != keyed->cursor) {
+      keyed->cursor = seg;
+      anim_set_seg(anim, tr, keyed->img, &keyed->segs[seg]);
+    }
+    tracks->progress[keyed->img] = ease_seg_progress(&keyed->segs[seg], t);
+  }
+}
+
+/**
+ * Sets the draw parameters of every image from its tracks' progress (passes 2
+ *   and 3).
+ */
+void eval_draw (slide_anim *anim)
+{
+  size_t cap = anim->cap;
+  float *const *start = anim->start;
+  float *const *change = anim->change;
+  const float *p_pos = anim->tracks[SLIDE_ANIM_POS].progress;
+  const float *p_size = anim->tracks[SLIDE_ANIM_SIZE].progress;
+  const float *p_rot = anim->tracks[SLIDE_ANIM_ROT].progress;
+  const float *p_tint = anim->tracks[SLIDE_ANIM_TINT].progress;
+
+#if defined(__SSE2__)
+  for (size_t i = 0; i < cap; i += SLIDE_ANIM_LANES) {
+    __m128 pp = _mm_load_ps(p_pos + i);
+    __m128 ps = _mm_load_ps(p_size + i);
+    __m128 pr = _mm_load_ps(p_rot + i);
+    __m128 pt = _mm_load_ps(p_tint + i);
+    __m128 v[SLIDE_ANIM_COMP_CNT];
+    for (int c = 0; c < SLIDE_ANIM_COMP_CNT; c++) {
+      __m128 p = c <= SLIDE_ANIM_Y ? pp : c <= SLIDE_ANIM_HEIGHT ? ps :
+                 c == SLIDE_ANIM_ROTATION ? pr : pt;
+      v[c] = _mm_add_ps(_mm_load_ps(start[c] + i),
+                        _mm_mul_ps(_mm_load_ps(change[c] + i), p));
+    }
+
+    // Rows of x, y, width and height become the images' rectangles:
+    _MM_TRANSPOSE4_PS(v[SLIDE_ANIM_X], v[SLIDE_ANIM_Y], v[SLIDE_ANIM_WIDTH],
+                      v[SLIDE_ANIM_HEIGHT]);
+    _mm_storeu_ps((float *)&anim->dest[i], v[SLIDE_ANIM_X]);
+    _mm_storeu_ps((float *)&anim->dest[i + 1], v[SLIDE_ANIM_Y]);
+    _mm_storeu_ps((float *)&anim->dest[i + 2], v[SLIDE_ANIM_WIDTH]);
+    _mm_storeu_ps((float *)&anim->dest[i + 3], v[SLIDE_ANIM_HEIGHT]);
+    _mm_store_ps(anim->rot + i, v[SLIDE_ANIM_ROTATION]);
+
+    // Channels saturate to bytes: r0-3, b0-3, g0-3, a0-3, then interleave
+    //   into r0 g0 b0 a0 r1 ... etc. (min keeps NaN, which converts to 0):
+    __m128 max = _mm_set1_ps(255.0f);
+    __m128i rb = _mm_packs_epi32(
+        _mm_cvttps_epi32(_mm_min_ps(max, v[SLIDE_ANIM_R])),
+        _mm_cvttps_epi32(_mm_min_ps(max, v[SLIDE_ANIM_B])));
+    __m128i ga = _mm_packs_epi32(
+        _mm_cvttps_epi32(_mm_min_ps(max, v[SLIDE_ANIM_G])),
+        _mm_cvttps_epi32(_mm_min_ps(max, v[SLIDE_ANIM_A])));
+    __m128i rbga = _mm_packus_epi16(rb, ga);
+    __m128i rgba = _mm_unpacklo_epi8(rbga, _mm_srli_si128(rbga, 8));
+    rgba = _mm_unpacklo_epi16(rgba, _mm_srli_si128(rgba, 8));
+    _mm_storeu_si128((__m128i *)&anim->tint[i], rgba);
+  }
+#elif defined(__ARM_NEON)
+  for (size_t i = 0; i < cap; i += SLIDE_ANIM_LANES) {
+    float32x4_t pp = vld1q_f32(p_pos + i);
+    float32x4_t ps = vld1q_f32(p_size + i);
+    float32x4_t pr = vld1q_f32(p_rot + i);
+    float32x4_t pt = vld1q_f32(p_tint + i);
+    float32x4_t v[SLIDE_ANIM_COMP_CNT];
+    for (int c = 0; c < SLIDE_ANIM_COMP_CNT; c++) {
+      float32x4_t p = c <= SLIDE_ANIM_Y ? pp : c <= SLIDE_ANIM_HEIGHT ? ps :
+                      c == SLIDE_ANIM_ROTATION ? pr : pt;
+      v[c] = vmlaq_f32(vld1q_f32(start[c] + i), vld1q_f32(change[c] + i), p);
+    }
+
+    // x, y, width and height, stored interleaved, are the rectangles:
+    float32x4x4_t rects = {{v[SLIDE_ANIM_X], v[SLIDE_ANIM_Y],
+                            v[SLIDE_ANIM_WIDTH], v[SLIDE_ANIM_HEIGHT]}};
+    vst4q_f32((float *)&anim->dest[i], rects);
+    vst1q_f32(anim->rot + i, v[SLIDE_ANIM_ROTATION]);
+
+    // Channels saturate to bytes, then interleave into r0 g0 b0 a0 r1 ...:
+    uint8x8_t ch[4];
+    for (int c = 0; c < 4; c++) {
+      uint16x4_t n = vqmovun_s32(vcvtq_s32_f32(v[SLIDE_ANIM_R + c]));
+      ch[c] = vqmovn_u16(vcombine_u16(n, n));
+    }
+    uint8x8x2_t rg = vzip_u8(ch[0], ch[1]); // r0 g0 r1 g1 ...
+    uint8x8x2_t ba = vzip_u8(ch[2], ch[3]);
+    uint16x4x2_t rgba = vzip_u16(vreinterpret_u16_u8(rg.val[0]),
+                                 vreinterpret_u16_u8(ba.val[0]));
+    vst1_u16((uint16_t *)&anim->tint[i], rgba.val[0]);
+    vst1_u16((uint16_t *)&anim->tint[i + 2], rgba.val[1]);
+  }
+#else
+  for (size_t i = 0; i < cap; i++) {
+    float pp = p_pos[i], ps = p_size[i], pt = p_tint[i];
+    anim->dest[i].x = start[SLIDE_ANIM_X][i] + change[SLIDE_ANIM_X][i] * pp;
+    anim->dest[i].y = start[SLIDE_ANIM_Y][i] + change[SLIDE_ANIM_Y][i] * pp;
+    anim->dest[i].width = start[SLIDE_ANIM_WIDTH][i] +
+                          change[SLIDE_ANIM_WIDTH][i] * ps;
+    anim->dest[i].height = start[SLIDE_ANIM_HEIGHT][i] +
+                           change[SLIDE_ANIM_HEIGHT][i] * ps;
+    anim->rot[i] = start[SLIDE_ANIM_ROTATION][i] +
+                   change[SLIDE_ANIM_ROTATION][i] * p_rot[i];
+    anim->tint[i].r = clamp_channel(start[SLIDE_ANIM_R][i] +
+                                    change[SLIDE_ANIM_R][i] * pt);
+    anim->tint[i].g = clamp_channel(start[SLIDE_ANIM_G][i] +
+                                    change[SLIDE_ANIM_G][i] * pt);
+    anim->tint[i].b = clamp_channel(start[SLIDE_ANIM_B][i] +
+                                    change[SLIDE_ANIM_B][i] * pt);
+    anim->tint[i].a = clamp_channel(start[SLIDE_ANIM_A][i] +
+                                    change[SLIDE_ANIM_A][i] * pt);
+  }
+#endif
+}
+
+/**
+ * Returns color channel v truncated and clamped to [0, 255] (NaN gives 0),
+ *   as the vector code converts it.
+ */
+unsigned char clamp_channel (float v)
+{
+  if (!(v > 0.0f))
+    return 0;
+  if (v >= 255.0f)
+    return 255;
+  return (unsigned char)v;
+}
@@ -0,0 +1,130 @@
+/**
+ * slide_anim.h
+ *
+ * Contains prototypes for a slide's compiled animations: every animated
+ *   property of every image of a slide, laid out as one contiguous array per
+ *   property component, evaluated a frame at a time in batches of
+ *   SLIDE_ANIM_LANES images.
+ *
+ * Evaluating a frame takes three passes over the arrays:
+ *   1. The eased progress of each track (pos, size, rot and tint of each
+ *      image), in vectors: a track that is over (or never runs) holds its
+ *      end; a linear one is t / duration. The few other running tracks then
+ *      have their easing function called, one by one, from a list kept
+ *      longest first so that the tracks that are over are never visited.
+ *      Tracks with keys (more than one segment) are listed apart: each keeps
+ *      a cursor on its segment, and sets its image's components' start and
+ *      change to the segment's when it moves on to the next.
+ *   2. Each component's start plus its change times its track's progress, in
+ *      vectors.
+ *   3. Packing: the destination rectangles and tint colors of the images
+ *      are stored interleaved, ready for DrawTexturePro.
+ *
+ * The vectors are SSE2 on x86 and NEON on ARM (when the compiler targets
+ *   it); otherwise, plain loops do the same work.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef SLIDE_ANIM_H
+#define SLIDE_ANIM_H
+
+#include <stddef.h> // size_t
+#include "raylib.h"
+#include "slidestruct.h"
+
+// Images evaluated at once (each array is padded to a multiple of this):
+#define SLIDE_ANIM_LANES 4
+
+// Tracks of each image, in the order of their arrays:
+typedef enum slide_anim_track
+{
+  SLIDE_ANIM_POS,
+  SLIDE_ANIM_SIZE,
+  SLIDE_ANIM_ROT,
+  SLIDE_ANIM_TINT,
+  SLIDE_ANIM_TRACK_CNT
+} slide_anim_track;
+
+// Components of the images' properties, in the order of their arrays:
+typedef enum slide_anim_comp
+{
+  SLIDE_ANIM_X,
+  SLIDE_ANIM_Y,
+  SLIDE_ANIM_WIDTH,
+  SLIDE_ANIM_HEIGHT,
+  SLIDE_ANIM_ROTATION,
+  SLIDE_ANIM_R,
+  SLIDE_ANIM_G,
+  SLIDE_ANIM_B,
+  SLIDE_ANIM_A,
+  SLIDE_ANIM_COMP_CNT
+} slide_anim_comp;
+
+// A track with keys (see ease_track):
+typedef struct slide_anim_keyed
+{
+  unsigned int img; // Index of the image
+  const ease_seg *segs; // The image's, which must outlive the slide_anim
+  size_t seg_cnt;
+  size_t cursor; // Segment the image's start and change are set to
+} slide_anim_keyed;
+
+// The tracks of one kind (e.g. every image's pos track):
+typedef struct slide_anim_tracks
+{
+  float *duration; // 0 if the track does not run (or has keys)
+  float *inv_duration; // 1 / duration, or 0
+  float *end; // Eased progress once the track is over
+  float *progress; // Of the frame evaluated last
+
+  // Tracks without keys eased by other than a linear function, longest
+  //   first:
+  size_t curve_cnt;
+  unsigned int *curve_img; // Index of the image
+  ease_func *curve_ease;
+  float *curve_duration;
+
+  // Tracks with keys:
+  size_t keyed_cnt;
+  slide_anim_keyed *keyed;
+} slide_anim_tracks;
+
+typedef struct slide_anim
+{
+  size_t cnt; // Images
+  size_t cap; // cnt rounded up to a multiple of SLIDE_ANIM_LANES
+  unsigned int *tex_id; // Each image's texture cache entry
+
+  slide_anim_tracks tracks[SLIDE_ANIM_TRACK_CNT];
+  // Value of each component as its track's current segment starts, and
+  //   change over it:
+  float *start[SLIDE_ANIM_COMP_CNT];
+  float *change[SLIDE_ANIM_COMP_CNT];
+
+  // Draw parameters of the frame evaluated last, per image:
+  Rectangle *dest;
+  float *rot;
+  Color *tint; // Channels clamped to [0, 255]
+
+  void *mem; // Holds every array above
+} slide_anim;
+
+/**
+ * Compiles the animations of the images of slide (whose tracks are resolved
+ *   and tex_ids set). Returns NULL (with errno set) if memory ran out. The
+ *   slide_anim refers to the segments of the images' tracks with keys, so it
+ *   must be freed before slide is.
+ */
+slide_anim *slide_anim_compile (const slidestruct *slide);
+
+/**
+ * Sets the draw parameters of anim's images (dest, rot and tint) to their
+ *   values t seconds into its slide.
+ */
+void slide_anim_eval (slide_anim *anim, float t);
+
+// Frees anim (NULL is ignored).
+void slide_anim_free (slide_anim *anim);
+
+#endif
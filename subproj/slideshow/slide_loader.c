@@ -0,0 +1,175 @@
+/**
+ * slide_loader.c
+ *
+ * Contains implementation of slide_loader.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdlib.h> // malloc, free
+#include <string.h> // strlen, strcpy, strcat
+#include "slide_loader.h"
+
+#define RES_PATH "resources/"
+#define RES_PATH_SIZE sizeof(RES_PATH)
+
+// --- Helper Function Prototypes ---
+void *run_slide_loader (void *arg);
+// --- ---
+
+bool slide_loader_start (slide_loader *loader)
+{
+  loader->requested = false;
+  loader->decoded = true; // Nothing requested is left to decode
+  loader->quit = false;
+  loader->jobs = NULL;
+  loader->jobs_len = 0;
+  loader->uploaded = 0;
+  if (pthread_mutex_init(&loader->lock, NULL))
+    return false;
+  if (pthread_cond_init(&loader->cond, NULL)) {
+    pthread_mutex_destroy(&loader->lock);
+    return false;
+  }
+  if (pthread_create(&loader->thread, NULL, run_slide_loader, loader)) {
+    pthread_cond_destroy(&loader->cond);
+    pthread_mutex_destroy(&loader->lock);
+    return false;
+  }
+  return true;
+}
+
+bool slide_loader_request (slide_loader *loader, texture_cache *cache,
+    slidestruct *slide)
+{
+  // Allocate a job for every image, in case the cache holds none of them:
+  size_t cnt = 0;
+  for (imgstruct *opts = slide->images; opts != NULL; opts = opts->next)
+    cnt++;
+  slide_load_job *jobs = malloc(sizeof(slide_load_job)*(cnt > 0 ? cnt : 1));
+  if (jobs == NULL)
+    return false;
+
+  cnt = 0;
+  for (imgstruct *opts = slide->images; opts != NULL; opts = opts->next) {
+    if (texture_cache_ref(cache, opts->tex_id))
+      continue; // Resident, or this slide loads it already
+    jobs[cnt].tex_id = opts->tex_id;
+    jobs[cnt].name = cache->entries[opts->tex_id].name;
+    jobs[cnt].image = (Image){0};
+    cnt++;
+  }
+  if (cnt == 0) { // Nothing to load
+    free(jobs);
+    jobs = NULL;
+  }
+
+  pthread_mutex_lock(&loader->lock);
+  loader->jobs = jobs;
+  loader->jobs_len = cnt;
+  loader->requested = cnt > 0;
+  loader->decoded = cnt == 0;
+  pthread_cond_broadcast(&loader->cond);
+  pthread_mutex_unlock(&loader->lock);
+  loader->uploaded = 0;
+  return true;
+}
+
+void slide_loader_wait (slide_loader *loader)
+{
+  pthread_mutex_lock(&loader->lock);
+  while (!loader->decoded)
+    pthread_cond_wait(&loader->cond, &loader->lock);
+  pthread_mutex_unlock(&loader->lock);
+}
+
+bool slide_loader_upload (slide_loader *loader, texture_cache *cache)
+{
+  pthread_mutex_lock(&loader->lock);
+  bool decoded = loader->decoded;
+  pthread_mutex_unlock(&loader->lock);
+  if (!decoded)
+    return false;
+
+  long budget = SLIDE_UPLOAD_BUDGET;
+  while (loader->uploaded < loader->jobs_len && budget > 0) {
+    slide_load_job *job = &loader->jobs[loader->uploaded++];
+    Texture2D texture = {0}; // Left so if the image failed to decode
+    if (job->image.data != NULL) {
+      budget -= GetPixelDataSize(job->image.width, job->image.height,
+          job->image.format);
+      texture = LoadTextureFromImage(job->image);
+    }
+    UnloadImage(job->image); // Only the texture is needed from now on
+    texture_cache_insert(cache, job->tex_id, texture);
+  }
+  if (loader->uploaded < loader->jobs_len)
+    return false;
+
+  free(loader->jobs);
+  loader->jobs = NULL;
+  loader->jobs_len = 0;
+  loader->uploaded = 0;
+  return true;
+}
+
+void slide_loader_release (texture_cache *cache, slidestruct *slide)
+{
+  for (imgstruct *opts = slide->images; opts != NULL; opts = opts->next)
+    texture_cache_unref(cache, opts->tex_id);
+}
+
+void slide_loader_stop (slide_loader *loader, texture_cache *cache)
+{
+  pthread_mutex_lock(&loader->lock);
+  loader->quit = true;
+  pthread_cond_broadcast(&loader->cond);
+  pthread_mutex_unlock(&loader->lock);
+  pthread_join(loader->thread, NULL);
+
+  // Whatever was not uploaded (its images are empty if never decoded):
+  for (size_t idx = loader->uploaded; idx < loader->jobs_len; idx++) {
+    UnloadImage(loader->jobs[idx].image);
+    texture_cache_insert(cache, loader->jobs[idx].tex_id, (Texture2D){0});
+  }
+  free(loader->jobs);
+  pthread_cond_destroy(&loader->cond);
+  pthread_mutex_destroy(&loader->lock);
+}
+
+/**
+ * The loader thread: decodes the images of the jobs of each slide requested,
+ *   until told to quit. The arg is the slide_loader.
+ */
+void *run_slide_loader (void *arg)
+{
+  slide_loader *loader = arg;
+  pthread_mutex_lock(&loader->lock);
+  while (!loader->quit) {
+    if (!loader->requested) {
+      pthread_cond_wait(&loader->cond, &loader->lock);
+      continue;
+    }
+    loader->requested = false;
+    slide_load_job *jobs = loader->jobs;
+    size_t jobs_len = loader->jobs_len;
+    pthread_mutex_unlock(&loader->lock);
+
+    for (size_t idx = 0; idx < jobs_len; idx++) {
+      // Find out the size of the image's path:
+      size_t name_size = strlen(jobs[idx].name);
+      size_t path_size = RES_PATH_SIZE + name_size; // Includes NUL
+      char img_path[path_size]; // Create a buffer of path_size in length
+      // Construct the image path:
+      strcpy(img_path, RES_PATH);
+      strcat(img_path, jobs[idx].name);
+      jobs[idx].image = LoadImage(img_path);
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    loader->decoded = true;
+    pthread_cond_broadcast(&loader->cond);
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return NULL;
+}
@@ -0,0 +1,104 @@
+/**
+ * slide_loader.h
+ *
+ * Contains prototypes for the slide loader, which gets the next slide's
+ *   textures ready while the current slide plays.
+ *
+ * Decoding a slide's images from the SD card takes far longer than a frame,
+ *   so it happens on a thread of its own. Only the upload of the decoded
+ *   images to the GPU needs the OpenGL context, so the render thread does
+ *   that, a few images a frame (see slide_loader_upload), as soon as they are
+ *   decoded. By the time the current slide is over, the next one's textures
+ *   are normally all on the GPU and changing slides costs nothing.
+ *
+ * Textures live in the texture cache (see texture_cache.h): requesting a
+ *   slide references all of its images there, and only those the cache does
+ *   not hold are decoded and uploaded.
+ *
+ * The loader gets one slide ready at a time. Every function but the loader
+ *   thread's own is called from the render thread.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef SLIDE_LOADER_H
+#define SLIDE_LOADER_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
+#include "raylib.h"
+#include "slidestruct.h"
+#include "texture_cache.h"
+
+// Bytes of pixels the render thread uploads per frame, at most (although at
+//   least one image goes up every frame, however large it is):
+#define SLIDE_UPLOAD_BUDGET (4 << 20)
+
+// An image of the requested slide that the cache does not hold:
+typedef struct slide_load_job
+{
+  unsigned int tex_id; // Its entry in the texture cache
+  const char *name; // Path relative to resources (the entry's name)
+  Image image; // Decoded by the loader thread
+} slide_load_job;
+
+typedef struct slide_loader
+{
+  pthread_t thread;
+  pthread_mutex_t lock; // Guards the fields below, up to the render thread's
+  pthread_cond_t cond; // Signalled when jobs are requested, decoded or quit
+  bool requested; // Whether jobs are waiting to be decoded
+  bool decoded; // Whether the jobs' images are decoded
+  bool quit; // Whether the loader thread is to end
+
+  // Left alone by the loader thread but while it decodes them:
+  slide_load_job *jobs;
+  size_t jobs_len;
+
+  // The render thread's own:
+  size_t uploaded;
+} slide_loader;
+
+/**
+ * Starts the loader thread, with no slide requested. Returns false if it
+ *   could not be started.
+ */
+bool slide_loader_start (slide_loader *loader);
+
+/**
+ * References every image of slide in cache, and has the loader thread decode
+ *   those the cache does not hold. The slide requested before must be ready
+ *   (see slide_loader_upload). Works before InitWindow.
+ *
+ * Returns false if memory ran out, without referencing anything.
+ */
+bool slide_loader_request (slide_loader *loader, texture_cache *cache,
+    slidestruct *slide);
+
+// Blocks until the images of the slide requested are decoded.
+void slide_loader_wait (slide_loader *loader);
+
+/**
+ * Uploads those of the requested slide's images that are decoded and not
+ *   uploaded yet into cache, until SLIDE_UPLOAD_BUDGET bytes are uploaded.
+ *   Needs the OpenGL context (see InitWindow).
+ *
+ * Returns true once all of them are uploaded: the requested slide is then
+ *   ready to be shown, and another can be requested. Never blocks.
+ */
+bool slide_loader_upload (slide_loader *loader, texture_cache *cache);
+
+/**
+ * Drops the references to slide's images (see slide_loader_request) once it
+ *   is no longer shown.
+ */
+void slide_loader_release (texture_cache *cache, slidestruct *slide);
+
+/**
+ * Ends the loader thread, once it is done decoding (if it is), and unloads
+ *   the images of the slide requested that were not uploaded yet.
+ */
+void slide_loader_stop (slide_loader *loader, texture_cache *cache);
+
+#endif
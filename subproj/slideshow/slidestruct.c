@@ -14,6 +14,24 @@
 #include <limits.h> // number type limits.
 #include "slidestruct.h" // includes bool type
 #include "slidestruct_defaults.h" 
+#include "easings.h"
+
+// Segments a track steps through from its cursor before binary searching:
+#define SEEK_STEPS 2
+
+// Easing functions by interp_type (NONE excluded) and interp_captype:
+static const ease_func ease_funcs[INTERP_TYPE_MAX][INTERP_CAPTYPE_MAX + 1] = {
+  {EaseLinearIn, EaseLinearOut, EaseLinearInOut},
+  {EaseSineIn, EaseSineOut, EaseSineInOut},
+  {EaseCircIn, EaseCircOut, EaseCircInOut},
+  {EaseCubicIn, EaseCubicOut, EaseCubicInOut},
+  {EaseQuadIn, EaseQuadOut, EaseQuadInOut},
+  {EaseExpoIn, EaseExpoOut, EaseExpoInOut},
+  {EaseBackIn, EaseBackOut, EaseBackInOut},
+  {EaseBounceIn, EaseBounceOut, EaseBounceInOut},
+  {EaseElasticIn, EaseElasticOut, EaseElasticInOut}
+};
+
 // --- Helper Function Prototypes ---
 slidestruct *construct_slidestruct (void);
 imgstruct *construct_imgstruct (void);
@@ -25,7 +43,17 @@ bool parse_vector2 (const char *str, Vector2 *v);
 bool parse_interp_type (const char *str, interp_type *type);
 bool parse_interp_captype (const char *str, interp_captype *captype);
 
+bool parse_key (const char *str, size_t comps, ease_key *key);
+bool add_key (ease_keys *keys, const ease_key *key);
+void print_keys (const char *prop, const ease_keys *keys, size_t comps);
+
 bool strtouc (unsigned char *c, const char *str, char **endptr, int base);
+
+bool resolve_tracks (slidestruct *ss);
+bool resolve_track (ease_track *track, ease_seg *segs, const float *initial,
+                    const float *final, size_t comps, interp_type type,
+                    interp_captype captype, float duration,
+                    const ease_keys *keys);
 // --- ---
 
 slidestruct *slidestruct_read_conf (const char *path)
@@ -305,6 +333,20 @@ slidestruct *slidestruct_read_conf (const char *path)
       
       current_imgstruct->tint_duration = tint_duration;
     }
+    else if (!strncmp(opt_start, "tint_key", opt_len)) {
+      if (current_imgstruct == NULL) {
+        printf("slidestruct read error: option %s line %zu before an"
+               " 'img_name' option\n", opt_start, lineno);
+        return NULL;
+      }
+
+      ease_key key;
+      if (!parse_key(opt_end+1, 4, &key)
+          || !add_key(&current_imgstruct->tint_keys, &key)) {
+        printf(" found option %s line %zu\n", opt_start, lineno);
+        return NULL;
+      }
+    }
     else if (!strncmp(opt_start, "pos_i", opt_len)) {
       if (current_imgstruct == NULL) {
         printf("slidestruct read error: option %s line %zu before an"
@@ -380,6 +422,20 @@ slidestruct *slidestruct_read_conf (const char *path)
       
       current_imgstruct->pos_duration = pos_duration;
     }
+    else if (!strncmp(opt_start, "pos_key", opt_len)) {
+      if (current_imgstruct == NULL) {
+        printf("slidestruct read error: option %s line %zu before an"
+               " 'img_name' option\n", opt_start, lineno);
+        return NULL;
+      }
+
+      ease_key key;
+      if (!parse_key(opt_end+1, 2, &key)
+          || !add_key(&current_imgstruct->pos_keys, &key)) {
+        printf(" found option %s line %zu\n", opt_start, lineno);
+        return NULL;
+      }
+    }
     else if (!strncmp(opt_start, "size_i", opt_len)) {
       if (current_imgstruct == NULL) {
         printf("slidestruct read error: option %s line %zu before an"
@@ -455,6 +511,20 @@ slidestruct *slidestruct_read_conf (const char *path)
       
       current_imgstruct->size_duration = size_duration;
     }
+    else if (!strncmp(opt_start, "size_key", opt_len)) {
+      if (current_imgstruct == NULL) {
+        printf("slidestruct read error: option %s line %zu before an"
+               " 'img_name' option\n", opt_start, lineno);
+        return NULL;
+      }
+
+      ease_key key;
+      if (!parse_key(opt_end+1, 2, &key)
+          || !add_key(&current_imgstruct->size_keys, &key)) {
+        printf(" found option %s line %zu\n", opt_start, lineno);
+        return NULL;
+      }
+    }
     else if (!strncmp(opt_start, "rot_i", opt_len)) {
       if (current_imgstruct == NULL) {
         printf("slidestruct read error: option %s line %zu before an"
@@ -530,6 +600,20 @@ slidestruct *slidestruct_read_conf (const char *path)
       
       current_imgstruct->rot_duration = rot_duration;
     }
+    else if (!strncmp(opt_start, "rot_key", opt_len)) {
+      if (current_imgstruct == NULL) {
+        printf("slidestruct read error: option %s line %zu before an"
+               " 'img_name' option\n", opt_start, lineno);
+        return NULL;
+      }
+
+      ease_key key;
+      if (!parse_key(opt_end+1, 1, &key)
+          || !add_key(&current_imgstruct->rot_keys, &key)) {
+        printf(" found option %s line %zu\n", opt_start, lineno);
+        return NULL;
+      }
+    }
     else {
       // Not a supported option
       printf("slidestruct read error: option %.*s found line %zu is not a"
@@ -559,9 +643,45 @@ slidestruct *slidestruct_read_conf (const char *path)
     }
   }
 
+  if (!resolve_tracks(head_slidestruct))
+    return NULL;
   return head_slidestruct;
 }
 
+size_t ease_seg_seek (const ease_seg *segs, size_t cnt, size_t cursor,
+                      float t)
+{
+  size_t lo = 0, hi = cnt; // The segment is one of lo up to hi
+  if (cursor < cnt && !(t < segs[cursor].start)) {
+    // Playing forward, it is cursor or one of the few after it:
+    for (int step = 0; step <= SEEK_STEPS; step++, cursor++) {
+      if (cursor + 1 == cnt || t < segs[cursor + 1].start)
+        return cursor;
+    }
+    lo = cursor;
+  }
+
+  // The last segment starting by t:
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (t < segs[mid].start)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return lo;
+}
+
+float ease_seg_progress (const ease_seg *seg, float t)
+{
+  t -= seg->start;
+  if (t >= seg->duration)
+    return seg->end; // Over, or never started
+  if (seg->ease == NULL)
+    return 0.0f; // Holds until over
+  return seg->ease(t, 0.0f, 1.0f, seg->duration);
+}
+
 void slidestruct_print(slidestruct *ss)
 {
   for (slidestruct *s = ss; s != NULL; s = s->next) {
@@ -581,6 +701,7 @@ void slidestruct_print(slidestruct *ss)
       printf("tint_interp: %u\n", i->tint_interp);
       printf("tint_interp_captype: %u\n", i->tint_interp_captype);
       printf("tint_duration: %f\n", i->tint_duration);
+      print_keys("tint", &i->tint_keys, 4);
 
       Vector2 vec2 = i->pos_i;
       printf("pos_i: (%f, %f)\n", vec2.x, vec2.y);
@@ -589,6 +710,7 @@ void slidestruct_print(slidestruct *ss)
       printf("pos_interp: %d\n", i->pos_interp);
       printf("pos_interp_captype: %u\n", i->pos_interp_captype);
       printf("pos_duration: %f\n", i->pos_duration);
+      print_keys("pos", &i->pos_keys, 2);
 
       vec2 = i->size_i;
       printf("size_i: (%f, %f)\n", vec2.x, vec2.y);
@@ -597,12 +719,14 @@ void slidestruct_print(slidestruct *ss)
       printf("size_interp: %d\n", i->size_interp);
       printf("size_interp_captype: %u\n", i->size_interp_captype);
       printf("size_duration: %f\n", i->size_duration);
+      print_keys("size", &i->size_keys, 2);
 
       printf("rot_i: %f\n", i->rot_i);
       printf("rot_f: %f\n", i->rot_f);
       printf("rot_interp: %d\n", i->rot_interp);
       printf("rot_interp_captype: %u\n", i->rot_interp_captype);
       printf("rot_duration: %f\n", i->rot_duration);
+      print_keys("rot", &i->rot_keys, 1);
     }
   }
 }
@@ -618,6 +742,11 @@ void slidestruct_free (slidestruct *ss)
       imgstruct *old_i = i;
       i = i->next;
       free(old_i->img_name);
+      free(old_i->tint_keys.keys);
+      free(old_i->pos_keys.keys);
+      free(old_i->size_keys.keys);
+      free(old_i->rot_keys.keys);
+      free(old_i->segs);
       free(old_i);
     }
 
@@ -647,6 +776,7 @@ slidestruct *construct_slidestruct (void)
   new_ss->title_duration = TITLE_DURATION_DEFAULT;
   new_ss->slide_duration = SLIDE_DURATION_DEFAULT;
   new_ss->images = NULL;
+  new_ss->anim = NULL;
   new_ss->next = NULL;
   return new_ss;
 }
@@ -667,6 +797,7 @@ imgstruct *construct_imgstruct (void)
 
   // Set defaults:
   new_is->img_name = NULL;
+  new_is->tex_id = 0; // Set once img_name is interned (see texture_cache.h)
   new_is->tint_i = TINT_I_DEFAULT;
   new_is->tint_f = TINT_F_DEFAULT;
   new_is->tint_interp = TINT_INTERP_DEFAULT;
@@ -687,6 +818,11 @@ imgstruct *construct_imgstruct (void)
   new_is->rot_interp = ROT_INTERP_DEFAULT;
   new_is->rot_interp_captype = ROT_INTERP_CAPTYPE_DEFAULT;
   new_is->rot_duration = ROT_DURATION_DEFAULT;
+  new_is->tint_keys = (ease_keys){NULL, 0, 0};
+  new_is->pos_keys = (ease_keys){NULL, 0, 0};
+  new_is->size_keys = (ease_keys){NULL, 0, 0};
+  new_is->rot_keys = (ease_keys){NULL, 0, 0};
+  new_is->segs = NULL; // Along with the tracks, once resolved
   new_is->next = NULL;
   return new_is;
 }
@@ -956,6 +1092,133 @@ bool parse_interp_captype (const char *str, interp_captype *captype)
   return true;
 }
 
+/**
+ * Populates key with the keyframe parsed from string str, which should appear
+ *   like so: "<time> <value> <interp> <captype>", where value has comps
+ *   components (a float for 1, "(x,y)" for 2, "(r,g,b,a)" for 4).
+ *
+ * If parsing is successful, then true is returned.
+ * If any parsing fails, then returns false.
+ * If the parsing would fail, this function prints an error message without a
+ *   newline.
+ */
+bool parse_key (const char *str, size_t comps, ease_key *key)
+{
+  char *endptr;
+  key->time = strtof(str, &endptr);
+  if (str == endptr || !isspace(*endptr) || !(key->time >= 0.0f)) {
+    printf("slidestruct read error: malformed key. Time did not start with a"
+        " number of seconds. Error");
+    return false;
+  }
+
+  // The value, then whatever follows it:
+  memset(key->value, 0, sizeof(key->value));
+  const char *value_str = endptr;
+  if (is_whitespace_str(value_str)) {
+    printf("slidestruct read error: malformed key. Time not followed by a"
+        " value. Error");
+    return false;
+  }
+  if (comps == 1) {
+    key->value[0] = strtof(value_str, &endptr);
+    if (value_str == endptr) {
+      printf("slidestruct read error: malformed key. Value did not start with"
+          " a number. Error");
+      return false;
+    }
+  }
+  else {
+    if (comps == 2) {
+      Vector2 v;
+      if (!parse_vector2(value_str, &v))
+        return false;
+      key->value[0] = v.x;
+      key->value[1] = v.y;
+    }
+    else {
+      Color color;
+      if (!parse_color(value_str, &color))
+        return false;
+      key->value[0] = color.r;
+      key->value[1] = color.g;
+      key->value[2] = color.b;
+      key->value[3] = color.a;
+    }
+    endptr = strchr(value_str, ')') + 1; // Found by the parse above
+  }
+  if (!isspace(*endptr)) {
+    printf("slidestruct read error: malformed key. Value not followed by an"
+        " interp type. Error");
+    return false;
+  }
+
+  const char *interp_str = endptr;
+  unsigned char t;
+  if (!strtouc(&t, interp_str, &endptr, 10) || interp_str == endptr
+      || !isspace(*endptr) || t > INTERP_TYPE_MAX) {
+    printf("slidestruct read error: malformed key. Interp type must be in"
+        " range [0, %u] and followed by a captype. Error", INTERP_TYPE_MAX);
+    return false;
+  }
+  key->interp = (interp_type)t;
+
+  const char *captype_str = endptr;
+  if (!strtouc(&t, captype_str, &endptr, 10) || captype_str == endptr
+      || !is_whitespace_str(endptr) || t > INTERP_CAPTYPE_MAX) {
+    printf("slidestruct read error: malformed key. Captype must be in range"
+        " [0, %u] and end the line. Error", INTERP_CAPTYPE_MAX);
+    return false;
+  }
+  key->captype = (interp_captype)t;
+  return true;
+}
+
+/**
+ * Appends key to keys. Returns false if key comes before the last of keys, or
+ *   if memory ran out.
+ *
+ * If this would fail, this function prints an error message without a
+ *   newline.
+ */
+bool add_key (ease_keys *keys, const ease_key *key)
+{
+  if (keys->cnt > 0 && key->time < keys->keys[keys->cnt - 1].time) {
+    printf("slidestruct read error: key at %f seconds comes before the key"
+        " before it. Error", key->time);
+    return false;
+  }
+  if (keys->cnt == keys->cap) {
+    size_t cap = keys->cap > 0 ? keys->cap * 2 : 4;
+    ease_key *grown = realloc(keys->keys, sizeof(ease_key) * cap);
+    if (grown == NULL) {
+      perror("slidestruct read malloc error");
+      return false;
+    }
+    keys->keys = grown;
+    keys->cap = cap;
+  }
+  keys->keys[keys->cnt++] = *key;
+  return true;
+}
+
+// Prints each of keys, of property prop (with comps components).
+void print_keys (const char *prop, const ease_keys *keys, size_t comps)
+{
+  for (size_t k = 0; k < keys->cnt; k++) {
+    const ease_key *key = &keys->keys[k];
+    printf("%s_key: %f ", prop, key->time);
+    if (comps == 1)
+      printf("%f", key->value[0]);
+    else {
+      for (size_t c = 0; c < comps; c++)
+        printf(c == 0 ? "(%f" : ", %f", key->value[c]);
+      printf(")");
+    }
+    printf(" %u %u\n", key->interp, key->captype);
+  }
+}
+
 /**
  * Parses str via strtoul and returns true if successful in converting its
  *   result to a unsigned char.
@@ -971,3 +1234,120 @@ bool strtouc (unsigned char *c, const char *str, char **endptr, int base)
   *c = (unsigned char)l;
   return true;
 }
+
+/**
+ * Resolves the tracks of every image of every slide of ss. Returns false if
+ *   the keys of a property start before its duration is over, or if memory ran
+ *   out (either is printed).
+ */
+bool resolve_tracks (slidestruct *ss)
+{
+  for (slidestruct *s = ss; s != NULL; s = s->next) {
+    for (imgstruct *i = s->images; i != NULL; i = i->next) {
+      const char *props[] = {"tint", "pos", "size", "rot"};
+      ease_track *tracks[] = {
+        &i->tint_track, &i->pos_track, &i->size_track, &i->rot_track
+      };
+      const float tint_i[] = {i->tint_i.r, i->tint_i.g, i->tint_i.b,
+                              i->tint_i.a};
+      const float tint_f[] = {i->tint_f.r, i->tint_f.g, i->tint_f.b,
+                              i->tint_f.a};
+      const float pos_i[] = {i->pos_i.x, i->pos_i.y};
+      const float pos_f[] = {i->pos_f.x, i->pos_f.y};
+      const float size_i[] = {i->size_i.x, i->size_i.y};
+      const float size_f[] = {i->size_f.x, i->size_f.y};
+      const float *initials[] = {tint_i, pos_i, size_i, &i->rot_i};
+      const float *finals[] = {tint_f, pos_f, size_f, &i->rot_f};
+      const size_t comps[] = {4, 2, 2, 1};
+      const interp_type types[] = {
+        i->tint_interp, i->pos_interp, i->size_interp, i->rot_interp
+      };
+      const interp_captype captypes[] = {
+        i->tint_interp_captype, i->pos_interp_captype,
+        i->size_interp_captype, i->rot_interp_captype
+      };
+      const float durations[] = {
+        i->tint_duration, i->pos_duration, i->size_duration, i->rot_duration
+      };
+      const ease_keys *keys[] = {
+        &i->tint_keys, &i->pos_keys, &i->size_keys, &i->rot_keys
+      };
+
+      // One segment per track, and one more per key:
+      size_t seg_cnt = 0;
+      for (int p = 0; p < 4; p++)
+        seg_cnt += 1 + keys[p]->cnt;
+      i->segs = malloc(sizeof(ease_seg) * seg_cnt);
+      if (i->segs == NULL) {
+        perror("slidestruct read malloc error");
+        return false;
+      }
+
+      ease_seg *segs = i->segs;
+      for (int p = 0; p < 4; p++) {
+        if (!resolve_track(tracks[p], segs, initials[p], finals[p], comps[p],
+                           types[p], captypes[p], durations[p], keys[p])) {
+          printf("slidestruct read error: image %s has a %s_key before its"
+              " %s_duration is over\n", i->img_name, props[p], props[p]);
+          return false;
+        }
+        segs += tracks[p]->seg_cnt;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Sets track up, in segs, to ease the comps components of its property from
+ *   initial by final, by the given type and captype over duration seconds, then
+ *   through each of keys. A type of NONE or a duration of 0 leaves the property
+ *   at its initial value until its first key. Returns false if the first key
+ *   comes before duration is over.
+ */
+bool resolve_track (ease_track *track, ease_seg *segs, const float *initial,
+                    const float *final, size_t comps, interp_type type,
+                    interp_captype captype, float duration,
+                    const ease_keys *keys)
+{
+  ease_seg *seg = &segs[0];
+  memset(seg, 0, sizeof(ease_seg));
+  for (size_t c = 0; c < comps; c++) {
+    seg->from[c] = initial[c];
+    seg->change[c] = final[c];
+  }
+  if (type != NONE && duration > 0.0f) {
+    seg->ease = ease_funcs[type - 1][captype];
+    seg->duration = duration;
+    // Once over, the property holds the value it ends on:
+    seg->end = seg->ease(duration, 0.0f, 1.0f, duration);
+  }
+
+  for (size_t k = 0; k < keys->cnt; k++) {
+    const ease_key *key = &keys->keys[k];
+    const ease_seg *prev = seg;
+    float time = prev->start + prev->duration;
+    if (key->time < time)
+      return false;
+
+    // From the value the segment before ends on to the key's:
+    seg = &segs[k + 1];
+    memset(seg, 0, sizeof(ease_seg));
+    seg->start = time;
+    for (size_t c = 0; c < comps; c++) {
+      seg->from[c] = prev->from[c] + prev->change[c] * prev->end;
+      seg->change[c] = key->value[c] - seg->from[c];
+    }
+    seg->duration = key->time - time;
+    seg->end = 1.0f;
+    if (key->interp != NONE && seg->duration > 0.0f) {
+      seg->ease = ease_funcs[key->interp - 1][key->captype];
+      seg->end = seg->ease(seg->duration, 0.0f, 1.0f, seg->duration);
+    }
+  }
+
+  track->segs = segs;
+  track->seg_cnt = 1 + keys->cnt;
+  track->cursor = 0;
+  return true;
+}
@@ -10,13 +10,20 @@
  * Joseph Yankel (jpyankel@gmail.com)
  */
 
+#ifndef SLIDESTRUCT_H
+#define SLIDESTRUCT_H
+
 #include <stdbool.h>
+#include <stddef.h> // size_t
 #include "raylib.h"
 
 #define INTERP_TYPE_MAX 9
 
 #define INTERP_CAPTYPE_MAX 2
 
+// Most components a property has (a tint's r, g, b and a):
+#define EASE_COMP_MAX 4
+
 // Type of interpolation
 typedef enum interp_type
 {
@@ -39,6 +46,59 @@ typedef enum interp_captype
   INOUT = 2,
 } interp_captype;
 
+// Easing function (see easings.h): the value, t seconds into a transition from
+//   b by c over d seconds.
+typedef float (*ease_func)(float t, float b, float c, float d);
+
+/**
+ * A keyframe of a property, as configured by its <property>_key option: the
+ *   value the property reaches time seconds into the slide, eased there from
+ *   the key before it.
+ */
+typedef struct ease_key
+{
+  float time;
+  float value[EASE_COMP_MAX]; // As many components as the property has
+  interp_type interp;
+  interp_captype captype;
+} ease_key;
+
+// The keyframes configured for a property, in order of time:
+typedef struct ease_keys
+{
+  ease_key *keys;
+  size_t cnt;
+  size_t cap;
+} ease_keys;
+
+/**
+ * A segment of an ease_track: from start seconds into the slide, the property
+ *   eases from its value then by change over duration seconds, then holds.
+ */
+typedef struct ease_seg
+{
+  float start;
+  float duration; // Seconds; 0 if the segment ends as soon as it starts
+  ease_func ease; // Eases progress from 0 to 1 (NULL holds it at 0 until over)
+  float end; // Eased progress once the segment is over
+  float from[EASE_COMP_MAX]; // The property's components at start
+  float change[EASE_COMP_MAX];
+} ease_seg;
+
+/**
+ * An animated property (tint, pos, size or rot) of an imgstruct, resolved by
+ *   the parser from its options, so that drawing an image picks no easing
+ *   function. The first segment goes from its initial value by its final value
+ *   over its duration; each of its keys adds one more. The property's value is
+ *   its current segment's from plus change times the segment's eased progress.
+ */
+typedef struct ease_track
+{
+  ease_seg *segs; // One after another, the first starting at 0
+  size_t seg_cnt; // At least 1
+  size_t cursor; // Segment evaluated last, where the next lookup starts
+} ease_track;
+
 /**
  * Container for image information. A slidestruct contains an array of these so
  *   that there can be multiple images with different animations on a single
@@ -47,6 +107,7 @@ typedef enum interp_captype
 typedef struct imgstruct
 {
   char *img_name; // Path (relative to resources) to the image
+  unsigned int tex_id; // img_name's entry in the slideshow's texture cache
 
   Color tint_i; // initial image tint color
   Color tint_f; // final image tint color
@@ -72,6 +133,19 @@ typedef struct imgstruct
   interp_captype rot_interp_captype;
   float rot_duration; // duration of the rotation in seconds
 
+  // Keyframes following each property's final value:
+  ease_keys tint_keys;
+  ease_keys pos_keys;
+  ease_keys size_keys;
+  ease_keys rot_keys;
+
+  // The properties' tracks, resolved once the config is parsed:
+  ease_track tint_track;
+  ease_track pos_track;
+  ease_track size_track;
+  ease_track rot_track;
+  ease_seg *segs; // Holds the segments of every track
+
   struct imgstruct *next;
 } imgstruct;
 
@@ -84,6 +158,8 @@ typedef struct slidestruct
   float title_duration; // How long before the title fades out in seconds
   float slide_duration; // slide display time in seconds
   imgstruct *images; // imagestruct linked list to be displayed on this slide
+  // images, compiled by the slideshow to be drawn (see slide_anim.h), or NULL:
+  struct slide_anim *anim;
 
   struct slidestruct *next; // Next slidestruct in the list (can be NULL)
 } slidestruct;
@@ -103,6 +179,18 @@ typedef struct slidestruct
  */
 slidestruct *slidestruct_read_conf (const char *path);
 
+/**
+ * Returns the index of the segment of the cnt segs that t seconds into the
+ *   slide falls in, looking from segment cursor on. Playing forward, that is
+ *   cursor or one of the few after it; only seeking back, or far ahead, takes
+ *   a binary search.
+ */
+size_t ease_seg_seek (const ease_seg *segs, size_t cnt, size_t cursor,
+                      float t);
+
+// Returns the eased progress of seg t seconds into its slide (t >= its start).
+float ease_seg_progress (const ease_seg *seg, float t);
+
 // Prints every parameter of every image in every slide from given slidestruct
 void slidestruct_print(slidestruct *ss);
 
@@ -110,3 +198,5 @@ void slidestruct_print(slidestruct *ss);
  * Frees a given slidestruct, releasing its used memory.
  */
 void slidestruct_free (slidestruct *ss);
+
+#endif
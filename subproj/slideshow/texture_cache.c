@@ -0,0 +1,240 @@
+/**
+ * texture_cache.c
+ *
+ * Contains implementation of texture_cache.h
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#include <stdlib.h> // malloc, calloc, realloc, free
+#include <string.h> // strcmp, strdup
+#include <stdint.h> // uint32_t
+#include <errno.h> // errno, ENOMEM
+#include "texture_cache.h"
+
+// Entries and table slots allocated at first:
+#define INITIAL_ENTRIES 16
+
+// --- Helper Function Prototypes ---
+uint32_t hash_name (const char *name);
+bool grow_table (texture_cache *cache);
+void lru_remove (texture_cache *cache, unsigned int id);
+void lru_push (texture_cache *cache, unsigned int id);
+void evict_over_budget (texture_cache *cache);
+// --- ---
+
+void texture_cache_init (texture_cache *cache, size_t budget)
+{
+  cache->entries = NULL;
+  cache->entries_len = 0;
+  cache->entries_cap = 0;
+  cache->table = NULL;
+  cache->table_size = 0;
+  cache->lru_head = TEXTURE_CACHE_NIL;
+  cache->lru_tail = TEXTURE_CACHE_NIL;
+  cache->budget = budget;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->evictions = 0;
+  cache->bytes_resident = 0;
+  cache->bytes_peak = 0;
+}
+
+bool texture_cache_intern (texture_cache *cache, const char *name,
+    unsigned int *id)
+{
+  // Keep the table at most half full:
+  if (cache->entries_len >= cache->table_size / 2 && !grow_table(cache))
+    return false;
+
+  unsigned int mask = cache->table_size - 1;
+  unsigned int slot = hash_name(name) & mask;
+  for (; cache->table[slot] != 0; slot = (slot + 1) & mask) {
+    unsigned int found = cache->table[slot] - 1;
+    if (!strcmp(cache->entries[found].name, name)) {
+      *id = found;
+      return true;
+    }
+  }
+
+  if (cache->entries_len == cache->entries_cap) {
+    unsigned int cap = cache->entries_cap > 0 ? cache->entries_cap * 2 :
+        INITIAL_ENTRIES;
+    texture_entry *entries = realloc(cache->entries,
+        sizeof(texture_entry)*cap);
+    if (entries == NULL)
+      return false;
+    cache->entries = entries;
+    cache->entries_cap = cap;
+  }
+  texture_entry *entry = &cache->entries[cache->entries_len];
+  if ((entry->name = strdup(name)) == NULL)
+    return false;
+  entry->texture = (Texture2D){0};
+  entry->bytes = 0;
+  entry->refs = 0;
+  entry->resident = false;
+  entry->pending = false;
+  entry->lru_prev = TEXTURE_CACHE_NIL;
+  entry->lru_next = TEXTURE_CACHE_NIL;
+  *id = cache->entries_len++;
+  cache->table[slot] = *id + 1;
+  return true;
+}
+
+bool texture_cache_ref (texture_cache *cache, unsigned int id)
+{
+  texture_entry *entry = &cache->entries[id];
+  if (entry->refs++ == 0 && entry->resident)
+    lru_remove(cache, id); // In use again
+  if (entry->resident || entry->pending) {
+    cache->hits++;
+    return true;
+  }
+  cache->misses++;
+  entry->pending = true;
+  return false;
+}
+
+void texture_cache_unref (texture_cache *cache, unsigned int id)
+{
+  texture_entry *entry = &cache->entries[id];
+  if (--entry->refs == 0 && entry->resident) {
+    lru_push(cache, id);
+    evict_over_budget(cache);
+  }
+}
+
+void texture_cache_insert (texture_cache *cache, unsigned int id,
+    Texture2D texture)
+{
+  texture_entry *entry = &cache->entries[id];
+  entry->pending = false;
+  if (texture.id == 0)
+    return; // Failed to load
+
+  entry->texture = texture;
+  entry->bytes = GetPixelDataSize(texture.width, texture.height,
+      texture.format);
+  entry->resident = true;
+  cache->bytes_resident += entry->bytes;
+  if (cache->bytes_resident > cache->bytes_peak)
+    cache->bytes_peak = cache->bytes_resident;
+  if (entry->refs == 0)
+    lru_push(cache, id);
+  evict_over_budget(cache);
+}
+
+Texture2D texture_cache_get (const texture_cache *cache, unsigned int id)
+{
+  return cache->entries[id].texture;
+}
+
+void texture_cache_print_stats (const texture_cache *cache, FILE *out)
+{
+  fprintf(out, "texture cache: %lu hits, %lu misses, %lu evictions, %zu "
+      "bytes resident (peak %zu, budget %zu), %u images\n", cache->hits,
+      cache->misses, cache->evictions, cache->bytes_resident,
+      cache->bytes_peak, cache->budget, cache->entries_len);
+}
+
+void texture_cache_free (texture_cache *cache)
+{
+  for (unsigned int id = 0; id < cache->entries_len; id++) {
+    texture_entry *entry = &cache->entries[id];
+    if (entry->resident)
+      UnloadTexture(entry->texture);
+    free(entry->name);
+  }
+  free(cache->entries);
+  free(cache->table);
+  texture_cache_init(cache, cache->budget);
+}
+
+// Returns the FNV-1a hash of name.
+uint32_t hash_name (const char *name)
+{
+  uint32_t hash = 2166136261u;
+  for (; *name != '\0'; name++) {
+    hash ^= (unsigned char)*name;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Doubles the size of cache's table (or allocates it) and re-inserts every
+ *   entry. Returns false (with errno set) if memory ran out.
+ */
+bool grow_table (texture_cache *cache)
+{
+  unsigned int size = cache->table_size > 0 ? cache->table_size * 2 :
+      INITIAL_ENTRIES * 2;
+  if (size <= cache->table_size) {
+    errno = ENOMEM;
+    return false;
+  }
+  unsigned int *table = calloc(size, sizeof(unsigned int));
+  if (table == NULL)
+    return false;
+
+  unsigned int mask = size - 1;
+  for (unsigned int id = 0; id < cache->entries_len; id++) {
+    unsigned int slot = hash_name(cache->entries[id].name) & mask;
+    while (table[slot] != 0)
+      slot = (slot + 1) & mask;
+    table[slot] = id + 1;
+  }
+  free(cache->table);
+  cache->table = table;
+  cache->table_size = size;
+  return true;
+}
+
+// Takes entry id out of the list of resident, unreferenced entries.
+void lru_remove (texture_cache *cache, unsigned int id)
+{
+  texture_entry *entry = &cache->entries[id];
+  if (entry->lru_prev != TEXTURE_CACHE_NIL)
+    cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+  else
+    cache->lru_head = entry->lru_next;
+  if (entry->lru_next != TEXTURE_CACHE_NIL)
+    cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+  else
+    cache->lru_tail = entry->lru_prev;
+  entry->lru_prev = TEXTURE_CACHE_NIL;
+  entry->lru_next = TEXTURE_CACHE_NIL;
+}
+
+// Adds entry id to the list of resident, unreferenced entries, as the most
+//   recently used.
+void lru_push (texture_cache *cache, unsigned int id)
+{
+  texture_entry *entry = &cache->entries[id];
+  entry->lru_prev = cache->lru_tail;
+  entry->lru_next = TEXTURE_CACHE_NIL;
+  if (cache->lru_tail != TEXTURE_CACHE_NIL)
+    cache->entries[cache->lru_tail].lru_next = id;
+  else
+    cache->lru_head = id;
+  cache->lru_tail = id;
+}
+
+// Unloads the least recently used unreferenced textures until the textures
+//   resident fit within the budget (or none of them is unreferenced).
+void evict_over_budget (texture_cache *cache)
+{
+  while (cache->bytes_resident > cache->budget &&
+         cache->lru_head != TEXTURE_CACHE_NIL) {
+    unsigned int id = cache->lru_head;
+    texture_entry *entry = &cache->entries[id];
+    lru_remove(cache, id);
+    UnloadTexture(entry->texture);
+    entry->texture = (Texture2D){0};
+    entry->resident = false;
+    cache->bytes_resident -= entry->bytes;
+    entry->bytes = 0;
+    cache->evictions++;
+  }
+}
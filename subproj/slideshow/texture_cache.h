@@ -0,0 +1,110 @@
+/**
+ * texture_cache.h
+ *
+ * Contains prototypes for the slideshow's texture cache, which keeps the
+ *   textures of images that several slides share (or that come back when the
+ *   show loops) on the GPU, so that each is only loaded once.
+ *
+ * Every image name in the config is interned once, after parsing, into an
+ *   entry of the cache; imgstructs then refer to their entry by its id, so
+ *   that lookups neither hash nor compare strings. A slide holds a reference
+ *   to each of its images' entries from the time it is requested from the
+ *   slide loader (see slide_loader.h) until it is over. Textures nothing
+ *   references stay resident, least recently used first in line to be
+ *   unloaded, until the textures resident take up more than the cache's
+ *   budget of GPU memory. Referenced textures are never unloaded, so the
+ *   budget may be exceeded by the slides showing and loading.
+ *
+ * The cache is the render thread's alone.
+ *
+ * Joseph Yankel (jpyankel@gmail.com)
+ */
+
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h> // size_t
+#include <stdio.h> // FILE
+#include "raylib.h"
+
+// GPU memory the textures resident take up at most, unless referenced:
+#define TEXTURE_CACHE_BUDGET (64 << 20)
+// An entry id standing for none:
+#define TEXTURE_CACHE_NIL ((unsigned int)-1)
+
+typedef struct texture_entry
+{
+  char *name; // Image path, relative to resources (the key)
+  Texture2D texture; // Valid while resident
+  size_t bytes; // Of GPU memory texture takes up, while resident
+  unsigned int refs; // Slides holding the entry
+  bool resident; // Whether texture is loaded
+  bool pending; // Whether a slide loader is loading it
+  // Neighbours in the list of resident, unreferenced entries:
+  unsigned int lru_prev;
+  unsigned int lru_next;
+} texture_entry;
+
+typedef struct texture_cache
+{
+  texture_entry *entries; // Indexed by id
+  unsigned int entries_len;
+  unsigned int entries_cap;
+  unsigned int *table; // Open-addressed: entry id + 1 per slot, or 0
+  unsigned int table_size; // A power of 2
+  unsigned int lru_head; // Least recently used resident unreferenced entry
+  unsigned int lru_tail; // Most recently used
+  size_t budget; // In bytes
+
+  // Counters:
+  unsigned long hits; // References to entries resident or being loaded
+  unsigned long misses; // References to entries that had to be loaded
+  unsigned long evictions; // Textures unloaded to keep within budget
+  size_t bytes_resident;
+  size_t bytes_peak;
+} texture_cache;
+
+// Prepares an empty cache that keeps within budget bytes of GPU memory.
+void texture_cache_init (texture_cache *cache, size_t budget);
+
+/**
+ * Sets id to that of the entry of the image at name (relative to resources),
+ *   adding one if it has none. Returns false (with errno set) if memory
+ *   ran out.
+ */
+bool texture_cache_intern (texture_cache *cache, const char *name,
+    unsigned int *id);
+
+/**
+ * Adds a reference to the entry id. Returns true if its texture is resident
+ *   or being loaded already; false if it is neither, in which case the entry
+ *   is marked as being loaded and it is up to the caller to load it (see
+ *   texture_cache_insert).
+ */
+bool texture_cache_ref (texture_cache *cache, unsigned int id);
+
+/**
+ * Drops a reference to the entry id. Once none are left, its texture may be
+ *   unloaded to keep within budget.
+ */
+void texture_cache_unref (texture_cache *cache, unsigned int id);
+
+/**
+ * Makes texture (uploaded from the image of entry id) resident. If the
+ *   load failed, pass a texture with an id of 0; the entry is then loaded
+ *   anew the next time it is referenced.
+ */
+void texture_cache_insert (texture_cache *cache, unsigned int id,
+    Texture2D texture);
+
+// Returns the texture of entry id (with an id of 0 if it is not resident).
+Texture2D texture_cache_get (const texture_cache *cache, unsigned int id);
+
+// Prints the cache's counters to out, on one line.
+void texture_cache_print_stats (const texture_cache *cache, FILE *out);
+
+// Unloads every texture of the cache and frees it.
+void texture_cache_free (texture_cache *cache);
+
+#endif